@@ -0,0 +1,234 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "leveldb/cache.h"
+#include "leveldb/env.h"
+#include "util/coding.h"
+#include "util/random.h"
+
+// Multi-threaded block cache benchmark.  Every thread looks up keys drawn
+// from a zipfian distribution and inserts the key on a miss, the way
+// Table::BlockReader uses the block cache.  Optionally a fraction of the
+// operations are part of sequential scans over cold keys, which is the
+// access pattern that flushes hot blocks out of an LRU cache.
+//
+//   cache_bench --cache_type=lru,clock --threads=8 --scan_percent=10
+
+// Comma-separated list of cache implementations to compare: lru, clock
+static const char* FLAGS_cache_type = "lru,clock";
+
+// Number of concurrent threads to run.
+static int FLAGS_threads = 4;
+
+// Number of cache operations per thread.
+static int FLAGS_ops_per_thread = 1000000;
+
+// Number of distinct keys.
+static int FLAGS_num_keys = 1000000;
+
+// Cache capacity, counted in entries of FLAGS_value_size.
+static int FLAGS_cache_entries = 65536;
+
+// Charge of each cache entry, like a block of this many bytes.
+static int FLAGS_value_size = 4096;
+
+// Zipfian skew of the key distribution, in [0, 1); 0 is uniform.
+static double FLAGS_skew = 0.99;
+
+// Percentage of operations that are part of long sequential scans.
+static int FLAGS_scan_percent = 0;
+
+// Number of shard bits for the clock cache; negative picks a default.
+static int FLAGS_num_shard_bits = -1;
+
+namespace leveldb {
+
+namespace {
+
+// Generates keys in [0, n) following a zipfian distribution, using the
+// method from Gray et al., "Quickly generating billion-record synthetic
+// databases", SIGMOD 1994.
+class ZipfianGenerator {
+ public:
+  ZipfianGenerator(uint64_t n, double theta) : n_(n), theta_(theta) {
+    zetan_ = Zeta(n, theta);
+    const double zeta2 = Zeta(2, theta);
+    alpha_ = 1.0 / (1.0 - theta);
+    eta_ = (1 - std::pow(2.0 / n, 1 - theta)) / (1 - zeta2 / zetan_);
+  }
+
+  uint64_t Next(Random* rnd) const {
+    if (theta_ <= 0) {
+      return rnd->Next() % n_;
+    }
+    const double u = static_cast<double>(rnd->Next()) / 2147483647.0;
+    const double uz = u * zetan_;
+    if (uz < 1.0) return 0;
+    if (uz < 1.0 + std::pow(0.5, theta_)) return 1;
+    uint64_t result =
+        static_cast<uint64_t>(n_ * std::pow(eta_ * u - eta_ + 1, alpha_));
+    return result < n_ ? result : n_ - 1;
+  }
+
+ private:
+  static double Zeta(uint64_t n, double theta) {
+    double sum = 0;
+    for (uint64_t i = 1; i <= n; i++) {
+      sum += 1.0 / std::pow(static_cast<double>(i), theta);
+    }
+    return sum;
+  }
+
+  const uint64_t n_;
+  const double theta_;
+  double zetan_;
+  double alpha_;
+  double eta_;
+};
+
+void DeleteValue(const Slice& key, void* value) {}
+
+struct SharedState {
+  Cache* cache;
+  const ZipfianGenerator* keys;
+  std::atomic<uint64_t> hits{0};
+  std::atomic<uint64_t> misses{0};
+};
+
+void ThreadBody(SharedState* shared, int tid) {
+  Random rnd(1000 + tid);
+  Cache* cache = shared->cache;
+  char key_buf[8];
+  uint64_t hits = 0;
+  uint64_t misses = 0;
+  uint64_t scan_pos = 0;
+  int scan_remaining = 0;
+  for (int i = 0; i < FLAGS_ops_per_thread; i++) {
+    uint64_t k;
+    if (scan_remaining > 0) {
+      // Scans walk cold keys that the zipfian reads rarely touch.
+      k = FLAGS_num_keys + scan_pos++;
+      scan_remaining--;
+    } else {
+      if (FLAGS_scan_percent > 0 &&
+          static_cast<int>(rnd.Uniform(100 * 1000)) < FLAGS_scan_percent) {
+        // Start a scan; one in every 1000 ops on average, each 1000 long.
+        scan_pos = static_cast<uint64_t>(rnd.Next()) * 1024;
+        scan_remaining = 1000;
+      }
+      k = shared->keys->Next(&rnd);
+    }
+    EncodeFixed64(key_buf, k);
+    Slice key(key_buf, sizeof(key_buf));
+    Cache::Handle* handle = cache->Lookup(key);
+    if (handle != nullptr) {
+      hits++;
+    } else {
+      misses++;
+      handle = cache->Insert(key, nullptr, FLAGS_value_size, &DeleteValue);
+    }
+    cache->Release(handle);
+  }
+  shared->hits.fetch_add(hits);
+  shared->misses.fetch_add(misses);
+}
+
+void RunBenchmark(const std::string& type, const ZipfianGenerator& keys) {
+  const size_t capacity =
+      static_cast<size_t>(FLAGS_cache_entries) * FLAGS_value_size;
+  Cache* cache;
+  if (type == "lru") {
+    cache = NewLRUCache(capacity);
+  } else if (type == "clock") {
+    cache = NewClockCache(capacity, FLAGS_num_shard_bits, FLAGS_value_size);
+  } else {
+    std::fprintf(stderr, "unknown cache type '%s'\n", type.c_str());
+    return;
+  }
+
+  SharedState shared;
+  shared.cache = cache;
+  shared.keys = &keys;
+  Env* env = Env::Default();
+  const uint64_t start = env->NowMicros();
+  std::vector<std::thread> threads;
+  for (int t = 0; t < FLAGS_threads; t++) {
+    threads.emplace_back(ThreadBody, &shared, t);
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  const double seconds = (env->NowMicros() - start) * 1e-6;
+  const uint64_t ops = static_cast<uint64_t>(FLAGS_threads) *
+                       FLAGS_ops_per_thread;
+  const uint64_t hits = shared.hits.load();
+  std::fprintf(stdout,
+               "%-6s : %11.3f micros/op; %8.2f Mops/s; hit rate %6.2f%%\n",
+               type.c_str(), seconds * 1e6 / ops * FLAGS_threads,
+               ops / seconds / 1e6, 100.0 * hits / ops);
+  delete cache;
+}
+
+}  // namespace
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  for (int i = 1; i < argc; i++) {
+    double d;
+    int n;
+    char junk;
+    if (strncmp(argv[i], "--cache_type=", 13) == 0) {
+      FLAGS_cache_type = argv[i] + 13;
+    } else if (sscanf(argv[i], "--threads=%d%c", &n, &junk) == 1) {
+      FLAGS_threads = n;
+    } else if (sscanf(argv[i], "--ops_per_thread=%d%c", &n, &junk) == 1) {
+      FLAGS_ops_per_thread = n;
+    } else if (sscanf(argv[i], "--num_keys=%d%c", &n, &junk) == 1) {
+      FLAGS_num_keys = n;
+    } else if (sscanf(argv[i], "--cache_entries=%d%c", &n, &junk) == 1) {
+      FLAGS_cache_entries = n;
+    } else if (sscanf(argv[i], "--value_size=%d%c", &n, &junk) == 1) {
+      FLAGS_value_size = n;
+    } else if (sscanf(argv[i], "--skew=%lf%c", &d, &junk) == 1 && d >= 0 &&
+               d < 1) {
+      FLAGS_skew = d;
+    } else if (sscanf(argv[i], "--scan_percent=%d%c", &n, &junk) == 1) {
+      FLAGS_scan_percent = n;
+    } else if (sscanf(argv[i], "--num_shard_bits=%d%c", &n, &junk) == 1) {
+      FLAGS_num_shard_bits = n;
+    } else {
+      std::fprintf(stderr, "Invalid flag '%s'\n", argv[i]);
+      std::exit(1);
+    }
+  }
+
+  std::fprintf(stdout,
+               "Keys:       %d (zipfian skew %.2f, %d%% scans)\n"
+               "Cache:      %d entries of %d bytes\n"
+               "Threads:    %d x %d ops\n"
+               "------------------------------------------------\n",
+               FLAGS_num_keys, FLAGS_skew, FLAGS_scan_percent,
+               FLAGS_cache_entries, FLAGS_value_size, FLAGS_threads,
+               FLAGS_ops_per_thread);
+  leveldb::ZipfianGenerator keys(FLAGS_num_keys, FLAGS_skew);
+
+  const char* types = FLAGS_cache_type;
+  while (types != nullptr && *types != '\0') {
+    const char* sep = strchr(types, ',');
+    std::string type = sep == nullptr ? std::string(types)
+                                      : std::string(types, sep - types);
+    types = sep == nullptr ? nullptr : sep + 1;
+    leveldb::RunBenchmark(type, keys);
+  }
+  return 0;
+}
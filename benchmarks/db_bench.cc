@@ -7,14 +7,18 @@
 #include <atomic>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 
 #include "leveldb/cache.h"
 #include "leveldb/comparator.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
+#include "leveldb/memtablerep.h"
+#include "leveldb/merge_operator.h"
 #include "leveldb/write_batch.h"
 #include "port/port.h"
+#include "util/coding.h"
 #include "util/crc32c.h"
 #include "util/histogram.h"
 #include "util/mutexlock.h"
@@ -30,6 +34,8 @@
 //      fill100K      -- write N/1000 100K values in random order in async mode
 //      deleteseq     -- delete N keys in sequential order
 //      deleterandom  -- delete N keys in random order
+//      mergerandom   -- add 1 to N random counters with DB::Merge
+//      updaterandom  -- add 1 to N random counters with DB::Get and DB::Put
 //      readseq       -- read N times sequentially
 //      readreverse   -- read N times in reverse order
 //      readrandom    -- read N times in random order
@@ -37,11 +43,19 @@
 //      readhot       -- read N times in random order from 1% section of DB
 //      seekrandom    -- N random seeks
 //      seekordered   -- N ordered seeks
+//      scanrange     -- N scans of --scan_length keys from random starts,
+//                       with iterate_lower_bound/iterate_upper_bound set
+//      readparallel  -- read the whole DB in order with DB::ParallelScan,
+//                       split into --scan_partitions ranges
 //      open          -- cost of opening a DB
 //      crc32c        -- repeated crc32c of 4K of data
+//      crc32c_portable -- crc32c with the portable, table-driven code
+//      crc32c_copy   -- crc32c of 4K of data fused with copying it
+//      memcpy_crc32c -- copy 4K of data, then crc32c it
 //   Meta operations:
 //      compact     -- Compact the entire DB
 //      stats       -- Print DB stats
+//      writeamp    -- Print the write amplification of the writes so far
 //      sstables    -- Print sstable info
 //      heapprofile -- Dump a heap profile (if supported by this port)
 static const char* FLAGS_benchmarks =
@@ -71,6 +85,12 @@ static int FLAGS_reads = -1;
 // Number of concurrent threads to run.
 static int FLAGS_threads = 1;
 
+// Number of keys each scan of the scanrange benchmark covers.
+static int FLAGS_scan_length = 100;
+
+// Number of ranges the readparallel benchmark splits the DB into.
+static int FLAGS_scan_partitions = 8;
+
 // Size of each value
 static int FLAGS_value_size = 100;
 
@@ -118,6 +138,37 @@ static bool FLAGS_use_existing_db = false;
 // If true, reuse existing log/MANIFEST files when re-opening a database.
 static bool FLAGS_reuse_logs = false;
 
+// If true, pipeline the log and memtable stages of group commit.
+static bool FLAGS_pipelined_write = false;
+
+// If true, the writers of a group commit apply their batches to the
+// memtable in parallel.
+static bool FLAGS_concurrent_memtable_write = false;
+
+// If true, reserve the space of each log file when it is created.
+static bool FLAGS_preallocate_log = false;
+
+// If true, write log files with direct I/O.
+static bool FLAGS_direct_io_log = false;
+
+// Microseconds a synced write group waits for more writers to join it.
+static int FLAGS_log_sync_delay_micros = 0;
+
+// Memtable index: "skiplist", "vector" or "hash" (a hash-skiplist keyed on
+// the whole key).
+static const char* FLAGS_memtablerep = "skiplist";
+
+// If true, run background compactions.
+static bool FLAGS_enable_compaction = false;
+
+// Rate in bytes/sec writes are slowed down to while compactions fall
+// behind; 0 delays each write by 1ms instead.
+// (initialized to default value by "main")
+static int FLAGS_delayed_write_rate = -1;
+
+// Compaction policy: 0 for leveled, 1 for tiered.
+static int FLAGS_compaction_style = 0;
+
 // Use the db with the following name.
 static const char* FLAGS_db = nullptr;
 
@@ -342,6 +393,9 @@ class Stats {
     if (FLAGS_histogram) {
       std::fprintf(stdout, "Microseconds per op:\n%s\n",
                    hist_.ToString().c_str());
+      std::fprintf(stdout, "Percentiles: P50: %.2f P99: %.2f P99.9: %.2f\n",
+                   hist_.Percentile(50), hist_.Percentile(99),
+                   hist_.Percentile(99.9));
     }
     std::fflush(stdout);
   }
@@ -383,6 +437,8 @@ class Benchmark {
  private:
   Cache* cache_;
   const FilterPolicy* filter_policy_;
+  MemTableRepFactory* memtable_factory_;
+  const MergeOperator* merge_operator_;
   DB* db_;
   int num_;
   int value_size_;
@@ -392,6 +448,8 @@ class Benchmark {
   int heap_counter_;
   CountComparator count_comparator_;
   int total_thread_count_;
+  // User bytes written to the DB since it was created
+  std::atomic<int64_t> user_bytes_written_;
 
   void PrintHeader() {
     const int kKeySize = 16 + FLAGS_key_prefix;
@@ -477,6 +535,8 @@ class Benchmark {
         filter_policy_(FLAGS_bloom_bits >= 0
                            ? NewBloomFilterPolicy(FLAGS_bloom_bits)
                            : nullptr),
+        memtable_factory_(nullptr),
+        merge_operator_(NewUInt64AddOperator()),
         db_(nullptr),
         num_(FLAGS_num),
         value_size_(FLAGS_value_size),
@@ -484,7 +544,8 @@ class Benchmark {
         reads_(FLAGS_reads < 0 ? FLAGS_num : FLAGS_reads),
         heap_counter_(0),
         count_comparator_(BytewiseComparator()),
-        total_thread_count_(0) {
+        total_thread_count_(0),
+        user_bytes_written_(0) {
     std::vector<std::string> files;
     g_env->GetChildren(FLAGS_db, &files);
     for (size_t i = 0; i < files.size(); i++) {
@@ -495,12 +556,22 @@ class Benchmark {
     if (!FLAGS_use_existing_db) {
       DestroyDB(FLAGS_db, Options());
     }
+    if (strcmp(FLAGS_memtablerep, "vector") == 0) {
+      memtable_factory_ = NewVectorRepFactory();
+    } else if (strcmp(FLAGS_memtablerep, "hash") == 0) {
+      memtable_factory_ = NewHashSkipListRepFactory(FLAGS_key_prefix + 16);
+    } else if (strcmp(FLAGS_memtablerep, "skiplist") != 0) {
+      std::fprintf(stderr, "unknown memtablerep '%s'\n", FLAGS_memtablerep);
+      std::exit(1);
+    }
   }
 
   ~Benchmark() {
     delete db_;
     delete cache_;
     delete filter_policy_;
+    delete memtable_factory_;
+    delete merge_operator_;
   }
 
   void Run() {
@@ -577,6 +648,10 @@ class Benchmark {
         method = &Benchmark::SeekRandom;
       } else if (name == Slice("seekordered")) {
         method = &Benchmark::SeekOrdered;
+      } else if (name == Slice("scanrange")) {
+        method = &Benchmark::ScanRange;
+      } else if (name == Slice("readparallel")) {
+        method = &Benchmark::ReadParallel;
       } else if (name == Slice("readhot")) {
         method = &Benchmark::ReadHot;
       } else if (name == Slice("readrandomsmall")) {
@@ -586,6 +661,10 @@ class Benchmark {
         method = &Benchmark::DeleteSeq;
       } else if (name == Slice("deleterandom")) {
         method = &Benchmark::DeleteRandom;
+      } else if (name == Slice("mergerandom")) {
+        method = &Benchmark::MergeRandom;
+      } else if (name == Slice("updaterandom")) {
+        method = &Benchmark::UpdateRandom;
       } else if (name == Slice("readwhilewriting")) {
         num_threads++;  // Add extra thread for writing
         method = &Benchmark::ReadWhileWriting;
@@ -593,6 +672,12 @@ class Benchmark {
         method = &Benchmark::Compact;
       } else if (name == Slice("crc32c")) {
         method = &Benchmark::Crc32c;
+      } else if (name == Slice("crc32c_portable")) {
+        method = &Benchmark::Crc32cPortable;
+      } else if (name == Slice("crc32c_copy")) {
+        method = &Benchmark::Crc32cCopy;
+      } else if (name == Slice("memcpy_crc32c")) {
+        method = &Benchmark::MemcpyCrc32c;
       } else if (name == Slice("snappycomp")) {
         method = &Benchmark::SnappyCompress;
       } else if (name == Slice("snappyuncomp")) {
@@ -601,6 +686,8 @@ class Benchmark {
         HeapProfile();
       } else if (name == Slice("stats")) {
         PrintStats("leveldb.stats");
+      } else if (name == Slice("writeamp")) {
+        PrintWriteAmplification();
       } else if (name == Slice("sstables")) {
         PrintStats("leveldb.sstables");
       } else {
@@ -620,6 +707,7 @@ class Benchmark {
           db_ = nullptr;
           DestroyDB(FLAGS_db, Options());
           Open();
+          user_bytes_written_ = 0;
         }
       }
 
@@ -712,14 +800,55 @@ class Benchmark {
   }
 
   void Crc32c(ThreadState* thread) {
+    Checksum(thread, kCrc32c);
+  }
+
+  void Crc32cPortable(ThreadState* thread) {
+    Checksum(thread, kCrc32cPortable);
+  }
+
+  void Crc32cCopy(ThreadState* thread) {
+    Checksum(thread, kCrc32cCopy);
+  }
+
+  void MemcpyCrc32c(ThreadState* thread) {
+    Checksum(thread, kMemcpyCrc32c);
+  }
+
+  enum ChecksumMethod {
+    kCrc32c,
+    kCrc32cPortable,
+    kCrc32cCopy,
+    kMemcpyCrc32c
+  };
+
+  void Checksum(ThreadState* thread, ChecksumMethod method) {
     // Checksum about 500MB of data total
     const int size = 4096;
-    const char* label = "(4K per op)";
+    std::string label = "(4K per op, ";
+    label += (method == kCrc32cPortable) ? "portable"
+                                         : crc32c::ImplementationName();
+    label += ")";
     std::string data(size, 'x');
+    std::string copy(size, '\0');
     int64_t bytes = 0;
     uint32_t crc = 0;
     while (bytes < 500 * 1048576) {
-      crc = crc32c::Value(data.data(), size);
+      switch (method) {
+        case kCrc32c:
+          crc = crc32c::Value(data.data(), size);
+          break;
+        case kCrc32cPortable:
+          crc = crc32c::ExtendPortable(0, data.data(), size);
+          break;
+        case kCrc32cCopy:
+          crc = crc32c::ExtendAndCopy(0, data.data(), size, &copy[0]);
+          break;
+        case kMemcpyCrc32c:
+          std::memcpy(&copy[0], data.data(), size);
+          crc = crc32c::Value(copy.data(), size);
+          break;
+      }
       thread->stats.FinishedSingleOp();
       bytes += size;
     }
@@ -791,7 +920,18 @@ class Benchmark {
     }
     options.max_open_files = FLAGS_open_files;
     options.filter_policy = filter_policy_;
+    options.memtable_factory = memtable_factory_;
+    options.merge_operator = merge_operator_;
     options.reuse_logs = FLAGS_reuse_logs;
+    options.enable_pipelined_write = FLAGS_pipelined_write;
+    options.allow_concurrent_memtable_write = FLAGS_concurrent_memtable_write;
+    options.preallocate_log_file = FLAGS_preallocate_log;
+    options.use_direct_io_for_log = FLAGS_direct_io_log;
+    options.log_sync_delay_micros = FLAGS_log_sync_delay_micros;
+    options.enable_compaction = FLAGS_enable_compaction;
+    options.delayed_write_rate = FLAGS_delayed_write_rate;
+    options.compaction_style =
+        static_cast<CompactionStyle>(FLAGS_compaction_style);
     Status s = DB::Open(options, FLAGS_db, &db_);
     if (!s.ok()) {
       std::fprintf(stderr, "open error: %s\n", s.ToString().c_str());
@@ -843,6 +983,15 @@ class Benchmark {
       }
     }
     thread->stats.AddBytes(bytes);
+    user_bytes_written_ += bytes;
+
+    std::string stall;
+    if (db_->GetProperty("leveldb.write-stall-micros", &stall)) {
+      char msg[100];
+      std::snprintf(msg, sizeof(msg), "(stalled %.1f ms)",
+                    std::stoull(stall) * 1e-3);
+      thread->stats.AddMessage(msg);
+    }
   }
 
   void ReadSequential(ThreadState* thread) {
@@ -1027,6 +1176,71 @@ class Benchmark {
     thread->stats.AddMessage(msg);
   }
 
+  void ScanRange(ThreadState* thread) {
+    ReadOptions options = ReadOptions(FLAGS_use_gitable,
+                                      FLAGS_use_file_gran_filter);
+    KeyBuffer lower;
+    KeyBuffer upper;
+    Slice lower_bound = lower.slice();
+    Slice upper_bound = upper.slice();
+    options.iterate_lower_bound = &lower_bound;
+    options.iterate_upper_bound = &upper_bound;
+    int64_t found = 0;
+    int64_t bytes = 0;
+    for (int i = 0; i < reads_; i++) {
+      const int k = thread->rand.Uniform(FLAGS_num);
+      lower.Set(k);
+      upper.Set(k + FLAGS_scan_length);
+      Iterator* iter = db_->NewIterator(options);
+      for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+        bytes += iter->key().size() + iter->value().size();
+        found++;
+      }
+      delete iter;
+      thread->stats.FinishedSingleOp();
+    }
+    thread->stats.AddBytes(bytes);
+    char msg[100];
+    std::snprintf(msg, sizeof(msg), "(%.1f keys per scan)",
+                  reads_ > 0 ? static_cast<double>(found) / reads_ : 0.0);
+    thread->stats.AddMessage(msg);
+  }
+
+  class CountingScanCallback : public ScanCallback {
+   public:
+    explicit CountingScanCallback(ThreadState* thread)
+        : thread_(thread), bytes_(0) {}
+
+    bool Entry(int partition, const Slice& key, const Slice& value) override {
+      bytes_ += key.size() + value.size();
+      thread_->stats.FinishedSingleOp();
+      return true;
+    }
+
+    int64_t bytes() const { return bytes_; }
+
+   private:
+    ThreadState* const thread_;
+    int64_t bytes_;
+  };
+
+  void ReadParallel(ThreadState* thread) {
+    ParallelScanOptions scan_options;
+    scan_options.num_partitions = FLAGS_scan_partitions;
+    scan_options.max_threads = FLAGS_scan_partitions;
+    // Entries are delivered on this thread, which keeps the stats safe.
+    scan_options.ordered = true;
+    CountingScanCallback callback(thread);
+    Status s = db_->ParallelScan(
+        ReadOptions(FLAGS_use_gitable, FLAGS_use_file_gran_filter),
+        scan_options, nullptr, nullptr, &callback);
+    if (!s.ok()) {
+      std::fprintf(stderr, "parallel scan error: %s\n", s.ToString().c_str());
+      std::exit(1);
+    }
+    thread->stats.AddBytes(callback.bytes());
+  }
+
   void DoDelete(ThreadState* thread, bool seq) {
     RandomGenerator gen;
     WriteBatch batch;
@@ -1052,6 +1266,45 @@ class Benchmark {
 
   void DeleteRandom(ThreadState* thread) { DoDelete(thread, false); }
 
+  void MergeRandom(ThreadState* thread) {
+    std::string one;
+    PutFixed64(&one, 1);
+    KeyBuffer key;
+    for (int i = 0; i < num_; i++) {
+      key.Set(thread->rand.Uniform(FLAGS_num));
+      Status s = db_->Merge(write_options_, key.slice(), one);
+      if (!s.ok()) {
+        std::fprintf(stderr, "merge error: %s\n", s.ToString().c_str());
+        std::exit(1);
+      }
+      thread->stats.FinishedSingleOp();
+    }
+  }
+
+  // The read-modify-write that MergeRandom() saves
+  void UpdateRandom(ThreadState* thread) {
+    ReadOptions options = ReadOptions(FLAGS_use_gitable,
+                                      FLAGS_use_file_gran_filter);
+    std::string value;
+    KeyBuffer key;
+    for (int i = 0; i < num_; i++) {
+      key.Set(thread->rand.Uniform(FLAGS_num));
+      uint64_t count = 0;
+      if (db_->Get(options, key.slice(), &value).ok() &&
+          value.size() == sizeof(uint64_t)) {
+        count = DecodeFixed64(value.data());
+      }
+      value.clear();
+      PutFixed64(&value, count + 1);
+      Status s = db_->Put(write_options_, key.slice(), value);
+      if (!s.ok()) {
+        std::fprintf(stderr, "put error: %s\n", s.ToString().c_str());
+        std::exit(1);
+      }
+      thread->stats.FinishedSingleOp();
+    }
+  }
+
   void ReadWhileWriting(ThreadState* thread) {
     if (thread->tid > 0) {
       ReadRandom(thread);
@@ -1093,6 +1346,25 @@ class Benchmark {
     std::fprintf(stdout, "\n%s\n", stats.c_str());
   }
 
+  // Table bytes written by flushes and compactions per user byte written.
+  // Reported for the writes done so far, so compactions that are still
+  // due are not counted.
+  void PrintWriteAmplification() {
+    std::string table_bytes;
+    if (!db_->GetProperty("leveldb.table-bytes-written", &table_bytes)) {
+      std::fprintf(stdout, "writeamp    : (failed)\n");
+      return;
+    }
+    const double user_mb = user_bytes_written_ / 1048576.0;
+    const double table_mb = std::stoull(table_bytes) / 1048576.0;
+    std::fprintf(stdout,
+                 "writeamp    : %.2f (%.1f MB written to tables for %.1f MB "
+                 "of user data, %s compaction)\n",
+                 user_mb > 0 ? table_mb / user_mb : 0.0, table_mb, user_mb,
+                 FLAGS_compaction_style == kCompactionStyleTiered ? "tiered"
+                                                                  : "leveled");
+  }
+
   static void WriteToFile(void* arg, const char* buf, int n) {
     reinterpret_cast<WritableFile*>(arg)->Append(Slice(buf, n));
   }
@@ -1123,6 +1395,7 @@ int main(int argc, char** argv) {
   FLAGS_max_file_size = leveldb::Options().max_file_size;
   FLAGS_block_size = leveldb::Options().block_size;
   FLAGS_open_files = leveldb::Options().max_open_files;
+  FLAGS_delayed_write_rate = leveldb::Options().delayed_write_rate;
   std::string default_db_path;
 
   for (int i = 1; i < argc; i++) {
@@ -1145,12 +1418,43 @@ int main(int argc, char** argv) {
     } else if (sscanf(argv[i], "--reuse_logs=%d%c", &n, &junk) == 1 &&
                (n == 0 || n == 1)) {
       FLAGS_reuse_logs = n;
+    } else if (sscanf(argv[i], "--pipelined_write=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_pipelined_write = n;
+    } else if (sscanf(argv[i], "--concurrent_memtable_write=%d%c", &n,
+                      &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_concurrent_memtable_write = n;
+    } else if (sscanf(argv[i], "--preallocate_log=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_preallocate_log = n;
+    } else if (sscanf(argv[i], "--direct_io_log=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_direct_io_log = n;
+    } else if (sscanf(argv[i], "--log_sync_delay_micros=%d%c", &n, &junk) ==
+                   1 &&
+               n >= 0) {
+      FLAGS_log_sync_delay_micros = n;
+    } else if (sscanf(argv[i], "--enable_compaction=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_enable_compaction = n;
+    } else if (sscanf(argv[i], "--delayed_write_rate=%d%c", &n, &junk) == 1) {
+      FLAGS_delayed_write_rate = n;
+    } else if (sscanf(argv[i], "--compaction_style=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_compaction_style = n;
     } else if (sscanf(argv[i], "--num=%d%c", &n, &junk) == 1) {
       FLAGS_num = n;
     } else if (sscanf(argv[i], "--reads=%d%c", &n, &junk) == 1) {
       FLAGS_reads = n;
     } else if (sscanf(argv[i], "--threads=%d%c", &n, &junk) == 1) {
       FLAGS_threads = n;
+    } else if (sscanf(argv[i], "--scan_length=%d%c", &n, &junk) == 1 &&
+               n > 0) {
+      FLAGS_scan_length = n;
+    } else if (sscanf(argv[i], "--scan_partitions=%d%c", &n, &junk) == 1 &&
+               n > 0) {
+      FLAGS_scan_partitions = n;
     } else if (sscanf(argv[i], "--value_size=%d%c", &n, &junk) == 1) {
       FLAGS_value_size = n;
     } else if (sscanf(argv[i], "--write_buffer_size=%d%c", &n, &junk) == 1) {
@@ -1167,6 +1471,8 @@ int main(int argc, char** argv) {
       FLAGS_bloom_bits = n;
     } else if (sscanf(argv[i], "--open_files=%d%c", &n, &junk) == 1) {
       FLAGS_open_files = n;
+    } else if (strncmp(argv[i], "--memtablerep=", 14) == 0) {
+      FLAGS_memtablerep = argv[i] + 14;
     } else if (strncmp(argv[i], "--db=", 5) == 0) {
       FLAGS_db = argv[i] + 5;
     } else if (sscanf(argv[i], "--use_gitable=%d%c", &n, &junk) == 1 &&
@@ -0,0 +1,244 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "db/dbformat.h"
+#include "leveldb/comparator.h"
+#include "leveldb/env.h"
+#include "leveldb/iterator.h"
+#include "table/merger.h"
+#include "util/random.h"
+
+// Benchmark of the merging iterator for wide merges.  It reports the key
+// comparisons the merge makes per entry, next to the n - 1 that a linear
+// scan over the children would make, and the time per entry.
+//
+//   compaction -- one pass over internal keys spread over all children,
+//                 like VersionSet::MakeInputIterator with overlapping L0
+//                 files
+//   scan       -- short scans from random keys, like user iterators over
+//                 memtables, L0 files and levels
+//   scanreverse -- the same scans backwards with Prev()
+//
+//   merge_bench --fan_in=2,8,20,64 --benchmarks=compaction,scan
+
+// Comma-separated list of benchmarks to run.
+static const char* FLAGS_benchmarks = "compaction,scan,scanreverse";
+
+// Comma-separated list of numbers of children to merge.
+static const char* FLAGS_fan_in = "2,4,8,12,20,32,64";
+
+// Number of keys spread over the children.
+static int FLAGS_num_keys = 1000000;
+
+// Number of scans of the scan benchmarks.
+static int FLAGS_scans = 100000;
+
+// Number of entries each scan reads.
+static int FLAGS_scan_length = 100;
+
+namespace leveldb {
+
+namespace {
+
+// Counts the comparisons made through it.
+class CountingComparator : public Comparator {
+ public:
+  explicit CountingComparator(const Comparator* base)
+      : base_(base), count_(0) {}
+
+  const char* Name() const override { return base_->Name(); }
+  int Compare(const Slice& a, const Slice& b) const override {
+    count_++;
+    return base_->Compare(a, b);
+  }
+  void FindShortestSeparator(std::string* start,
+                             const Slice& limit) const override {
+    base_->FindShortestSeparator(start, limit);
+  }
+  void FindShortSuccessor(std::string* key) const override {
+    base_->FindShortSuccessor(key);
+  }
+
+  uint64_t count() const { return count_; }
+  void Reset() { count_ = 0; }
+
+ private:
+  const Comparator* const base_;
+  mutable uint64_t count_;
+};
+
+// Iterates over a sorted vector of keys, standing in for a table.
+class VectorIterator : public Iterator {
+ public:
+  VectorIterator(const Comparator* cmp, std::vector<std::string> keys)
+      : cmp_(cmp), keys_(std::move(keys)), pos_(keys_.size()) {}
+
+  bool Valid() const override { return pos_ < keys_.size(); }
+  void SeekToFirst() override { pos_ = 0; }
+  void SeekToLast() override {
+    pos_ = keys_.empty() ? keys_.size() : keys_.size() - 1;
+  }
+  void Seek(const Slice& target) override {
+    pos_ = std::lower_bound(keys_.begin(), keys_.end(), target,
+                            [this](const std::string& a, const Slice& b) {
+                              return cmp_->Compare(a, b) < 0;
+                            }) -
+           keys_.begin();
+  }
+  void Next() override { pos_++; }
+  void Prev() override { pos_ = pos_ == 0 ? keys_.size() : pos_ - 1; }
+  Slice key() const override { return keys_[pos_]; }
+  Slice value() const override { return Slice(); }
+  Status status() const override { return Status::OK(); }
+
+ private:
+  const Comparator* const cmp_;
+  const std::vector<std::string> keys_;
+  size_t pos_;
+};
+
+std::string UserKey(int k) {
+  char buf[20];
+  std::snprintf(buf, sizeof(buf), "%016d", k);
+  return buf;
+}
+
+// Spread FLAGS_num_keys keys over "n" children at random.  Internal keys
+// get a sequence number and type appended, the way tables store them.
+// The children seek with "child_cmp", so only the merge itself is counted.
+Iterator* NewMerger(const Comparator* cmp, const Comparator* child_cmp, int n,
+                    bool internal_keys) {
+  Random rnd(301);
+  std::vector<std::vector<std::string>> keys(n);
+  for (int k = 0; k < FLAGS_num_keys; k++) {
+    std::string key = UserKey(k);
+    if (internal_keys) {
+      std::string ikey;
+      AppendInternalKey(&ikey,
+                        ParsedInternalKey(key, rnd.Next(), kTypeValue));
+      key.swap(ikey);
+    }
+    keys[rnd.Uniform(n)].push_back(key);
+  }
+  std::vector<Iterator*> children;
+  for (int i = 0; i < n; i++) {
+    children.push_back(new VectorIterator(child_cmp, keys[i]));
+  }
+  return NewMergingIterator(cmp, children.data(), n);
+}
+
+void Report(const char* name, int n, uint64_t entries, uint64_t seeks,
+            uint64_t comparisons, uint64_t micros) {
+  // A linear scan compares all children once per entry and once more per
+  // seek.
+  const double linear =
+      static_cast<double>(n - 1) * (entries + seeks) / entries;
+  std::fprintf(stdout,
+               "%-11s fan_in=%-3d: %6.2f comparisons/entry (linear %6.2f); "
+               "%7.3f micros/entry\n",
+               name, n, static_cast<double>(comparisons) / entries, linear,
+               static_cast<double>(micros) / entries);
+}
+
+void RunBenchmark(const std::string& name, int n) {
+  Env* env = Env::Default();
+  if (name == "compaction") {
+    InternalKeyComparator icmp(BytewiseComparator());
+    CountingComparator cmp(&icmp);
+    Iterator* iter = NewMerger(&cmp, &icmp, n, true);
+    cmp.Reset();
+    const uint64_t start = env->NowMicros();
+    uint64_t entries = 0;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      entries++;
+    }
+    Report(name.c_str(), n, entries, 1, cmp.count(), env->NowMicros() - start);
+    delete iter;
+  } else if (name == "scan" || name == "scanreverse") {
+    const bool reverse = name == "scanreverse";
+    CountingComparator cmp(BytewiseComparator());
+    Iterator* iter = NewMerger(&cmp, BytewiseComparator(), n, false);
+    cmp.Reset();
+    Random rnd(1000);
+    const uint64_t start = env->NowMicros();
+    uint64_t entries = 0;
+    for (int i = 0; i < FLAGS_scans; i++) {
+      iter->Seek(UserKey(rnd.Uniform(FLAGS_num_keys)));
+      if (reverse) {
+        // The first Prev() also turns the merge around.
+        if (iter->Valid()) iter->Prev();
+      }
+      for (int j = 0; j < FLAGS_scan_length && iter->Valid(); j++) {
+        entries++;
+        if (reverse) {
+          iter->Prev();
+        } else {
+          iter->Next();
+        }
+      }
+    }
+    Report(name.c_str(), n, entries, FLAGS_scans, cmp.count(),
+           env->NowMicros() - start);
+    delete iter;
+  } else {
+    std::fprintf(stderr, "unknown benchmark '%s'\n", name.c_str());
+  }
+}
+
+}  // namespace
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  for (int i = 1; i < argc; i++) {
+    int n;
+    char junk;
+    if (strncmp(argv[i], "--benchmarks=", 13) == 0) {
+      FLAGS_benchmarks = argv[i] + 13;
+    } else if (strncmp(argv[i], "--fan_in=", 9) == 0) {
+      FLAGS_fan_in = argv[i] + 9;
+    } else if (sscanf(argv[i], "--num_keys=%d%c", &n, &junk) == 1 && n > 0) {
+      FLAGS_num_keys = n;
+    } else if (sscanf(argv[i], "--scans=%d%c", &n, &junk) == 1) {
+      FLAGS_scans = n;
+    } else if (sscanf(argv[i], "--scan_length=%d%c", &n, &junk) == 1) {
+      FLAGS_scan_length = n;
+    } else {
+      std::fprintf(stderr, "Invalid flag '%s'\n", argv[i]);
+      std::exit(1);
+    }
+  }
+
+  std::fprintf(stdout,
+               "Keys:       %d\n"
+               "Scans:      %d x %d entries\n"
+               "------------------------------------------------\n",
+               FLAGS_num_keys, FLAGS_scans, FLAGS_scan_length);
+
+  const char* benchmarks = FLAGS_benchmarks;
+  while (benchmarks != nullptr && *benchmarks != '\0') {
+    const char* sep = strchr(benchmarks, ',');
+    std::string name = sep == nullptr ? std::string(benchmarks)
+                                      : std::string(benchmarks, sep - benchmarks);
+    benchmarks = sep == nullptr ? nullptr : sep + 1;
+    const char* fan_in = FLAGS_fan_in;
+    while (fan_in != nullptr && *fan_in != '\0') {
+      const int n = std::atoi(fan_in);
+      if (n > 0) {
+        leveldb::RunBenchmark(name, n);
+      }
+      fan_in = strchr(fan_in, ',');
+      if (fan_in != nullptr) fan_in++;
+    }
+  }
+  return 0;
+}
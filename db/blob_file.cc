@@ -0,0 +1,104 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/blob_file.h"
+
+#include "db/filename.h"
+#include "leveldb/env.h"
+#include "util/coding.h"
+#include "util/crc32c.h"
+#include "util/rate_limited_file.h"
+
+namespace leveldb {
+
+void BlobIndex::EncodeTo(std::string* dst) const {
+  PutVarint64(dst, file_number);
+  PutVarint64(dst, offset);
+  PutVarint64(dst, size);
+}
+
+Status BlobIndex::DecodeFrom(const Slice& input) {
+  Slice in = input;
+  if (GetVarint64(&in, &file_number) && GetVarint64(&in, &offset) &&
+      GetVarint64(&in, &size) && in.empty()) {
+    return Status::OK();
+  }
+  return Status::Corruption("bad blob index");
+}
+
+BlobFileBuilder::BlobFileBuilder(const std::string& dbname, Env* env,
+                                 RateLimiter* rate_limiter,
+                                 RateLimiter::IOPriority pri, uint64_t number)
+    : fname_(BlobFileName(dbname, number)),
+      env_(env),
+      rate_limiter_(rate_limiter),
+      pri_(pri),
+      number_(number),
+      file_(nullptr),
+      num_entries_(0),
+      offset_(0),
+      closed_(false) {}
+
+BlobFileBuilder::~BlobFileBuilder() {
+  assert(file_ == nullptr || closed_);
+  delete file_;
+}
+
+Status BlobFileBuilder::Add(const Slice& value, std::string* blob_index) {
+  assert(!closed_);
+  if (file_ == nullptr) {
+    Status s = env_->NewWritableFile(fname_, &file_);
+    if (!s.ok()) {
+      return s;
+    }
+    if (rate_limiter_ != nullptr) {
+      file_ = NewRateLimitedWritableFile(file_, rate_limiter_, pri_);
+    }
+  }
+
+  char trailer[kBlobRecordTrailerSize];
+  EncodeFixed32(trailer, crc32c::Mask(crc32c::Value(value.data(),
+                                                    value.size())));
+  Status s = file_->Append(value);
+  if (s.ok()) {
+    s = file_->Append(Slice(trailer, sizeof(trailer)));
+  }
+  if (!s.ok()) {
+    return s;
+  }
+
+  BlobIndex index;
+  index.file_number = number_;
+  index.offset = offset_;
+  index.size = value.size();
+  blob_index->clear();
+  index.EncodeTo(blob_index);
+  offset_ += index.record_size();
+  num_entries_++;
+  return s;
+}
+
+Status BlobFileBuilder::Finish() {
+  assert(!closed_);
+  closed_ = true;
+  if (file_ == nullptr) {
+    return Status::OK();
+  }
+  Status s = file_->Sync();
+  if (s.ok()) {
+    s = file_->Close();
+  }
+  return s;
+}
+
+void BlobFileBuilder::Abandon() {
+  assert(!closed_);
+  closed_ = true;
+  if (file_ != nullptr) {
+    file_->Close();
+    env_->RemoveFile(fname_);
+  }
+}
+
+}  // namespace leveldb
@@ -0,0 +1,98 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A blob file holds the values that Options::min_blob_size moves out of
+// the tables.  It is written together with the table of the same number,
+// by a memtable flush or a compaction, and never changes afterwards.
+// Each record is
+//
+//    value: uint8[size]
+//    crc: fixed32      (masked crc32c of value)
+//
+// and the table entry of the value has type kTypeBlobIndex and holds an
+// encoded BlobIndex in place of the value.  Entries keep referencing a
+// blob file after its table is compacted away; the MANIFEST counts how
+// many of its records are no longer referenced (see BlobFileMetaData).
+
+#ifndef STORAGE_LEVELDB_DB_BLOB_FILE_H_
+#define STORAGE_LEVELDB_DB_BLOB_FILE_H_
+
+#include <cstdint>
+#include <string>
+
+#include "leveldb/rate_limiter.h"
+#include "leveldb/slice.h"
+#include "leveldb/status.h"
+
+namespace leveldb {
+
+class Env;
+class WritableFile;
+
+// Size of the crc that follows every value in a blob file.
+static const size_t kBlobRecordTrailerSize = 4;
+
+// Location of a value in a blob file.
+struct BlobIndex {
+  BlobIndex() : file_number(0), offset(0), size(0) {}
+
+  // Bytes the value takes in its blob file.
+  uint64_t record_size() const { return size + kBlobRecordTrailerSize; }
+
+  void EncodeTo(std::string* dst) const;
+  Status DecodeFrom(const Slice& input);
+
+  uint64_t file_number;
+  uint64_t offset;  // Of the value in the file
+  uint64_t size;    // Of the value
+};
+
+// Writes a blob file.  The file is only created once the first value is
+// added, so a builder that is not used leaves nothing behind.
+class BlobFileBuilder {
+ public:
+  // Appends to the blob file "number" of database "dbname".  If
+  // "rate_limiter" is not null, writes are requested from it at "pri".
+  BlobFileBuilder(const std::string& dbname, Env* env,
+                  RateLimiter* rate_limiter, RateLimiter::IOPriority pri,
+                  uint64_t number);
+
+  BlobFileBuilder(const BlobFileBuilder&) = delete;
+  BlobFileBuilder& operator=(const BlobFileBuilder&) = delete;
+
+  // REQUIRES: Finish() or Abandon() has been called.
+  ~BlobFileBuilder();
+
+  // Append "value" and set "*blob_index" to its encoded BlobIndex.
+  Status Add(const Slice& value, std::string* blob_index);
+
+  // Sync and close the file, if one was created.
+  Status Finish();
+
+  // Close and delete the file, if one was created.
+  void Abandon();
+
+  uint64_t number() const { return number_; }
+
+  // Number of values added so far.
+  uint64_t NumEntries() const { return num_entries_; }
+
+  // Size of the file generated so far.
+  uint64_t FileSize() const { return offset_; }
+
+ private:
+  const std::string fname_;
+  Env* const env_;
+  RateLimiter* const rate_limiter_;
+  const RateLimiter::IOPriority pri_;
+  const uint64_t number_;
+  WritableFile* file_;
+  uint64_t num_entries_;
+  uint64_t offset_;
+  bool closed_;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_BLOB_FILE_H_
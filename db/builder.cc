@@ -4,6 +4,7 @@
 
 #include "db/builder.h"
 
+#include "db/blob_file.h"
 #include "db/dbformat.h"
 #include "db/filename.h"
 #include "db/table_cache.h"
@@ -11,15 +12,27 @@
 #include "leveldb/db.h"
 #include "leveldb/env.h"
 #include "leveldb/iterator.h"
+#include "util/rate_limited_file.h"
 
 namespace leveldb {
 
 Status BuildTable(const std::string& dbname, Env* env, const Options& options,
-                  TableCache* table_cache, Iterator* iter, FileMetaData* meta) {
+                  TableCache* table_cache, Iterator* iter, FileMetaData* meta,
+                  BlobFileMetaData* blob) {
   Status s;
   meta->file_size = 0;
   iter->SeekToFirst();
 
+  BlobFileBuilder* blob_builder = nullptr;
+  if (blob != nullptr) {
+    *blob = BlobFileMetaData();
+    blob->number = meta->number;
+    if (options.min_blob_size > 0) {
+      blob_builder = new BlobFileBuilder(dbname, env, options.rate_limiter,
+                                         RateLimiter::kFlush, meta->number);
+    }
+  }
+
   std::string fname = TableFileName(dbname, meta->number);
   if (iter->Valid()) {
     WritableFile* file;
@@ -27,20 +40,44 @@ Status BuildTable(const std::string& dbname, Env* env, const Options& options,
     if (!s.ok()) {
       return s;
     }
+    if (options.rate_limiter != nullptr) {
+      file = NewRateLimitedWritableFile(file, options.rate_limiter,
+                                        RateLimiter::kFlush);
+    }
 
     TableBuilder* builder = new TableBuilder(options, file);
     meta->smallest.DecodeFrom(iter->key());
     Slice key;
+    ParsedInternalKey ikey;
+    std::string blob_key, blob_index;
     for (; iter->Valid(); iter->Next()) {
       key = iter->key();
-      builder->Add(key, iter->value());
+      Slice value = iter->value();
+      if (blob_builder != nullptr && value.size() >= options.min_blob_size &&
+          ParseInternalKey(key, &ikey) && ikey.type == kTypeValue) {
+        s = blob_builder->Add(value, &blob_index);
+        if (!s.ok()) {
+          break;
+        }
+        blob_key.clear();
+        AppendInternalKey(&blob_key, ParsedInternalKey(ikey.user_key,
+                                                       ikey.sequence,
+                                                       kTypeBlobIndex));
+        builder->Add(blob_key, blob_index);
+      } else {
+        builder->Add(key, value);
+      }
     }
     if (!key.empty()) {
       meta->largest.DecodeFrom(key);
     }
 
     // Finish and check for builder errors
-    s = builder->Finish();
+    if (s.ok()) {
+      s = builder->Finish();
+    } else {
+      builder->Abandon();
+    }
     if (s.ok()) {
       meta->file_size = builder->FileSize();
       assert(meta->file_size > 0);
@@ -71,6 +108,19 @@ Status BuildTable(const std::string& dbname, Env* env, const Options& options,
     s = iter->status();
   }
 
+  if (blob_builder != nullptr) {
+    if (s.ok() && meta->file_size > 0) {
+      s = blob_builder->Finish();
+    } else {
+      blob_builder->Abandon();
+    }
+    if (s.ok()) {
+      blob->total_count = blob_builder->NumEntries();
+      blob->total_bytes = blob_builder->FileSize();
+    }
+    delete blob_builder;
+  }
+
   if (s.ok() && meta->file_size > 0) {
     // Keep it
   } else {
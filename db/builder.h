@@ -16,14 +16,21 @@ class Env;
 class Iterator;
 class TableCache;
 class VersionEdit;
+struct BlobFileMetaData;
 
 // Build a Table file from the contents of *iter.  The generated file
 // will be named according to meta->number.  On success, the rest of
 // *meta will be filled with metadata about the generated table.
 // If no data is present in *iter, meta->file_size will be set to
 // zero, and no Table file will be produced.
+//
+// If "blob" is not null and options.min_blob_size is set, values of at
+// least that size go to the blob file of the same number as the table,
+// which *blob then describes.  blob->total_count is zero if there was
+// no such value.
 Status BuildTable(const std::string& dbname, Env* env, const Options& options,
-                  TableCache* table_cache, Iterator* iter, FileMetaData* meta);
+                  TableCache* table_cache, Iterator* iter, FileMetaData* meta,
+                  BlobFileMetaData* blob);
 
 }  // namespace leveldb
 
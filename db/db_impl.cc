@@ -8,11 +8,15 @@
 #include <atomic>
 #include <cstdint>
 #include <cstdio>
+#include <deque>
 #include <set>
 #include <string>
+#include <thread>
 #include <vector>
 #include <iostream>
+#include <map>
 
+#include "db/blob_file.h"
 #include "db/builder.h"
 #include "db/db_iter.h"
 #include "db/dbformat.h"
@@ -20,10 +24,13 @@
 #include "db/log_reader.h"
 #include "db/log_writer.h"
 #include "db/memtable.h"
+#include "db/merge_helper.h"
 #include "db/table_cache.h"
 #include "db/version_set.h"
 #include "db/git_iter.h"
 #include "db/write_batch_internal.h"
+#include "db/write_controller.h"
+#include "leveldb/compaction_filter.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
 #include "leveldb/status.h"
@@ -36,21 +43,43 @@
 #include "util/coding.h"
 #include "util/logging.h"
 #include "util/mutexlock.h"
+#include "util/rate_limited_file.h"
 
 namespace leveldb {
 
 const int kNumNonTableCacheFiles = 10;
 
+// Compaction input is charged to Options::rate_limiter in chunks of this
+// many bytes rather than per entry.
+const int64_t kRateLimitReadChunk = 32 * 1024;
+
 // Information kept for every waiting writer
 struct DBImpl::Writer {
   explicit Writer(port::Mutex* mu)
-      : batch(nullptr), sync(false), done(false), cv(mu) {}
+      : batch(nullptr),
+        sync(false),
+        done(false),
+        exclusive(false),
+        cv(mu),
+        sequence(0),
+        insert_leader(nullptr),
+        pending_inserts(0) {}
 
   Status status;
   WriteBatch* batch;
   bool sync;
   bool done;
+  // Set by IngestExternalFile(), which holds the queue by itself: the
+  // writer is never folded into another writer's group.
+  bool exclusive;
   port::CondVar cv;
+
+  // Used by options_.allow_concurrent_memtable_write.  A group member is
+  // told to apply "batch" at "sequence" by setting "insert_leader"; the
+  // leader counts the members still applying in "pending_inserts".
+  SequenceNumber sequence;
+  Writer* insert_leader;
+  int pending_inserts;
 };
 
 struct DBImpl::CompactionState {
@@ -59,32 +88,76 @@ struct DBImpl::CompactionState {
     uint64_t number;
     uint64_t file_size;
     InternalKey smallest, largest;
+    // Values moved to the blob file of the same number, if any
+    uint64_t blob_count;
+    uint64_t blob_bytes;
   };
 
   Output* current_output() { return &outputs[outputs.size() - 1]; }
 
   explicit CompactionState(Compaction* c)
       : compaction(c),
+        has_begin(false),
+        has_end(false),
         smallest_snapshot(0),
+        newest_snapshot(0),
         outfile(nullptr),
         builder(nullptr),
-        total_bytes(0) {}
+        blob_builder(nullptr),
+        total_bytes(0),
+        filtered_entries(0),
+        filtered_bytes(0) {}
 
   Compaction* const compaction;
 
+  // User key range [begin, end) handled by this state when the compaction
+  // is split into sub-compactions; a missing bound is unbounded.
+  bool has_begin;
+  bool has_end;
+  std::string begin;
+  std::string end;
+
+  // Position of this key range in the levels below the compaction
+  Compaction::KeyCursor cursor;
+
   // Sequence numbers < smallest_snapshot are not significant since we
   // will never have to service a snapshot below smallest_snapshot.
   // Therefore if we have seen a sequence number S <= smallest_snapshot,
   // we can drop all entries for the same key with sequence numbers < S.
   SequenceNumber smallest_snapshot;
 
+  // No snapshot sees the entries with larger sequence numbers, so only
+  // they are passed to Options::compaction_filter.
+  SequenceNumber newest_snapshot;
+
   std::vector<Output> outputs;
 
   // State kept for output being generated
   WritableFile* outfile;
   TableBuilder* builder;
+  BlobFileBuilder* blob_builder;
+
+  // Blob files whose values still referenced from the input are moved to
+  // the output blob files, and the (count, bytes) of the blob records the
+  // compaction stopped referencing, by blob file.
+  std::set<uint64_t> blob_gc_files;
+  std::map<uint64_t, std::pair<uint64_t, uint64_t>> blob_garbage;
 
   uint64_t total_bytes;
+
+  // Keys Options::compaction_filter removed, and their bytes
+  uint64_t filtered_entries;
+  uint64_t filtered_bytes;
+
+  // Counts the blob record that "blob_index" references as garbage.
+  void AddBlobGarbage(const Slice& blob_index) {
+    BlobIndex index;
+    if (index.DecodeFrom(blob_index).ok()) {
+      std::pair<uint64_t, uint64_t>* garbage = &blob_garbage[index.file_number];
+      garbage->first++;
+      garbage->second += index.record_size();
+    }
+  }
 };
 
 // Fix user-supplied options to be reasonable
@@ -104,6 +177,12 @@ Options SanitizeOptions(const std::string& dbname,
   ClipToRange(&result.write_buffer_size, 64 << 10, 1 << 30);
   ClipToRange(&result.max_file_size, 1 << 20, 1 << 30);
   ClipToRange(&result.block_size, 1 << 10, 4 << 20);
+  ClipToRange(&result.thread_compaction, 1, 64);
+  ClipToRange(&result.max_subcompactions, 1, 64);
+  ClipToRange(&result.max_recovery_threads, 1, 64);
+  ClipToRange(&result.tiered_size_ratio, 0, 1000);
+  ClipToRange(&result.tiered_max_size_amplification_percent, 1, 100000);
+  ClipToRange(&result.blob_gc_garbage_ratio, 0.0, 1.0);
   if (result.info_log == nullptr) {
     // Open a log file in the same directory as the db
     src.env->CreateDir(dbname);  // In case it does not exist
@@ -125,10 +204,39 @@ static int TableCacheSize(const Options& sanitized_options) {
   return sanitized_options.max_open_files - kNumNonTableCacheFiles;
 }
 
+// Options for building a table that will be placed at "level", with the
+// compression type picked from options.compression_per_level.
+static Options TableOptionsForLevel(const Options& options, int level) {
+  Options result = options;
+  const std::vector<CompressionType>& per_level = options.compression_per_level;
+  if (!per_level.empty()) {
+    const size_t index =
+        std::min(static_cast<size_t>(level), per_level.size() - 1);
+    result.compression = per_level[index];
+  }
+  return result;
+}
+
+// Describes the inputs of "c" as "<files>@<level> + ..." for the info log.
+static std::string InputSummary(const Compaction* c) {
+  std::string result;
+  for (int which = 0; which < c->num_input_levels(); which++) {
+    if (which > 0) {
+      result.append(" + ");
+    }
+    char buf[50];
+    std::snprintf(buf, sizeof(buf), "%d@%d", c->num_input_files(which),
+                  c->input_level(which));
+    result.append(buf);
+  }
+  return result;
+}
+
 DBImpl::DBImpl(const Options& raw_options, const std::string& dbname)
     : env_(raw_options.env),
       internal_comparator_(raw_options.comparator),
-      internal_filter_policy_(raw_options.filter_policy),
+      internal_filter_policy_(raw_options.filter_policy,
+                              raw_options.prefix_extractor),
       options_(SanitizeOptions(dbname, &internal_comparator_,
                                &internal_filter_policy_, raw_options)),
       owns_info_log_(options_.info_log != raw_options.info_log),
@@ -148,16 +256,27 @@ DBImpl::DBImpl(const Options& raw_options, const std::string& dbname)
       log_(nullptr),
       seed_(0),
       tmp_batch_(new WriteBatch),
-      background_compaction_scheduled_(false),
+      memtable_writers_drained_(&mutex_),
+      last_allocated_sequence_(0),
+      write_controller_(options_.delayed_write_rate),
+      write_stall_micros_(0),
+      log_syncs_(0),
+      background_compactions_scheduled_(0),
+      running_compactions_(0),
+      compacting_memtable_(false),
+      logging_version_edit_(false),
+      version_edit_logged_(&mutex_),
       manual_compaction_(nullptr),
       versions_(new VersionSet(dbname_, &options_, table_cache_,
-                               &internal_comparator_)) {}
+                               &internal_comparator_)) {
+  env_->SetBackgroundThreads(options_.thread_compaction);
+}
 
 DBImpl::~DBImpl() {
   // Wait for background work to finish.
   mutex_.Lock();
   shutting_down_.store(true, std::memory_order_release);
-  while (background_compaction_scheduled_) {
+  while (background_compactions_scheduled_ > 0) {
     background_work_finished_signal_.Wait();
   }
   mutex_.Unlock();
@@ -239,6 +358,9 @@ void DBImpl::RemoveObsoleteFiles() {
   // Make a set of all of the live files
   std::set<uint64_t> live = pending_outputs_;
   versions_->AddLiveFiles(&live);
+  // Blob files outlive the tables they were written with
+  std::set<uint64_t> live_blobs = pending_outputs_;
+  versions_->AddLiveBlobFiles(&live_blobs);
 
   std::vector<std::string> filenames;
   env_->GetChildren(dbname_, &filenames);  // Ignoring errors on purpose
@@ -266,6 +388,9 @@ void DBImpl::RemoveObsoleteFiles() {
           // be recorded in pending_outputs_, which is inserted into "live"
           keep = (live.find(number) != live.end());
           break;
+        case kBlobFile:
+          keep = (live_blobs.find(number) != live_blobs.end());
+          break;
         case kCurrentFile:
         case kDBLockFile:
         case kInfoLogFile:
@@ -277,6 +402,8 @@ void DBImpl::RemoveObsoleteFiles() {
         files_to_delete.push_back(std::move(filename));
         if (type == kTableFile) {
           table_cache_->Evict(number);
+        } else if (type == kBlobFile) {
+          table_cache_->EvictBlobFile(number);
         }
         Log(options_.info_log, "Delete type=%d #%lld\n", static_cast<int>(type),
             static_cast<unsigned long long>(number));
@@ -387,6 +514,224 @@ Status DBImpl::Recover(VersionEdit* edit, bool* save_manifest) {
   return Status::OK();
 }
 
+// Replays log records for RecoverLogFile() with options_.max_recovery_threads
+// threads.  The thread that reads the log cuts its records into
+// partitions of write_buffer_size bytes, each replayed into a memtable of
+// its own.  Sequence numbers only grow along the log, so the partitions
+// cover increasing sequence ranges, and each full one takes its table
+// file number when it is cut so that newer level-0 tables keep getting
+// larger numbers however the flushes interleave.  Workers insert runs of
+// records into the partitions' memtables concurrently, and the worker
+// that finishes the last run of a full partition writes it out.
+class DBImpl::LogReplay {
+ public:
+  LogReplay(DBImpl* db, VersionEdit* edit)
+      : db_(db),
+        edit_(edit),
+        cv_(&mu_),
+        done_(false),
+        flushed_(0),
+        partition_(nullptr),
+        partition_bytes_(0),
+        run_(nullptr),
+        run_bytes_(0) {
+    const int workers = db_->options_.max_recovery_threads - 1;
+    max_queued_runs_ = 2 * workers;
+    for (int i = 0; i < workers; i++) {
+      threads_.emplace_back([this]() { WorkerLoop(); });
+    }
+  }
+
+  LogReplay(const LogReplay&) = delete;
+  LogReplay& operator=(const LogReplay&) = delete;
+
+  ~LogReplay() { assert(threads_.empty()); }
+
+  // Queue "record" for insertion.  May return the first error any worker
+  // has run into so far.
+  // REQUIRES: db_->mutex_ is not held
+  Status Add(const Slice& record, SequenceNumber* max_sequence) {
+    if (partition_ == nullptr) {
+      partition_ = new Partition;
+      partition_->mem = new MemTable(db_->internal_comparator_,
+                                     db_->options_.memtable_factory);
+      partition_->mem->Ref();
+      partition_bytes_ = 0;
+    }
+    if (run_ == nullptr) {
+      run_ = new Run;
+      run_->partition = partition_;
+      run_bytes_ = 0;
+    }
+    run_->batches.emplace_back();
+    WriteBatch* batch = &run_->batches.back();
+    WriteBatchInternal::SetContents(batch, record);
+    const SequenceNumber last_seq = WriteBatchInternal::Sequence(batch) +
+                                    WriteBatchInternal::Count(batch) - 1;
+    if (last_seq > *max_sequence) {
+      *max_sequence = last_seq;
+    }
+    partition_bytes_ += record.size();
+    run_bytes_ += record.size();
+
+    const bool full = partition_bytes_ > db_->options_.write_buffer_size;
+    if (full || run_bytes_ >= kRunBytes) {
+      return Submit(full);
+    }
+    return Status::OK();
+  }
+
+  // Wait for every queued record to be inserted and every full partition
+  // to be written out, and stop the workers.  *mem is set to the memtable
+  // of the last partition, which is not written out, or null if there is
+  // none.  *tables is set to the number of tables written.
+  // REQUIRES: db_->mutex_ is not held
+  Status Finish(MemTable** mem, int* tables) {
+    if (run_ != nullptr) {
+      Submit(false);
+    }
+    {
+      MutexLock l(&mu_);
+      while (partition_ != nullptr && partition_->unfinished_runs > 0) {
+        cv_.Wait();
+      }
+      done_ = true;
+      cv_.SignalAll();
+    }
+    for (size_t i = 0; i < threads_.size(); i++) {
+      threads_[i].join();
+    }
+    threads_.clear();
+
+    *mem = nullptr;
+    if (partition_ != nullptr) {
+      *mem = partition_->mem;
+      delete partition_;
+      partition_ = nullptr;
+    }
+    MutexLock l(&mu_);
+    *tables = flushed_;
+    return status_;
+  }
+
+ private:
+  // Records are handed to the workers in runs of about this many bytes.
+  static const size_t kRunBytes = 256 << 10;
+
+  struct Partition {
+    Partition() : mem(nullptr), unfinished_runs(0), full(false) {}
+
+    MemTable* mem;
+    FileMetaData meta;    // meta.number is taken when the partition is full
+    int unfinished_runs;  // Queued or being inserted; guarded by mu_
+    bool full;            // No more runs will be added; guarded by mu_
+  };
+
+  struct Run {
+    Partition* partition;
+    std::deque<WriteBatch> batches;  // A deque never moves its elements
+  };
+
+  // Queue run_ and, if "full", mark its partition full.
+  Status Submit(bool full) {
+    if (full) {
+      MutexLock l(&db_->mutex_);
+      partition_->meta.number = db_->versions_->NewFileNumber();
+      db_->pending_outputs_.insert(partition_->meta.number);
+    }
+    MutexLock l(&mu_);
+    // Runs are queued even after an error so that the workers release
+    // their partitions.
+    while (queue_.size() >= max_queued_runs_) {
+      cv_.Wait();
+    }
+    queue_.push_back(run_);
+    run_ = nullptr;
+    partition_->unfinished_runs++;
+    if (full) {
+      partition_->full = true;
+      partition_ = nullptr;
+    }
+    cv_.SignalAll();
+    return status_;
+  }
+
+  void WorkerLoop() {
+    MutexLock l(&mu_);
+    while (true) {
+      while (queue_.empty() && !done_) {
+        cv_.Wait();
+      }
+      if (queue_.empty()) {
+        break;
+      }
+      Run* run = queue_.front();
+      queue_.pop_front();
+      cv_.SignalAll();  // The reader may be waiting for room in the queue
+      Status s = status_;
+      mu_.Unlock();
+
+      Partition* p = run->partition;
+      for (size_t i = 0; i < run->batches.size() && s.ok(); i++) {
+        s = WriteBatchInternal::InsertIntoConcurrently(&run->batches[i],
+                                                       p->mem);
+        db_->MaybeIgnoreError(&s);
+      }
+      delete run;
+
+      mu_.Lock();
+      if (!s.ok() && status_.ok()) {
+        status_ = s;
+      }
+      p->unfinished_runs--;
+      if (p->full && p->unfinished_runs == 0) {
+        s = status_;
+        mu_.Unlock();
+        s = Flush(p, s);
+        mu_.Lock();
+        if (s.ok()) {
+          flushed_++;
+        } else if (status_.ok()) {
+          status_ = s;
+        }
+      }
+      cv_.SignalAll();
+    }
+  }
+
+  // Write out full partition "p", unless "s" is an error, and free it.
+  Status Flush(Partition* p, Status s) {
+    {
+      MutexLock l(&db_->mutex_);
+      if (s.ok()) {
+        s = db_->WriteLevel0Table(p->mem, edit_, nullptr, &p->meta);
+      }
+      db_->pending_outputs_.erase(p->meta.number);
+    }
+    p->mem->Unref();
+    delete p;
+    return s;
+  }
+
+  DBImpl* const db_;
+  VersionEdit* const edit_;  // Tables are added under db_->mutex_
+  std::vector<std::thread> threads_;
+  size_t max_queued_runs_;
+
+  port::Mutex mu_;
+  port::CondVar cv_ GUARDED_BY(mu_);
+  std::deque<Run*> queue_ GUARDED_BY(mu_);
+  bool done_ GUARDED_BY(mu_);
+  Status status_ GUARDED_BY(mu_);  // First error of any worker
+  int flushed_ GUARDED_BY(mu_);
+
+  // Only used by the thread that reads the log
+  Partition* partition_;  // Partition being filled, or null
+  size_t partition_bytes_;
+  Run* run_;  // Run being filled, or null
+  size_t run_bytes_;
+};
+
 Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
                               bool* save_manifest, VersionEdit* edit,
                               SequenceNumber* max_sequence) {
@@ -434,16 +779,33 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
   WriteBatch batch;
   int compactions = 0;
   MemTable* mem = nullptr;
+  LogReplay* replay = nullptr;
+  if (options_.max_recovery_threads > 1) {
+    // Only a rep can tell whether it takes concurrent inserts.
+    MemTable* probe =
+        new MemTable(internal_comparator_, options_.memtable_factory);
+    probe->Ref();
+    if (probe->IsInsertConcurrentlySupported()) {
+      replay = new LogReplay(this, edit);
+      // The workers take mutex_ to write out their memtables.
+      mutex_.Unlock();
+    }
+    probe->Unref();
+  }
   while (reader.ReadRecord(&record, &scratch) && status.ok()) {
     if (record.size() < 12) {
       reporter.Corruption(record.size(),
                           Status::Corruption("log record too small"));
       continue;
     }
+    if (replay != nullptr) {
+      status = replay->Add(record, max_sequence);
+      continue;
+    }
     WriteBatchInternal::SetContents(&batch, record);
 
     if (mem == nullptr) {
-      mem = new MemTable(internal_comparator_);
+      mem = new MemTable(internal_comparator_, options_.memtable_factory);
       mem->Ref();
     }
     status = WriteBatchInternal::InsertInto(&batch, mem);
@@ -462,6 +824,7 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
       *save_manifest = true;
       FileMetaData f;
       status = WriteLevel0Table(mem, edit, nullptr, &f);
+      pending_outputs_.erase(f.number);
       mem->Unref();
       mem = nullptr;
       if (!status.ok()) {
@@ -472,10 +835,27 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
     }
   }
 
+  if (replay != nullptr) {
+    int tables;
+    Status s = replay->Finish(&mem, &tables);
+    if (status.ok()) {
+      status = s;
+    }
+    delete replay;
+    mutex_.Lock();
+    compactions += tables;
+    if (tables > 0) {
+      *save_manifest = true;
+    }
+  }
+
   delete file;
 
-  // See if we should keep reusing the last log file.
-  if (status.ok() && options_.reuse_logs && last_log && compactions == 0) {
+  // See if we should keep reusing the last log file.  Not with direct
+  // I/O: a log that was not closed cleanly may end in zero padding,
+  // which appending to would turn into garbage in the middle of the log.
+  if (status.ok() && options_.reuse_logs && !options_.use_direct_io_for_log &&
+      last_log && compactions == 0) {
     assert(logfile_ == nullptr);
     assert(log_ == nullptr);
     assert(mem_ == nullptr);
@@ -490,7 +870,7 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
         mem = nullptr;
       } else {
         // mem can be nullptr if lognum exists but was empty.
-        mem_ = new MemTable(internal_comparator_);
+        mem_ = new MemTable(internal_comparator_, options_.memtable_factory);
         mem_->Ref();
       }
     }
@@ -502,6 +882,7 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
       *save_manifest = true;
       FileMetaData f;
       status = WriteLevel0Table(mem, edit, nullptr, &f);
+      pending_outputs_.erase(f.number);
     }
     mem->Unref();
   }
@@ -513,17 +894,20 @@ Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
                                 Version* base, FileMetaData* meta) {
   mutex_.AssertHeld();
   const uint64_t start_micros = env_->NowMicros();
-  // FileMetaData meta;
-  meta->number = versions_->NewFileNumber();
-  pending_outputs_.insert(meta->number);
+  if (meta->number == 0) {
+    meta->number = versions_->NewFileNumber();
+    pending_outputs_.insert(meta->number);
+  }
   Iterator* iter = mem->NewIterator();
   Log(options_.info_log, "Level-0 table #%llu: started",
       (unsigned long long)meta->number);
 
   Status s;
+  BlobFileMetaData blob;
   {
     mutex_.Unlock();
-    s = BuildTable(dbname_, env_, options_, table_cache_, iter, meta);
+    s = BuildTable(dbname_, env_, TableOptionsForLevel(options_, 0),
+                   table_cache_, iter, meta, &blob);
     mutex_.Lock();
   }
 
@@ -531,7 +915,6 @@ Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
       (unsigned long long)meta->number, (unsigned long long)meta->file_size,
       s.ToString().c_str());
   delete iter;
-  pending_outputs_.erase(meta->number);
 
   // Note that if file_size is zero, the file has been deleted and
   // should not be added to the manifest.
@@ -539,16 +922,29 @@ Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
   if (s.ok() && meta->file_size > 0) {
     const Slice min_user_key = meta->smallest.user_key();
     const Slice max_user_key = meta->largest.user_key();
-    if (base != nullptr) {
-      level = base->PickLevelForMemTableOutput(min_user_key, max_user_key);
+    // A running compaction may install outputs that span the gaps
+    // between its inputs, so only push the table down when none runs.
+    // Neither while another edit is being logged: the level would be
+    // picked from a version that is about to change.  The current version
+    // rather than "base" is used, since it may have changed while the
+    // table was built.  Tiered compaction keeps every flush a level-0 run
+    // of its own.
+    if (base != nullptr && running_compactions_ == 0 &&
+        !logging_version_edit_ &&
+        options_.compaction_style == kCompactionStyleLevel) {
+      level = versions_->current()->PickLevelForMemTableOutput(min_user_key,
+                                                               max_user_key);
     }
     edit->AddFile(level, meta->number, meta->file_size, meta->smallest,
                   meta->largest);
+    if (blob.total_count > 0) {
+      edit->AddBlobFile(blob.number, blob.total_count, blob.total_bytes);
+    }
   }
 
   CompactionStats stats;
   stats.micros = env_->NowMicros() - start_micros;
-  stats.bytes_written = meta->file_size;
+  stats.bytes_written = meta->file_size + blob.total_bytes;
   stats_[level].Add(stats);
   return s;
 }
@@ -556,6 +952,8 @@ Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
 void DBImpl::CompactMemTable() {
   mutex_.AssertHeld();
   assert(imm_ != nullptr);
+  assert(!compacting_memtable_);
+  compacting_memtable_ = true;
 
   // Save the contents of the memtable as a new Table
   VersionEdit edit;
@@ -574,9 +972,11 @@ void DBImpl::CompactMemTable() {
     edit.SetPrevLogNumber(0);
     edit.SetLogNumber(logfile_number_);  // Earlier logs no longer needed
     global_index->global_index_exists_ = false;
-    s = versions_->LogAndApply(&edit, &mutex_);
+    s = LogAndApply(&edit);
   }
+  pending_outputs_.erase(f.number);
 
+  compacting_memtable_ = false;
   if (s.ok()) {
     // Commit to the new state
     imm_->Unref();
@@ -668,10 +1068,24 @@ void DBImpl::RecordBackgroundError(const Status& s) {
   }
 }
 
+Status DBImpl::LogAndApply(VersionEdit* edit) {
+  mutex_.AssertHeld();
+  // VersionSet::LogAndApply() releases the mutex while it writes the
+  // MANIFEST, and must not be entered by a second thread meanwhile.
+  while (logging_version_edit_) {
+    version_edit_logged_.Wait();
+  }
+  logging_version_edit_ = true;
+  Status s = versions_->LogAndApply(edit, &mutex_);
+  logging_version_edit_ = false;
+  version_edit_logged_.SignalAll();
+  return s;
+}
+
 void DBImpl::MaybeScheduleCompaction() {
   if(!options_.enable_compaction) return;
   mutex_.AssertHeld();
-  if (background_compaction_scheduled_) {
+  if (background_compactions_scheduled_ >= options_.thread_compaction) {
     // Already scheduled
   } else if (shutting_down_.load(std::memory_order_acquire)) {
     // DB is being deleted; no more background compactions
@@ -681,8 +1095,12 @@ void DBImpl::MaybeScheduleCompaction() {
              !versions_->NeedsCompaction()) {
     // No work to be done
   } else {
-    background_compaction_scheduled_ = true;
-    env_->Schedule(&DBImpl::BGWork, this);
+    // Start as many threads as allowed; the ones that find no compaction
+    // whose inputs are free exit right away.
+    while (background_compactions_scheduled_ < options_.thread_compaction) {
+      background_compactions_scheduled_++;
+      env_->Schedule(&DBImpl::BGWork, this);
+    }
   }
 }
 
@@ -692,35 +1110,56 @@ void DBImpl::BGWork(void* db) {
 
 void DBImpl::BackgroundCall() {
   MutexLock l(&mutex_);
-  assert(background_compaction_scheduled_);
+  assert(background_compactions_scheduled_ > 0);
+  bool did_work = false;
   if (shutting_down_.load(std::memory_order_acquire)) {
     // No more background work when shutting down.
   } else if (!bg_error_.ok()) {
     // No more background work after a background error.
   } else {
-    BackgroundCompaction();
+    did_work = BackgroundCompaction();
   }
 
-  background_compaction_scheduled_ = false;
+  background_compactions_scheduled_--;
 
   // Previous compaction may have produced too many files in a level,
-  // so reschedule another compaction if needed.
-  MaybeScheduleCompaction();
+  // so reschedule another compaction if needed.  A thread that found
+  // nothing to do does not: the compactions that kept it idle reschedule
+  // when they finish.
+  if (did_work) {
+    MaybeScheduleCompaction();
+  }
   background_work_finished_signal_.SignalAll();
 }
 
-void DBImpl::BackgroundCompaction() {
+bool DBImpl::BackgroundCompaction() {
   mutex_.AssertHeld();
 
-  if (imm_ != nullptr) {
+  // A flush or an ingestion picks the level of its tables while no
+  // compaction runs and then logs its edit without the lock.  Picking a
+  // compaction from the version it is about to replace could place
+  // outputs over them.
+  while (logging_version_edit_) {
+    version_edit_logged_.Wait();
+  }
+  if (shutting_down_.load(std::memory_order_acquire) || !bg_error_.ok()) {
+    return false;
+  }
+
+  if (imm_ != nullptr && !compacting_memtable_) {
     CompactMemTable();
-    return;
+    return true;
   }
 
   Compaction* c;
   bool is_manual = (manual_compaction_ != nullptr);
   InternalKey manual_end;
   if (is_manual) {
+    // A manual compaction does not avoid the inputs of other compactions,
+    // so it waits until none is running.  No new one starts meanwhile.
+    if (running_compactions_ > 0) {
+      return false;
+    }
     ManualCompaction* m = manual_compaction_;
     c = versions_->CompactRange(m->level, m->begin, m->end);
     m->done = (c == nullptr);
@@ -734,8 +1173,14 @@ void DBImpl::BackgroundCompaction() {
         (m->done ? "(end)" : manual_end.DebugString().c_str()));
   } else {
     c = versions_->PickCompaction();
+    if (c == nullptr) {
+      return false;
+    }
   }
 
+  if (c != nullptr) {
+    running_compactions_++;
+  }
   Status status;
   if (c == nullptr) {
     // Nothing to do
@@ -744,16 +1189,16 @@ void DBImpl::BackgroundCompaction() {
     assert(c->num_input_files(0) == 1);
     FileMetaData* f = c->input(0, 0);
     c->edit()->RemoveFile(c->level(), f->number);
-    c->edit()->AddFile(c->level() + 1, f->number, f->file_size, f->smallest,
+    c->edit()->AddFile(c->output_level(), f->number, f->file_size, f->smallest,
                        f->largest);
     global_index->global_index_exists_ = false;
-    status = versions_->LogAndApply(c->edit(), &mutex_);
+    status = LogAndApply(c->edit());
     if (!status.ok()) {
       RecordBackgroundError(status);
     }
     VersionSet::LevelSummaryStorage tmp;
     Log(options_.info_log, "Moved #%lld to level-%d %lld bytes %s: %s\n",
-        static_cast<unsigned long long>(f->number), c->level() + 1,
+        static_cast<unsigned long long>(f->number), c->output_level(),
         static_cast<unsigned long long>(f->file_size),
         status.ToString().c_str(), versions_->LevelSummary(&tmp));
   } else {
@@ -766,6 +1211,9 @@ void DBImpl::BackgroundCompaction() {
     c->ReleaseInputs();
     RemoveObsoleteFiles();
   }
+  if (c != nullptr) {
+    running_compactions_--;
+  }
   delete c;
 
   if (status.ok()) {
@@ -789,6 +1237,7 @@ void DBImpl::BackgroundCompaction() {
     }
     manual_compaction_ = nullptr;
   }
+  return true;
 }
 
 void DBImpl::CleanupCompaction(CompactionState* compact) {
@@ -800,6 +1249,10 @@ void DBImpl::CleanupCompaction(CompactionState* compact) {
   } else {
     assert(compact->outfile == nullptr);
   }
+  if (compact->blob_builder != nullptr) {
+    compact->blob_builder->Abandon();
+    delete compact->blob_builder;
+  }
   delete compact->outfile;
   for (size_t i = 0; i < compact->outputs.size(); i++) {
     const CompactionState::Output& out = compact->outputs[i];
@@ -820,6 +1273,8 @@ Status DBImpl::OpenCompactionOutputFile(CompactionState* compact) {
     out.number = file_number;
     out.smallest.Clear();
     out.largest.Clear();
+    out.blob_count = 0;
+    out.blob_bytes = 0;
     compact->outputs.push_back(out);
     mutex_.Unlock();
   }
@@ -828,7 +1283,18 @@ Status DBImpl::OpenCompactionOutputFile(CompactionState* compact) {
   std::string fname = TableFileName(dbname_, file_number);
   Status s = env_->NewWritableFile(fname, &compact->outfile);
   if (s.ok()) {
-    compact->builder = new TableBuilder(options_, compact->outfile);
+    if (options_.rate_limiter != nullptr) {
+      compact->outfile = NewRateLimitedWritableFile(
+          compact->outfile, options_.rate_limiter, RateLimiter::kCompaction);
+    }
+    compact->builder = new TableBuilder(
+        TableOptionsForLevel(options_, compact->compaction->output_level()),
+        compact->outfile);
+    if (options_.min_blob_size > 0 || !compact->blob_gc_files.empty()) {
+      compact->blob_builder =
+          new BlobFileBuilder(dbname_, env_, options_.rate_limiter,
+                              RateLimiter::kCompaction, file_number);
+    }
   }
   return s;
 }
@@ -866,6 +1332,23 @@ Status DBImpl::FinishCompactionOutputFile(CompactionState* compact,
   delete compact->outfile;
   compact->outfile = nullptr;
 
+  if (compact->blob_builder != nullptr) {
+    if (s.ok()) {
+      s = compact->blob_builder->Finish();
+    } else {
+      compact->blob_builder->Abandon();
+    }
+    if (s.ok()) {
+      compact->current_output()->blob_count =
+          compact->blob_builder->NumEntries();
+      compact->current_output()->blob_bytes =
+          compact->blob_builder->FileSize();
+      compact->total_bytes += compact->blob_builder->FileSize();
+    }
+    delete compact->blob_builder;
+    compact->blob_builder = nullptr;
+  }
+
   if (s.ok() && current_entries > 0) {
     // Verify that the table is usable
     Iterator* iter =
@@ -882,70 +1365,418 @@ Status DBImpl::FinishCompactionOutputFile(CompactionState* compact,
   return s;
 }
 
+Status DBImpl::MoveToBlobFile(CompactionState* compact,
+                              const ParsedInternalKey& ikey, Slice* key,
+                              Slice* value, std::string* key_buf,
+                              std::string* value_buf) {
+  Status s;
+  if (ikey.type == kTypeValue && options_.min_blob_size > 0 &&
+      value->size() >= options_.min_blob_size) {
+    s = compact->blob_builder->Add(*value, value_buf);
+    if (s.ok()) {
+      key_buf->clear();
+      AppendInternalKey(key_buf, ParsedInternalKey(ikey.user_key, ikey.sequence,
+                                                   kTypeBlobIndex));
+      *key = *key_buf;
+      *value = *value_buf;
+    }
+  } else if (ikey.type == kTypeBlobIndex && !compact->blob_gc_files.empty()) {
+    BlobIndex index;
+    s = index.DecodeFrom(*value);
+    if (s.ok() && compact->blob_gc_files.count(index.file_number) > 0) {
+      ReadOptions options;
+      options.fill_cache = false;
+      PinnableSlice blob;
+      s = table_cache_->GetBlob(options, *value, &blob);
+      if (s.ok()) {
+        s = compact->blob_builder->Add(blob, value_buf);
+      }
+      if (s.ok()) {
+        compact->AddBlobGarbage(*value);
+        *value = *value_buf;
+      }
+    }
+  }
+  return s;
+}
+
+Status DBImpl::FilterEntry(CompactionState* compact, ParsedInternalKey* ikey,
+                           Slice* key, Slice* value, std::string* key_buf,
+                           std::string* value_buf, bool* drop) {
+  Status s;
+  const Slice blob_index = *value;
+  const bool in_blob = ikey->type == kTypeBlobIndex;
+  Slice existing_value = *value;
+  PinnableSlice blob;
+  if (in_blob) {
+    ReadOptions options;
+    options.fill_cache = false;
+    s = table_cache_->GetBlob(options, *value, &blob);
+    if (!s.ok()) {
+      return s;
+    }
+    existing_value = blob;
+  }
+
+  bool value_changed = false;
+  value_buf->clear();
+  if (options_.compaction_filter->Filter(compact->compaction->level(),
+                                         ikey->user_key, existing_value,
+                                         value_buf, &value_changed)) {
+    compact->filtered_entries++;
+    compact->filtered_bytes += ikey->user_key.size() + existing_value.size();
+    if (ikey->sequence <= compact->smallest_snapshot &&
+        compact->compaction->IsBaseLevelForKey(ikey->user_key,
+                                               &compact->cursor)) {
+      // Nothing is left that a deletion would have to hide
+      *drop = true;
+      return s;
+    }
+    // Older entries of the key, kept for snapshots or below the levels
+    // being compacted, would show up again, so the key is deleted instead.
+    ikey->type = kTypeDeletion;
+    *value = Slice();
+  } else if (value_changed) {
+    ikey->type = kTypeValue;
+    *value = *value_buf;
+  } else {
+    return s;
+  }
+  if (in_blob) {
+    compact->AddBlobGarbage(blob_index);
+  }
+  key_buf->clear();
+  AppendInternalKey(key_buf, *ikey);
+  *key = *key_buf;
+  return s;
+}
+
+Status DBImpl::MergeCompactionOperands(CompactionState* compact,
+                                       Iterator* input, bool* hides_older) {
+  *hides_older = false;
+  ParsedInternalKey ikey;
+  ParseInternalKey(input->key(), &ikey);
+  const std::string user_key = ikey.user_key.ToString();
+  // The operands of the key and the sequence numbers of their entries
+  std::vector<std::string> operands;
+  std::vector<SequenceNumber> sequences;
+  bool has_base = false;
+  while (true) {
+    operands.push_back(input->value().ToString());
+    sequences.push_back(ikey.sequence);
+    input->Next();
+    if (!input->Valid() || !ParseInternalKey(input->key(), &ikey) ||
+        user_comparator()->Compare(ikey.user_key, user_key) != 0) {
+      break;
+    }
+    if (ikey.type != kTypeMerge) {
+      has_base = true;
+      break;
+    }
+  }
+  // Oldest first
+  std::reverse(operands.begin(), operands.end());
+  std::reverse(sequences.begin(), sequences.end());
+
+  Status s;
+  std::string key_buf, value_buf, value;
+  if (has_base ||
+      compact->compaction->IsBaseLevelForKey(user_key, &compact->cursor)) {
+    Slice existing;
+    PinnableSlice blob;
+    if (has_base && ikey.type == kTypeBlobIndex) {
+      ReadOptions options;
+      options.fill_cache = false;
+      s = table_cache_->GetBlob(options, input->value(), &blob);
+      if (!s.ok()) {
+        return s;
+      }
+      existing = blob;
+    } else if (has_base && ikey.type == kTypeValue) {
+      existing = input->value();
+    }
+    std::vector<Slice> operand_slices(operands.begin(), operands.end());
+    const bool has_existing = has_base && ikey.type != kTypeDeletion;
+    if (MergeOperands(options_.merge_operator, user_key,
+                      has_existing ? &existing : nullptr, operand_slices,
+                      &value)
+            .ok()) {
+      ParsedInternalKey merged(user_key, sequences.back(), kTypeValue);
+      std::string key;
+      AppendInternalKey(&key, merged);
+      *hides_older = true;
+      return WriteCompactionEntry(compact, input, &merged, key, value,
+                                  &key_buf, &value_buf);
+    }
+    // Keep the operands, which reads report as corrupt, and what they
+    // apply to.
+  }
+
+  // Combine neighboring operands where the operator can; a combined
+  // operand takes the sequence number of the newer one.
+  std::vector<std::string> combined;
+  std::vector<SequenceNumber> combined_sequences;
+  for (size_t i = 0; i < operands.size(); i++) {
+    if (!combined.empty() &&
+        options_.merge_operator->PartialMerge(user_key, combined.back(),
+                                              operands[i], &value)) {
+      combined.back().swap(value);
+      combined_sequences.back() = sequences[i];
+    } else {
+      combined.push_back(operands[i]);
+      combined_sequences.push_back(sequences[i]);
+    }
+  }
+  for (size_t i = combined.size(); s.ok() && i > 0; i--) {
+    ParsedInternalKey operand(user_key, combined_sequences[i - 1], kTypeMerge);
+    std::string key;
+    AppendInternalKey(&key, operand);
+    s = WriteCompactionEntry(compact, input, &operand, key, combined[i - 1],
+                             &key_buf, &value_buf);
+  }
+  return s;
+}
+
+Status DBImpl::WriteCompactionEntry(CompactionState* compact, Iterator* input,
+                                    const ParsedInternalKey* ikey, Slice key,
+                                    Slice value, std::string* key_buf,
+                                    std::string* value_buf) {
+  Status s;
+  // Open output file if necessary
+  if (compact->builder == nullptr) {
+    s = OpenCompactionOutputFile(compact);
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  if (compact->blob_builder != nullptr && ikey != nullptr) {
+    s = MoveToBlobFile(compact, *ikey, &key, &value, key_buf, value_buf);
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  if (compact->builder->NumEntries() == 0) {
+    compact->current_output()->smallest.DecodeFrom(key);
+  }
+  compact->current_output()->largest.DecodeFrom(key);
+  compact->builder->Add(key, value);
+
+  // Close output file if it is big enough
+  if (compact->builder->FileSize() >=
+      compact->compaction->MaxOutputFileSize()) {
+    s = FinishCompactionOutputFile(compact, input);
+  }
+  return s;
+}
+
 Status DBImpl::InstallCompactionResults(CompactionState* compact) {
   mutex_.AssertHeld();
-  Log(options_.info_log, "Compacted %d@%d + %d@%d files => %lld bytes",
-      compact->compaction->num_input_files(0), compact->compaction->level(),
-      compact->compaction->num_input_files(1), compact->compaction->level() + 1,
-      static_cast<long long>(compact->total_bytes));
+  Log(options_.info_log, "Compacted %s files => %lld bytes@%d",
+      InputSummary(compact->compaction).c_str(),
+      static_cast<long long>(compact->total_bytes),
+      compact->compaction->output_level());
 
   // Add compaction outputs
   compact->compaction->AddInputDeletions(compact->compaction->edit());
-  const int level = compact->compaction->level();
+  const int level = compact->compaction->output_level();
   for (size_t i = 0; i < compact->outputs.size(); i++) {
     const CompactionState::Output& out = compact->outputs[i];
-    compact->compaction->edit()->AddFile(level + 1, out.number, out.file_size,
+    compact->compaction->edit()->AddFile(level, out.number, out.file_size,
                                          out.smallest, out.largest);
+    if (out.blob_count > 0) {
+      compact->compaction->edit()->AddBlobFile(out.number, out.blob_count,
+                                               out.blob_bytes);
+    }
+  }
+  for (const auto& kvp : compact->blob_garbage) {
+    compact->compaction->edit()->AddBlobGarbage(kvp.first, kvp.second.first,
+                                                kvp.second.second);
   }
   global_index->global_index_exists_ = false;
-  return versions_->LogAndApply(compact->compaction->edit(), &mutex_);
+  return LogAndApply(compact->compaction->edit());
 }
 
 Status DBImpl::DoCompactionWork(CompactionState* compact) {
   const uint64_t start_micros = env_->NowMicros();
-  int64_t imm_micros = 0;  // Micros spent doing imm_ compactions
 
-  Log(options_.info_log, "Compacting %d@%d + %d@%d files",
-      compact->compaction->num_input_files(0), compact->compaction->level(),
-      compact->compaction->num_input_files(1),
-      compact->compaction->level() + 1);
+  Log(options_.info_log, "Compacting %s files",
+      InputSummary(compact->compaction).c_str());
 
   assert(versions_->NumLevelFiles(compact->compaction->level()) > 0);
   assert(compact->builder == nullptr);
   assert(compact->outfile == nullptr);
   if (snapshots_.empty()) {
     compact->smallest_snapshot = versions_->LastSequence();
+    compact->newest_snapshot = 0;
   } else {
     compact->smallest_snapshot = snapshots_.oldest()->sequence_number();
+    compact->newest_snapshot = snapshots_.newest()->sequence_number();
   }
+  compact->compaction->input_version()->GetBlobFilesToCollect(
+      options_.blob_gc_garbage_ratio, &compact->blob_gc_files);
 
-  Iterator* input = versions_->MakeInputIterator(compact->compaction);
-
-  // Release mutex while we're actually doing the compaction work
+  // Release mutex while we're actually doing the compaction work.  The
+  // input version stays pinned by the compaction.
   mutex_.Unlock();
 
-  input->SeekToFirst();
+  // Cut the compaction into key ranges that are compacted in parallel.
+  // Each range keeps all entries of a user key together, so the outputs
+  // of different ranges never overlap.
+  std::vector<std::string> boundaries;
+  versions_->SplitCompaction(compact->compaction, options_.max_subcompactions,
+                             &boundaries);
+  std::vector<CompactionState*> subs;
+  if (boundaries.empty()) {
+    subs.push_back(compact);
+  } else {
+    Log(options_.info_log, "Splitting compaction into %d sub-compactions",
+        static_cast<int>(boundaries.size() + 1));
+    for (size_t i = 0; i <= boundaries.size(); i++) {
+      CompactionState* sub = new CompactionState(compact->compaction);
+      sub->smallest_snapshot = compact->smallest_snapshot;
+      sub->newest_snapshot = compact->newest_snapshot;
+      sub->blob_gc_files = compact->blob_gc_files;
+      if (i > 0) {
+        sub->has_begin = true;
+        sub->begin = boundaries[i - 1];
+      }
+      if (i < boundaries.size()) {
+        sub->has_end = true;
+        sub->end = boundaries[i];
+      }
+      subs.push_back(sub);
+    }
+  }
+  std::vector<Iterator*> inputs(subs.size());
+  for (size_t i = 0; i < subs.size(); i++) {
+    inputs[i] = versions_->MakeInputIterator(compact->compaction);
+  }
+
+  std::vector<Status> statuses(subs.size());
+  std::vector<int64_t> imm_micros(subs.size(), 0);
+  std::vector<std::thread> threads;
+  for (size_t i = 1; i < subs.size(); i++) {
+    threads.emplace_back([this, &subs, &inputs, &statuses, &imm_micros, i]() {
+      statuses[i] = DoSubcompactionWork(subs[i], inputs[i], &imm_micros[i]);
+    });
+  }
+  statuses[0] = DoSubcompactionWork(subs[0], inputs[0], &imm_micros[0]);
+  for (size_t i = 0; i < threads.size(); i++) {
+    threads[i].join();
+  }
+
+  Status status;
+  for (size_t i = 0; i < statuses.size() && status.ok(); i++) {
+    status = statuses[i];
+  }
+
+  CompactionStats stats;
+  // Sub-compactions flush the memtable one at a time, so the longest
+  // stall stands for the time taken away from this compaction.
+  stats.micros = env_->NowMicros() - start_micros -
+                 *std::max_element(imm_micros.begin(), imm_micros.end());
+  for (int which = 0; which < compact->compaction->num_input_levels();
+       which++) {
+    for (int i = 0; i < compact->compaction->num_input_files(which); i++) {
+      stats.bytes_read += compact->compaction->input(which, i)->file_size;
+    }
+  }
+
+  mutex_.Lock();
+  if (subs[0] != compact) {
+    // Hand the outputs over to the parent in key order.  They stay in
+    // pending_outputs_ until the parent is cleaned up after installation.
+    for (size_t i = 0; i < subs.size(); i++) {
+      CompactionState* sub = subs[i];
+      compact->outputs.insert(compact->outputs.end(), sub->outputs.begin(),
+                              sub->outputs.end());
+      compact->total_bytes += sub->total_bytes;
+      compact->filtered_entries += sub->filtered_entries;
+      compact->filtered_bytes += sub->filtered_bytes;
+      for (const auto& kvp : sub->blob_garbage) {
+        std::pair<uint64_t, uint64_t>* garbage =
+            &compact->blob_garbage[kvp.first];
+        garbage->first += kvp.second.first;
+        garbage->second += kvp.second.second;
+      }
+      sub->outputs.clear();
+      CleanupCompaction(sub);
+    }
+  }
+  for (size_t i = 0; i < compact->outputs.size(); i++) {
+    stats.bytes_written +=
+        compact->outputs[i].file_size + compact->outputs[i].blob_bytes;
+  }
+  stats.filtered_entries = compact->filtered_entries;
+  stats.filtered_bytes = compact->filtered_bytes;
+  stats_[compact->compaction->output_level()].Add(stats);
+  if (compact->filtered_entries > 0) {
+    Log(options_.info_log, "%s removed %lld keys, %lld bytes",
+        options_.compaction_filter->Name(),
+        static_cast<long long>(compact->filtered_entries),
+        static_cast<long long>(compact->filtered_bytes));
+  }
+
+  if (status.ok()) {
+    status = InstallCompactionResults(compact);
+  }
+  if (!status.ok()) {
+    RecordBackgroundError(status);
+  }
+  VersionSet::LevelSummaryStorage tmp;
+  Log(options_.info_log, "compacted to: %s", versions_->LevelSummary(&tmp));
+  return status;
+}
+
+Status DBImpl::DoSubcompactionWork(CompactionState* compact, Iterator* input,
+                                   int64_t* imm_micros) {
+  if (compact->has_begin) {
+    InternalKey begin(compact->begin, kMaxSequenceNumber, kValueTypeForSeek);
+    input->Seek(begin.Encode());
+  } else {
+    input->SeekToFirst();
+  }
   Status status;
   ParsedInternalKey ikey;
   std::string current_user_key;
   bool has_current_user_key = false;
   SequenceNumber last_sequence_for_key = kMaxSequenceNumber;
+  // Set once an operand of the current user key is kept without the
+  // entries it applies to being merged into it, so they are kept as well
+  bool unmerged_operand = false;
+  std::string blob_key, blob_index;
+  std::string filter_key, filter_value;
+  // Input bytes read since they were last charged to the rate limiter
+  int64_t unlimited_read_bytes = 0;
   while (input->Valid() && !shutting_down_.load(std::memory_order_acquire)) {
     // Prioritize immutable compaction work
     if (has_imm_.load(std::memory_order_relaxed)) {
       const uint64_t imm_start = env_->NowMicros();
       mutex_.Lock();
-      if (imm_ != nullptr) {
+      if (imm_ != nullptr && !compacting_memtable_) {
         CompactMemTable();
         // Wake up MakeRoomForWrite() if necessary.
         background_work_finished_signal_.SignalAll();
       }
       mutex_.Unlock();
-      imm_micros += (env_->NowMicros() - imm_start);
+      *imm_micros += (env_->NowMicros() - imm_start);
     }
 
     Slice key = input->key();
-    if (compact->compaction->ShouldStopBefore(key) &&
+    if (options_.rate_limiter != nullptr) {
+      unlimited_read_bytes += key.size() + input->value().size();
+      if (unlimited_read_bytes >= kRateLimitReadChunk) {
+        options_.rate_limiter->Request(unlimited_read_bytes,
+                                       RateLimiter::kCompaction);
+        unlimited_read_bytes = 0;
+      }
+    }
+    if (compact->has_end && ParseInternalKey(key, &ikey) &&
+        user_comparator()->Compare(ikey.user_key, compact->end) >= 0) {
+      // The rest belongs to the next sub-compaction
+      break;
+    }
+    if (compact->compaction->ShouldStopBefore(key, &compact->cursor) &&
         compact->builder != nullptr) {
       status = FinishCompactionOutputFile(compact, input);
       if (!status.ok()) {
@@ -955,11 +1786,13 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
 
     // Handle key/value, add to state, etc.
     bool drop = false;
+    bool filter = false;
     if (!ParseInternalKey(key, &ikey)) {
       // Do not hide error keys
       current_user_key.clear();
       has_current_user_key = false;
       last_sequence_for_key = kMaxSequenceNumber;
+      unmerged_operand = false;
     } else {
       if (!has_current_user_key ||
           user_comparator()->Compare(ikey.user_key, Slice(current_user_key)) !=
@@ -968,14 +1801,18 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
         current_user_key.assign(ikey.user_key.data(), ikey.user_key.size());
         has_current_user_key = true;
         last_sequence_for_key = kMaxSequenceNumber;
+        unmerged_operand = false;
       }
 
-      if (last_sequence_for_key <= compact->smallest_snapshot) {
+      if (unmerged_operand) {
+        // Needed by a newer merge operand
+      } else if (last_sequence_for_key <= compact->smallest_snapshot) {
         // Hidden by an newer entry for same user key
         drop = true;  // (A)
       } else if (ikey.type == kTypeDeletion &&
                  ikey.sequence <= compact->smallest_snapshot &&
-                 compact->compaction->IsBaseLevelForKey(ikey.user_key)) {
+                 compact->compaction->IsBaseLevelForKey(ikey.user_key,
+                                                        &compact->cursor)) {
         // For this user key:
         // (1) there is no data in higher levels
         // (2) data in lower levels will have larger sequence numbers
@@ -984,6 +1821,11 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
         //     few iterations of this loop (by rule (A) above).
         // Therefore this deletion marker is obsolete and can be dropped.
         drop = true;
+      } else if (last_sequence_for_key == kMaxSequenceNumber &&
+                 ikey.sequence > compact->newest_snapshot &&
+                 (ikey.type == kTypeValue || ikey.type == kTypeBlobIndex)) {
+        // Newest entry of the key, and no snapshot sees it
+        filter = options_.compaction_filter != nullptr;
       }
 
       last_sequence_for_key = ikey.sequence;
@@ -994,31 +1836,45 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
         "%d smallest_snapshot: %d",
         ikey.user_key.ToString().c_str(),
         (int)ikey.sequence, ikey.type, kTypeValue, drop,
-        compact->compaction->IsBaseLevelForKey(ikey.user_key),
+        compact->compaction->IsBaseLevelForKey(ikey.user_key,
+                                               &compact->cursor),
         (int)last_sequence_for_key, (int)compact->smallest_snapshot);
 #endif
 
-    if (!drop) {
-      // Open output file if necessary
-      if (compact->builder == nullptr) {
-        status = OpenCompactionOutputFile(compact);
-        if (!status.ok()) {
-          break;
-        }
-      }
-      if (compact->builder->NumEntries() == 0) {
-        compact->current_output()->smallest.DecodeFrom(key);
+    Slice value = input->value();
+    if (filter) {
+      status = FilterEntry(compact, &ikey, &key, &value, &filter_key,
+                           &filter_value, &drop);
+      if (!status.ok()) {
+        break;
       }
-      compact->current_output()->largest.DecodeFrom(key);
-      compact->builder->Add(key, input->value());
+    }
 
-      // Close output file if it is big enough
-      if (compact->builder->FileSize() >=
-          compact->compaction->MaxOutputFileSize()) {
-        status = FinishCompactionOutputFile(compact, input);
+    if (!drop && has_current_user_key && ikey.type == kTypeMerge &&
+        ikey.sequence <= compact->smallest_snapshot) {
+      // No snapshot needs the operands of the key one by one anymore
+      if (options_.merge_operator != nullptr) {
+        bool hides_older;
+        status = MergeCompactionOperands(compact, input, &hides_older);
         if (!status.ok()) {
           break;
         }
+        unmerged_operand = !hides_older;
+        continue;  // "input" is at the next entry already
+      }
+      unmerged_operand = true;
+    }
+
+    if (drop) {
+      if (has_current_user_key && ikey.type == kTypeBlobIndex) {
+        compact->AddBlobGarbage(input->value());
+      }
+    } else {
+      status = WriteCompactionEntry(compact, input,
+                                    has_current_user_key ? &ikey : nullptr,
+                                    key, value, &blob_key, &blob_index);
+      if (!status.ok()) {
+        break;
       }
     }
 
@@ -1035,34 +1891,10 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
     status = input->status();
   }
   delete input;
-  input = nullptr;
-
-  CompactionStats stats;
-  stats.micros = env_->NowMicros() - start_micros - imm_micros;
-  for (int which = 0; which < 2; which++) {
-    for (int i = 0; i < compact->compaction->num_input_files(which); i++) {
-      stats.bytes_read += compact->compaction->input(which, i)->file_size;
-    }
-  }
-  for (size_t i = 0; i < compact->outputs.size(); i++) {
-    stats.bytes_written += compact->outputs[i].file_size;
-  }
+  return status;
+}
 
-  mutex_.Lock();
-  stats_[compact->compaction->level() + 1].Add(stats);
-
-  if (status.ok()) {
-    status = InstallCompactionResults(compact);
-  }
-  if (!status.ok()) {
-    RecordBackgroundError(status);
-  }
-  VersionSet::LevelSummaryStorage tmp;
-  Log(options_.info_log, "compacted to: %s", versions_->LevelSummary(&tmp));
-  return status;
-}
-
-namespace {
+namespace {
 
 struct IterState {
   port::Mutex* const mu;
@@ -1139,6 +1971,18 @@ void DBImpl::BuildGlobalIndex(const ReadOptions& options) {
 
 Status DBImpl::Get(const ReadOptions& options, const Slice& key,
                    std::string* value) {
+  // Values found in the memtables are copied straight into *value.
+  PinnableSlice pinnable(value);
+  Status s = Get(options, key, &pinnable);
+  if (s.ok() && pinnable.IsPinned()) {
+    value->assign(pinnable.data(), pinnable.size());
+  }
+  return s;
+}
+
+Status DBImpl::Get(const ReadOptions& options, const Slice& key,
+                   PinnableSlice* value) {
+  value->Reset();
   Status s;
   MutexLock l(&mutex_);
   SequenceNumber snapshot;
@@ -1163,15 +2007,32 @@ Status DBImpl::Get(const ReadOptions& options, const Slice& key,
   {
     mutex_.Unlock();
     // First look in the memtable, then in the immutable memtable (if any).
+    // Memtable memory cannot be pinned without the mutex, so those values
+    // are copied.
     LookupKey lkey(key, snapshot);
-    if (mem->Get(lkey, value, &s)) {
-      // Done
-    } else if (imm != nullptr && imm->Get(lkey, value, &s)) {
-      // Done
+    MergeContext merge_context;
+    if (mem->Get(lkey, value->GetSelf(), &s, &merge_context) ||
+        (imm != nullptr &&
+         imm->Get(lkey, value->GetSelf(), &s, &merge_context))) {
+      if (s.ok()) {
+        value->PinSelf();
+      }
     } else {
-      s = current->Get(options, lkey, value, &stats, global_index);
+      s = current->Get(options, lkey, value, &stats, global_index,
+                       &merge_context);
       have_stat_update = true;
     }
+    if (!merge_context.empty() && (s.ok() || s.IsNotFound())) {
+      // Apply the operands to the value found under them, if any.
+      std::string merged;
+      s = merge_context.Merge(options_.merge_operator, key,
+                              s.ok() ? value : nullptr, &merged);
+      value->Reset();
+      if (s.ok()) {
+        value->GetSelf()->swap(merged);
+        value->PinSelf();
+      }
+    }
     mutex_.Lock();
   }
 
@@ -1188,12 +2049,265 @@ Iterator* DBImpl::NewIterator(const ReadOptions& options) {
   SequenceNumber latest_snapshot;
   uint32_t seed;
   Iterator* iter = NewInternalIterator(options, &latest_snapshot, &seed);
-  return NewDBIterator(this, user_comparator(), iter,
+  return NewDBIterator(this, options, user_comparator(), iter,
                        (options.snapshot != nullptr
                             ? static_cast<const SnapshotImpl*>(options.snapshot)
                                   ->sequence_number()
                             : latest_snapshot),
-                       seed);
+                       seed, options.iterate_lower_bound,
+                       options.iterate_upper_bound,
+                       options.prefix_same_as_start ? options_.prefix_extractor
+                                                    : nullptr);
+}
+
+namespace {
+
+// Runs a DB::ParallelScan() over the key ranges cut by "cuts".  Threads
+// take the ranges in key order and scan each with an iterator bounded to
+// it.  In an unordered scan they deliver the entries themselves; in an
+// ordered one they hand them over in batches to the calling thread,
+// which delivers the ranges one after the other.  Because the ranges are
+// taken in order, the range being delivered is always being scanned, so
+// the threads waiting for room in later ranges cannot stall the scan.
+class ParallelScanner {
+ public:
+  ParallelScanner(DB* db, const ReadOptions& options,
+                  const ParallelScanOptions& scan_options, const Slice* begin,
+                  const Slice* end, const std::vector<std::string>& cuts,
+                  ScanCallback* callback)
+      : db_(db),
+        options_(options),
+        scan_options_(scan_options),
+        callback_(callback),
+        partitions_(cuts.size() + 1),
+        cv_(&mu_),
+        next_partition_(0),
+        stop_(false) {
+    for (size_t i = 0; i < partitions_.size(); i++) {
+      Partition* p = &partitions_[i];
+      p->has_lower = (i > 0 || begin != nullptr);
+      p->has_upper = (i < cuts.size() || end != nullptr);
+      if (p->has_lower) p->lower = (i > 0) ? Slice(cuts[i - 1]) : *begin;
+      if (p->has_upper) p->upper = (i < cuts.size()) ? Slice(cuts[i]) : *end;
+    }
+  }
+
+  ParallelScanner(const ParallelScanner&) = delete;
+  ParallelScanner& operator=(const ParallelScanner&) = delete;
+
+  Status Run() {
+    const int num_threads = std::max(
+        1, std::min(scan_options_.max_threads,
+                    static_cast<int>(partitions_.size())));
+    std::vector<std::thread> threads;
+    const int extra_threads =
+        scan_options_.ordered ? num_threads : num_threads - 1;
+    for (int i = 0; i < extra_threads; i++) {
+      threads.emplace_back([this]() { WorkerLoop(); });
+    }
+    if (scan_options_.ordered) {
+      DeliverInOrder();
+    } else {
+      WorkerLoop();
+    }
+    for (size_t i = 0; i < threads.size(); i++) {
+      threads[i].join();
+    }
+    MutexLock l(&mu_);
+    return status_;
+  }
+
+ private:
+  // Ordered scans hand entries over in batches of about this many bytes
+  static const size_t kBatchBytes = 64 * 1024;
+
+  struct Partition {
+    Partition() : has_lower(false), has_upper(false), buffered_bytes(0),
+                  done(false) {}
+
+    bool has_lower;
+    bool has_upper;
+    Slice lower;  // Included in the range
+    Slice upper;  // Not included in the range
+
+    // Ordered scans only: entries scanned but not delivered yet, encoded
+    // as length-prefixed key and value pairs.
+    std::deque<std::string> batches;
+    size_t buffered_bytes;
+    bool done;  // All entries are in "batches"
+  };
+
+  void WorkerLoop() {
+    while (true) {
+      int i;
+      {
+        MutexLock l(&mu_);
+        if (stop_.load(std::memory_order_relaxed) ||
+            next_partition_ == static_cast<int>(partitions_.size())) {
+          return;
+        }
+        i = next_partition_++;
+      }
+      Scan(i);
+    }
+  }
+
+  void Scan(int i) {
+    Partition* p = &partitions_[i];
+    ReadOptions options = options_;
+    options.iterate_lower_bound = p->has_lower ? &p->lower : nullptr;
+    options.iterate_upper_bound = p->has_upper ? &p->upper : nullptr;
+    Iterator* iter = db_->NewIterator(options);
+    std::string batch;
+    for (iter->SeekToFirst();
+         iter->Valid() && !stop_.load(std::memory_order_relaxed);
+         iter->Next()) {
+      if (!scan_options_.ordered) {
+        if (!callback_->Entry(i, iter->key(), iter->value())) {
+          Stop(Status::OK());
+        }
+        continue;
+      }
+      PutLengthPrefixedSlice(&batch, iter->key());
+      PutLengthPrefixedSlice(&batch, iter->value());
+      if (batch.size() >= kBatchBytes) {
+        HandOver(p, &batch);
+      }
+    }
+    Status s = iter->status();
+    delete iter;
+
+    MutexLock l(&mu_);
+    if (!batch.empty()) {
+      p->buffered_bytes += batch.size();
+      p->batches.push_back(std::move(batch));
+    }
+    p->done = true;
+    if (!s.ok()) {
+      StopLocked(s);
+    }
+    cv_.SignalAll();
+  }
+
+  // Queue "*batch" for delivery once "p" has room for it.
+  void HandOver(Partition* p, std::string* batch) {
+    MutexLock l(&mu_);
+    while (!stop_.load(std::memory_order_relaxed) && p->buffered_bytes > 0 &&
+           p->buffered_bytes + batch->size() >
+               scan_options_.max_buffered_bytes) {
+      cv_.Wait();
+    }
+    p->buffered_bytes += batch->size();
+    p->batches.push_back(std::move(*batch));
+    batch->clear();
+    cv_.SignalAll();
+  }
+
+  void DeliverInOrder() {
+    for (size_t i = 0; i < partitions_.size(); i++) {
+      Partition* p = &partitions_[i];
+      while (true) {
+        std::string batch;
+        {
+          MutexLock l(&mu_);
+          while (!stop_.load(std::memory_order_relaxed) &&
+                 p->batches.empty() && !p->done) {
+            cv_.Wait();
+          }
+          if (stop_.load(std::memory_order_relaxed)) {
+            return;
+          }
+          if (p->batches.empty()) {
+            break;  // Go on with the next range
+          }
+          batch.swap(p->batches.front());
+          p->batches.pop_front();
+          p->buffered_bytes -= batch.size();
+          cv_.SignalAll();
+        }
+        Slice input(batch);
+        Slice key, value;
+        while (GetLengthPrefixedSlice(&input, &key) &&
+               GetLengthPrefixedSlice(&input, &value)) {
+          if (!callback_->Entry(static_cast<int>(i), key, value)) {
+            Stop(Status::OK());
+            return;
+          }
+        }
+      }
+    }
+  }
+
+  // End the scan, with "s" as its result unless it has failed already
+  void Stop(const Status& s) {
+    MutexLock l(&mu_);
+    StopLocked(s);
+  }
+
+  void StopLocked(const Status& s) EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    if (status_.ok()) {
+      status_ = s;
+    }
+    stop_.store(true, std::memory_order_relaxed);
+    cv_.SignalAll();
+  }
+
+  DB* const db_;
+  const ReadOptions options_;
+  const ParallelScanOptions scan_options_;
+  ScanCallback* const callback_;
+  std::vector<Partition> partitions_;  // Bounds are not changed after setup
+
+  port::Mutex mu_;
+  port::CondVar cv_ GUARDED_BY(mu_);
+  int next_partition_ GUARDED_BY(mu_);  // Next range for a thread to scan
+  Status status_ GUARDED_BY(mu_);       // First error of any range
+  std::atomic<bool> stop_;  // Only set under mu_, read by scans without it
+};
+
+}  // anonymous namespace
+
+Status DBImpl::ParallelScan(const ReadOptions& options,
+                            const ParallelScanOptions& scan_options,
+                            const Slice* begin, const Slice* end,
+                            ScanCallback* callback) {
+  // All ranges read from one snapshot
+  ReadOptions read_options = options;
+  const Snapshot* snapshot = nullptr;
+  if (read_options.snapshot == nullptr) {
+    snapshot = GetSnapshot();
+    read_options.snapshot = snapshot;
+  }
+
+  // The cuts are picked without the lock, since that reads index blocks
+  std::vector<std::string> cuts;
+  mutex_.Lock();
+  Version* v = versions_->current();
+  v->Ref();
+  GlobalIndex* git =
+      (options.useGITable() && global_index->global_index_exists_)
+          ? global_index
+          : nullptr;
+  mutex_.Unlock();
+  versions_->SplitRange(v, begin, end, scan_options.num_partitions, git,
+                        &cuts);
+  mutex_.Lock();
+  v->Unref();
+  mutex_.Unlock();
+
+  ParallelScanner scanner(this, read_options, scan_options, begin, end, cuts,
+                          callback);
+  Status s = scanner.Run();
+  if (snapshot != nullptr) {
+    ReleaseSnapshot(snapshot);
+  }
+  return s;
+}
+
+Status DBImpl::GetBlobValue(const ReadOptions& options,
+                            const Slice& blob_index, PinnableSlice* value) {
+  value->Reset();
+  return table_cache_->GetBlob(options, blob_index, value);
 }
 
 void DBImpl::RecordReadSample(Slice key) {
@@ -1222,7 +2336,19 @@ Status DBImpl::Delete(const WriteOptions& options, const Slice& key) {
   return DB::Delete(options, key);
 }
 
+Status DBImpl::Merge(const WriteOptions& options, const Slice& key,
+                     const Slice& value) {
+  if (options_.merge_operator == nullptr) {
+    return Status::InvalidArgument("no merge operator set");
+  }
+  return DB::Merge(options, key, value);
+}
+
 Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
+  if (options_.enable_pipelined_write) {
+    return PipelinedWrite(options, updates);
+  }
+
   Writer w(&mutex_);
   w.batch = updates;
   w.sync = options.sync;
@@ -1231,6 +2357,10 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
   MutexLock l(&mutex_);
   writers_.push_back(&w);
   while (!w.done && &w != writers_.front()) {
+    if (w.insert_leader != nullptr) {
+      InsertMemberConcurrently(&w);
+      continue;
+    }
     w.cv.Wait();
   }
   if (w.done) {
@@ -1242,7 +2372,14 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
   uint64_t last_sequence = versions_->LastSequence();
   Writer* last_writer = &w;
   if (status.ok() && updates != nullptr) {  // nullptr batch is for compactions
-    WriteBatch* write_batch = BuildBatchGroup(&last_writer);
+    if (options.sync) {
+      WaitForSyncGroup();
+    }
+    WriteBatch* write_batch = BuildBatchGroup(&last_writer, tmp_batch_);
+    if (write_controller_.IsDelayed()) {
+      write_controller_.Charge(env_->NowMicros(),
+                               WriteBatchInternal::ByteSize(write_batch));
+    }
     WriteBatchInternal::SetSequence(write_batch, last_sequence + 1);
     last_sequence += WriteBatchInternal::Count(write_batch);
 
@@ -1254,14 +2391,24 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
       mutex_.Unlock();
       status = log_->AddRecord(WriteBatchInternal::Contents(write_batch));
       bool sync_error = false;
+      bool synced = false;
       if (status.ok() && options.sync) {
         status = logfile_->Sync();
-        if (!status.ok()) {
+        if (status.ok()) {
+          synced = true;
+        } else {
           sync_error = true;
         }
       }
       if (status.ok()) {
-        status = WriteBatchInternal::InsertInto(write_batch, mem_);
+        if (options_.allow_concurrent_memtable_write && last_writer != &w &&
+            mem_->IsInsertConcurrentlySupported()) {
+          status = InsertGroupConcurrently(last_writer,
+                                           WriteBatchInternal::Sequence(
+                                               write_batch));
+        } else {
+          status = WriteBatchInternal::InsertInto(write_batch, mem_);
+        }
       }
       mutex_.Lock();
       if (sync_error) {
@@ -1270,6 +2417,9 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
         // So we force the DB into a mode where all future writes fail.
         RecordBackgroundError(status);
       }
+      if (synced) {
+        log_syncs_++;
+      }
     }
     if (write_batch == tmp_batch_) tmp_batch_->Clear();
 
@@ -1295,9 +2445,176 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
   return status;
 }
 
+Status DBImpl::PipelinedWrite(const WriteOptions& options,
+                              WriteBatch* updates) {
+  Writer w(&mutex_);
+  w.batch = updates;
+  w.sync = options.sync;
+  w.done = false;
+
+  MutexLock l(&mutex_);
+  writers_.push_back(&w);
+  while (!w.done && &w != writers_.front()) {
+    w.cv.Wait();
+  }
+  if (w.done) {
+    return w.status;
+  }
+
+  // Log stage.  May temporarily unlock and wait.
+  Status status = MakeRoomForWrite(updates == nullptr);
+  uint64_t last_sequence =
+      std::max(versions_->LastSequence(), last_allocated_sequence_);
+  Writer* last_writer = &w;
+  WriteBatch group_batch;
+  WriteBatch* write_batch = nullptr;
+  if (status.ok() && updates != nullptr) {  // nullptr batch is for compactions
+    if (options.sync) {
+      WaitForSyncGroup();
+    }
+    // tmp_batch_ cannot be used: the previous group may still be reading
+    // its batch while it is applied to the memtable.
+    write_batch = BuildBatchGroup(&last_writer, &group_batch);
+    if (write_controller_.IsDelayed()) {
+      write_controller_.Charge(env_->NowMicros(),
+                               WriteBatchInternal::ByteSize(write_batch));
+    }
+    WriteBatchInternal::SetSequence(write_batch, last_sequence + 1);
+    last_sequence += WriteBatchInternal::Count(write_batch);
+    last_allocated_sequence_ = last_sequence;
+
+    // Only the log is written here, so the previous group can be
+    // inserting into mem_ at the same time.
+    mutex_.Unlock();
+    status = log_->AddRecord(WriteBatchInternal::Contents(write_batch));
+    bool sync_error = false;
+    bool synced = false;
+    if (status.ok() && options.sync) {
+      status = logfile_->Sync();
+      if (status.ok()) {
+        synced = true;
+      } else {
+        sync_error = true;
+      }
+    }
+    mutex_.Lock();
+    if (sync_error) {
+      // The state of the log file is indeterminate: the log record we
+      // just added may or may not show up when the DB is re-opened.
+      // So we force the DB into a mode where all future writes fail.
+      RecordBackgroundError(status);
+    }
+    if (synced) {
+      log_syncs_++;
+    }
+  }
+
+  // Hand the log over to the next group.  The members of this group stay
+  // blocked until their updates are visible.
+  std::vector<Writer*> members;
+  while (true) {
+    Writer* ready = writers_.front();
+    writers_.pop_front();
+    if (ready != &w) {
+      members.push_back(ready);
+    }
+    if (ready == last_writer) break;
+  }
+  if (!writers_.empty()) {
+    writers_.front()->cv.Signal();
+  }
+
+  if (status.ok() && write_batch != nullptr) {
+    // Memtable stage.  Groups are applied in log order so that the last
+    // sequence never covers a group that is not fully in mem_.
+    memtable_writers_.push_back(&w);
+    while (&w != memtable_writers_.front()) {
+      w.cv.Wait();
+    }
+    mutex_.Unlock();
+    status = WriteBatchInternal::InsertInto(write_batch, mem_);
+    mutex_.Lock();
+    versions_->SetLastSequence(last_sequence);
+    memtable_writers_.pop_front();
+    if (!memtable_writers_.empty()) {
+      memtable_writers_.front()->cv.Signal();
+    } else {
+      memtable_writers_drained_.SignalAll();
+    }
+  }
+
+  for (Writer* member : members) {
+    member->status = status;
+    member->done = true;
+    member->cv.Signal();
+  }
+  return status;
+}
+
+// REQUIRES: mutex_ is not held
+// REQUIRES: the calling thread is at the front of the writer queue
+Status DBImpl::InsertGroupConcurrently(Writer* last_writer,
+                                       SequenceNumber first_sequence) {
+  mutex_.Lock();
+  Writer* leader = writers_.front();
+  leader->status = Status::OK();
+  leader->pending_inserts = 0;
+  // Hand out sequence numbers in the order BuildBatchGroup() appended the
+  // batches to the logged group batch.
+  SequenceNumber sequence = first_sequence;
+  for (Writer* member : writers_) {
+    if (member->batch != nullptr) {
+      member->sequence = sequence;
+      sequence += WriteBatchInternal::Count(member->batch);
+      if (member != leader) {
+        member->insert_leader = leader;
+        leader->pending_inserts++;
+        member->cv.Signal();
+      }
+    }
+    if (member == last_writer) break;
+  }
+  MemTable* mem = mem_;
+  mutex_.Unlock();
+
+  WriteBatchInternal::SetSequence(leader->batch, leader->sequence);
+  Status s = WriteBatchInternal::InsertIntoConcurrently(leader->batch, mem);
+
+  mutex_.Lock();
+  while (leader->pending_inserts > 0) {
+    leader->cv.Wait();
+  }
+  if (s.ok()) {
+    s = leader->status;
+  }
+  mutex_.Unlock();
+  return s;
+}
+
+// REQUIRES: mutex_ is held
+void DBImpl::InsertMemberConcurrently(Writer* w) {
+  mutex_.AssertHeld();
+  Writer* leader = w->insert_leader;
+  w->insert_leader = nullptr;
+  MemTable* mem = mem_;
+  mutex_.Unlock();
+
+  WriteBatchInternal::SetSequence(w->batch, w->sequence);
+  Status s = WriteBatchInternal::InsertIntoConcurrently(w->batch, mem);
+
+  mutex_.Lock();
+  if (!s.ok() && leader->status.ok()) {
+    leader->status = s;
+  }
+  if (--leader->pending_inserts == 0) {
+    leader->cv.Signal();
+  }
+}
+
 // REQUIRES: Writer list must be non-empty
 // REQUIRES: First writer must have a non-null batch
-WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer) {
+WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer,
+                                    WriteBatch* tmp_batch) {
   mutex_.AssertHeld();
   assert(!writers_.empty());
   Writer* first = writers_.front();
@@ -1319,6 +2636,10 @@ WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer) {
   ++iter;  // Advance past "first"
   for (; iter != writers_.end(); ++iter) {
     Writer* w = *iter;
+    if (w->exclusive) {
+      break;
+    }
+
     if (w->sync && !first->sync) {
       // Do not include a sync write into a batch handled by a non-sync write.
       break;
@@ -1334,7 +2655,7 @@ WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer) {
       // Append to *result
       if (result == first->batch) {
         // Switch to temporary batch instead of disturbing caller's batch
-        result = tmp_batch_;
+        result = tmp_batch;
         assert(WriteBatchInternal::Count(result) == 0);
         WriteBatchInternal::Append(result, first->batch);
       }
@@ -1353,12 +2674,26 @@ Status DBImpl::MakeRoomForWrite(bool force) {
   bool allow_delay = !force;
   Status s;
   while (true) {
+    UpdateWriteController();
     if (!bg_error_.ok()) {
       // Yield previous error
       s = bg_error_;
       break;
-    } else if (allow_delay && versions_->NumLevelFiles(0) >=
-                                  config::kL0_SlowdownWritesTrigger) {
+    } else if (allow_delay && write_controller_.IsDelayed()) {
+      // Compactions are falling behind.  Pace writes at the controller's
+      // rate so that ingest slows down gradually well before the hard
+      // limit on L0 files is reached.
+      allow_delay = false;  // Do not delay a single write more than once
+      const uint64_t delay = write_controller_.DelayMicros(env_->NowMicros());
+      if (delay > 0) {
+        mutex_.Unlock();
+        env_->SleepForMicroseconds(delay);
+        mutex_.Lock();
+        write_stall_micros_ += delay;
+      }
+    } else if (allow_delay && options_.delayed_write_rate == 0 &&
+               versions_->NumLevelFiles(0) >=
+                   config::kL0_SlowdownWritesTrigger) {
       // We are getting close to hitting a hard limit on the number of
       // L0 files.  Rather than delaying a single write by several
       // seconds when we hit the hard limit, start delaying each
@@ -1369,6 +2704,7 @@ Status DBImpl::MakeRoomForWrite(bool force) {
       env_->SleepForMicroseconds(1000);
       allow_delay = false;  // Do not delay a single write more than once
       mutex_.Lock();
+      write_stall_micros_ += 1000;
     } else if (!force &&
                (mem_->ApproximateMemoryUsage() <= options_.write_buffer_size)) {
       // There is room in current memtable
@@ -1377,17 +2713,25 @@ Status DBImpl::MakeRoomForWrite(bool force) {
       // We have filled up the current memtable, but the previous
       // one is still being compacted, so we wait.
       Log(options_.info_log, "Current memtable full; waiting...\n");
+      const uint64_t start_micros = env_->NowMicros();
       background_work_finished_signal_.Wait();
+      write_stall_micros_ += env_->NowMicros() - start_micros;
     } else if (versions_->NumLevelFiles(0) >= config::kL0_StopWritesTrigger) {
       // There are too many level-0 files.
       Log(options_.info_log, "Too many L0 files; waiting...\n");
+      const uint64_t start_micros = env_->NowMicros();
       background_work_finished_signal_.Wait();
+      write_stall_micros_ += env_->NowMicros() - start_micros;
+    } else if (!memtable_writers_.empty()) {
+      // A logged write group is still being applied to mem_; it must
+      // finish before mem_ is handed to the compaction.
+      memtable_writers_drained_.Wait();
     } else {
       // Attempt to switch to a new memtable and trigger compaction of old
       assert(versions_->PrevLogNumber() == 0);
       uint64_t new_log_number = versions_->NewFileNumber();
       WritableFile* lfile = nullptr;
-      s = env_->NewWritableFile(LogFileName(dbname_, new_log_number), &lfile);
+      s = NewLogFile(new_log_number, &lfile);
       if (!s.ok()) {
         // Avoid chewing through file number space in a tight loop.
         versions_->ReuseFileNumber(new_log_number);
@@ -1399,8 +2743,9 @@ Status DBImpl::MakeRoomForWrite(bool force) {
       logfile_number_ = new_log_number;
       log_ = new log::Writer(lfile);
       imm_ = mem_;
+      imm_->MarkImmutable();
       has_imm_.store(true, std::memory_order_release);
-      mem_ = new MemTable(internal_comparator_);
+      mem_ = new MemTable(internal_comparator_, options_.memtable_factory);
       mem_->Ref();
       force = false;  // Do not force another compaction if have room
       MaybeScheduleCompaction();
@@ -1409,6 +2754,433 @@ Status DBImpl::MakeRoomForWrite(bool force) {
   return s;
 }
 
+void DBImpl::WaitForSyncGroup() {
+  mutex_.AssertHeld();
+  if (options_.log_sync_delay_micros == 0) {
+    return;
+  }
+  // Writers that arrive meanwhile queue up behind this leader and are
+  // picked up by BuildBatchGroup().
+  mutex_.Unlock();
+  env_->SleepForMicroseconds(static_cast<int>(options_.log_sync_delay_micros));
+  mutex_.Lock();
+}
+
+Status DBImpl::NewLogFile(uint64_t number, WritableFile** result) {
+  const std::string fname = LogFileName(dbname_, number);
+  Status s = options_.use_direct_io_for_log
+                 ? env_->NewDirectWritableFile(fname, result)
+                 : env_->NewWritableFile(fname, result);
+  if (s.ok() && options_.preallocate_log_file) {
+    s = (*result)->Preallocate(0, options_.write_buffer_size);
+    if (!s.ok()) {
+      delete *result;
+      *result = nullptr;
+      env_->RemoveFile(fname);
+    }
+  }
+  return s;
+}
+
+void DBImpl::UpdateWriteController() {
+  mutex_.AssertHeld();
+  if (options_.delayed_write_rate == 0) {
+    return;
+  }
+  const uint64_t pending_bytes = versions_->PendingCompactionBytes();
+  const bool slowdown =
+      versions_->NumLevelFiles(0) >= config::kL0_SlowdownWritesTrigger ||
+      (options_.soft_pending_compaction_bytes_limit > 0 &&
+       pending_bytes >= options_.soft_pending_compaction_bytes_limit);
+  // Every level-0 file counts as backlog, even below the compaction
+  // trigger, so that each new flush during a slowdown lowers the rate.
+  const uint64_t level0_bytes = versions_->NumLevelBytes(0);
+  write_controller_.Update(slowdown, pending_bytes + level0_bytes);
+}
+
+// A table handed to IngestExternalFile()
+struct DBImpl::ExternalFile {
+  std::string path;
+  uint64_t file_size;
+  InternalKey smallest;
+  InternalKey largest;
+  FileMetaData meta;  // The table it becomes in the database
+  bool moved;         // Renamed into the database rather than copied
+};
+
+namespace {
+
+// Presents the entries of an external table with sequence number "seq"
+// in place of the zero they were written with.
+class SequenceStampingIterator : public Iterator {
+ public:
+  SequenceStampingIterator(Iterator* iter, SequenceNumber seq)
+      : iter_(iter), seq_(seq) {}
+
+  ~SequenceStampingIterator() override { delete iter_; }
+
+  bool Valid() const override { return iter_->Valid(); }
+  void SeekToFirst() override {
+    iter_->SeekToFirst();
+    Stamp();
+  }
+  void SeekToLast() override {
+    iter_->SeekToLast();
+    Stamp();
+  }
+  void Seek(const Slice& target) override {
+    iter_->Seek(target);
+    Stamp();
+  }
+  void Next() override {
+    iter_->Next();
+    Stamp();
+  }
+  void Prev() override {
+    iter_->Prev();
+    Stamp();
+  }
+  Slice key() const override { return key_; }
+  Slice value() const override { return iter_->value(); }
+  Status status() const override {
+    return status_.ok() ? iter_->status() : status_;
+  }
+
+ private:
+  // Past the last entry key_ still holds the last key, which BuildTable()
+  // reads after the loop as the largest key of the table.
+  void Stamp() {
+    if (iter_->Valid()) {
+      key_.clear();
+      ParsedInternalKey ikey;
+      if (!ParseInternalKey(iter_->key(), &ikey)) {
+        status_ = Status::Corruption("bad key in external table");
+        ikey.type = kTypeValue;
+      }
+      ikey.sequence = seq_;
+      AppendInternalKey(&key_, ikey);
+    }
+  }
+
+  Iterator* const iter_;
+  const SequenceNumber seq_;
+  std::string key_;
+  Status status_;
+};
+
+}  // anonymous namespace
+
+// Read the size and key range of the table at "path" and check that it
+// was written by an SstFileWriter.
+static Status InspectExternalFile(const Options& options,
+                                  const std::string& path,
+                                  uint64_t* file_size, InternalKey* smallest,
+                                  InternalKey* largest) {
+  Env* env = options.env;
+  Status s = env->GetFileSize(path, file_size);
+  RandomAccessFile* rfile = nullptr;
+  if (s.ok()) {
+    s = env->NewRandomAccessFile(path, &rfile);
+  }
+  Table* table = nullptr;
+  if (s.ok()) {
+    s = Table::Open(options, rfile, *file_size, &table);
+  }
+  if (s.ok()) {
+    Iterator* iter = table->NewIterator(ReadOptions());
+    iter->SeekToFirst();
+    if (iter->Valid()) {
+      smallest->DecodeFrom(iter->key());
+      iter->SeekToLast();
+      largest->DecodeFrom(iter->key());
+    }
+    s = iter->status();
+    if (s.ok()) {
+      ParsedInternalKey first, last;
+      if (largest->Encode().empty()) {
+        s = Status::InvalidArgument("external table is empty", path);
+      } else if (!ParseInternalKey(smallest->Encode(), &first) ||
+                 !ParseInternalKey(largest->Encode(), &last) ||
+                 first.sequence != 0 || last.sequence != 0) {
+        s = Status::InvalidArgument(
+            "external table was not written by SstFileWriter", path);
+      }
+    }
+    delete iter;
+  }
+  delete table;
+  delete rfile;
+  return s;
+}
+
+static Status CopyFile(Env* env, const std::string& src,
+                       const std::string& dst) {
+  SequentialFile* in;
+  Status s = env->NewSequentialFile(src, &in);
+  if (!s.ok()) {
+    return s;
+  }
+  WritableFile* out;
+  s = env->NewWritableFile(dst, &out);
+  if (!s.ok()) {
+    delete in;
+    return s;
+  }
+  const size_t kBufferSize = 64 * 1024;
+  char* buffer = new char[kBufferSize];
+  while (s.ok()) {
+    Slice chunk;
+    s = in->Read(kBufferSize, &chunk, buffer);
+    if (!s.ok() || chunk.empty()) {
+      break;
+    }
+    s = out->Append(chunk);
+  }
+  delete[] buffer;
+  if (s.ok()) {
+    s = out->Sync();
+  }
+  if (s.ok()) {
+    s = out->Close();
+  }
+  delete out;
+  delete in;
+  if (!s.ok()) {
+    env->RemoveFile(dst);
+  }
+  return s;
+}
+
+// Write the entries of the table at "path" into table meta->number of the
+// database, all with sequence number "seq".
+static Status BuildStampedTable(const std::string& dbname, Env* env,
+                                const Options& options,
+                                TableCache* table_cache,
+                                const std::string& path, uint64_t file_size,
+                                SequenceNumber seq, FileMetaData* meta) {
+  RandomAccessFile* rfile;
+  Status s = env->NewRandomAccessFile(path, &rfile);
+  if (!s.ok()) {
+    return s;
+  }
+  Table* table;
+  s = Table::Open(options, rfile, file_size, &table);
+  if (s.ok()) {
+    ReadOptions read_options;
+    read_options.fill_cache = false;
+    SequenceStampingIterator iter(table->NewIterator(read_options), seq);
+    s = BuildTable(dbname, env, options, table_cache, &iter, meta, nullptr);
+    delete table;
+  }
+  delete rfile;
+  return s;
+}
+
+Status DBImpl::FlushMemTablesOverlapping(
+    const std::vector<ExternalFile>& files, bool allow_flush) {
+  mutex_.AssertHeld();
+  auto overlaps = [&](MemTable* mem) {
+    if (mem == nullptr) {
+      return false;
+    }
+    bool found = false;
+    Iterator* iter = mem->NewIterator();
+    for (const ExternalFile& f : files) {
+      const Slice smallest = f.smallest.user_key();
+      iter->Seek(InternalKey(smallest, kMaxSequenceNumber, kValueTypeForSeek)
+                     .Encode());
+      if (iter->Valid() &&
+          user_comparator()->Compare(ExtractUserKey(iter->key()),
+                                     f.largest.user_key()) <= 0) {
+        found = true;
+        break;
+      }
+    }
+    delete iter;
+    return found;
+  };
+
+  if (!overlaps(mem_) && !overlaps(imm_)) {
+    return Status::OK();
+  }
+  if (!allow_flush) {
+    return Status::InvalidArgument(
+        "external table overlaps writes that are not flushed");
+  }
+
+  Status s;
+  bool switched = false;
+  while (true) {
+    if (!bg_error_.ok()) {
+      s = bg_error_;
+      break;
+    } else if (imm_ != nullptr) {
+      if (options_.enable_compaction) {
+        background_work_finished_signal_.Wait();
+      } else {
+        // No background thread will write it out
+        CompactMemTable();
+      }
+    } else if (!switched && overlaps(mem_)) {
+      s = MakeRoomForWrite(true /* force */);
+      if (!s.ok()) {
+        break;
+      }
+      switched = true;
+    } else {
+      break;
+    }
+  }
+  return s;
+}
+
+Status DBImpl::IngestExternalFile(const IngestExternalFileOptions& options,
+                                  const std::vector<std::string>& paths) {
+  std::vector<ExternalFile> files(paths.size());
+  Status s;
+  for (size_t i = 0; i < files.size() && s.ok(); i++) {
+    ExternalFile* f = &files[i];
+    f->path = paths[i];
+    f->meta.number = 0;
+    f->moved = false;
+    s = InspectExternalFile(options_, f->path, &f->file_size, &f->smallest,
+                            &f->largest);
+  }
+  if (!s.ok() || files.empty()) {
+    return s;
+  }
+
+  const Comparator* ucmp = user_comparator();
+  std::sort(files.begin(), files.end(),
+            [ucmp](const ExternalFile& a, const ExternalFile& b) {
+              return ucmp->Compare(a.smallest.user_key(),
+                                   b.smallest.user_key()) < 0;
+            });
+  for (size_t i = 1; i < files.size(); i++) {
+    if (ucmp->Compare(files[i - 1].largest.user_key(),
+                      files[i].smallest.user_key()) >= 0) {
+      return Status::InvalidArgument("external tables overlap",
+                                     files[i].path);
+    }
+  }
+
+  // Hold the writer queue so that no sequence number is handed out and
+  // nothing enters the memtable until the files are in place.
+  Writer w(&mutex_);
+  w.exclusive = true;
+  MutexLock l(&mutex_);
+  writers_.push_back(&w);
+  while (&w != writers_.front()) {
+    w.cv.Wait();
+  }
+  while (!memtable_writers_.empty()) {
+    memtable_writers_drained_.Wait();
+  }
+
+  // Older writes to the same keys must be in a table before the files
+  // can be placed above them.
+  s = FlushMemTablesOverlapping(files, options.allow_blocking_flush);
+
+  // Entries with sequence number zero are older than anything in the
+  // database, which is only right if nothing else has their keys and no
+  // snapshot should miss them.
+  bool assign_sequence = !snapshots_.empty();
+  for (const ExternalFile& f : files) {
+    if (versions_->current()->OverlapInAnyLevel(f.smallest.user_key(),
+                                                f.largest.user_key())) {
+      assign_sequence = true;
+    }
+  }
+  const SequenceNumber seq =
+      assign_sequence ? versions_->LastSequence() + 1 : 0;
+
+  if (s.ok()) {
+    for (ExternalFile& f : files) {
+      f.meta.number = versions_->NewFileNumber();
+      pending_outputs_.insert(f.meta.number);
+    }
+
+    // The files are set up without the lock; writes stay blocked.
+    mutex_.Unlock();
+    for (ExternalFile& f : files) {
+      const std::string fname = TableFileName(dbname_, f.meta.number);
+      if (assign_sequence) {
+        s = BuildStampedTable(dbname_, env_, TableOptionsForLevel(options_, 0),
+                              table_cache_, f.path, f.file_size, seq,
+                              &f.meta);
+      } else {
+        if (options.move_files) {
+          s = env_->RenameFile(f.path, fname);
+          f.moved = s.ok();
+        } else {
+          s = CopyFile(env_, f.path, fname);
+        }
+        f.meta.file_size = f.file_size;
+        f.meta.smallest = f.smallest;
+        f.meta.largest = f.largest;
+      }
+      if (!s.ok()) {
+        break;
+      }
+    }
+    mutex_.Lock();
+  }
+
+  if (s.ok()) {
+    VersionEdit edit;
+    Version* current = versions_->current();
+    for (const ExternalFile& f : files) {
+      // As in WriteLevel0Table(), only push a file down while no
+      // compaction can install outputs that span its range and no other
+      // edit is being logged.  Background threads do not pick a
+      // compaction until the edit below is in place.
+      int level = 0;
+      if (running_compactions_ == 0 && !logging_version_edit_ &&
+          options_.compaction_style == kCompactionStyleLevel) {
+        level = current->PickLevelForExternalFile(f.meta.smallest.user_key(),
+                                                  f.meta.largest.user_key());
+      }
+      edit.AddFile(level, f.meta.number, f.meta.file_size, f.meta.smallest,
+                   f.meta.largest);
+      Log(options_.info_log, "Ingested %s as table #%llu@%d: %lld bytes",
+          f.path.c_str(), static_cast<unsigned long long>(f.meta.number),
+          level, static_cast<long long>(f.meta.file_size));
+    }
+    if (assign_sequence) {
+      versions_->SetLastSequence(seq);
+    }
+    global_index->global_index_exists_ = false;
+    s = LogAndApply(&edit);
+  }
+
+  for (ExternalFile& f : files) {
+    if (f.meta.number == 0) {
+      continue;  // Never got a table number
+    }
+    pending_outputs_.erase(f.meta.number);
+    if (!s.ok()) {
+      const std::string fname = TableFileName(dbname_, f.meta.number);
+      if (f.moved) {
+        env_->RenameFile(fname, f.path);
+      } else {
+        env_->RemoveFile(fname);
+      }
+    } else if (options.move_files && !f.moved) {
+      env_->RemoveFile(f.path);
+    }
+  }
+  if (s.ok()) {
+    MaybeScheduleCompaction();
+  }
+
+  // Notify new head of write queue
+  writers_.pop_front();
+  if (!writers_.empty()) {
+    writers_.front()->cv.Signal();
+  }
+  return s;
+}
+
 bool DBImpl::GetProperty(const Slice& property, std::string* value) {
   value->clear();
 
@@ -1455,6 +3227,9 @@ bool DBImpl::GetProperty(const Slice& property, std::string* value) {
     return true;
   } else if (in == "approximate-memory-usage") {
     size_t total_usage = options_.block_cache->TotalCharge();
+    if (options_.compressed_block_cache != nullptr) {
+      total_usage += options_.compressed_block_cache->TotalCharge();
+    }
     if (mem_) {
       total_usage += mem_->ApproximateMemoryUsage();
     }
@@ -1466,6 +3241,83 @@ bool DBImpl::GetProperty(const Slice& property, std::string* value) {
                   static_cast<unsigned long long>(total_usage));
     value->append(buf);
     return true;
+  } else if (in == "block-cache-hits" || in == "block-cache-misses" ||
+             in == "compressed-block-cache-hits" ||
+             in == "compressed-block-cache-misses") {
+    const BlockCacheStats& stats = table_cache_->cache_stats();
+    uint64_t count;
+    if (in == "block-cache-hits") {
+      count = stats.block_cache_hits.load(std::memory_order_relaxed);
+    } else if (in == "block-cache-misses") {
+      count = stats.block_cache_misses.load(std::memory_order_relaxed);
+    } else if (in == "compressed-block-cache-hits") {
+      count = stats.compressed_cache_hits.load(std::memory_order_relaxed);
+    } else {
+      count = stats.compressed_cache_misses.load(std::memory_order_relaxed);
+    }
+    char buf[50];
+    std::snprintf(buf, sizeof(buf), "%llu",
+                  static_cast<unsigned long long>(count));
+    value->append(buf);
+    return true;
+  } else if (in == "actual-delayed-write-rate" || in == "write-stall-micros" ||
+             in == "estimate-pending-compaction-bytes") {
+    uint64_t count;
+    if (in == "actual-delayed-write-rate") {
+      count = write_controller_.delayed_rate();
+    } else if (in == "write-stall-micros") {
+      count = write_stall_micros_;
+    } else {
+      count = versions_->PendingCompactionBytes();
+    }
+    char buf[50];
+    std::snprintf(buf, sizeof(buf), "%llu",
+                  static_cast<unsigned long long>(count));
+    value->append(buf);
+    return true;
+  } else if (in == "log-syncs") {
+    char buf[50];
+    std::snprintf(buf, sizeof(buf), "%llu",
+                  static_cast<unsigned long long>(log_syncs_));
+    value->append(buf);
+    return true;
+  } else if (in == "table-bytes-written") {
+    uint64_t bytes = 0;
+    for (int level = 0; level < config::kNumLevels; level++) {
+      bytes += stats_[level].bytes_written;
+    }
+    char buf[50];
+    std::snprintf(buf, sizeof(buf), "%llu",
+                  static_cast<unsigned long long>(bytes));
+    value->append(buf);
+    return true;
+  } else if (in == "compaction-filter-removed-keys" ||
+             in == "compaction-filter-removed-bytes") {
+    uint64_t count = 0;
+    for (int level = 0; level < config::kNumLevels; level++) {
+      count += in == "compaction-filter-removed-keys"
+                   ? stats_[level].filtered_entries
+                   : stats_[level].filtered_bytes;
+    }
+    char buf[50];
+    std::snprintf(buf, sizeof(buf), "%llu",
+                  static_cast<unsigned long long>(count));
+    value->append(buf);
+    return true;
+  } else if (in == "rate-limiter-throttled-bytes") {
+    if (options_.rate_limiter == nullptr) {
+      return false;
+    }
+    uint64_t count = 0;
+    for (int i = 0; i < RateLimiter::kNumPriorities; i++) {
+      count += options_.rate_limiter->GetThrottledBytes(
+          static_cast<RateLimiter::IOPriority>(i));
+    }
+    char buf[50];
+    std::snprintf(buf, sizeof(buf), "%llu",
+                  static_cast<unsigned long long>(count));
+    value->append(buf);
+    return true;
   }
 
   return false;
@@ -1503,6 +3355,40 @@ Status DB::Delete(const WriteOptions& opt, const Slice& key) {
   return Write(opt, &batch);
 }
 
+Status DB::Merge(const WriteOptions& opt, const Slice& key,
+                 const Slice& value) {
+  WriteBatch batch;
+  batch.Merge(key, value);
+  return Write(opt, &batch);
+}
+
+Status DB::Get(const ReadOptions& options, const Slice& key,
+               PinnableSlice* value) {
+  value->Reset();
+  Status s = Get(options, key, value->GetSelf());
+  if (s.ok()) {
+    value->PinSelf();
+  }
+  return s;
+}
+
+Status DB::ParallelScan(const ReadOptions& options,
+                        const ParallelScanOptions& scan_options,
+                        const Slice* begin, const Slice* end,
+                        ScanCallback* callback) {
+  ReadOptions read_options = options;
+  read_options.iterate_lower_bound = begin;
+  read_options.iterate_upper_bound = end;
+  Iterator* iter = NewIterator(read_options);
+  for (iter->SeekToFirst();
+       iter->Valid() && callback->Entry(0, iter->key(), iter->value());
+       iter->Next()) {
+  }
+  Status s = iter->status();
+  delete iter;
+  return s;
+}
+
 DB::~DB() = default;
 
 Status DB::Open(const Options& options, const std::string& dbname, DB** dbptr) {
@@ -1518,14 +3404,14 @@ Status DB::Open(const Options& options, const std::string& dbname, DB** dbptr) {
     // Create new log and a corresponding memtable.
     uint64_t new_log_number = impl->versions_->NewFileNumber();
     WritableFile* lfile;
-    s = options.env->NewWritableFile(LogFileName(dbname, new_log_number),
-                                     &lfile);
+    s = impl->NewLogFile(new_log_number, &lfile);
     if (s.ok()) {
       edit.SetLogNumber(new_log_number);
       impl->logfile_ = lfile;
       impl->logfile_number_ = new_log_number;
       impl->log_ = new log::Writer(lfile);
-      impl->mem_ = new MemTable(impl->internal_comparator_);
+      impl->mem_ = new MemTable(impl->internal_comparator_,
+                                 impl->options_.memtable_factory);
       impl->mem_->Ref();
     }
   }
@@ -1551,6 +3437,8 @@ Status DB::Open(const Options& options, const std::string& dbname, DB** dbptr) {
 
 Snapshot::~Snapshot() = default;
 
+ScanCallback::~ScanCallback() = default;
+
 Status DestroyDB(const std::string& dbname, const Options& options) {
   Env* env = options.env;
   std::vector<std::string> filenames;
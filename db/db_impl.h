@@ -9,10 +9,12 @@
 #include <deque>
 #include <set>
 #include <string>
+#include <vector>
 
 #include "db/dbformat.h"
 #include "db/log_writer.h"
 #include "db/snapshot.h"
+#include "db/write_controller.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
 #include "port/port.h"
@@ -41,16 +43,26 @@ class DBImpl : public DB {
   Status Put(const WriteOptions&, const Slice& key,
              const Slice& value) override;
   Status Delete(const WriteOptions&, const Slice& key) override;
+  Status Merge(const WriteOptions&, const Slice& key,
+               const Slice& value) override;
   Status Write(const WriteOptions& options, WriteBatch* updates) override;
   void BuildGlobalIndex(const ReadOptions& options);
   Status Get(const ReadOptions& options, const Slice& key,
              std::string* value) override;
+  Status Get(const ReadOptions& options, const Slice& key,
+             PinnableSlice* value) override;
   Iterator* NewIterator(const ReadOptions&) override;
+  Status ParallelScan(const ReadOptions& options,
+                      const ParallelScanOptions& scan_options,
+                      const Slice* begin, const Slice* end,
+                      ScanCallback* callback) override;
   const Snapshot* GetSnapshot() override;
   void ReleaseSnapshot(const Snapshot* snapshot) override;
   bool GetProperty(const Slice& property, std::string* value) override;
   void GetApproximateSizes(const Range* range, int n, uint64_t* sizes) override;
   void CompactRange(const Slice* begin, const Slice* end) override;
+  Status IngestExternalFile(const IngestExternalFileOptions& options,
+                            const std::vector<std::string>& paths) override;
 
   // Extra methods (for testing) that are not in the public DB interface
 
@@ -74,9 +86,21 @@ class DBImpl : public DB {
   // bytes.
   void RecordReadSample(Slice key);
 
+  // Read the value that the encoded BlobIndex "blob_index" refers to
+  // into *value.
+  Status GetBlobValue(const ReadOptions& options, const Slice& blob_index,
+                      PinnableSlice* value);
+
+  // The operator that merges the operands of DB::Merge(), if any.
+  const MergeOperator* merge_operator() const {
+    return options_.merge_operator;
+  }
+
  private:
   friend class DB;
   struct CompactionState;
+  struct ExternalFile;
+  class LogReplay;
   struct Writer;
 
   // Information for a manual compaction
@@ -91,17 +115,27 @@ class DBImpl : public DB {
   // Per level compaction stats.  stats_[level] stores the stats for
   // compactions that produced data for the specified "level".
   struct CompactionStats {
-    CompactionStats() : micros(0), bytes_read(0), bytes_written(0) {}
+    CompactionStats()
+        : micros(0),
+          bytes_read(0),
+          bytes_written(0),
+          filtered_entries(0),
+          filtered_bytes(0) {}
 
     void Add(const CompactionStats& c) {
       this->micros += c.micros;
       this->bytes_read += c.bytes_read;
       this->bytes_written += c.bytes_written;
+      this->filtered_entries += c.filtered_entries;
+      this->filtered_bytes += c.filtered_bytes;
     }
 
     int64_t micros;
     int64_t bytes_read;
     int64_t bytes_written;
+    // Keys Options::compaction_filter removed, and their bytes
+    int64_t filtered_entries;
+    int64_t filtered_bytes;
   };
 
   Iterator* NewInternalIterator(const ReadOptions&,
@@ -130,28 +164,97 @@ class DBImpl : public DB {
                         VersionEdit* edit, SequenceNumber* max_sequence)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
+  // The new table stays in pending_outputs_ until the caller has applied
+  // *edit, so that no concurrent RemoveObsoleteFiles() deletes it.  A
+  // non-zero file->number is a file number the caller already took and
+  // put in pending_outputs_; otherwise a new one is taken.
   Status WriteLevel0Table(MemTable* mem, VersionEdit* edit, Version* base,
                           leveldb::FileMetaData* file)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
   Status MakeRoomForWrite(bool force /* compact even if there is room? */)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
-  WriteBatch* BuildBatchGroup(Writer** last_writer)
+  // Gives writers options_.log_sync_delay_micros to join the group of a
+  // leader that is about to sync the log.
+  void WaitForSyncGroup() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Creates log file "number" with the options_ for log files.
+  Status NewLogFile(uint64_t number, WritableFile** result);
+  // Feeds the current compaction backlog to write_controller_.
+  void UpdateWriteController() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  WriteBatch* BuildBatchGroup(Writer** last_writer, WriteBatch* tmp_batch)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Write() for options_.enable_pipelined_write: the log and the memtable
+  // are two stages, each with its own queue of writers.
+  Status PipelinedWrite(const WriteOptions& options, WriteBatch* updates);
+
+  // Used by options_.allow_concurrent_memtable_write.  The group leader
+  // has every writer up to last_writer apply its own batch to mem_, in
+  // parallel with its own, and waits for all of them.
+  Status InsertGroupConcurrently(Writer* last_writer,
+                                 SequenceNumber first_sequence)
+      LOCKS_EXCLUDED(mutex_);
+  // Run by a group member that was handed its batch by the leader.
+  void InsertMemberConcurrently(Writer* w) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Used by IngestExternalFile(): writes out the memtables if they hold
+  // keys in the range of any of "files".
+  Status FlushMemTablesOverlapping(const std::vector<ExternalFile>& files,
+                                   bool allow_flush)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
   void RecordBackgroundError(const Status& s);
 
+  // Apply *edit to the current version and log it to the MANIFEST, one
+  // background thread at a time.
+  Status LogAndApply(VersionEdit* edit) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
   void MaybeScheduleCompaction() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
   static void BGWork(void* db);
   void BackgroundCall();
-  void BackgroundCompaction() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Returns false if there was no work that this thread could start.
+  bool BackgroundCompaction() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
   void CleanupCompaction(CompactionState* compact)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
   Status DoCompactionWork(CompactionState* compact)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Compacts the key range of "compact" read from "input", which it takes
+  // ownership of.  Called without mutex_ held, possibly from several
+  // threads at once for disjoint key ranges.
+  Status DoSubcompactionWork(CompactionState* compact, Iterator* input,
+                             int64_t* imm_micros);
 
   Status OpenCompactionOutputFile(CompactionState* compact);
   Status FinishCompactionOutputFile(CompactionState* compact, Iterator* input);
+  // Moves the value of the entry *key/*value that compaction writes out
+  // to the current blob file if it is large enough or lives in a blob
+  // file being collected, repointing *key/*value into the buffers.
+  Status MoveToBlobFile(CompactionState* compact, const ParsedInternalKey& ikey,
+                        Slice* key, Slice* value, std::string* key_buf,
+                        std::string* value_buf);
+  // Passes the entry *key/*value that compaction writes out to
+  // Options::compaction_filter.  Sets *drop if the filter removes the key
+  // and no older entry of it is left to hide; otherwise a removed key
+  // becomes a deletion and a changed value is written instead, with
+  // *ikey, *key and *value repointed into the buffers.
+  Status FilterEntry(CompactionState* compact, ParsedInternalKey* ikey,
+                     Slice* key, Slice* value, std::string* key_buf,
+                     std::string* value_buf, bool* drop);
+  // Merges the operand at "input", the newest entry of its key that no
+  // snapshot separates from the older ones, with the older operands of the
+  // key, and with the value or deletion under them if the compaction reads
+  // it or the key is at its base level.  Otherwise combines what
+  // MergeOperator::PartialMerge() can.  Leaves "input" at the first entry
+  // it did not merge, and sets *hides_older if the result hides it.
+  Status MergeCompactionOperands(CompactionState* compact, Iterator* input,
+                                 bool* hides_older);
+  // Writes the entry key/value out to the current output file of the
+  // compaction, opening and finishing files as needed.  "ikey" is null if
+  // "key" does not parse.
+  Status WriteCompactionEntry(CompactionState* compact, Iterator* input,
+                              const ParsedInternalKey* ikey, Slice key,
+                              Slice value, std::string* key_buf,
+                              std::string* value_buf);
   Status InstallCompactionResults(CompactionState* compact)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
@@ -190,14 +293,39 @@ class DBImpl : public DB {
   std::deque<Writer*> writers_ GUARDED_BY(mutex_);
   WriteBatch* tmp_batch_ GUARDED_BY(mutex_);
 
+  // Leaders of logged write groups waiting, in log order, to be applied
+  // to mem_.  Only used when options_.enable_pipelined_write is set.
+  std::deque<Writer*> memtable_writers_ GUARDED_BY(mutex_);
+  port::CondVar memtable_writers_drained_ GUARDED_BY(mutex_);
+  // Last sequence number handed out to a logged write group; may be ahead
+  // of versions_->LastSequence() while groups are being applied.
+  SequenceNumber last_allocated_sequence_ GUARDED_BY(mutex_);
+
+  // Paces writes while compactions fall behind; see MakeRoomForWrite().
+  WriteController write_controller_ GUARDED_BY(mutex_);
+  // Total time writes spent delayed or stopped waiting for compactions.
+  uint64_t write_stall_micros_ GUARDED_BY(mutex_);
+  // Number of times write groups have synced the log.
+  uint64_t log_syncs_ GUARDED_BY(mutex_);
+
   SnapshotList snapshots_ GUARDED_BY(mutex_);
 
   // Set of table files to protect from deletion because they are
   // part of ongoing compactions.
   std::set<uint64_t> pending_outputs_ GUARDED_BY(mutex_);
 
-  // Has a background compaction been scheduled or is running?
-  bool background_compaction_scheduled_ GUARDED_BY(mutex_);
+  // Number of background compactions that are scheduled or running.
+  int background_compactions_scheduled_ GUARDED_BY(mutex_);
+
+  // Number of picked compactions that have not been installed yet.
+  int running_compactions_ GUARDED_BY(mutex_);
+
+  // Is a background thread writing imm_ to a table?
+  bool compacting_memtable_ GUARDED_BY(mutex_);
+
+  // Is a background thread inside versions_->LogAndApply()?
+  bool logging_version_edit_ GUARDED_BY(mutex_);
+  port::CondVar version_edit_logged_ GUARDED_BY(mutex_);
 
   ManualCompaction* manual_compaction_ GUARDED_BY(mutex_);
 
@@ -4,11 +4,16 @@
 
 #include "db/db_iter.h"
 
+#include <algorithm>
+#include <vector>
+
 #include "db/db_impl.h"
 #include "db/dbformat.h"
 #include "db/filename.h"
+#include "db/merge_helper.h"
 #include "leveldb/env.h"
 #include "leveldb/iterator.h"
+#include "leveldb/pinnable_slice.h"
 #include "port/port.h"
 #include "util/logging.h"
 #include "util/mutexlock.h"
@@ -40,19 +45,30 @@ class DBIter : public Iterator {
  public:
   // Which direction is the iterator currently moving?
   // (1) When moving forward, the internal iterator is positioned at
-  //     the exact entry that yields this->key(), this->value()
+  //     the exact entry that yields this->key(), this->value(), or, if
+  //     merged_, just after the entries merged into this->value().
   // (2) When moving backwards, the internal iterator is positioned
   //     just before all entries whose user key == this->key().
   enum Direction { kForward, kReverse };
 
-  DBIter(DBImpl* db, const Comparator* cmp, Iterator* iter, SequenceNumber s,
-         uint32_t seed)
+  DBIter(DBImpl* db, const ReadOptions& options, const Comparator* cmp,
+         Iterator* iter, SequenceNumber s, uint32_t seed,
+         const Slice* lower_bound, const Slice* upper_bound,
+         const SliceTransform* prefix_extractor)
       : db_(db),
+        blob_options_(options),
         user_comparator_(cmp),
         iter_(iter),
         sequence_(s),
+        lower_bound_(lower_bound),
+        upper_bound_(upper_bound),
+        prefix_extractor_(prefix_extractor),
+        has_prefix_(false),
         direction_(kForward),
         valid_(false),
+        merged_(false),
+        is_blob_index_(false),
+        blob_value_read_(false),
         rnd_(seed),
         bytes_until_read_sampling_(RandomCompactionPeriod()) {}
 
@@ -63,17 +79,30 @@ class DBIter : public Iterator {
   bool Valid() const override { return valid_; }
   Slice key() const override {
     assert(valid_);
-    return (direction_ == kForward) ? ExtractUserKey(iter_->key()) : saved_key_;
+    return (direction_ == kForward && !merged_) ? ExtractUserKey(iter_->key())
+                                                : saved_key_;
   }
   Slice value() const override {
     assert(valid_);
-    return (direction_ == kForward) ? iter_->value() : saved_value_;
+    Slice raw_value =
+        (direction_ == kForward && !merged_) ? iter_->value() : saved_value_;
+    if (!is_blob_index_) {
+      return raw_value;
+    }
+    // Only read a value from its blob file once it is asked for
+    if (!blob_value_read_) {
+      blob_value_read_ = true;
+      blob_status_ = db_->GetBlobValue(blob_options_, raw_value, &blob_value_);
+    }
+    return blob_value_;
   }
   Status status() const override {
-    if (status_.ok()) {
-      return iter_->status();
-    } else {
+    if (!status_.ok()) {
       return status_;
+    } else if (!blob_status_.ok()) {
+      return blob_status_;
+    } else {
+      return iter_->status();
     }
   }
 
@@ -87,11 +116,37 @@ class DBIter : public Iterator {
   void FindNextUserEntry(bool skipping, std::string* skip);
   void FindPrevUserEntry();
   bool ParseKey(ParsedInternalKey* key);
+  bool MergeValuesNewToOld();
+  bool MergeIntoSavedValue(ValueType base_type, const Slice& base,
+                           const std::vector<std::string>& operands);
 
   inline void SaveKey(const Slice& k, std::string* dst) {
     dst->assign(k.data(), k.size());
   }
 
+  inline bool BeforeLowerBound(const Slice& user_key) const {
+    return lower_bound_ != nullptr &&
+           user_comparator_->Compare(user_key, *lower_bound_) < 0;
+  }
+
+  inline bool PastUpperBound(const Slice& user_key) const {
+    return upper_bound_ != nullptr &&
+           user_comparator_->Compare(user_key, *upper_bound_) >= 0;
+  }
+
+  // True if "user_key" does not share the prefix the iterator is held to.
+  inline bool OutsidePrefix(const Slice& user_key) const {
+    return has_prefix_ && (!prefix_extractor_->InDomain(user_key) ||
+                           prefix_extractor_->Transform(user_key) != prefix_);
+  }
+
+  // Note that the entry at which the iterator now stands is of "type".
+  inline void SetEntryType(ValueType type) {
+    is_blob_index_ = (type == kTypeBlobIndex);
+    blob_value_read_ = false;
+    blob_value_.Reset();
+  }
+
   inline void ClearSavedValue() {
     if (saved_value_.capacity() > 1048576) {
       std::string empty;
@@ -107,14 +162,25 @@ class DBIter : public Iterator {
   }
 
   DBImpl* db_;
+  const ReadOptions blob_options_;  // For reading values from blob files
   const Comparator* const user_comparator_;
   Iterator* const iter_;
   SequenceNumber const sequence_;
+  const Slice* const lower_bound_;
+  const Slice* const upper_bound_;
+  const SliceTransform* const prefix_extractor_;
+  std::string prefix_;  // Prefix of the last Seek() target if has_prefix_
+  bool has_prefix_;
   Status status_;
   std::string saved_key_;    // == current key when direction_==kReverse
   std::string saved_value_;  // == current raw value when direction_==kReverse
   Direction direction_;
   bool valid_;
+  bool merged_;  // Forward at saved_key_ => saved_value_, merged from operands
+  bool is_blob_index_;  // The current value is a reference to a blob
+  mutable bool blob_value_read_;
+  mutable PinnableSlice blob_value_;
+  mutable Status blob_status_;
   Random rnd_;
   size_t bytes_until_read_sampling_;
 };
@@ -157,6 +223,15 @@ void DBIter::Next() {
       return;
     }
     // saved_key_ already contains the key to skip past.
+  } else if (merged_) {
+    // saved_key_ already contains the key to skip past, and iter_ is past
+    // the entries merged into its value.
+    merged_ = false;
+    if (!iter_->Valid()) {
+      valid_ = false;
+      saved_key_.clear();
+      return;
+    }
   } else {
     // Store in saved_key_ the current key so we skip it below.
     SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
@@ -181,6 +256,9 @@ void DBIter::FindNextUserEntry(bool skipping, std::string* skip) {
   do {
     ParsedInternalKey ikey;
     if (ParseKey(&ikey) && ikey.sequence <= sequence_) {
+      if (PastUpperBound(ikey.user_key) || OutsidePrefix(ikey.user_key)) {
+        break;
+      }
       switch (ikey.type) {
         case kTypeDeletion:
           // Arrange to skip all upcoming entries for this key since
@@ -189,12 +267,23 @@ void DBIter::FindNextUserEntry(bool skipping, std::string* skip) {
           skipping = true;
           break;
         case kTypeValue:
+        case kTypeBlobIndex:
           if (skipping &&
               user_comparator_->Compare(ikey.user_key, *skip) <= 0) {
             // Entry hidden
           } else {
             valid_ = true;
             saved_key_.clear();
+            SetEntryType(ikey.type);
+            return;
+          }
+          break;
+        case kTypeMerge:
+          if (skipping &&
+              user_comparator_->Compare(ikey.user_key, *skip) <= 0) {
+            // Entry hidden
+          } else {
+            valid_ = MergeValuesNewToOld();
             return;
           }
           break;
@@ -210,22 +299,28 @@ void DBIter::Prev() {
   assert(valid_);
 
   if (direction_ == kForward) {  // Switch directions?
-    // iter_ is pointing at the current entry.  Scan backwards until
-    // the key changes so we can use the normal reverse scanning code.
-    assert(iter_->Valid());  // Otherwise valid_ would have been false
-    SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
-    while (true) {
-      iter_->Prev();
+    // iter_ is pointing at the current entry, or past it if merged_.  Scan
+    // backwards until the key changes so we can use the normal reverse
+    // scanning code.
+    if (merged_) {
+      merged_ = false;
       if (!iter_->Valid()) {
-        valid_ = false;
-        saved_key_.clear();
-        ClearSavedValue();
-        return;
-      }
-      if (user_comparator_->Compare(ExtractUserKey(iter_->key()), saved_key_) <
-          0) {
-        break;
+        iter_->SeekToLast();
       }
+    } else {
+      assert(iter_->Valid());  // Otherwise valid_ would have been false
+      SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
+    }
+    while (iter_->Valid() &&
+           user_comparator_->Compare(ExtractUserKey(iter_->key()),
+                                     saved_key_) >= 0) {
+      iter_->Prev();
+    }
+    if (!iter_->Valid()) {
+      valid_ = false;
+      saved_key_.clear();
+      ClearSavedValue();
+      return;
     }
     direction_ = kReverse;
   }
@@ -237,15 +332,37 @@ void DBIter::FindPrevUserEntry() {
   assert(direction_ == kReverse);
 
   ValueType value_type = kTypeDeletion;
+  // If value_type is kTypeMerge, the operands of saved_key_ seen so far,
+  // oldest first, and the type of the entry before them.  saved_value_
+  // holds that entry if it is a value.
+  std::vector<std::string> operands;
+  ValueType base_type = kTypeDeletion;
   if (iter_->Valid()) {
     do {
       ParsedInternalKey ikey;
-      if (ParseKey(&ikey) && ikey.sequence <= sequence_) {
+      if (ParseKey(&ikey) && ikey.sequence <= sequence_ &&
+          !PastUpperBound(ikey.user_key)) {
+        if (BeforeLowerBound(ikey.user_key) || OutsidePrefix(ikey.user_key)) {
+          // Keys before the range end the iteration like the first key
+          break;
+        }
         if ((value_type != kTypeDeletion) &&
             user_comparator_->Compare(ikey.user_key, saved_key_) < 0) {
           // We encountered a non-deleted value in entries for previous keys,
           break;
         }
+        if (ikey.type == kTypeMerge) {
+          if (value_type != kTypeMerge) {
+            base_type = value_type;
+            operands.clear();
+            SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
+          }
+          value_type = kTypeMerge;
+          Slice raw_value = iter_->value();
+          operands.emplace_back(raw_value.data(), raw_value.size());
+          iter_->Prev();
+          continue;
+        }
         value_type = ikey.type;
         if (value_type == kTypeDeletion) {
           saved_key_.clear();
@@ -264,6 +381,14 @@ void DBIter::FindPrevUserEntry() {
     } while (iter_->Valid());
   }
 
+  if (value_type == kTypeMerge) {
+    if (MergeIntoSavedValue(base_type, saved_value_, operands)) {
+      value_type = kTypeValue;
+    } else {
+      value_type = kTypeDeletion;
+    }
+  }
+
   if (value_type == kTypeDeletion) {
     // End
     valid_ = false;
@@ -272,15 +397,88 @@ void DBIter::FindPrevUserEntry() {
     direction_ = kForward;
   } else {
     valid_ = true;
+    SetEntryType(value_type);
+  }
+}
+
+// Called with iter_ at the newest visible entry of a key, which is a merge
+// operand.  Merges it and the older entries of the key into saved_value_,
+// and leaves iter_ just past the merged entries.
+bool DBIter::MergeValuesNewToOld() {
+  SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
+  std::vector<std::string> operands;
+  ValueType base_type = kTypeDeletion;
+  Slice base;
+  ParsedInternalKey ikey;
+  do {
+    if (!ParseKey(&ikey)) {
+      return false;
+    }
+    if (user_comparator_->Compare(ikey.user_key, saved_key_) != 0) {
+      break;
+    }
+    if (ikey.type != kTypeMerge) {
+      // The operands apply to this entry, and anything older is hidden.
+      base_type = ikey.type;
+      base = iter_->value();
+      break;
+    }
+    Slice raw_value = iter_->value();
+    operands.emplace_back(raw_value.data(), raw_value.size());
+    iter_->Next();
+  } while (iter_->Valid());
+
+  // Newest first to oldest first
+  std::reverse(operands.begin(), operands.end());
+  const bool ok = MergeIntoSavedValue(base_type, base, operands);
+  if (base_type != kTypeDeletion) {
+    iter_->Next();  // Past the base, which "base" pointed into
+  }
+  merged_ = ok;
+  return ok;
+}
+
+// Stores in saved_value_ the result of applying "operands" to "base",
+// which has type "base_type", or to nothing if it is a deletion.
+bool DBIter::MergeIntoSavedValue(ValueType base_type, const Slice& base,
+                                 const std::vector<std::string>& operands) {
+  Status s;
+  PinnableSlice blob;
+  Slice existing = base;
+  if (base_type == kTypeBlobIndex) {
+    s = db_->GetBlobValue(blob_options_, base, &blob);
+    existing = blob;
+  }
+  std::string merged;
+  if (s.ok()) {
+    std::vector<Slice> operand_slices(operands.begin(), operands.end());
+    s = MergeOperands(db_->merge_operator(), saved_key_,
+                      base_type == kTypeDeletion ? nullptr : &existing,
+                      operand_slices, &merged);
   }
+  if (!s.ok()) {
+    status_ = s;
+    return false;
+  }
+  saved_value_.swap(merged);
+  SetEntryType(kTypeValue);
+  return true;
 }
 
 void DBIter::Seek(const Slice& target) {
   direction_ = kForward;
+  merged_ = false;
+  has_prefix_ =
+      prefix_extractor_ != nullptr && prefix_extractor_->InDomain(target);
+  if (has_prefix_) {
+    SaveKey(prefix_extractor_->Transform(target), &prefix_);
+  }
   ClearSavedValue();
   saved_key_.clear();
   AppendInternalKey(&saved_key_,
-                    ParsedInternalKey(target, sequence_, kValueTypeForSeek));
+                    ParsedInternalKey(BeforeLowerBound(target) ? *lower_bound_
+                                                               : target,
+                                      sequence_, kValueTypeForSeek));
   iter_->Seek(saved_key_);
   if (iter_->Valid()) {
     FindNextUserEntry(false, &saved_key_ /* temporary storage */);
@@ -291,8 +489,17 @@ void DBIter::Seek(const Slice& target) {
 
 void DBIter::SeekToFirst() {
   direction_ = kForward;
+  merged_ = false;
+  has_prefix_ = false;
   ClearSavedValue();
-  iter_->SeekToFirst();
+  if (lower_bound_ != nullptr) {
+    saved_key_.clear();
+    AppendInternalKey(&saved_key_, ParsedInternalKey(*lower_bound_, sequence_,
+                                                     kValueTypeForSeek));
+    iter_->Seek(saved_key_);
+  } else {
+    iter_->SeekToFirst();
+  }
   if (iter_->Valid()) {
     FindNextUserEntry(false, &saved_key_ /* temporary storage */);
   } else {
@@ -302,17 +509,38 @@ void DBIter::SeekToFirst() {
 
 void DBIter::SeekToLast() {
   direction_ = kReverse;
+  merged_ = false;
+  has_prefix_ = false;
   ClearSavedValue();
-  iter_->SeekToLast();
+  if (upper_bound_ != nullptr) {
+    // Start from the last entry before the bound instead of walking back
+    // to it from the end of the database.
+    saved_key_.clear();
+    AppendInternalKey(&saved_key_, ParsedInternalKey(*upper_bound_,
+                                                     kMaxSequenceNumber,
+                                                     kValueTypeForSeek));
+    iter_->Seek(saved_key_);
+    if (iter_->Valid()) {
+      iter_->Prev();
+    } else {
+      iter_->SeekToLast();
+    }
+  } else {
+    iter_->SeekToLast();
+  }
   FindPrevUserEntry();
 }
 
 }  // anonymous namespace
 
-Iterator* NewDBIterator(DBImpl* db, const Comparator* user_key_comparator,
+Iterator* NewDBIterator(DBImpl* db, const ReadOptions& options,
+                        const Comparator* user_key_comparator,
                         Iterator* internal_iter, SequenceNumber sequence,
-                        uint32_t seed) {
-  return new DBIter(db, user_key_comparator, internal_iter, sequence, seed);
+                        uint32_t seed, const Slice* lower_bound,
+                        const Slice* upper_bound,
+                        const SliceTransform* prefix_extractor) {
+  return new DBIter(db, options, user_key_comparator, internal_iter, sequence,
+                    seed, lower_bound, upper_bound, prefix_extractor);
 }
 
 }  // namespace leveldb
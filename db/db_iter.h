@@ -16,10 +16,17 @@ class DBImpl;
 
 // Return a new iterator that converts internal keys (yielded by
 // "*internal_iter") that were live at the specified "sequence" number
-// into appropriate user keys.
-Iterator* NewDBIterator(DBImpl* db, const Comparator* user_key_comparator,
+// into appropriate user keys.  If "lower_bound" is non-null, the iterator
+// starts at it; if "upper_bound" is non-null, the iterator ends before it.
+// If "prefix_extractor" is non-null, the iterator ends after the keys
+// sharing the prefix of the target of a Seek().  Values kept in blob
+// files are read with the checksum and caching settings of "options".
+Iterator* NewDBIterator(DBImpl* db, const ReadOptions& options,
+                        const Comparator* user_key_comparator,
                         Iterator* internal_iter, SequenceNumber sequence,
-                        uint32_t seed);
+                        uint32_t seed, const Slice* lower_bound,
+                        const Slice* upper_bound,
+                        const SliceTransform* prefix_extractor);
 
 }  // namespace leveldb
 
@@ -4,8 +4,12 @@
 
 #include "leveldb/db.h"
 
+#include <algorithm>
 #include <atomic>
 #include <cinttypes>
+#include <map>
+#include <memory>
+#include <set>
 #include <string>
 
 #include "gtest/gtest.h"
@@ -14,12 +18,20 @@
 #include "db/filename.h"
 #include "db/version_set.h"
 #include "db/write_batch_internal.h"
+#include "helpers/memenv/memenv.h"
 #include "leveldb/cache.h"
+#include "leveldb/compaction_filter.h"
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
+#include "leveldb/memtablerep.h"
+#include "leveldb/merge_operator.h"
+#include "leveldb/rate_limiter.h"
+#include "leveldb/slice_transform.h"
+#include "leveldb/sst_file_writer.h"
 #include "leveldb/table.h"
 #include "port/port.h"
 #include "port/thread_annotations.h"
+#include "util/coding.h"
 #include "util/hash.h"
 #include "util/logging.h"
 #include "util/mutexlock.h"
@@ -277,6 +289,12 @@ class DBTest : public testing::Test {
       case kUncompressed:
         options.compression = kNoCompression;
         break;
+      case kPipelinedWrite:
+        options.enable_pipelined_write = true;
+        break;
+      case kConcurrentMemTableWrite:
+        options.allow_concurrent_memtable_write = true;
+        break;
       default:
         break;
     }
@@ -322,6 +340,10 @@ class DBTest : public testing::Test {
 
   Status Delete(const std::string& k) { return db_->Delete(WriteOptions(), k); }
 
+  Status Merge(const std::string& k, const std::string& v) {
+    return db_->Merge(WriteOptions(), k, v);
+  }
+
   std::string Get(const std::string& k, const Snapshot* snapshot = nullptr) {
     ReadOptions options;
     options.snapshot = snapshot;
@@ -391,6 +413,12 @@ class DBTest : public testing::Test {
             case kTypeDeletion:
               result += "DEL";
               break;
+            case kTypeMerge:
+              result += "+" + iter->value().ToString();
+              break;
+            case kTypeBlobIndex:
+              result += "BLOB";
+              break;
           }
         }
         iter->Next();
@@ -442,6 +470,20 @@ class DBTest : public testing::Test {
     return static_cast<int>(files.size());
   }
 
+  std::set<uint64_t> BlobFiles() {
+    std::vector<std::string> filenames;
+    env_->GetChildren(dbname_, &filenames);
+    std::set<uint64_t> result;
+    uint64_t number;
+    FileType type;
+    for (size_t i = 0; i < filenames.size(); i++) {
+      if (ParseFileName(filenames[i], &number, &type) && type == kBlobFile) {
+        result.insert(number);
+      }
+    }
+    return result;
+  }
+
   uint64_t Size(const Slice& start, const Slice& limit) {
     Range r(start, limit);
     uint64_t size;
@@ -533,7 +575,15 @@ class DBTest : public testing::Test {
 
  private:
   // Sequence of option configurations to try
-  enum OptionConfig { kDefault, kReuse, kFilter, kUncompressed, kEnd };
+  enum OptionConfig {
+    kDefault,
+    kReuse,
+    kFilter,
+    kUncompressed,
+    kPipelinedWrite,
+    kConcurrentMemTableWrite,
+    kEnd
+  };
 
   const FilterPolicy* filter_policy_;
   int option_config_;
@@ -627,6 +677,54 @@ TEST_F(DBTest, GetMemUsage) {
   } while (ChangeOptions());
 }
 
+TEST_F(DBTest, GetPinnableSlice) {
+  Options options = CurrentOptions();
+  options.create_if_missing = true;
+  options.enable_compaction = true;
+  DestroyAndReopen(&options);
+
+  Random rnd(301);
+  const std::string v1 = RandomString(&rnd, 10000);
+  ASSERT_LEVELDB_OK(Put("foo", v1));
+
+  // Memtable values are copied.
+  PinnableSlice value;
+  ASSERT_LEVELDB_OK(db_->Get(ReadOptions(), "foo", &value));
+  ASSERT_FALSE(value.IsPinned());
+  ASSERT_EQ(v1, value.ToString());
+  ASSERT_TRUE(db_->Get(ReadOptions(), "bar", &value).IsNotFound());
+  ASSERT_TRUE(value.empty());
+
+  // Table values are pinned, through the index blocks and the global index.
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_LEVELDB_OK(db_->Get(ReadOptions(), "foo", &value));
+  ASSERT_TRUE(value.IsPinned());
+  ASSERT_EQ(v1, value.ToString());
+  ReadOptions git_options(1, true);
+  db_->BuildGlobalIndex(git_options);
+  PinnableSlice git_value;
+  ASSERT_LEVELDB_OK(db_->Get(git_options, "foo", &git_value));
+  ASSERT_TRUE(git_value.IsPinned());
+  ASSERT_EQ(v1, git_value.ToString());
+  git_value.Reset();
+  ASSERT_EQ("NOT_FOUND", Get("bar"));
+
+  // A pinned value outlives the table it was read from.
+  ASSERT_LEVELDB_OK(Delete("foo"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  dbfull()->CompactRange(nullptr, nullptr);
+  ASSERT_EQ("NOT_FOUND", Get("foo"));
+  ASSERT_EQ(0, TotalTableFiles());
+  ASSERT_EQ(v1, value.ToString());
+  value.Reset();
+  ASSERT_FALSE(value.IsPinned());
+
+  // The std::string overload reads the same values.
+  ASSERT_LEVELDB_OK(Put("foo", "v2"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ("v2", Get("foo"));
+}
+
 TEST_F(DBTest, GetSnapshot) {
   do {
     // Try with both a short key and a long key
@@ -1099,6 +1197,52 @@ TEST_F(DBTest, RecoverWithLargeLog) {
   ASSERT_GT(NumTableFilesAtLevel(0), 1);
 }
 
+TEST_F(DBTest, ParallelRecovery) {
+  for (int reuse_logs = 0; reuse_logs < 2; reuse_logs++) {
+    SCOPED_TRACE(reuse_logs);
+    Options options = CurrentOptions();
+    options.create_if_missing = true;
+    options.reuse_logs = reuse_logs;
+    DestroyAndReopen(&options);
+
+    // Rewrite a small set of keys many times so that every partition of
+    // the log holds versions of the same keys.
+    Random rnd(301);
+    std::map<std::string, std::string> expected;
+    for (int i = 0; i < 3000; i++) {
+      const std::string key = Key(i % 300);
+      if (i % 7 == 0) {
+        ASSERT_LEVELDB_OK(Delete(key));
+        expected.erase(key);
+      } else {
+        const std::string value = RandomString(&rnd, 500);
+        ASSERT_LEVELDB_OK(Put(key, value));
+        expected[key] = value;
+      }
+    }
+    ASSERT_EQ(NumTableFilesAtLevel(0), 0);
+
+    options.write_buffer_size = 100000;
+    options.max_recovery_threads = 4;
+    Reopen(&options);
+    ASSERT_GT(NumTableFilesAtLevel(0), 5);
+    for (int i = 0; i < 300; i++) {
+      auto it = expected.find(Key(i));
+      ASSERT_EQ(it == expected.end() ? "NOT_FOUND" : it->second, Get(Key(i)));
+    }
+    std::string want;
+    for (const auto& kv : expected) {
+      want += "(" + kv.first + "->" + kv.second + ")";
+    }
+    ASSERT_EQ(want, Contents());
+
+    // Writes after recovery go on from the recovered sequence numbers.
+    ASSERT_LEVELDB_OK(Put(Key(0), "new"));
+    Reopen(&options);
+    ASSERT_EQ("new", Get(Key(0)));
+  }
+}
+
 TEST_F(DBTest, CompactionsGenerateMultipleFiles) {
   Options options = CurrentOptions();
   options.write_buffer_size = 100000000;  // Large write buffer
@@ -1125,6 +1269,876 @@ TEST_F(DBTest, CompactionsGenerateMultipleFiles) {
   }
 }
 
+TEST_F(DBTest, ConcurrentCompactions) {
+  Options options = CurrentOptions();
+  options.enable_compaction = true;
+  options.thread_compaction = 4;
+  options.write_buffer_size = 100000;  // Small write buffer
+  Reopen(&options);
+
+  // Overwrite random keys so that many overlapping level-0 files are
+  // produced and several levels need compactions at the same time.
+  const int kNumKeys = 2000;
+  Random rnd(301);
+  std::vector<std::string> values(kNumKeys);
+  for (int i = 0; i < 12000; i++) {
+    const int k = rnd.Uniform(kNumKeys);
+    values[k] = RandomString(&rnd, 1000);
+    ASSERT_LEVELDB_OK(Put(Key(k), values[k]));
+  }
+
+  for (int pass = 0; pass < 2; pass++) {
+    for (int k = 0; k < kNumKeys; k++) {
+      ASSERT_EQ(values[k].empty() ? "NOT_FOUND" : values[k], Get(Key(k)));
+    }
+    // The MANIFEST must hold the edits of every compaction.
+    Reopen(&options);
+  }
+}
+
+TEST_F(DBTest, Subcompactions) {
+  Options options = CurrentOptions();
+  options.enable_compaction = true;
+  options.max_subcompactions = 4;
+  options.write_buffer_size = 100000;  // Small write buffer
+  Reopen(&options);
+
+  // Mix overwrites and deletions so that sub-compactions both merge and
+  // drop entries near their key range boundaries.
+  const int kNumKeys = 2000;
+  Random rnd(301);
+  std::vector<std::string> values(kNumKeys);
+  for (int i = 0; i < 12000; i++) {
+    const int k = rnd.Uniform(kNumKeys);
+    if (rnd.OneIn(10)) {
+      values[k].clear();
+      ASSERT_LEVELDB_OK(Delete(Key(k)));
+    } else {
+      values[k] = RandomString(&rnd, 1000);
+      ASSERT_LEVELDB_OK(Put(Key(k), values[k]));
+    }
+  }
+  dbfull()->TEST_CompactRange(0, nullptr, nullptr);
+  dbfull()->TEST_CompactRange(1, nullptr, nullptr);
+
+  for (int pass = 0; pass < 2; pass++) {
+    for (int k = 0; k < kNumKeys; k++) {
+      ASSERT_EQ(values[k].empty() ? "NOT_FOUND" : values[k], Get(Key(k)));
+    }
+    // Outputs of neighbouring sub-compactions must not overlap.
+    Iterator* iter = db_->NewIterator(ReadOptions());
+    int k = 0;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next(), k++) {
+      while (values[k].empty()) k++;
+      ASSERT_EQ(Key(k), iter->key().ToString());
+      ASSERT_EQ(values[k], iter->value().ToString());
+    }
+    delete iter;
+    Reopen(&options);
+  }
+}
+
+TEST_F(DBTest, BlobFiles) {
+  Options options = CurrentOptions();
+  options.create_if_missing = true;
+  options.enable_compaction = true;
+  options.min_blob_size = 100;
+  DestroyAndReopen(&options);
+
+  // Even keys get values large enough for the blob files.
+  const int kNumKeys = 100;
+  Random rnd(301);
+  std::vector<std::string> values(kNumKeys);
+  for (int i = 0; i < kNumKeys; i++) {
+    values[i] = (i % 2 == 0) ? RandomString(&rnd, 1000) : "v" + Key(i);
+    ASSERT_LEVELDB_OK(Put(Key(i), values[i]));
+  }
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  std::set<uint64_t> blobs = BlobFiles();
+  ASSERT_EQ(1, blobs.size());
+  const uint64_t first_blob = *blobs.begin();
+
+  // The global index is only built once per open database.
+  ReadOptions git_options(1, true);
+  auto check = [&](bool use_git) {
+    for (int i = 0; i < kNumKeys; i++) {
+      ASSERT_EQ(values[i].empty() ? "NOT_FOUND" : values[i], Get(Key(i)));
+    }
+    if (use_git) {
+      db_->BuildGlobalIndex(git_options);
+    }
+    for (int i = 0; use_git && i < kNumKeys; i++) {
+      std::string value;
+      Status s = db_->Get(git_options, Key(i), &value);
+      if (values[i].empty()) {
+        ASSERT_TRUE(s.IsNotFound());
+      } else {
+        ASSERT_LEVELDB_OK(s);
+        ASSERT_EQ(values[i], value);
+      }
+    }
+    Iterator* iter = db_->NewIterator(ReadOptions());
+    int i = 0;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next(), i++) {
+      while (values[i].empty()) i++;
+      ASSERT_EQ(Key(i), iter->key().ToString());
+      ASSERT_EQ(values[i], iter->value().ToString());
+    }
+    i = kNumKeys - 1;
+    for (iter->SeekToLast(); iter->Valid(); iter->Prev(), i--) {
+      while (values[i].empty()) i--;
+      ASSERT_EQ(Key(i), iter->key().ToString());
+      ASSERT_EQ(values[i], iter->value().ToString());
+    }
+    ASSERT_LEVELDB_OK(iter->status());
+    delete iter;
+  };
+  check(true);
+
+  // Overwrite or delete 30 of the 50 values of the blob file.
+  for (int i = 0; i < 60; i += 2) {
+    if (i % 10 == 0) {
+      values[i].clear();
+      ASSERT_LEVELDB_OK(Delete(Key(i)));
+    } else {
+      values[i] = RandomString(&rnd, 1000);
+      ASSERT_LEVELDB_OK(Put(Key(i), values[i]));
+    }
+  }
+  dbfull()->CompactRange(nullptr, nullptr);
+  blobs = BlobFiles();
+  ASSERT_EQ(2, blobs.size());
+  ASSERT_EQ(1, blobs.count(first_blob));
+  check(false);
+
+  // The blob file is now mostly garbage, so the next compaction moves its
+  // remaining values elsewhere and the file goes.
+  int level = 0;
+  while (NumTableFilesAtLevel(level) == 0) level++;
+  dbfull()->TEST_CompactRange(level, nullptr, nullptr);
+  blobs = BlobFiles();
+  ASSERT_EQ(2, blobs.size());
+  ASSERT_EQ(0, blobs.count(first_blob));
+  check(false);
+
+  Reopen(&options);
+  check(true);
+  ASSERT_EQ(blobs, BlobFiles());
+}
+
+TEST_F(DBTest, PrefixIterator) {
+  env_->count_random_reads_ = true;
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.create_if_missing = true;
+  options.enable_compaction = true;
+  options.filter_policy = NewBloomFilterPolicy(10);
+  options.prefix_extractor = NewFixedPrefixTransform(4);
+  DestroyAndReopen(&options);
+
+  // Prefixes "p000", "p002", ..., "p098" with 20 keys each.
+  auto key = [](int prefix, int i) {
+    char buf[100];
+    std::snprintf(buf, sizeof(buf), "p%03d/%02d", prefix, i);
+    return std::string(buf);
+  };
+  for (int p = 0; p < 100; p += 2) {
+    for (int i = 0; i < 20; i++) {
+      ASSERT_LEVELDB_OK(Put(key(p, i), std::string(100, 'a' + i)));
+    }
+  }
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ("NOT_FOUND", Get("missing"));  // Opens the table
+
+  // A prefix that no key has is rejected by the filters, without reading
+  // any data block.
+  ReadOptions ropts;
+  ropts.fill_cache = false;
+  ropts.prefix_same_as_start = true;
+  Iterator* iter = db_->NewIterator(ropts);
+  env_->random_read_counter_.Reset();
+  iter->Seek(key(43, 0));
+  ASSERT_TRUE(!iter->Valid());
+  iter->Seek("p043");
+  ASSERT_TRUE(!iter->Valid());
+  ASSERT_EQ(0, env_->random_read_counter_.Read());
+  ASSERT_LEVELDB_OK(iter->status());
+  delete iter;
+
+  ReadOptions git_options(1, true);
+  db_->BuildGlobalIndex(git_options);
+  for (int use_git = 0; use_git < 2; use_git++) {
+    ropts = use_git ? git_options : ReadOptions();
+    ropts.prefix_same_as_start = true;
+
+    // A scan stops at the end of its prefix.
+    iter = db_->NewIterator(ropts);
+    int i = 5;
+    for (iter->Seek(key(42, 5)); iter->Valid(); iter->Next(), i++) {
+      ASSERT_EQ(key(42, i), iter->key().ToString());
+    }
+    ASSERT_EQ(20, i);
+    i = 3;
+    for (iter->Seek(key(42, 3)); iter->Valid(); iter->Prev(), i--) {
+      ASSERT_EQ(key(42, i), iter->key().ToString());
+    }
+    ASSERT_EQ(-1, i);
+    iter->Seek(key(43, 0));
+    ASSERT_TRUE(!iter->Valid());
+    ASSERT_LEVELDB_OK(iter->status());
+    delete iter;
+
+    // Without the option the same seek lands on the next prefix.
+    ropts.prefix_same_as_start = false;
+    iter = db_->NewIterator(ropts);
+    iter->Seek(key(43, 0));
+    ASSERT_TRUE(iter->Valid());
+    ASSERT_EQ(key(44, 0), iter->key().ToString());
+    delete iter;
+
+    // An upper bound stops a scan in either direction.
+    Slice upper("p010");
+    ropts.iterate_upper_bound = &upper;
+    iter = db_->NewIterator(ropts);
+    int count = 0;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      ASSERT_LT(iter->key().compare(upper), 0);
+      count++;
+    }
+    ASSERT_EQ(5 * 20, count);
+    iter->SeekToLast();
+    ASSERT_TRUE(iter->Valid());
+    ASSERT_EQ(key(8, 19), iter->key().ToString());
+    iter->Prev();
+    ASSERT_EQ(key(8, 18), iter->key().ToString());
+    ASSERT_LEVELDB_OK(iter->status());
+    delete iter;
+  }
+
+  Close();
+  delete options.filter_policy;
+  delete options.prefix_extractor;
+}
+
+TEST_F(DBTest, IterateBounds) {
+  env_->count_random_reads_ = true;
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.create_if_missing = true;
+  options.enable_compaction = true;
+  options.block_size = 1024;
+  DestroyAndReopen(&options);
+
+  // Three files with 100 keys each, in disjoint key ranges.
+  for (int f = 0; f < 3; f++) {
+    for (int i = f * 100; i < (f + 1) * 100; i++) {
+      ASSERT_LEVELDB_OK(Put(Key(i), std::string(100, 'a' + f)));
+    }
+    ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  }
+
+  ReadOptions git_options(1, true);
+  db_->BuildGlobalIndex(git_options);
+  for (int use_git = 0; use_git < 2; use_git++) {
+    ReadOptions ropts = use_git ? git_options : ReadOptions();
+    std::string lower = Key(120);
+    std::string upper = Key(130);
+    Slice lower_bound(lower);
+    Slice upper_bound(upper);
+    ropts.iterate_lower_bound = &lower_bound;
+    ropts.iterate_upper_bound = &upper_bound;
+    Iterator* iter = db_->NewIterator(ropts);
+
+    int i = 120;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next(), i++) {
+      ASSERT_EQ(Key(i), iter->key().ToString());
+    }
+    ASSERT_EQ(130, i);
+    i = 129;
+    for (iter->SeekToLast(); iter->Valid(); iter->Prev(), i--) {
+      ASSERT_EQ(Key(i), iter->key().ToString());
+    }
+    ASSERT_EQ(119, i);
+
+    // Seeks before the lower bound go to it.
+    iter->Seek(Key(5));
+    ASSERT_TRUE(iter->Valid());
+    ASSERT_EQ(Key(120), iter->key().ToString());
+    iter->Seek(Key(125));
+    ASSERT_EQ(Key(125), iter->key().ToString());
+    iter->Prev();
+    ASSERT_EQ(Key(124), iter->key().ToString());
+    iter->Seek(Key(130));
+    ASSERT_TRUE(!iter->Valid());
+    ASSERT_LEVELDB_OK(iter->status());
+    delete iter;
+  }
+
+  // A scan does not read the files and blocks outside the bounds, so a
+  // scan back to the lower bound stops without reading the previous file.
+  // Open all the tables first, so only data blocks are counted.
+  ReadOptions ropts;
+  ropts.fill_cache = false;
+  Iterator* iter = db_->NewIterator(ropts);
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+  }
+  delete iter;
+  auto reverse_scan_reads = [&](const Slice* lower_bound) {
+    ropts.iterate_lower_bound = lower_bound;
+    Iterator* iter = db_->NewIterator(ropts);
+    env_->random_read_counter_.Reset();
+    int count = 0;
+    for (iter->Seek(Key(105)); iter->Valid(); iter->Prev()) {
+      if (iter->key().ToString() < Key(100)) break;
+      count++;
+    }
+    EXPECT_EQ(6, count);
+    delete iter;
+    return env_->random_read_counter_.Read();
+  };
+  std::string lower = Key(100);
+  Slice lower_bound(lower);
+  const int unbounded_reads = reverse_scan_reads(nullptr);
+  const int bounded_reads = reverse_scan_reads(&lower_bound);
+  ASSERT_LT(bounded_reads, unbounded_reads);
+}
+
+namespace {
+
+typedef std::vector<std::pair<std::string, std::string>> ScanEntries;
+
+// Collects the entries of a ParallelScan(), and ends the scan after
+// "limit" of them.
+class CollectingScanCallback : public ScanCallback {
+ public:
+  explicit CollectingScanCallback(int limit = -1) : limit_(limit) {}
+
+  bool Entry(int partition, const Slice& key, const Slice& value) override {
+    MutexLock l(&mu_);
+    entries.emplace_back(key.ToString(), value.ToString());
+    partitions.insert(partition);
+    return limit_ < 0 || static_cast<int>(entries.size()) < limit_;
+  }
+
+  ScanEntries entries;
+  std::set<int> partitions;
+
+ private:
+  const int limit_;
+  port::Mutex mu_;
+};
+
+}  // namespace
+
+TEST_F(DBTest, ParallelScan) {
+  Options options = CurrentOptions();
+  options.create_if_missing = true;
+  options.enable_compaction = true;
+  options.block_size = 1024;
+  DestroyAndReopen(&options);
+
+  // Four tables and a few unflushed writes
+  const int kNumKeys = 2000;
+  ScanEntries expected;
+  for (int i = 0; i < kNumKeys; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), "v" + Key(i)));
+    if (i % 500 == 499) {
+      ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+    }
+  }
+  for (int i = 0; i < kNumKeys; i += 100) {
+    ASSERT_LEVELDB_OK(Put(Key(i), "new"));
+  }
+  for (int i = 0; i < kNumKeys; i++) {
+    expected.emplace_back(Key(i), i % 100 == 0 ? "new" : "v" + Key(i));
+  }
+
+  ReadOptions git_options(1, true);
+  db_->BuildGlobalIndex(git_options);
+  for (int use_git = 0; use_git < 2; use_git++) {
+    ReadOptions ropts = use_git ? git_options : ReadOptions();
+    ParallelScanOptions scan_options;
+    scan_options.num_partitions = 4;
+    scan_options.max_threads = 3;
+    scan_options.max_buffered_bytes = 1;  // Hand over one batch at a time
+
+    // An ordered scan delivers every entry in key order.
+    CollectingScanCallback ordered;
+    ASSERT_LEVELDB_OK(
+        db_->ParallelScan(ropts, scan_options, nullptr, nullptr, &ordered));
+    ASSERT_TRUE(ordered.entries == expected);
+    ASSERT_EQ(4, ordered.partitions.size());
+
+    // An unordered scan delivers the same entries.
+    scan_options.ordered = false;
+    CollectingScanCallback unordered;
+    ASSERT_LEVELDB_OK(
+        db_->ParallelScan(ropts, scan_options, nullptr, nullptr, &unordered));
+    std::sort(unordered.entries.begin(), unordered.entries.end());
+    ASSERT_TRUE(unordered.entries == expected);
+
+    // A bounded scan only delivers the range.
+    scan_options.ordered = true;
+    std::string begin = Key(150);
+    std::string end = Key(1250);
+    Slice begin_slice(begin);
+    Slice end_slice(end);
+    CollectingScanCallback bounded;
+    ASSERT_LEVELDB_OK(db_->ParallelScan(ropts, scan_options, &begin_slice,
+                                        &end_slice, &bounded));
+    ASSERT_TRUE(bounded.entries ==
+                ScanEntries(expected.begin() + 150, expected.begin() + 1250));
+    ASSERT_LT(1, bounded.partitions.size());
+
+    // The callback can end a scan.
+    CollectingScanCallback stopped(10);
+    ASSERT_LEVELDB_OK(
+        db_->ParallelScan(ropts, scan_options, nullptr, nullptr, &stopped));
+    ASSERT_TRUE(stopped.entries ==
+                ScanEntries(expected.begin(), expected.begin() + 10));
+  }
+
+  // A scan reads from the snapshot it is given.
+  const Snapshot* snapshot = db_->GetSnapshot();
+  for (int i = 0; i < kNumKeys; i += 2) {
+    ASSERT_LEVELDB_OK(Delete(Key(i)));
+  }
+  ReadOptions ropts;
+  ropts.snapshot = snapshot;
+  CollectingScanCallback old_entries;
+  ASSERT_LEVELDB_OK(db_->ParallelScan(ropts, ParallelScanOptions(), nullptr,
+                                      nullptr, &old_entries));
+  ASSERT_TRUE(old_entries.entries == expected);
+  db_->ReleaseSnapshot(snapshot);
+  CollectingScanCallback new_entries;
+  ASSERT_LEVELDB_OK(db_->ParallelScan(ReadOptions(), ParallelScanOptions(),
+                                      nullptr, nullptr, &new_entries));
+  ASSERT_EQ(kNumKeys / 2, new_entries.entries.size());
+}
+
+namespace {
+
+// Removes the keys with value "remove" and changes "change" to "changed".
+class TestCompactionFilter : public CompactionFilter {
+ public:
+  const char* Name() const override { return "TestCompactionFilter"; }
+
+  bool Filter(int level, const Slice& key, const Slice& existing_value,
+              std::string* new_value, bool* value_changed) const override {
+    if (existing_value == "remove") {
+      return true;
+    }
+    if (existing_value == "change") {
+      new_value->assign("changed");
+      *value_changed = true;
+    }
+    return false;
+  }
+};
+
+}  // namespace
+
+TEST_F(DBTest, CompactionFilter) {
+  TestCompactionFilter filter;
+  Options options = CurrentOptions();
+  options.enable_compaction = true;
+  options.compaction_filter = &filter;
+  Reopen(&options);
+
+  Put("foo", "v1");
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  const int last = config::kMaxMemCompactLevel;
+  ASSERT_EQ(NumTableFilesAtLevel(last), 1);  // foo => v1 is now in last level
+
+  // Place a table at level last-1 to prevent merging with preceding mutation
+  Put("a", "begin");
+  Put("z", "end");
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ(NumTableFilesAtLevel(last), 1);
+  ASSERT_EQ(NumTableFilesAtLevel(last - 1), 1);
+
+  Put("bar", "change");
+  Put("baz", "remove");
+  Put("foo", "remove");
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());  // Moves to last-2
+  ASSERT_EQ(AllEntriesFor("foo"), "[ remove, v1 ]");
+  ASSERT_EQ(AllEntriesFor("bar"), "[ change ]");
+  dbfull()->TEST_CompactRange(last - 2, nullptr, nullptr);
+  // "baz" is gone for good, while "foo" needs a deletion to hide v1.
+  ASSERT_EQ(AllEntriesFor("baz"), "[ ]");
+  ASSERT_EQ(AllEntriesFor("foo"), "[ DEL, v1 ]");
+  ASSERT_EQ(AllEntriesFor("bar"), "[ changed ]");
+  ASSERT_EQ("NOT_FOUND", Get("foo"));
+  ASSERT_EQ("changed", Get("bar"));
+  ASSERT_EQ("begin", Get("a"));
+  dbfull()->TEST_CompactRange(last - 1, nullptr, nullptr);
+  ASSERT_EQ(AllEntriesFor("foo"), "[ ]");
+
+  std::string removed;
+  ASSERT_TRUE(
+      db_->GetProperty("leveldb.compaction-filter-removed-keys", &removed));
+  ASSERT_EQ("2", removed);
+  ASSERT_TRUE(
+      db_->GetProperty("leveldb.compaction-filter-removed-bytes", &removed));
+  ASSERT_EQ("18", removed);  // "baz", "foo" and two times "remove"
+
+  // Values a snapshot sees are left alone.
+  Put("qux", "remove");
+  const Snapshot* snapshot = db_->GetSnapshot();
+  Put("quux", "remove");
+  dbfull()->CompactRange(nullptr, nullptr);
+  ASSERT_EQ("remove", Get("qux"));
+  ASSERT_EQ("NOT_FOUND", Get("quux"));
+  ASSERT_EQ("remove", Get("qux", snapshot));
+  db_->ReleaseSnapshot(snapshot);
+}
+
+TEST_F(DBTest, TTLCompactionFilter) {
+  const CompactionFilter* filter = NewTTLCompactionFilter(3600, env_);
+  Options options = CurrentOptions();
+  options.enable_compaction = true;
+  options.compaction_filter = filter;
+  options.min_blob_size = 100;
+  Reopen(&options);
+
+  // Every third key expired an hour ago; every seventh is in a blob file.
+  // The even and odd keys go to two overlapping tables, on levels
+  // last and last-1, which are then compacted together.
+  const uint64_t now = env_->NowMicros() / 1000000;
+  for (int odd = 0; odd < 2; odd++) {
+    for (int i = odd; i < 100; i += 2) {
+      std::string value(i % 7 == 0 ? 200 : 10, 'x');
+      AppendTTLTimestamp(&value, i % 3 == 0 ? now - 7200 : now);
+      ASSERT_LEVELDB_OK(Put(Key(i), value));
+    }
+    if (odd) {
+      ASSERT_LEVELDB_OK(Put("short", "v"));
+    }
+    ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  }
+  const int last = config::kMaxMemCompactLevel;
+  ASSERT_EQ(NumTableFilesAtLevel(last), 1);
+  ASSERT_EQ(NumTableFilesAtLevel(last - 1), 1);
+  dbfull()->TEST_CompactRange(last - 1, nullptr, nullptr);
+  for (int i = 0; i < 100; i++) {
+    std::string value = Get(Key(i));
+    if (i % 3 == 0) {
+      ASSERT_EQ("NOT_FOUND", value);
+    } else {
+      ASSERT_EQ((i % 7 == 0 ? 200 : 10) + 8, value.size());
+    }
+  }
+  ASSERT_EQ("v", Get("short"));
+  std::string removed;
+  ASSERT_TRUE(
+      db_->GetProperty("leveldb.compaction-filter-removed-keys", &removed));
+  ASSERT_EQ("34", removed);
+
+  Close();
+  delete filter;
+}
+
+TEST_F(DBTest, MergeOperator) {
+  const MergeOperator* op = NewStringAppendOperator(',');
+  Options options = CurrentOptions();
+  options.enable_compaction = true;
+  options.merge_operator = op;
+  Reopen(&options);
+
+  // Operands apply to the value under them, or to nothing.
+  ASSERT_LEVELDB_OK(Merge("a", "1"));
+  ASSERT_LEVELDB_OK(Put("b", "x"));
+  ASSERT_LEVELDB_OK(Merge("b", "y"));
+  ASSERT_LEVELDB_OK(Merge("b", "z"));
+  ASSERT_LEVELDB_OK(Put("c", "old"));
+  ASSERT_LEVELDB_OK(Delete("c"));
+  ASSERT_LEVELDB_OK(Merge("c", "new"));
+  ASSERT_EQ("1", Get("a"));
+  ASSERT_EQ("x,y,z", Get("b"));
+  ASSERT_EQ("new", Get("c"));
+  ASSERT_EQ("(a->1)(b->x,y,z)(c->new)", Contents());
+
+  // Operands in the memtable apply to the values in the tables.
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  const Snapshot* snapshot = db_->GetSnapshot();
+  ASSERT_LEVELDB_OK(Merge("b", "w"));
+  ASSERT_LEVELDB_OK(Merge("d", "2"));
+  ASSERT_EQ("x,y,z,w", Get("b"));
+  ASSERT_EQ("x,y,z", Get("b", snapshot));
+  ASSERT_EQ("(a->1)(b->x,y,z,w)(c->new)(d->2)", Contents());
+
+  // Changing direction on a merged entry
+  Iterator* iter = db_->NewIterator(ReadOptions());
+  iter->Seek("b");
+  ASSERT_EQ(IterStatus(iter), "b->x,y,z,w");
+  iter->Prev();
+  ASSERT_EQ(IterStatus(iter), "a->1");
+  iter->Next();
+  ASSERT_EQ(IterStatus(iter), "b->x,y,z,w");
+  iter->Next();
+  ASSERT_EQ(IterStatus(iter), "c->new");
+  delete iter;
+
+  // The global index table finds the operands in the tables.
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ReadOptions git_options(1, true);
+  db_->BuildGlobalIndex(git_options);
+  std::string value;
+  ASSERT_LEVELDB_OK(db_->Get(git_options, "b", &value));
+  ASSERT_EQ("x,y,z,w", value);
+  ASSERT_LEVELDB_OK(db_->Get(git_options, "a", &value));
+  ASSERT_EQ("1", value);
+  db_->ReleaseSnapshot(snapshot);
+
+  // Writing operands needs an operator.
+  options.merge_operator = nullptr;
+  Reopen(&options);
+  ASSERT_TRUE(Merge("a", "2").IsInvalidArgument());
+  ASSERT_TRUE(Get("a").find("Invalid argument") != std::string::npos);
+
+  Close();
+  delete op;
+}
+
+TEST_F(DBTest, MergeOperatorCompaction) {
+  const MergeOperator* op = NewStringAppendOperator(',');
+  Options options = CurrentOptions();
+  options.enable_compaction = true;
+  options.merge_operator = op;
+  Reopen(&options);
+
+  ASSERT_LEVELDB_OK(Put("foo", "v"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  const int last = config::kMaxMemCompactLevel;
+  ASSERT_EQ(NumTableFilesAtLevel(last), 1);  // foo => v is now in last level
+
+  // Place a table at level last-1 to prevent merging with preceding mutation
+  ASSERT_LEVELDB_OK(Put("a", "begin"));
+  ASSERT_LEVELDB_OK(Put("z", "end"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ(NumTableFilesAtLevel(last), 1);
+  ASSERT_EQ(NumTableFilesAtLevel(last - 1), 1);
+
+  ASSERT_LEVELDB_OK(Merge("foo", "1"));
+  ASSERT_LEVELDB_OK(Merge("foo", "2"));
+  const Snapshot* snapshot = db_->GetSnapshot();
+  ASSERT_LEVELDB_OK(Merge("foo", "3"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());  // Moves to last-2
+  ASSERT_EQ(AllEntriesFor("foo"), "[ +3, +2, +1, v ]");
+
+  // Without the value, the operands the snapshot does not separate are
+  // combined.
+  dbfull()->TEST_CompactRange(last - 2, nullptr, nullptr);
+  ASSERT_EQ(AllEntriesFor("foo"), "[ +3, +1,2, v ]");
+  ASSERT_EQ("v,1,2,3", Get("foo"));
+  ASSERT_EQ("v,1,2", Get("foo", snapshot));
+
+  // With it, they are merged into a value.
+  db_->ReleaseSnapshot(snapshot);
+  dbfull()->TEST_CompactRange(last - 1, nullptr, nullptr);
+  ASSERT_EQ(AllEntriesFor("foo"), "[ v,1,2,3 ]");
+  ASSERT_EQ("v,1,2,3", Get("foo"));
+  ASSERT_EQ("(a->begin)(foo->v,1,2,3)(z->end)", Contents());
+
+  Close();
+  delete op;
+}
+
+TEST_F(DBTest, UInt64AddOperator) {
+  const MergeOperator* op = NewUInt64AddOperator();
+  Options options = CurrentOptions();
+  options.enable_compaction = true;
+  options.merge_operator = op;
+  options.block_size = 256;  // The operands of "all" span several blocks
+  Reopen(&options);
+
+  std::string one, value;
+  PutFixed64(&one, 1);
+  for (int i = 0; i < 100; i++) {
+    ASSERT_LEVELDB_OK(Merge(Key(i % 10), one));
+    ASSERT_LEVELDB_OK(Merge("all", one));
+    if (i % 30 == 29) {
+      ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+    }
+  }
+  for (int i = 0; i < 10; i++) {
+    value = Get(Key(i));
+    ASSERT_EQ(8, value.size());
+    ASSERT_EQ(10, DecodeFixed64(value.data()));
+  }
+  ReadOptions git_options(1, true);
+  db_->BuildGlobalIndex(git_options);
+  for (const ReadOptions& ropts : {ReadOptions(), git_options}) {
+    ASSERT_LEVELDB_OK(db_->Get(ropts, "all", &value));
+    ASSERT_EQ(100, DecodeFixed64(value.data()));
+  }
+  dbfull()->CompactRange(nullptr, nullptr);
+  ASSERT_EQ(100, DecodeFixed64(Get("all").data()));
+  for (int i = 0; i < 10; i++) {
+    value = Get(Key(i));
+    ASSERT_EQ(8, value.size());
+    ASSERT_EQ(10, DecodeFixed64(value.data()));
+  }
+
+  // Operands the operator cannot apply read as corruption.
+  ASSERT_LEVELDB_OK(Merge(Key(0), "bad"));
+  ASSERT_TRUE(Get(Key(0)).find("Corruption") != std::string::npos);
+
+  Close();
+  delete op;
+}
+
+TEST_F(DBTest, TieredCompaction) {
+  Options options = CurrentOptions();
+  options.enable_compaction = true;
+  options.compaction_style = kCompactionStyleTiered;
+  options.write_buffer_size = 100000;  // Small write buffer
+  Reopen(&options);
+
+  const int kNumKeys = 2000;
+  Random rnd(301);
+  std::vector<std::string> values(kNumKeys);
+  for (int i = 0; i < 12000; i++) {
+    const int k = rnd.Uniform(kNumKeys);
+    if (rnd.OneIn(10)) {
+      values[k].clear();
+      ASSERT_LEVELDB_OK(Delete(Key(k)));
+    } else {
+      values[k] = RandomString(&rnd, 1000);
+      ASSERT_LEVELDB_OK(Put(Key(k), values[k]));
+    }
+  }
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+
+  // Every level-0 file and every non-empty level is a run.  Over a
+  // hundred flushes must be merged into fewer runs than slow writes down.
+  int runs;
+  for (int i = 0; i < 1000; i++) {
+    runs = NumTableFilesAtLevel(0);
+    for (int level = 1; level < config::kNumLevels; level++) {
+      if (NumTableFilesAtLevel(level) > 0) {
+        runs++;
+      }
+    }
+    if (runs < config::kL0_SlowdownWritesTrigger) {
+      break;
+    }
+    env_->SleepForMicroseconds(10000);
+  }
+  ASSERT_LT(runs, config::kL0_SlowdownWritesTrigger);
+
+  std::string written;
+  ASSERT_TRUE(db_->GetProperty("leveldb.table-bytes-written", &written));
+  ASSERT_LT(0, std::stoull(written));
+
+  // Each run gets its own table in the global index, which merges them
+  // like the runs themselves.
+  ReadOptions git_options(1, true);
+  db_->BuildGlobalIndex(git_options);
+  Iterator* iter = db_->NewIterator(git_options);
+  int k = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next(), k++) {
+    while (values[k].empty()) k++;
+    ASSERT_EQ(Key(k), iter->key().ToString());
+    ASSERT_EQ(values[k], iter->value().ToString());
+  }
+  delete iter;
+
+  // The layout can be reopened with either style.
+  for (int pass = 0; pass < 2; pass++) {
+    for (int i = 0; i < kNumKeys; i++) {
+      ASSERT_EQ(values[i].empty() ? "NOT_FOUND" : values[i], Get(Key(i)));
+    }
+    iter = db_->NewIterator(ReadOptions());
+    k = 0;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next(), k++) {
+      while (values[k].empty()) k++;
+      ASSERT_EQ(Key(k), iter->key().ToString());
+      ASSERT_EQ(values[k], iter->value().ToString());
+    }
+    delete iter;
+    options.compaction_style = kCompactionStyleLevel;
+    Reopen(&options);
+  }
+}
+
+TEST_F(DBTest, DelayedWriteRate) {
+  // Recovery with a small write buffer leaves the log as many level-0
+  // files, past the slowdown trigger but short of the stop trigger.
+  Options options = CurrentOptions();
+  options.write_buffer_size = 10 << 20;
+  Reopen(&options);
+  Random rnd(301);
+  for (int i = 0; i < 450; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), RandomString(&rnd, 1000)));
+  }
+  options.write_buffer_size = 64 << 10;
+  options.delayed_write_rate = 64 << 10;
+  Reopen(&options);
+  ASSERT_GE(NumTableFilesAtLevel(0), config::kL0_SlowdownWritesTrigger);
+  ASSERT_LT(NumTableFilesAtLevel(0), config::kL0_StopWritesTrigger);
+
+  std::string rate, stall, pending;
+  ASSERT_TRUE(db_->GetProperty("leveldb.estimate-pending-compaction-bytes",
+                               &pending));
+  ASSERT_LT(0, std::stoull(pending));
+
+  // Writes are paced at the configured rate: 20KB take about 300ms.
+  const uint64_t start = env_->NowMicros();
+  for (int i = 0; i < 20; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), RandomString(&rnd, 1000)));
+  }
+  ASSERT_LE(200000, env_->NowMicros() - start);
+  ASSERT_TRUE(db_->GetProperty("leveldb.actual-delayed-write-rate", &rate));
+  ASSERT_EQ(std::to_string(64 << 10), rate);
+  ASSERT_TRUE(db_->GetProperty("leveldb.write-stall-micros", &stall));
+  ASSERT_LE(200000, std::stoull(stall));
+
+  // Without a rate every write is delayed by a fixed 1ms.
+  options.delayed_write_rate = 0;
+  Reopen(&options);
+  for (int i = 0; i < 20; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), "v"));
+  }
+  ASSERT_TRUE(db_->GetProperty("leveldb.actual-delayed-write-rate", &rate));
+  ASSERT_EQ("0", rate);
+  ASSERT_TRUE(db_->GetProperty("leveldb.write-stall-micros", &stall));
+  ASSERT_EQ("20000", stall);
+}
+
+TEST_F(DBTest, RateLimiter) {
+  Options options = CurrentOptions();
+  options.enable_compaction = true;
+  options.write_buffer_size = 100000;  // Small write buffer
+  std::unique_ptr<RateLimiter> limiter(NewGenericRateLimiter(4 << 20));
+  options.rate_limiter = limiter.get();
+  Reopen(&options);
+
+  // Keys are written in random order so that no compaction is a trivial
+  // move.
+  Random rnd(301);
+  for (int i = 0; i < 500; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(rnd.Uniform(250)), RandomString(&rnd, 1000)));
+  }
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_LT(400000, limiter->GetTotalBytesThrough(RateLimiter::kFlush));
+
+  // Compactions charge both the input they read and the output they write.
+  const uint64_t flushed = limiter->GetTotalBytesThrough(RateLimiter::kFlush);
+  dbfull()->TEST_CompactRange(0, nullptr, nullptr);
+  ASSERT_LT(400000, limiter->GetTotalBytesThrough(RateLimiter::kCompaction));
+  ASSERT_EQ(flushed, limiter->GetTotalBytesThrough(RateLimiter::kFlush));
+  ASSERT_EQ(0, NumTableFilesAtLevel(0));
+
+  std::string throttled;
+  ASSERT_TRUE(db_->GetProperty("leveldb.rate-limiter-throttled-bytes",
+                               &throttled));
+  ASSERT_EQ(limiter->GetThrottledBytes(RateLimiter::kFlush) +
+                limiter->GetThrottledBytes(RateLimiter::kCompaction),
+            std::stoull(throttled));
+  Close();
+}
+
 TEST_F(DBTest, RepeatedWritesToSameKey) {
   Options options = CurrentOptions();
   options.env = env_;
@@ -1942,6 +2956,82 @@ TEST_F(DBTest, BloomFilter) {
   delete options.filter_policy;
 }
 
+TEST_F(DBTest, BlockCacheCounters) {
+  // Blocks read from memory-mapped tables are not cached, so keep the
+  // tables in memory.
+  std::unique_ptr<Env> mem_env(NewMemEnv(env_));
+  Options options = CurrentOptions();
+  options.env = mem_env.get();
+  options.create_if_missing = true;
+  options.enable_compaction = true;
+  options.block_size = 1024;
+  options.compression = kSnappyCompression;
+  options.block_cache = NewLRUCache(1 << 20);
+  options.compressed_block_cache = NewLRUCache(1 << 20);
+  DestroyAndReopen(&options);
+
+  Random rnd(301);
+  std::string tmp;
+  std::vector<std::string> values(50);
+  for (int i = 0; i < 50; i++) {
+    values[i] = test::CompressibleString(&rnd, 0.25, 1000, &tmp).ToString();
+    ASSERT_LEVELDB_OK(Put(Key(i), values[i]));
+  }
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+
+  auto counter = [&](const char* name) {
+    std::string value;
+    EXPECT_TRUE(db_->GetProperty(name, &value));
+    return std::stoull(value);
+  };
+  auto read_all = [&]() {
+    for (int i = 0; i < 50; i++) {
+      ASSERT_EQ(values[i], Get(Key(i)));
+    }
+  };
+
+  // The first reads miss both tiers; the second ones hit the block cache.
+  read_all();
+  const uint64_t misses = counter("leveldb.block-cache-misses");
+  ASSERT_LT(0, misses);
+  ASSERT_EQ(misses, counter("leveldb.compressed-block-cache-misses"));
+  ASSERT_EQ(0, counter("leveldb.compressed-block-cache-hits"));
+  const uint64_t hits = counter("leveldb.block-cache-hits");
+  read_all();
+  ASSERT_LT(hits, counter("leveldb.block-cache-hits"));
+  ASSERT_EQ(misses, counter("leveldb.block-cache-misses"));
+  ASSERT_EQ(misses, counter("leveldb.compressed-block-cache-misses"));
+
+  // Without room in the block cache every read goes to the compressed
+  // tier, which serves the second reads if the blocks were compressed.
+  Close();
+  delete options.block_cache;
+  options.block_cache = NewLRUCache(0);
+  Reopen(&options);
+  read_all();
+  const uint64_t compressed_misses =
+      counter("leveldb.compressed-block-cache-misses");
+  ASSERT_LT(0, compressed_misses);
+  ASSERT_EQ(compressed_misses, counter("leveldb.block-cache-misses"));
+  read_all();
+  const uint64_t compressed_hits =
+      counter("leveldb.compressed-block-cache-hits");
+  std::string compressed;
+  if (port::Snappy_Compress(values[0].data(), values[0].size(),
+                            &compressed)) {
+    ASSERT_LT(0, compressed_hits);
+    ASSERT_EQ(compressed_misses,
+              counter("leveldb.compressed-block-cache-misses"));
+  } else {
+    ASSERT_EQ(0, compressed_hits);
+  }
+  ASSERT_EQ(0, counter("leveldb.block-cache-hits"));
+
+  Close();
+  delete options.block_cache;
+  delete options.compressed_block_cache;
+}
+
 // Multi-threaded test:
 namespace {
 
@@ -2039,6 +3129,360 @@ TEST_F(DBTest, MultiThreaded) {
   } while (ChangeOptions());
 }
 
+TEST_F(DBTest, MemTableRepFactories) {
+  std::unique_ptr<MemTableRepFactory> factories[] = {
+      std::unique_ptr<MemTableRepFactory>(NewVectorRepFactory()),
+      std::unique_ptr<MemTableRepFactory>(NewHashSkipListRepFactory(4)),
+  };
+  for (const auto& factory : factories) {
+    SCOPED_TRACE(factory->Name());
+    Options options = CurrentOptions();
+    options.memtable_factory = factory.get();
+    options.create_if_missing = true;
+    options.write_buffer_size = 100000;  // Small write buffer
+    options.enable_compaction = true;
+    DestroyAndReopen(&options);
+
+    // Enough to go through several memtables.
+    Random rnd(301);
+    std::map<std::string, std::string> model;
+    for (int i = 0; i < 2000; i++) {
+      std::string key = Key(rnd.Uniform(1000));
+      std::string value = RandomString(&rnd, 100);
+      ASSERT_LEVELDB_OK(Put(key, value));
+      model[key] = value;
+      if (i % 7 == 0) {
+        key = Key(rnd.Uniform(1000));
+        ASSERT_LEVELDB_OK(Delete(key));
+        model.erase(key);
+      }
+    }
+
+    for (int reopen = 0; reopen < 2; reopen++) {
+      for (int i = 0; i < 1000; i++) {
+        std::map<std::string, std::string>::const_iterator it =
+            model.find(Key(i));
+        ASSERT_EQ(it == model.end() ? "NOT_FOUND" : it->second, Get(Key(i)));
+      }
+      Iterator* iter = db_->NewIterator(ReadOptions());
+      std::map<std::string, std::string>::const_iterator expected =
+          model.begin();
+      for (iter->SeekToFirst(); iter->Valid(); iter->Next(), ++expected) {
+        ASSERT_TRUE(expected != model.end());
+        ASSERT_EQ(expected->first, iter->key().ToString());
+        ASSERT_EQ(expected->second, iter->value().ToString());
+      }
+      ASSERT_TRUE(expected == model.end());
+      delete iter;
+      Reopen(&options);
+    }
+  }
+  Close();
+}
+
+namespace {
+
+// Writes "count" keys from Key(first) on to an external table at "path",
+// each with "value", or deleted if value is null.
+Status WriteExternalFile(const Options& options, const std::string& path,
+                         int first, int count, const char* value) {
+  SstFileWriter writer(options);
+  Status s = writer.Open(path);
+  for (int i = first; s.ok() && i < first + count; i++) {
+    s = value == nullptr ? writer.Delete(Key(i)) : writer.Put(Key(i), value);
+  }
+  if (s.ok()) {
+    s = writer.Finish();
+  }
+  return s;
+}
+
+}  // namespace
+
+TEST_F(DBTest, SstFileWriter) {
+  Options options = CurrentOptions();
+  const std::string path = dbname_ + "_external.ldb";
+  SstFileWriter writer(options);
+  ASSERT_TRUE(writer.Put("a", "v").IsInvalidArgument());  // Not open
+  ASSERT_LEVELDB_OK(writer.Open(path));
+  ASSERT_LEVELDB_OK(writer.Put("b", "v"));
+  ASSERT_TRUE(writer.Put("b", "v").IsInvalidArgument());
+  ASSERT_TRUE(writer.Put("a", "v").IsInvalidArgument());
+  ASSERT_LEVELDB_OK(writer.Delete("c"));
+  uint64_t file_size = 0;
+  ASSERT_LEVELDB_OK(writer.Finish(&file_size));
+  uint64_t actual_size;
+  ASSERT_LEVELDB_OK(env_->GetFileSize(path, &actual_size));
+  ASSERT_EQ(file_size, actual_size);
+
+  // A table needs at least one entry.
+  ASSERT_LEVELDB_OK(writer.Open(path));
+  ASSERT_TRUE(writer.Finish().IsInvalidArgument());
+  ASSERT_TRUE(!env_->FileExists(path));
+}
+
+TEST_F(DBTest, IngestExternalFile) {
+  const std::string path1 = dbname_ + "_external1.ldb";
+  const std::string path2 = dbname_ + "_external2.ldb";
+  for (int enable_compaction = 0; enable_compaction < 2; enable_compaction++) {
+    SCOPED_TRACE(enable_compaction ? "compaction" : "no compaction");
+    Options options = CurrentOptions();
+    options.create_if_missing = true;
+    options.enable_compaction = enable_compaction;
+    DestroyAndReopen(&options);
+    IngestExternalFileOptions ingest_options;
+
+    // A range new to the database goes to the last level unchanged.
+    ASSERT_LEVELDB_OK(Put(Key(500), "mem"));
+    ASSERT_LEVELDB_OK(WriteExternalFile(options, path1, 0, 100, "a"));
+    ASSERT_LEVELDB_OK(db_->IngestExternalFile(ingest_options, {path1}));
+    ASSERT_EQ(1, NumTableFilesAtLevel(config::kNumLevels - 1));
+    ASSERT_EQ(1, TotalTableFiles());
+    ASSERT_EQ("a", Get(Key(0)));
+    ASSERT_EQ("a", Get(Key(99)));
+    ASSERT_EQ("mem", Get(Key(500)));
+
+    // Files must not overlap each other, and must be tables of entries
+    // with sequence number zero.
+    ASSERT_LEVELDB_OK(WriteExternalFile(options, path1, 200, 10, "x"));
+    ASSERT_LEVELDB_OK(WriteExternalFile(options, path2, 205, 10, "x"));
+    ASSERT_TRUE(
+        db_->IngestExternalFile(ingest_options, {path1, path2})
+            .IsInvalidArgument());
+    ASSERT_TRUE(
+        !db_->IngestExternalFile(ingest_options, {dbname_ + "/CURRENT"})
+             .ok());
+    ASSERT_EQ("NOT_FOUND", Get(Key(200)));
+
+    // Overlapping the memtable writes it out first, unless not allowed.
+    ASSERT_LEVELDB_OK(Put(Key(150), "mem"));
+    ASSERT_LEVELDB_OK(WriteExternalFile(options, path1, 140, 20, "b"));
+    ingest_options.allow_blocking_flush = false;
+    ASSERT_TRUE(
+        db_->IngestExternalFile(ingest_options, {path1}).IsInvalidArgument());
+    ASSERT_EQ("mem", Get(Key(150)));
+    ingest_options.allow_blocking_flush = true;
+    const Snapshot* snapshot = db_->GetSnapshot();
+    ASSERT_LEVELDB_OK(db_->IngestExternalFile(ingest_options, {path1}));
+    ASSERT_EQ("b", Get(Key(150)));
+    ASSERT_EQ("mem", Get(Key(150), snapshot));
+    ASSERT_EQ("NOT_FOUND", Get(Key(140), snapshot));
+    db_->ReleaseSnapshot(snapshot);
+
+    // Overlapping tables get a newer sequence number, and deletions in
+    // a file hide older values.  Moved files are gone from their path.
+    ASSERT_LEVELDB_OK(WriteExternalFile(options, path1, 50, 10, "c"));
+    ASSERT_LEVELDB_OK(WriteExternalFile(options, path2, 90, 60, nullptr));
+    ingest_options.move_files = true;
+    ASSERT_LEVELDB_OK(db_->IngestExternalFile(ingest_options, {path2, path1}));
+    ASSERT_TRUE(!env_->FileExists(path1));
+    ASSERT_TRUE(!env_->FileExists(path2));
+    ingest_options.move_files = false;
+
+    ASSERT_LEVELDB_OK(Put(Key(55), "d"));
+    for (int reopen = 0; reopen < 2; reopen++) {
+      ASSERT_EQ("a", Get(Key(49)));
+      ASSERT_EQ("c", Get(Key(50)));
+      ASSERT_EQ("d", Get(Key(55)));
+      ASSERT_EQ("a", Get(Key(89)));
+      ASSERT_EQ("NOT_FOUND", Get(Key(90)));
+      ASSERT_EQ("NOT_FOUND", Get(Key(149)));
+      ASSERT_EQ("b", Get(Key(150)));
+      ASSERT_EQ("mem", Get(Key(500)));
+      int count = 0;
+      Iterator* iter = db_->NewIterator(ReadOptions());
+      for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+        count++;
+      }
+      ASSERT_LEVELDB_OK(iter->status());
+      delete iter;
+      ASSERT_EQ(90 + 10 + 1, count);
+      Reopen(&options);
+    }
+  }
+  env_->RemoveFile(path1);
+  env_->RemoveFile(path2);
+  Close();
+}
+
+namespace {
+
+static const int kPipelinedWriters = 4;
+static const int kPipelinedWritesPerThread = 2000;
+
+struct PipelinedWriteThread {
+  DB* db;
+  int id;
+  std::atomic<bool>* done;
+};
+
+static void PipelinedWriteBody(void* arg) {
+  PipelinedWriteThread* t = reinterpret_cast<PipelinedWriteThread*>(arg);
+  char key[100];
+  for (int i = 0; i < kPipelinedWritesPerThread; i++) {
+    std::snprintf(key, sizeof(key), "%d.%06d", t->id, i);
+    ASSERT_LEVELDB_OK(t->db->Put(WriteOptions(), key, key));
+  }
+  t->done->store(true, std::memory_order_release);
+}
+
+}  // namespace
+
+TEST_F(DBTest, PipelinedWriteConcurrentWriters) {
+  Options options = CurrentOptions();
+  options.enable_pipelined_write = true;
+  options.create_if_missing = true;
+  DestroyAndReopen(&options);
+
+  std::atomic<bool> done[kPipelinedWriters];
+  PipelinedWriteThread thread[kPipelinedWriters];
+  for (int id = 0; id < kPipelinedWriters; id++) {
+    done[id].store(false, std::memory_order_release);
+    thread[id].db = db_;
+    thread[id].id = id;
+    thread[id].done = &done[id];
+    env_->StartThread(PipelinedWriteBody, &thread[id]);
+  }
+
+  // Write groups become visible in log order, so any snapshot must hold
+  // a prefix of each thread's writes.
+  bool running = true;
+  while (running) {
+    running = false;
+    for (int id = 0; id < kPipelinedWriters; id++) {
+      if (!done[id].load(std::memory_order_acquire)) running = true;
+    }
+    int count[kPipelinedWriters] = {0};
+    ReadOptions read_options;
+    read_options.snapshot = db_->GetSnapshot();
+    Iterator* iter = db_->NewIterator(read_options);
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      int id, index;
+      ASSERT_EQ(2, std::sscanf(iter->key().ToString().c_str(), "%d.%d", &id,
+                               &index));
+      ASSERT_EQ(count[id], index);
+      count[id]++;
+    }
+    ASSERT_LEVELDB_OK(iter->status());
+    delete iter;
+    db_->ReleaseSnapshot(read_options.snapshot);
+  }
+
+  char key[100];
+  for (int id = 0; id < kPipelinedWriters; id++) {
+    for (int i = 0; i < kPipelinedWritesPerThread; i++) {
+      std::snprintf(key, sizeof(key), "%d.%06d", id, i);
+      ASSERT_EQ(key, Get(key));
+    }
+  }
+}
+
+TEST_F(DBTest, ConcurrentMemTableWrite) {
+  Options options = CurrentOptions();
+  options.allow_concurrent_memtable_write = true;
+  options.create_if_missing = true;
+  DestroyAndReopen(&options);
+
+  std::atomic<bool> done[kPipelinedWriters];
+  PipelinedWriteThread thread[kPipelinedWriters];
+  for (int id = 0; id < kPipelinedWriters; id++) {
+    done[id].store(false, std::memory_order_release);
+    thread[id].db = db_;
+    thread[id].id = id;
+    thread[id].done = &done[id];
+    env_->StartThread(PipelinedWriteBody, &thread[id]);
+  }
+  for (int id = 0; id < kPipelinedWriters; id++) {
+    while (!done[id].load(std::memory_order_acquire)) {
+      env_->SleepForMicroseconds(1000);
+    }
+  }
+
+  // Every write is found, both in the memtables and after the log is
+  // replayed on reopen.
+  for (int pass = 0; pass < 2; pass++) {
+    char key[100];
+    for (int id = 0; id < kPipelinedWriters; id++) {
+      for (int i = 0; i < kPipelinedWritesPerThread; i++) {
+        std::snprintf(key, sizeof(key), "%d.%06d", id, i);
+        ASSERT_EQ(key, Get(key));
+      }
+    }
+    int count = 0;
+    Iterator* iter = db_->NewIterator(ReadOptions());
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      count++;
+    }
+    ASSERT_LEVELDB_OK(iter->status());
+    delete iter;
+    ASSERT_EQ(kPipelinedWriters * kPipelinedWritesPerThread, count);
+    Reopen(&options);
+  }
+}
+
+namespace {
+
+static const int kSyncWritesPerThread = 100;
+
+static void SyncWriteBody(void* arg) {
+  PipelinedWriteThread* t = reinterpret_cast<PipelinedWriteThread*>(arg);
+  WriteOptions write_options;
+  write_options.sync = true;
+  char key[100];
+  for (int i = 0; i < kSyncWritesPerThread; i++) {
+    std::snprintf(key, sizeof(key), "%d.%06d", t->id, i);
+    ASSERT_LEVELDB_OK(t->db->Put(write_options, key, key));
+  }
+  t->done->store(true, std::memory_order_release);
+}
+
+}  // namespace
+
+TEST_F(DBTest, LogSyncGroup) {
+  for (int pipelined = 0; pipelined < 2; pipelined++) {
+    SCOPED_TRACE(pipelined ? "pipelined" : "not pipelined");
+    Options options = CurrentOptions();
+    options.create_if_missing = true;
+    options.enable_pipelined_write = pipelined;
+    options.preallocate_log_file = true;
+    options.use_direct_io_for_log = true;
+    options.log_sync_delay_micros = 2000;
+    DestroyAndReopen(&options);
+
+    std::atomic<bool> done[kPipelinedWriters];
+    PipelinedWriteThread thread[kPipelinedWriters];
+    for (int id = 0; id < kPipelinedWriters; id++) {
+      done[id].store(false, std::memory_order_release);
+      thread[id].db = db_;
+      thread[id].id = id;
+      thread[id].done = &done[id];
+      env_->StartThread(SyncWriteBody, &thread[id]);
+    }
+    for (int id = 0; id < kPipelinedWriters; id++) {
+      while (!done[id].load(std::memory_order_acquire)) {
+        env_->SleepForMicroseconds(1000);
+      }
+    }
+
+    // Concurrent synced writes share syncs.
+    std::string syncs;
+    ASSERT_TRUE(db_->GetProperty("leveldb.log-syncs", &syncs));
+    ASSERT_GT(std::stoi(syncs), 0);
+    ASSERT_LT(std::stoi(syncs), kPipelinedWriters * kSyncWritesPerThread);
+
+    for (int pass = 0; pass < 2; pass++) {
+      char key[100];
+      for (int id = 0; id < kPipelinedWriters; id++) {
+        for (int i = 0; i < kSyncWritesPerThread; i++) {
+          std::snprintf(key, sizeof(key), "%d.%06d", id, i);
+          ASSERT_EQ(key, Get(key));
+        }
+      }
+      Reopen(&options);
+    }
+  }
+}
+
 namespace {
 typedef std::map<std::string, std::string> KVMap;
 }
@@ -2107,6 +3551,10 @@ class ModelDB : public DB {
     }
   }
   void CompactRange(const Slice* start, const Slice* end) override {}
+  Status IngestExternalFile(const IngestExternalFileOptions& options,
+                            const std::vector<std::string>& paths) override {
+    return Status::NotSupported("IngestExternalFile");
+  }
 
  private:
   class ModelIter : public Iterator {
@@ -76,6 +76,10 @@ Status Writer::AddRecord(const Slice& slice) {
     left -= fragment_length;
     begin = false;
   } while (s.ok() && left > 0);
+  if (s.ok()) {
+    // One write for all fragments of the record
+    s = dest_->Flush();
+  }
   return s;
 }
 
@@ -85,24 +89,20 @@ Status Writer::EmitPhysicalRecord(RecordType t, const char* ptr,
   assert(block_offset_ + kHeaderSize + length <= kBlockSize);
 
   // Format the header
-  char buf[kHeaderSize];
+  char* buf = record_buf_;
   buf[4] = static_cast<char>(length & 0xff);
   buf[5] = static_cast<char>(length >> 8);
   buf[6] = static_cast<char>(t);
 
-  // Compute the crc of the record type and the payload.
-  uint32_t crc = crc32c::Extend(type_crc_[t], ptr, length);
+  // Compute the crc of the record type and the payload while copying the
+  // payload in behind the header.
+  uint32_t crc =
+      crc32c::ExtendAndCopy(type_crc_[t], ptr, length, buf + kHeaderSize);
   crc = crc32c::Mask(crc);  // Adjust for storage
   EncodeFixed32(buf, crc);
 
   // Write the header and the payload
-  Status s = dest_->Append(Slice(buf, kHeaderSize));
-  if (s.ok()) {
-    s = dest_->Append(Slice(ptr, length));
-    if (s.ok()) {
-      s = dest_->Flush();
-    }
-  }
+  Status s = dest_->Append(Slice(buf, kHeaderSize + length));
   block_offset_ += kHeaderSize + length;
   return s;
 }
@@ -46,6 +46,9 @@ class Writer {
   // pre-computed to reduce the overhead of computing the crc of the
   // record type stored in the header.
   uint32_t type_crc_[kMaxRecordType + 1];
+
+  // A physical record is assembled here so that it is appended in one go.
+  char record_buf_[kBlockSize];
 };
 
 }  // namespace log
@@ -8,20 +8,25 @@
 #include <string>
 
 #include "db/dbformat.h"
-#include "db/skiplist.h"
 #include "leveldb/db.h"
+#include "leveldb/memtablerep.h"
 #include "util/arena.h"
 
 namespace leveldb {
 
 class InternalKeyComparator;
 class MemTableIterator;
+class MergeContext;
 
 class MemTable {
  public:
   // MemTables are reference counted.  The initial reference count
   // is zero and the caller must call Ref() at least once.
-  explicit MemTable(const InternalKeyComparator& comparator);
+  //
+  // Entries are indexed by a rep made by "rep_factory", or by a skiplist
+  // if it is null.
+  explicit MemTable(const InternalKeyComparator& comparator,
+                    MemTableRepFactory* rep_factory = nullptr);
 
   MemTable(const MemTable&) = delete;
   MemTable& operator=(const MemTable&) = delete;
@@ -56,30 +61,50 @@ class MemTable {
   void Add(SequenceNumber seq, ValueType type, const Slice& key,
            const Slice& value);
 
+  // Same as Add(), but may be called from several threads at once.
+  // REQUIRES: no Add() is running at the same time.
+  // REQUIRES: IsInsertConcurrentlySupported()
+  void AddConcurrently(SequenceNumber seq, ValueType type, const Slice& key,
+                       const Slice& value);
+
+  bool IsInsertConcurrentlySupported() const {
+    return rep_->IsInsertConcurrentlySupported();
+  }
+
+  // Called once no more entries will be added.
+  void MarkImmutable() { rep_->MarkReadOnly(); }
+
   // If memtable contains a value for key, store it in *value and return true.
   // If memtable contains a deletion for key, store a NotFound() error
   // in *status and return true.
   // Else, return false.
-  bool Get(const LookupKey& key, std::string* value, Status* s);
+  //
+  // The merge operands newer than the value or deletion, or all of them if
+  // false is returned, are pushed to "*merge_context".  Without a
+  // "merge_context", finding an operand stores a NotSupported() error in
+  // *status and returns true.
+  bool Get(const LookupKey& key, std::string* value, Status* s,
+           MergeContext* merge_context = nullptr);
 
  private:
   friend class MemTableIterator;
   friend class MemTableBackwardIterator;
 
-  struct KeyComparator {
+  struct KeyComparator : public MemTableRep::KeyComparator {
     const InternalKeyComparator comparator;
     explicit KeyComparator(const InternalKeyComparator& c) : comparator(c) {}
-    int operator()(const char* a, const char* b) const;
+    int operator()(const char* a, const char* b) const override;
   };
 
-  typedef SkipList<const char*, KeyComparator> Table;
-
   ~MemTable();  // Private since only Unref() should be used to delete it
 
+  void Add(SequenceNumber seq, ValueType type, const Slice& key,
+           const Slice& value, bool concurrently);
+
   KeyComparator comparator_;
   int refs_;
-  Arena<char> arena_;
-  Table table_;
+  Arena<char> arena_;  // Entries
+  MemTableRep* const rep_;
 };
 
 }  // namespace leveldb
@@ -0,0 +1,350 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/memtablerep.h"
+
+#include <algorithm>
+#include <atomic>
+#include <utility>
+#include <vector>
+
+#include "db/skiplist.h"
+#include "leveldb/slice.h"
+#include "port/port.h"
+#include "port/thread_annotations.h"
+#include "util/arena.h"
+#include "util/coding.h"
+#include "util/hash.h"
+#include "util/mutexlock.h"
+
+namespace leveldb {
+
+MemTableRep::KeyComparator::~KeyComparator() = default;
+
+MemTableRep::Iterator::~Iterator() = default;
+
+MemTableRep::~MemTableRep() = default;
+
+MemTableRepFactory::~MemTableRepFactory() = default;
+
+void MemTableRep::InsertConcurrently(const char* entry) {
+  assert(false);  // Only reps that support it may be called
+  Insert(entry);
+}
+
+void MemTableRep::Get(const char* key, void* arg,
+                      bool (*callback)(void* arg, const char* entry)) {
+  Iterator* iter = GetIterator();
+  for (iter->Seek(key); iter->Valid() && callback(arg, iter->key());
+       iter->Next()) {
+  }
+  delete iter;
+}
+
+namespace {
+
+// Adapts a MemTableRep::KeyComparator to the functor SkipList expects.
+struct SkipListCompare {
+  const MemTableRep::KeyComparator* cmp;
+  int operator()(const char* a, const char* b) const { return (*cmp)(a, b); }
+};
+
+typedef SkipList<const char*, SkipListCompare> EntryList;
+
+class SkipListIterator : public MemTableRep::Iterator {
+ public:
+  explicit SkipListIterator(const EntryList* list) : iter_(list) {}
+
+  bool Valid() const override { return iter_.Valid(); }
+  const char* key() const override { return iter_.key(); }
+  void Next() override { iter_.Next(); }
+  void Prev() override { iter_.Prev(); }
+  void Seek(const char* key) override { iter_.Seek(key); }
+  void SeekToFirst() override { iter_.SeekToFirst(); }
+  void SeekToLast() override { iter_.SeekToLast(); }
+
+ private:
+  EntryList::Iterator iter_;
+};
+
+class SkipListRep : public MemTableRep {
+ public:
+  explicit SkipListRep(const KeyComparator& cmp)
+      : list_(SkipListCompare{&cmp}, &arena_) {}
+
+  void Insert(const char* entry) override { list_.Insert(entry); }
+
+  bool IsInsertConcurrentlySupported() const override { return true; }
+
+  void InsertConcurrently(const char* entry) override {
+    list_.InsertConcurrently(entry);
+  }
+
+  size_t ApproximateMemoryUsage() override { return arena_.MemoryUsage(); }
+
+  void Get(const char* key, void* arg,
+           bool (*callback)(void* arg, const char* entry)) override {
+    // Avoids the heap-allocated iterator of the default.
+    EntryList::Iterator iter(&list_);
+    for (iter.Seek(key); iter.Valid() && callback(arg, iter.key());
+         iter.Next()) {
+    }
+  }
+
+  Iterator* GetIterator() override { return new SkipListIterator(&list_); }
+
+ private:
+  Arena<char> arena_;  // Skiplist nodes
+  EntryList list_;
+};
+
+// Iterates over a sorted array of entries, which it either owns or
+// borrows from a rep that no longer changes.
+class SortedVectorIterator : public MemTableRep::Iterator {
+ public:
+  // Borrows "*entries".
+  SortedVectorIterator(const MemTableRep::KeyComparator* cmp,
+                       const std::vector<const char*>* entries)
+      : cmp_(cmp), entries_(entries), pos_(entries->size()) {}
+
+  // Owns "entries", which must be sorted.
+  SortedVectorIterator(const MemTableRep::KeyComparator* cmp,
+                       std::vector<const char*>&& entries)
+      : cmp_(cmp),
+        owned_(std::move(entries)),
+        entries_(&owned_),
+        pos_(owned_.size()) {}
+
+  bool Valid() const override { return pos_ < entries_->size(); }
+
+  const char* key() const override {
+    assert(Valid());
+    return (*entries_)[pos_];
+  }
+
+  void Next() override {
+    assert(Valid());
+    pos_++;
+  }
+
+  void Prev() override {
+    assert(Valid());
+    pos_ = (pos_ == 0) ? entries_->size() : pos_ - 1;
+  }
+
+  void Seek(const char* key) override {
+    const MemTableRep::KeyComparator* cmp = cmp_;
+    pos_ = std::lower_bound(entries_->begin(), entries_->end(), key,
+                            [cmp](const char* a, const char* b) {
+                              return (*cmp)(a, b) < 0;
+                            }) -
+           entries_->begin();
+  }
+
+  void SeekToFirst() override { pos_ = 0; }
+
+  void SeekToLast() override {
+    pos_ = entries_->empty() ? 0 : entries_->size() - 1;
+  }
+
+ private:
+  const MemTableRep::KeyComparator* const cmp_;
+  std::vector<const char*> owned_;
+  const std::vector<const char*>* const entries_;
+  size_t pos_;
+};
+
+void SortEntries(const MemTableRep::KeyComparator* cmp,
+                 std::vector<const char*>* entries) {
+  std::sort(entries->begin(), entries->end(),
+            [cmp](const char* a, const char* b) { return (*cmp)(a, b) < 0; });
+}
+
+class VectorRep : public MemTableRep {
+ public:
+  VectorRep(const KeyComparator& cmp, size_t reserve)
+      : cmp_(cmp), read_only_(false), sorted_(false), memory_usage_(0) {
+    entries_.reserve(reserve);
+  }
+
+  void Insert(const char* entry) override {
+    MutexLock l(&mu_);
+    assert(!read_only_);
+    entries_.push_back(entry);
+    // Counts the slots in use rather than the capacity, so that a large
+    // "reserve" does not make the memtable look full.
+    memory_usage_.store(entries_.size() * sizeof(const char*),
+                        std::memory_order_relaxed);
+  }
+
+  void MarkReadOnly() override {
+    MutexLock l(&mu_);
+    read_only_ = true;
+  }
+
+  size_t ApproximateMemoryUsage() override {
+    return memory_usage_.load(std::memory_order_relaxed);
+  }
+
+  Iterator* GetIterator() override {
+    std::vector<const char*> copy;
+    {
+      MutexLock l(&mu_);
+      if (read_only_) {
+        // Sorted in place once; every later reader shares the result.
+        if (!sorted_) {
+          SortEntries(&cmp_, &entries_);
+          sorted_ = true;
+        }
+        return new SortedVectorIterator(&cmp_, &entries_);
+      }
+      copy = entries_;
+    }
+    SortEntries(&cmp_, &copy);
+    return new SortedVectorIterator(&cmp_, std::move(copy));
+  }
+
+ private:
+  const KeyComparator& cmp_;
+  port::Mutex mu_;
+  std::vector<const char*> entries_ GUARDED_BY(mu_);
+  bool read_only_ GUARDED_BY(mu_);
+  bool sorted_ GUARDED_BY(mu_);
+  std::atomic<size_t> memory_usage_;
+};
+
+class HashSkipListRep : public MemTableRep {
+ public:
+  HashSkipListRep(const KeyComparator& cmp, size_t prefix_length,
+                  size_t bucket_count)
+      : cmp_(cmp),
+        prefix_length_(prefix_length),
+        bucket_count_(std::max<size_t>(bucket_count, 1)),
+        buckets_(new std::atomic<EntryList*>[bucket_count_]) {
+    for (size_t i = 0; i < bucket_count_; i++) {
+      buckets_[i].store(nullptr, std::memory_order_relaxed);
+    }
+  }
+
+  ~HashSkipListRep() override {
+    for (size_t i = 0; i < bucket_count_; i++) {
+      delete buckets_[i].load(std::memory_order_relaxed);
+    }
+    delete[] buckets_;
+  }
+
+  void Insert(const char* entry) override {
+    std::atomic<EntryList*>* bucket = Bucket(entry);
+    EntryList* list = bucket->load(std::memory_order_relaxed);
+    if (list == nullptr) {
+      list = new EntryList(SkipListCompare{&cmp_}, &arena_);
+      // Publish the empty list to readers before adding to it.
+      bucket->store(list, std::memory_order_release);
+    }
+    list->Insert(entry);
+  }
+
+  // The bucket array is left out: it is a fixed cost that would make a
+  // small write buffer look full before the first insert.
+  size_t ApproximateMemoryUsage() override { return arena_.MemoryUsage(); }
+
+  void Get(const char* key, void* arg,
+           bool (*callback)(void* arg, const char* entry)) override {
+    EntryList* list = Bucket(key)->load(std::memory_order_acquire);
+    if (list == nullptr) {
+      return;
+    }
+    EntryList::Iterator iter(list);
+    for (iter.Seek(key); iter.Valid() && callback(arg, iter.key());
+         iter.Next()) {
+    }
+  }
+
+  // Entries are only ordered within a bucket, so a full iteration
+  // collects and sorts all of them.
+  Iterator* GetIterator() override {
+    std::vector<const char*> entries;
+    for (size_t i = 0; i < bucket_count_; i++) {
+      EntryList* list = buckets_[i].load(std::memory_order_acquire);
+      if (list == nullptr) continue;
+      EntryList::Iterator iter(list);
+      for (iter.SeekToFirst(); iter.Valid(); iter.Next()) {
+        entries.push_back(iter.key());
+      }
+    }
+    SortEntries(&cmp_, &entries);
+    return new SortedVectorIterator(&cmp_, std::move(entries));
+  }
+
+ private:
+  std::atomic<EntryList*>* Bucket(const char* entry) const {
+    // Entries and lookup keys start with a length-prefixed internal key.
+    uint32_t internal_key_size;
+    const char* p = GetVarint32Ptr(entry, entry + 5, &internal_key_size);
+    assert(internal_key_size >= 8);
+    const size_t user_key_size = internal_key_size - 8;
+    const size_t n = std::min(prefix_length_, user_key_size);
+    return &buckets_[Hash(p, n, 0) % bucket_count_];
+  }
+
+  const KeyComparator& cmp_;
+  const size_t prefix_length_;
+  const size_t bucket_count_;
+  std::atomic<EntryList*>* const buckets_;
+  Arena<char> arena_;  // Skiplist nodes of all buckets
+};
+
+class SkipListRepFactory : public MemTableRepFactory {
+ public:
+  MemTableRep* CreateMemTableRep(
+      const MemTableRep::KeyComparator& cmp) override {
+    return new SkipListRep(cmp);
+  }
+  const char* Name() const override { return "SkipListRepFactory"; }
+};
+
+class VectorRepFactory : public MemTableRepFactory {
+ public:
+  explicit VectorRepFactory(size_t reserve) : reserve_(reserve) {}
+
+  MemTableRep* CreateMemTableRep(
+      const MemTableRep::KeyComparator& cmp) override {
+    return new VectorRep(cmp, reserve_);
+  }
+  const char* Name() const override { return "VectorRepFactory"; }
+
+ private:
+  const size_t reserve_;
+};
+
+class HashSkipListRepFactory : public MemTableRepFactory {
+ public:
+  HashSkipListRepFactory(size_t prefix_length, size_t bucket_count)
+      : prefix_length_(prefix_length), bucket_count_(bucket_count) {}
+
+  MemTableRep* CreateMemTableRep(
+      const MemTableRep::KeyComparator& cmp) override {
+    return new HashSkipListRep(cmp, prefix_length_, bucket_count_);
+  }
+  const char* Name() const override { return "HashSkipListRepFactory"; }
+
+ private:
+  const size_t prefix_length_;
+  const size_t bucket_count_;
+};
+
+}  // namespace
+
+MemTableRepFactory* NewSkipListRepFactory() { return new SkipListRepFactory; }
+
+MemTableRepFactory* NewVectorRepFactory(size_t reserve) {
+  return new VectorRepFactory(reserve);
+}
+
+MemTableRepFactory* NewHashSkipListRepFactory(size_t prefix_length,
+                                              size_t bucket_count) {
+  return new HashSkipListRepFactory(prefix_length, bucket_count);
+}
+
+}  // namespace leveldb
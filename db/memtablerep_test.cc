@@ -0,0 +1,157 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/memtablerep.h"
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "db/dbformat.h"
+#include "db/memtable.h"
+#include "leveldb/comparator.h"
+#include "leveldb/iterator.h"
+#include "util/random.h"
+
+namespace leveldb {
+
+class MemTableRepTest : public testing::Test {
+ public:
+  MemTableRepTest() : icmp_(BytewiseComparator()) {
+    factories_.emplace_back(NewSkipListRepFactory());
+    factories_.emplace_back(NewVectorRepFactory());
+    // Few buckets so that several prefixes share one.
+    factories_.emplace_back(NewHashSkipListRepFactory(3, 7));
+  }
+
+  MemTable* NewMemTable(MemTableRepFactory* factory) {
+    MemTable* mem = new MemTable(icmp_, factory);
+    mem->Ref();
+    return mem;
+  }
+
+  static std::string Get(MemTable* mem, const std::string& key,
+                         SequenceNumber seq) {
+    std::string value;
+    Status s;
+    if (!mem->Get(LookupKey(key, seq), &value, &s)) {
+      return "MISSING";
+    }
+    return s.IsNotFound() ? "NOT_FOUND" : value;
+  }
+
+  InternalKeyComparator icmp_;
+  std::vector<std::unique_ptr<MemTableRepFactory>> factories_;
+};
+
+TEST_F(MemTableRepTest, Empty) {
+  for (const auto& factory : factories_) {
+    SCOPED_TRACE(factory->Name());
+    MemTable* mem = NewMemTable(factory.get());
+    ASSERT_EQ("MISSING", Get(mem, "foo", 100));
+    Iterator* iter = mem->NewIterator();
+    iter->SeekToFirst();
+    ASSERT_TRUE(!iter->Valid());
+    iter->Seek(InternalKey("foo", 100, kTypeValue).Encode());
+    ASSERT_TRUE(!iter->Valid());
+    iter->SeekToLast();
+    ASSERT_TRUE(!iter->Valid());
+    delete iter;
+    mem->Unref();
+  }
+}
+
+TEST_F(MemTableRepTest, Versions) {
+  for (const auto& factory : factories_) {
+    SCOPED_TRACE(factory->Name());
+    MemTable* mem = NewMemTable(factory.get());
+    mem->Add(1, kTypeValue, "foo", "v1");
+    mem->Add(2, kTypeValue, "bar", "b1");
+    mem->Add(3, kTypeValue, "foo", "v3");
+    mem->Add(4, kTypeDeletion, "foo", "");
+    mem->Add(5, kTypeValue, "foobar", "fb");
+
+    ASSERT_EQ("MISSING", Get(mem, "foo", 0));
+    ASSERT_EQ("v1", Get(mem, "foo", 1));
+    ASSERT_EQ("v1", Get(mem, "foo", 2));
+    ASSERT_EQ("v3", Get(mem, "foo", 3));
+    ASSERT_EQ("NOT_FOUND", Get(mem, "foo", 4));
+    ASSERT_EQ("NOT_FOUND", Get(mem, "foo", 100));
+    ASSERT_EQ("b1", Get(mem, "bar", 100));
+    ASSERT_EQ("fb", Get(mem, "foobar", 100));
+    ASSERT_EQ("MISSING", Get(mem, "fo", 100));
+    ASSERT_EQ("MISSING", Get(mem, "baz", 100));
+    mem->Unref();
+  }
+}
+
+TEST_F(MemTableRepTest, Iteration) {
+  for (const auto& factory : factories_) {
+    SCOPED_TRACE(factory->Name());
+    // Reads before and after the memtable turns immutable see the same
+    // entries in the same order.
+    for (int immutable = 0; immutable < 2; immutable++) {
+      MemTable* mem = NewMemTable(factory.get());
+      std::map<std::string, std::string> model;
+      Random rnd(301);
+      for (int i = 0; i < 2000; i++) {
+        std::string key = std::to_string(rnd.Uniform(500));
+        std::string value = std::to_string(i);
+        mem->Add(i + 1, kTypeValue, key, value);
+        model[key] = value;
+      }
+      if (immutable) {
+        mem->MarkImmutable();
+      }
+
+      for (int pass = 0; pass < 2; pass++) {
+        Iterator* iter = mem->NewIterator();
+        std::map<std::string, std::string>::const_iterator expected =
+            model.begin();
+        std::string last_user_key;
+        for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+          ParsedInternalKey ikey;
+          ASSERT_TRUE(ParseInternalKey(iter->key(), &ikey));
+          if (ikey.user_key == last_user_key) continue;  // Older version
+          ASSERT_TRUE(expected != model.end());
+          ASSERT_EQ(expected->first, ikey.user_key.ToString());
+          ASSERT_EQ(expected->second, iter->value().ToString());
+          last_user_key = ikey.user_key.ToString();
+          ++expected;
+        }
+        ASSERT_TRUE(expected == model.end());
+
+        iter->Seek(InternalKey("2", kMaxSequenceNumber, kTypeValue).Encode());
+        ASSERT_TRUE(iter->Valid());
+        ParsedInternalKey ikey;
+        ASSERT_TRUE(ParseInternalKey(iter->key(), &ikey));
+        ASSERT_EQ(model.lower_bound("2")->first, ikey.user_key.ToString());
+        iter->Prev();
+        ASSERT_TRUE(iter->Valid());
+        ASSERT_TRUE(ParseInternalKey(iter->key(), &ikey));
+        ASSERT_LT(ikey.user_key.ToString(), "2");
+
+        iter->SeekToLast();
+        ASSERT_TRUE(iter->Valid());
+        ASSERT_TRUE(ParseInternalKey(iter->key(), &ikey));
+        ASSERT_EQ(model.rbegin()->first, ikey.user_key.ToString());
+        delete iter;
+      }
+
+      for (const auto& kv : model) {
+        ASSERT_EQ(kv.second, Get(mem, kv.first, kMaxSequenceNumber));
+      }
+      mem->Unref();
+    }
+  }
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
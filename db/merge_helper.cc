@@ -0,0 +1,29 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/merge_helper.h"
+
+namespace leveldb {
+
+Status MergeOperands(const MergeOperator* op, const Slice& user_key,
+                     const Slice* existing_value,
+                     const std::vector<Slice>& operands, std::string* value) {
+  if (op == nullptr) {
+    return Status::InvalidArgument("merge operand without a merge operator",
+                                   user_key);
+  }
+  if (!op->FullMerge(user_key, existing_value, operands, value)) {
+    return Status::Corruption("merge operator failed", user_key);
+  }
+  return Status::OK();
+}
+
+Status MergeContext::Merge(const MergeOperator* op, const Slice& user_key,
+                           const Slice* existing_value,
+                           std::string* value) const {
+  std::vector<Slice> operands(operands_.rbegin(), operands_.rend());
+  return MergeOperands(op, user_key, existing_value, operands, value);
+}
+
+}  // namespace leveldb
@@ -0,0 +1,52 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// Helpers for applying the kTypeMerge operands of a key with
+// Options::merge_operator, shared by point lookups, iterators and
+// compactions.
+
+#ifndef STORAGE_LEVELDB_DB_MERGE_HELPER_H_
+#define STORAGE_LEVELDB_DB_MERGE_HELPER_H_
+
+#include <string>
+#include <vector>
+
+#include "leveldb/merge_operator.h"
+#include "leveldb/slice.h"
+#include "leveldb/status.h"
+
+namespace leveldb {
+
+// Store in "*value" the result of applying "operands", oldest first, to
+// "*existing_value", or to nothing if "existing_value" is nullptr.
+// Returns InvalidArgument if "op" is nullptr, and Corruption if "op"
+// rejects the operands.
+Status MergeOperands(const MergeOperator* op, const Slice& user_key,
+                     const Slice* existing_value,
+                     const std::vector<Slice>& operands, std::string* value);
+
+// The operands a point lookup found for a key.  The lookup goes from the
+// newest entry of the key to the oldest, so operands are pushed newest
+// first; the lookup continues until it finds a value or a deletion to
+// apply them to, or runs out of entries.
+class MergeContext {
+ public:
+  void PushOperand(const Slice& operand) {
+    operands_.push_back(operand.ToString());
+  }
+
+  bool empty() const { return operands_.empty(); }
+
+  // Store in "*value" the result of applying the operands to
+  // "*existing_value", or to nothing if "existing_value" is nullptr.
+  Status Merge(const MergeOperator* op, const Slice& user_key,
+               const Slice* existing_value, std::string* value) const;
+
+ private:
+  std::vector<std::string> operands_;  // Newest first
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_MERGE_HELPER_H_
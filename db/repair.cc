@@ -7,6 +7,7 @@
 // (2) We scan every table to compute
 //     (a) smallest/largest for the table
 //     (b) largest sequence number in the table
+//     (c) the blob file records the table references
 // (3) We generate descriptor contents:
 //      - log number is set to zero
 //      - next-file-number is set to 1 + largest file number we found
@@ -14,6 +15,8 @@
 //        all tables (see 2c)
 //      - compaction pointers are cleared
 //      - every table file is added at level 0
+//      - every blob file that a table references is added, with its
+//        unreferenced bytes counted as garbage
 //
 // Possible optimization 1:
 //   (a) Compute total size and use to pick appropriate max-level M
@@ -24,6 +27,9 @@
 //   Store per-table metadata (smallest, largest, largest-seq#, ...)
 //   in the table's meta section to speed up ScanTable.
 
+#include <map>
+
+#include "db/blob_file.h"
 #include "db/builder.h"
 #include "db/db_impl.h"
 #include "db/dbformat.h"
@@ -48,7 +54,7 @@ class Repairer {
       : dbname_(dbname),
         env_(options.env),
         icmp_(options.comparator),
-        ipolicy_(options.filter_policy),
+        ipolicy_(options.filter_policy, options.prefix_extractor),
         options_(SanitizeOptions(dbname, &icmp_, &ipolicy_, options)),
         owns_info_log_(options_.info_log != options.info_log),
         owns_cache_(options_.block_cache != options.block_cache),
@@ -119,6 +125,8 @@ class Repairer {
             logs_.push_back(number);
           } else if (type == kTableFile) {
             table_numbers_.push_back(number);
+          } else if (type == kBlobFile) {
+            blob_numbers_.push_back(number);
           } else {
             // Ignore other files
           }
@@ -203,7 +211,8 @@ class Repairer {
     FileMetaData meta;
     meta.number = next_file_number_++;
     Iterator* iter = mem->NewIterator();
-    status = BuildTable(dbname_, env_, options_, table_cache_, iter, &meta);
+    status = BuildTable(dbname_, env_, options_, table_cache_, iter, &meta,
+                        nullptr);
     delete iter;
     mem->Unref();
     mem = nullptr;
@@ -276,6 +285,13 @@ class Repairer {
       if (parsed.sequence > t.max_sequence) {
         t.max_sequence = parsed.sequence;
       }
+      BlobIndex index;
+      if (parsed.type == kTypeBlobIndex &&
+          index.DecodeFrom(iter->value()).ok()) {
+        std::pair<uint64_t, uint64_t>* refs = &blob_refs_[index.file_number];
+        refs->first++;
+        refs->second += index.record_size();
+      }
     }
     if (!iter->status().ok()) {
       status = iter->status();
@@ -371,6 +387,20 @@ class Repairer {
       edit_.AddFile(0, t.meta.number, t.meta.file_size, t.meta.smallest,
                     t.meta.largest);
     }
+    for (size_t i = 0; i < blob_numbers_.size(); i++) {
+      const uint64_t number = blob_numbers_[i];
+      auto refs = blob_refs_.find(number);
+      uint64_t file_size;
+      if (refs == blob_refs_.end() ||
+          !env_->GetFileSize(BlobFileName(dbname_, number), &file_size).ok() ||
+          file_size < refs->second.second) {
+        continue;
+      }
+      edit_.AddBlobFile(number, refs->second.first, file_size);
+      if (file_size > refs->second.second) {
+        edit_.AddBlobGarbage(number, 0, file_size - refs->second.second);
+      }
+    }
 
     // std::fprintf(stderr,
     //              "NewDescriptor:\n%s\n", edit_.DebugString().c_str());
@@ -437,6 +467,9 @@ class Repairer {
 
   std::vector<std::string> manifests_;
   std::vector<uint64_t> table_numbers_;
+  std::vector<uint64_t> blob_numbers_;
+  // (count, bytes) of the records referenced, by blob file
+  std::map<uint64_t, std::pair<uint64_t, uint64_t>> blob_refs_;
   std::vector<uint64_t> logs_;
   std::vector<TableInfo> tables_;
   uint64_t next_file_number_;
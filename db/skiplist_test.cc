@@ -6,6 +6,8 @@
 
 #include <atomic>
 #include <set>
+#include <thread>
+#include <vector>
 
 #include "gtest/gtest.h"
 #include "leveldb/env.h"
@@ -359,6 +361,57 @@ static void RunConcurrent(int run) {
   }
 }
 
+TEST(SkipTest, InsertConcurrently) {
+  const int kThreads = 4;
+  const int kPerThread = 20000;
+  Arena<char> arena;
+  Comparator cmp;
+  SkipList<Key, Comparator> list(cmp, &arena);
+
+  // A reader runs alongside the writers and must always see sorted keys.
+  std::atomic<bool> done(false);
+  std::thread reader([&]() {
+    while (!done.load(std::memory_order_acquire)) {
+      SkipList<Key, Comparator>::Iterator iter(&list);
+      Key last = 0;
+      bool first = true;
+      for (iter.SeekToFirst(); iter.Valid(); iter.Next()) {
+        ASSERT_TRUE(first || last < iter.key());
+        last = iter.key();
+        first = false;
+      }
+    }
+  });
+
+  std::vector<std::thread> writers;
+  for (int t = 0; t < kThreads; t++) {
+    writers.emplace_back([&list, t]() {
+      // Interleaved keys make the threads race for the same links.
+      Random rnd(301 + t);
+      for (int i = 0; i < kPerThread; i++) {
+        list.InsertConcurrently(
+            (static_cast<Key>(rnd.Next()) << 8 | t) * kPerThread + i);
+      }
+    });
+  }
+  for (std::thread& writer : writers) {
+    writer.join();
+  }
+  done.store(true, std::memory_order_release);
+  reader.join();
+
+  int count = 0;
+  Key last = 0;
+  SkipList<Key, Comparator>::Iterator iter(&list);
+  for (iter.SeekToFirst(); iter.Valid(); iter.Next()) {
+    ASSERT_TRUE(count == 0 || last < iter.key());
+    ASSERT_TRUE(list.Contains(iter.key()));
+    last = iter.key();
+    count++;
+  }
+  ASSERT_EQ(kThreads * kPerThread, count);
+}
+
 TEST(SkipTest, Concurrent1) { RunConcurrent(1); }
 TEST(SkipTest, Concurrent2) { RunConcurrent(2); }
 TEST(SkipTest, Concurrent3) { RunConcurrent(3); }
@@ -7,10 +7,14 @@
 #include "db/filename.h"
 #include "leveldb/env.h"
 #include "leveldb/table.h"
+#include "table/table_rep.h"
 #include "util/coding.h"
+#include "util/crc32c.h"
 
 namespace leveldb {
 
+// Blob files are cached with a null table, under their number followed
+// by a 'b' so that they do not collide with the table of the same number.
 struct TableAndFile {
   RandomAccessFile* file;
   Table* table;
@@ -29,6 +33,10 @@ static void UnrefEntry(void* arg1, void* arg2) {
   cache->Release(h);
 }
 
+static void DeleteScratch(void* arg1, void* arg2) {
+  delete[] reinterpret_cast<char*>(arg1);
+}
+
 TableCache::TableCache(const std::string& dbname, const Options& options,
                        int entries)
     : env_(options.env),
@@ -66,6 +74,9 @@ Status TableCache::FindTable(uint64_t file_number, uint64_t file_size,
     if (s.ok()) {
       s = Table::Open(options_, file, file_size, &table);
     }
+    if (s.ok()) {
+      table->rep_->cache_stats = &cache_stats_;
+    }
 
     if (!s.ok()) {
       assert(table == nullptr);
@@ -106,14 +117,17 @@ Iterator* TableCache::NewIterator(const ReadOptions& options,
 
 Status TableCache::Get(const ReadOptions& options, uint64_t file_number,
                        uint64_t file_size, const Slice& k, void* arg,
-                       void (*handle_result)(void*, const Slice&,
-                                             const Slice&)) {
+                       bool (*handle_result)(void*, const Slice&,
+                                             const Slice&, Cleanable*)) {
   Cache::Handle* handle = nullptr;
   Status s = FindTable(file_number, file_size, &handle);
   if (s.ok()) {
     Table* t = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
-    s = t->InternalGet(options, k, arg, handle_result);
-    cache_->Release(handle);
+    // Values read from a memory-mapped file point into the table, so the
+    // table goes with the block to whoever pins the value.
+    Cleanable table_pin;
+    table_pin.RegisterCleanup(&UnrefEntry, cache_, handle);
+    s = t->InternalGet(options, k, arg, handle_result, &table_pin);
   }
   return s;
 }
@@ -144,7 +158,7 @@ Status TableCache::GetByIndexBlock(const ReadOptions& options,
   if (s.ok()) {
     Table* t = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
     *d_iter = t->GetByIndex(options, value);
-    cache_->Release(handle);
+    (*d_iter)->RegisterCleanup(&UnrefEntry, cache_, handle);
   }
   return s;
 }
@@ -152,10 +166,85 @@ Status TableCache::GetByIndexBlock(const ReadOptions& options,
 
 
 
+Status TableCache::FindBlobFile(uint64_t file_number, Cache::Handle** handle) {
+  char buf[sizeof(file_number) + 1];
+  EncodeFixed64(buf, file_number);
+  buf[sizeof(file_number)] = 'b';
+  Slice key(buf, sizeof(buf));
+  *handle = cache_->Lookup(key);
+  if (*handle == nullptr) {
+    RandomAccessFile* file = nullptr;
+    Status s =
+        env_->NewRandomAccessFile(BlobFileName(dbname_, file_number), &file);
+    if (!s.ok()) {
+      return s;
+    }
+    TableAndFile* tf = new TableAndFile;
+    tf->file = file;
+    tf->table = nullptr;
+    *handle = cache_->Insert(key, tf, 1, &DeleteEntry);
+  }
+  return Status::OK();
+}
+
+Status TableCache::GetBlob(const ReadOptions& options,
+                           const Slice& blob_index, PinnableSlice* value) {
+  BlobIndex index;
+  Status s = index.DecodeFrom(blob_index);
+  if (!s.ok()) {
+    return s;
+  }
+  Cache::Handle* handle = nullptr;
+  s = FindBlobFile(index.file_number, &handle);
+  if (!s.ok()) {
+    return s;
+  }
+  RandomAccessFile* file =
+      reinterpret_cast<TableAndFile*>(cache_->Value(handle))->file;
+
+  const size_t n = static_cast<size_t>(index.record_size());
+  char* scratch = new char[n];
+  Slice record;
+  s = file->Read(index.offset, n, &record, scratch);
+  if (s.ok() && record.size() != n) {
+    s = Status::Corruption("truncated blob record");
+  }
+  if (s.ok() && options.verify_checksums) {
+    const uint32_t crc =
+        crc32c::Unmask(DecodeFixed32(record.data() + index.size));
+    if (crc32c::Value(record.data(), index.size) != crc) {
+      s = Status::Corruption("blob checksum mismatch");
+    }
+  }
+  if (!s.ok()) {
+    delete[] scratch;
+    cache_->Release(handle);
+    return s;
+  }
+
+  const Slice v(record.data(), index.size);
+  if (record.data() == scratch) {
+    cache_->Release(handle);
+    value->PinSlice(v, &DeleteScratch, scratch, nullptr);
+  } else {
+    // Read in place from a memory-mapped file
+    delete[] scratch;
+    value->PinSlice(v, &UnrefEntry, cache_, handle);
+  }
+  return s;
+}
+
 void TableCache::Evict(uint64_t file_number) {
   char buf[sizeof(file_number)];
   EncodeFixed64(buf, file_number);
   cache_->Erase(Slice(buf, sizeof(buf)));
 }
 
+void TableCache::EvictBlobFile(uint64_t file_number) {
+  char buf[sizeof(file_number) + 1];
+  EncodeFixed64(buf, file_number);
+  buf[sizeof(file_number)] = 'b';
+  cache_->Erase(Slice(buf, sizeof(buf)));
+}
+
 }  // namespace leveldb
@@ -10,11 +10,14 @@
 #include <cstdint>
 #include <string>
 
+#include "db/blob_file.h"
 #include "db/dbformat.h"
 #include "leveldb/cache.h"
+#include "leveldb/pinnable_slice.h"
 #include "leveldb/table.h"
 #include "port/port.h"
 #include "table/filter_block.h"
+#include "table/format.h"
 
 namespace leveldb {
 
@@ -36,10 +39,14 @@ class TableCache {
                         uint64_t file_size, Table** tableptr = nullptr);
 
   // If a seek to internal key "k" in specified file finds an entry,
-  // call (*handle_result)(arg, found_key, found_value).
+  // call (*handle_result)(arg, found_key, found_value, pinner), and again
+  // for the following entries for as long as it returns true.  The
+  // value stays valid, table included, until the cleanup functions of
+  // "pinner" run, so handle_result may take them over to keep it.
   Status Get(const ReadOptions& options, uint64_t file_number,
              uint64_t file_size, const Slice& k, void* arg,
-             void (*handle_result)(void*, const Slice&, const Slice&));
+             bool (*handle_result)(void*, const Slice&, const Slice&,
+                                   Cleanable*));
 
     // **********************************************
 
@@ -55,22 +62,38 @@ class TableCache {
     // Get the iterator of a data block into d_iter, given a file and an index.
     // @param file_number:
     // @param file_size: Both are info of the file that stores the index block
-    // @param d_iter: The secondary pointer to an iterator over data block
+    // @param d_iter: The secondary pointer to an iterator over data block,
+    //      which keeps the table open until it is deleted
     // @param value: The index information of that data block
     Status GetByIndexBlock(const ReadOptions& options, uint64_t file_number,
                            uint64_t file_size, Iterator** d_iter, Slice& value);
     // **********************************************
 
+    // Read the value that the encoded BlobIndex "blob_index" locates in a
+    // blob file into *value.  Values of memory-mapped files are pinned in
+    // place.  Blob files are kept open in the same cache as the tables.
+    // REQUIRES: !value->IsPinned()
+    Status GetBlob(const ReadOptions& options, const Slice& blob_index,
+                   PinnableSlice* value);
+
     // Evict any entry for the specified file number
     void Evict(uint64_t file_number);
 
+    // Evict any entry for the specified blob file number
+    void EvictBlobFile(uint64_t file_number);
+
+    // Block cache hit and miss counts of all tables opened by this cache.
+    const BlockCacheStats& cache_stats() const { return cache_stats_; }
+
    private:
     Status FindTable(uint64_t file_number, uint64_t file_size, Cache::Handle**);
+    Status FindBlobFile(uint64_t file_number, Cache::Handle**);
 
     Env* const env_;
     const std::string dbname_;
     const Options& options_;
     Cache* cache_;
+    BlockCacheStats cache_stats_;
 };
 
 }  // namespace leveldb
@@ -20,7 +20,9 @@ enum Tag {
   kDeletedFile = 6,
   kNewFile = 7,
   // 8 was used for large value refs
-  kPrevLogNumber = 9
+  kPrevLogNumber = 9,
+  kNewBlobFile = 10,
+  kBlobGarbage = 11
 };
 
 void VersionEdit::Clear() {
@@ -36,6 +38,8 @@ void VersionEdit::Clear() {
   has_last_sequence_ = false;
   deleted_files_.clear();
   new_files_.clear();
+  new_blob_files_.clear();
+  blob_garbage_.clear();
 }
 
 void VersionEdit::EncodeTo(std::string* dst) const {
@@ -81,6 +85,22 @@ void VersionEdit::EncodeTo(std::string* dst) const {
     PutLengthPrefixedSlice(dst, f.smallest.Encode());
     PutLengthPrefixedSlice(dst, f.largest.Encode());
   }
+
+  for (size_t i = 0; i < new_blob_files_.size(); i++) {
+    const BlobFileMetaData& b = new_blob_files_[i];
+    PutVarint32(dst, kNewBlobFile);
+    PutVarint64(dst, b.number);
+    PutVarint64(dst, b.total_count);
+    PutVarint64(dst, b.total_bytes);
+  }
+
+  for (size_t i = 0; i < blob_garbage_.size(); i++) {
+    const BlobFileMetaData& b = blob_garbage_[i];
+    PutVarint32(dst, kBlobGarbage);
+    PutVarint64(dst, b.number);
+    PutVarint64(dst, b.garbage_count);
+    PutVarint64(dst, b.garbage_bytes);
+  }
 }
 
 static bool GetInternalKey(Slice* input, InternalKey* dst) {
@@ -112,6 +132,7 @@ Status VersionEdit::DecodeFrom(const Slice& src) {
   int level;
   uint64_t number;
   FileMetaData f;
+  BlobFileMetaData b;
   Slice str;
   InternalKey key;
 
@@ -185,6 +206,28 @@ Status VersionEdit::DecodeFrom(const Slice& src) {
         }
         break;
 
+      case kNewBlobFile:
+        b = BlobFileMetaData();
+        if (GetVarint64(&input, &b.number) &&
+            GetVarint64(&input, &b.total_count) &&
+            GetVarint64(&input, &b.total_bytes)) {
+          new_blob_files_.push_back(b);
+        } else {
+          msg = "new-blob-file entry";
+        }
+        break;
+
+      case kBlobGarbage:
+        b = BlobFileMetaData();
+        if (GetVarint64(&input, &b.number) &&
+            GetVarint64(&input, &b.garbage_count) &&
+            GetVarint64(&input, &b.garbage_bytes)) {
+          blob_garbage_.push_back(b);
+        } else {
+          msg = "blob garbage";
+        }
+        break;
+
       default:
         msg = "unknown tag";
         break;
@@ -250,6 +293,24 @@ std::string VersionEdit::DebugString() const {
     r.append(" .. ");
     r.append(f.largest.DebugString());
   }
+  for (size_t i = 0; i < new_blob_files_.size(); i++) {
+    const BlobFileMetaData& b = new_blob_files_[i];
+    r.append("\n  AddBlobFile: ");
+    AppendNumberTo(&r, b.number);
+    r.append(" ");
+    AppendNumberTo(&r, b.total_count);
+    r.append(" ");
+    AppendNumberTo(&r, b.total_bytes);
+  }
+  for (size_t i = 0; i < blob_garbage_.size(); i++) {
+    const BlobFileMetaData& b = blob_garbage_[i];
+    r.append("\n  BlobGarbage: ");
+    AppendNumberTo(&r, b.number);
+    r.append(" ");
+    AppendNumberTo(&r, b.garbage_count);
+    r.append(" ");
+    AppendNumberTo(&r, b.garbage_bytes);
+  }
   r.append("\n}\n");
   return r;
 }
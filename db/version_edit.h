@@ -16,7 +16,12 @@ namespace leveldb {
 class VersionSet;
 
 struct FileMetaData {
-  FileMetaData() : refs(0), allowed_seeks(1 << 30), file_size(0) {}
+  FileMetaData()
+      : refs(0),
+        allowed_seeks(1 << 30),
+        number(0),
+        file_size(0),
+        being_compacted(false) {}
 
   int refs;
   int allowed_seeks;  // Seeks allowed until compaction
@@ -24,6 +29,25 @@ struct FileMetaData {
   uint64_t file_size;    // File size in bytes
   InternalKey smallest;  // Smallest internal key served by table
   InternalKey largest;   // Largest internal key served by table
+  bool being_compacted;  // Input of a running compaction; guarded by DB mutex
+};
+
+// Record counts of a blob file (see db/blob_file.h).  Records become
+// garbage as compactions drop the entries that reference them; the file
+// is deleted once all of them are garbage.
+struct BlobFileMetaData {
+  BlobFileMetaData()
+      : number(0),
+        total_count(0),
+        total_bytes(0),
+        garbage_count(0),
+        garbage_bytes(0) {}
+
+  uint64_t number;
+  uint64_t total_count;    // Records written
+  uint64_t total_bytes;    // File size in bytes
+  uint64_t garbage_count;  // Records no longer referenced
+  uint64_t garbage_bytes;  // Bytes of those records
 };
 
 class VersionEdit {
@@ -75,6 +99,25 @@ class VersionEdit {
     deleted_files_.insert(std::make_pair(level, file));
   }
 
+  // Add the blob file "number", holding "count" records in "bytes".
+  void AddBlobFile(uint64_t number, uint64_t count, uint64_t bytes) {
+    BlobFileMetaData b;
+    b.number = number;
+    b.total_count = count;
+    b.total_bytes = bytes;
+    new_blob_files_.push_back(b);
+  }
+
+  // Record that "count" records of the blob file "number", "bytes" in
+  // all, are no longer referenced.
+  void AddBlobGarbage(uint64_t number, uint64_t count, uint64_t bytes) {
+    BlobFileMetaData b;
+    b.number = number;
+    b.garbage_count = count;
+    b.garbage_bytes = bytes;
+    blob_garbage_.push_back(b);
+  }
+
   void EncodeTo(std::string* dst) const;
   Status DecodeFrom(const Slice& src);
 
@@ -99,6 +142,8 @@ class VersionEdit {
   std::vector<std::pair<int, InternalKey>> compact_pointers_;
   DeletedFileSet deleted_files_;
   std::vector<std::pair<int, FileMetaData>> new_files_;
+  std::vector<BlobFileMetaData> new_blob_files_;
+  std::vector<BlobFileMetaData> blob_garbage_;
 };
 
 }  // namespace leveldb
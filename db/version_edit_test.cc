@@ -29,6 +29,8 @@ TEST(VersionEditTest, EncodeDecode) {
                  InternalKey("zoo", kBig + 600 + i, kTypeDeletion));
     edit.RemoveFile(4, kBig + 700 + i);
     edit.SetCompactPointer(i, InternalKey("x", kBig + 900 + i, kTypeValue));
+    edit.AddBlobFile(kBig + 1100 + i, kBig + 1200 + i, kBig + 1300 + i);
+    edit.AddBlobGarbage(kBig + 1100 + i, i, kBig + 1400 + i);
   }
 
   edit.SetComparatorName("foo");
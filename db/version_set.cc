@@ -14,6 +14,7 @@
 #include "db/log_reader.h"
 #include "db/log_writer.h"
 #include "db/memtable.h"
+#include "db/merge_helper.h"
 #include "db/table_cache.h"
 #include "leveldb/env.h"
 #include "leveldb/table_builder.h"
@@ -229,22 +230,45 @@ Iterator* Version::NewConcatenatingIterator(const ReadOptions& options,
                                             int level) const {
   return NewTwoLevelIterator(
       new LevelFileNumIterator(vset_->icmp_, &files_[level]), &GetFileIterator,
-      vset_->table_cache_, options);
+      vset_->table_cache_, options, &vset_->icmp_);
+}
+
+// Returns true if the keys from "smallest" to "largest" all lie outside
+// the iterate bounds of "options".
+static bool OutsideIterateBounds(const Comparator* ucmp,
+                                 const ReadOptions& options,
+                                 const InternalKey& smallest,
+                                 const InternalKey& largest) {
+  return (options.iterate_lower_bound != nullptr &&
+          ucmp->Compare(largest.user_key(), *options.iterate_lower_bound) <
+              0) ||
+         (options.iterate_upper_bound != nullptr &&
+          ucmp->Compare(smallest.user_key(), *options.iterate_upper_bound) >=
+              0);
 }
 
 void Version::AddIteratorsForIndexBlock(const ReadOptions& options,
                                         std::vector<Iterator*>* iters) {
-  // Merge all level zero files together since they may overlap
+  const Comparator* ucmp = vset_->icmp_.user_comparator();
+
+  // Merge all level zero files together since they may overlap.  Files
+  // outside the iterate bounds are left out.
   for (size_t i = 0; i < files_[0].size(); i++) {
-    iters->push_back(vset_->table_cache_->NewIterator(
-        options, files_[0][i]->number, files_[0][i]->file_size));
+    FileMetaData* f = files_[0][i];
+    if (!OutsideIterateBounds(ucmp, options, f->smallest, f->largest)) {
+      iters->push_back(
+          vset_->table_cache_->NewIterator(options, f->number, f->file_size));
+    }
   }
 
   // For levels > 0, we can use a concatenating iterator that sequentially
   // walks through the non-overlapping files in the level, opening them
   // lazily.
   for (int level = 1; level < config::kNumLevels; level++) {
-    if (!files_[level].empty()) {
+    const std::vector<FileMetaData*>& files = files_[level];
+    if (!files.empty() &&
+        !OutsideIterateBounds(ucmp, options, files.front()->smallest,
+                              files.back()->largest)) {
       iters->push_back(NewConcatenatingIterator(options, level));
     }
   }
@@ -257,12 +281,17 @@ void Version::AddIteratorsForGlobalIndex(const ReadOptions& options,
   if (!global_index) {
     return;
   }
+  const SliceTransform* prefix_extractor =
+      options.prefix_same_as_start ? vset_->options_->prefix_extractor
+                                   : nullptr;
   // Merge all level zero files together since they may overlap
   std::vector<GlobalIndex::GITable*> index_files_level0 = global_index->Get_index_files_level0();
   size_t level0_size = index_files_level0.size();
   for (size_t i = 0; i < level0_size; i++) {
     Iterator* git_iter = new GITIter(index_files_level0[i]);
-    iters->push_back(NewTwoLevelIterator(git_iter, nullptr, table_cache, options));
+    iters->push_back(NewTwoLevelIterator(git_iter, nullptr, table_cache,
+                                         options, &vset_->icmp_,
+                                         prefix_extractor));
   }
 
   // Merge all levels that are > 0
@@ -270,7 +299,9 @@ void Version::AddIteratorsForGlobalIndex(const ReadOptions& options,
   size_t other_size = other_files.size();
   for (size_t i = 0; i < other_size; i++) {
     Iterator* git_iter = new GITIter(other_files[i]);
-    iters->push_back(NewTwoLevelIterator(git_iter, nullptr, table_cache, options));
+    iters->push_back(NewTwoLevelIterator(git_iter, nullptr, table_cache,
+                                         options, &vset_->icmp_,
+                                         prefix_extractor));
   }
 }
 
@@ -281,27 +312,40 @@ enum SaverState {
   kFound,
   kDeleted,
   kCorrupt,
+  kMerge,  // Found merge operands, but nothing they apply to yet
 };
 struct Saver {
   SaverState state;
   const Comparator* ucmp;
   Slice user_key;
-  std::string* value;
+  PinnableSlice* value;
+  bool is_blob_index;  // *value holds a BlobIndex
+  MergeContext* merge_context;
 };
 }  // namespace
-static void SaveValue(void* arg, const Slice& ikey, const Slice& v) {
+// Returns true to be called with the next entry as well, which holds an
+// older version of the key if it still has the same user key.
+static bool SaveValue(void* arg, const Slice& ikey, const Slice& v,
+                      Cleanable* value_pinner) {
   Saver* s = reinterpret_cast<Saver*>(arg);
   ParsedInternalKey parsed_key;
   if (!ParseInternalKey(ikey, &parsed_key)) {
     s->state = kCorrupt;
   } else {
     if (s->ucmp->Compare(parsed_key.user_key, s->user_key) == 0) {
-      s->state = (parsed_key.type == kTypeValue) ? kFound : kDeleted;
+      if (parsed_key.type == kTypeMerge) {
+        s->state = kMerge;
+        s->merge_context->PushOperand(v);
+        return true;
+      }
+      s->state = (parsed_key.type == kTypeDeletion) ? kDeleted : kFound;
+      s->is_blob_index = (parsed_key.type == kTypeBlobIndex);
       if (s->state == kFound) {
-        s->value->assign(v.data(), v.size());
+        s->value->PinSlice(v, value_pinner);
       }
     }
   }
+  return false;
 }
 
 static bool NewestFirst(FileMetaData* a, FileMetaData* b) {
@@ -326,7 +370,8 @@ void CheckIsSameResult(Saver saver_1, Saver saver_2) {
   // 1. both have found same value
   if (saver_1.state == kFound && saver_2.state == kFound 
       && *(saver_1.value) == *(saver_2.value)) {
-    std::cout << "Both found same value: " << *(saver_1.value) << std::endl;
+    std::cout << "Both found same value: " << saver_1.value->ToString()
+              << std::endl;
   } 
   // 2. both haven't found
   else if (saver_1.state != kFound && saver_2.state != kFound){
@@ -335,12 +380,14 @@ void CheckIsSameResult(Saver saver_1, Saver saver_2) {
   // 3. different result
   else {
     if (saver_1.state == kFound) {
-      std::cout << "w/o git, value is " << *(saver_1.value) << std::endl;
+      std::cout << "w/o git, value is " << saver_1.value->ToString()
+                << std::endl;
     } else { 
       std::cout << "w/o git, not found\n";
     }
     if (saver_2.state == kFound) {
-      std::cout << "w git, value is " << *(saver_2.value) << std::endl;
+      std::cout << "w git, value is " << saver_2.value->ToString()
+                << std::endl;
     } else { 
       std::cout << "w git, not found\n";
     }
@@ -662,8 +709,9 @@ void GlobalIndex::GlobalIndexBuilder(
 void GlobalIndex::SearchGITable(const ReadOptions& options, Slice internal_key,
                                 GITable* gitable_, GITable::Node** next_level_,
                                 void* arg_saver,
-                                void (*handle_result)(void*, const Slice&,
-                                                      const Slice&)) {
+                                bool (*handle_result)(void*, const Slice&,
+                                                      const Slice&,
+                                                      Cleanable*)) {
   Status s;
   
   GITable::Iterator* index_iter = nullptr;
@@ -688,11 +736,30 @@ void GlobalIndex::SearchGITable(const ReadOptions& options, Slice internal_key,
     vset->table_cache_->GetByIndexBlock(options, found_item.file_number,
                                         found_item.file_size, &block_iter,
                                         found_item.value);
-    block_iter->Seek(internal_key);
-    if (block_iter->Valid()) {
-      //std::cout << "my found key: " << block_iter->key().ToString()
-      //           << std::endl;
-      (*handle_result)(arg_saver, block_iter->key(), block_iter->value());
+    Block::SeekForGet(block_iter, internal_key);
+    //std::cout << "my found key: " << block_iter->key().ToString()
+    //           << std::endl;
+    while (block_iter->Valid() &&
+           (*handle_result)(arg_saver, block_iter->key(), block_iter->value(),
+                            block_iter)) {
+      // The older entries of a key may continue in the data block of the
+      // next index entry, which may be in the next file of the level.
+      block_iter->Next();
+      if (!block_iter->Valid() && block_iter->status().ok()) {
+        index_iter->Next();
+        if (!index_iter->Valid()) {
+          break;
+        }
+        SkipListItem next_item = index_iter->key();
+        Iterator* next_iter;
+        vset->table_cache_->GetByIndexBlock(options, next_item.file_number,
+                                            next_item.file_size, &next_iter,
+                                            next_item.value);
+        block_iter->DelegateCleanupsTo(next_iter);
+        delete block_iter;
+        block_iter = next_iter;
+        block_iter->SeekToFirst();
+      }
     }
     s = block_iter->status();
     delete block_iter;
@@ -725,8 +792,9 @@ bool GlobalIndex::SkipListItem::KeyMaybeInDataBlock(Slice internal_key, bool use
 
 bool GlobalIndex::GetFromGlobalIndex(const ReadOptions& options, 
                                  Slice internal_key, void* arg_saver, void* arg_stats,
-                                 void (*handle_result)(void*, const Slice&,
-                                                       const Slice&)) {
+                                 bool (*handle_result)(void*, const Slice&,
+                                                       const Slice&,
+                                                       Cleanable*)) {
   // TODO:
   assert(global_index_exists_);
   Saver* saver = reinterpret_cast<Saver*>(arg_saver);
@@ -788,15 +856,16 @@ void Version::ForEachOverlapping(Slice user_key, Slice internal_key, void* arg,
     if (num_files == 0) continue;
 
     // Binary search to find earliest index whose largest key >= internal_key.
-    uint32_t index = FindFile(vset_->icmp_, files_[level], internal_key);
-    if (index < num_files) {
+    // The older entries of user_key may continue in the files after it.
+    for (uint32_t index = FindFile(vset_->icmp_, files_[level], internal_key);
+         index < num_files; index++) {
       FileMetaData* f = files_[level][index];
       if (ucmp->Compare(user_key, f->smallest.user_key()) < 0) {
         // All of "f" is past any data for user_key
-      } else {
-        if (!(*func)(arg, level, f)) {
-          return;
-        }
+        break;
+      }
+      if (!(*func)(arg, level, f)) {
+        return;
       }
     }
   }
@@ -828,7 +897,9 @@ int op_count = 0;
 clock_t running_time = 0;
 // get the value from lsm tree according to key
 Status Version::Get(const ReadOptions& options, const LookupKey& k,
-                    std::string* value, GetStats* stats, leveldb::GlobalIndex* global_index_) {
+                    PinnableSlice* value, GetStats* stats,
+                    leveldb::GlobalIndex* global_index_,
+                    MergeContext* merge_context) {
   stats->seek_file = nullptr;
   stats->seek_file_level = -1;
 
@@ -865,6 +936,7 @@ Status Version::Get(const ReadOptions& options, const LookupKey& k,
       }
       switch (state->saver.state) {
         case kNotFound:
+        case kMerge:
           return true;  // Keep searching in other files
         case kFound:
           state->found = true;
@@ -898,17 +970,24 @@ Status Version::Get(const ReadOptions& options, const LookupKey& k,
   state.saver.ucmp = vset_->icmp_.user_comparator();
   state.saver.user_key = k.user_key();
   state.saver.value = value;
+  state.saver.is_blob_index = false;
+  state.saver.merge_context = merge_context;
 
   // ***********************************************************
   // Counting Search time
   clock_t start_time, end_time;
-  // my_saver shows whether the key is found by using global index table
+  // my_saver shows whether the key is found by using global index table.
+  // It only needs a value of its own when both lookups run.
   Saver my_saver;
-  std::string my_value;
+  PinnableSlice my_value;
+  MergeContext my_merge_context(*merge_context);
   my_saver.state = kNotFound;
   my_saver.ucmp = vset_->icmp_.user_comparator();
   my_saver.user_key = k.user_key();
-  my_saver.value = &my_value;
+  my_saver.value = options.useIndexBlock() ? &my_value : value;
+  my_saver.is_blob_index = false;
+  my_saver.merge_context =
+      options.useIndexBlock() ? &my_merge_context : merge_context;
 
   start_time = clock();
   if (options.useIndexBlock()) {
@@ -932,13 +1011,33 @@ Status Version::Get(const ReadOptions& options, const LookupKey& k,
   if (options.useGITableAndIndexBlock()) {
     CheckIsSameResult(state.saver, my_saver);
   }
-  return (my_saver.state == kFound || my_saver.state == kDeleted ||
-          state.saver.state == kFound || state.saver.state == kDeleted)
-             ? Status::OK()
-             : Status::NotFound(Slice());
+  // A deletion marker hides older values, so it reads as not found.  So
+  // do merge operands with nothing older to apply them to; the caller
+  // merges them.
+  const Saver& result = options.useIndexBlock() ? state.saver : my_saver;
+  if (result.state != kFound) {
+    return Status::NotFound(Slice());
+  }
+  if (result.is_blob_index) {
+    const std::string blob_index = value->ToString();
+    value->Reset();
+    return vset_->table_cache_->GetBlob(options, blob_index, value);
+  }
+  return Status::OK();
   // return state.found ? state.s : Status::NotFound(Slice());
 }
 
+void Version::GetBlobFilesToCollect(double garbage_ratio,
+                                    std::set<uint64_t>* numbers) const {
+  for (const auto& kvp : blob_files_) {
+    const BlobFileMetaData& b = kvp.second;
+    if (b.garbage_bytes > 0 &&
+        b.garbage_bytes >= garbage_ratio * b.total_bytes) {
+      numbers->insert(b.number);
+    }
+  }
+}
+
 bool Version::UpdateStats(const GetStats& stats) {
   FileMetaData* f = stats.seek_file;
   if (f != nullptr) {
@@ -1034,6 +1133,27 @@ int Version::PickLevelForMemTableOutput(const Slice& smallest_user_key,
   return level;
 }
 
+int Version::PickLevelForExternalFile(const Slice& smallest_user_key,
+                                      const Slice& largest_user_key) {
+  int level = 0;
+  while (level + 1 < config::kNumLevels &&
+         !OverlapInLevel(level, &smallest_user_key, &largest_user_key) &&
+         !OverlapInLevel(level + 1, &smallest_user_key, &largest_user_key)) {
+    level++;
+  }
+  return level;
+}
+
+bool Version::OverlapInAnyLevel(const Slice& smallest_user_key,
+                                const Slice& largest_user_key) {
+  for (int level = 0; level < config::kNumLevels; level++) {
+    if (OverlapInLevel(level, &smallest_user_key, &largest_user_key)) {
+      return true;
+    }
+  }
+  return false;
+}
+
 // Store in "*inputs" all files in "level" that overlap [begin,end]
 void Version::GetOverlappingInputs(int level, const InternalKey* begin,
                                    const InternalKey* end,
@@ -1132,10 +1252,12 @@ class VersionSet::Builder {
   VersionSet* vset_;
   Version* base_;
   LevelState levels_[config::kNumLevels];
+  std::map<uint64_t, BlobFileMetaData> blob_files_;
 
  public:
   // Initialize a builder with the files from *base and other info from *vset
-  Builder(VersionSet* vset, Version* base) : vset_(vset), base_(base) {
+  Builder(VersionSet* vset, Version* base)
+      : vset_(vset), base_(base), blob_files_(base->blob_files_) {
     base_->Ref();
     BySmallestKey cmp;
     cmp.internal_comparator = &vset_->icmp_;
@@ -1206,10 +1328,31 @@ class VersionSet::Builder {
       levels_[level].deleted_files.erase(f->number);
       levels_[level].added_files->insert(f);
     }
+
+    // Add new blob files and their garbage
+    for (size_t i = 0; i < edit->new_blob_files_.size(); i++) {
+      const BlobFileMetaData& b = edit->new_blob_files_[i];
+      blob_files_[b.number] = b;
+    }
+    for (size_t i = 0; i < edit->blob_garbage_.size(); i++) {
+      const BlobFileMetaData& g = edit->blob_garbage_[i];
+      auto it = blob_files_.find(g.number);
+      if (it != blob_files_.end()) {
+        it->second.garbage_count += g.garbage_count;
+        it->second.garbage_bytes += g.garbage_bytes;
+      }
+    }
   }
 
   // Save the current state in *v.
   void SaveTo(Version* v) {
+    // A blob file that is all garbage is no longer referenced by any table
+    for (const auto& kvp : blob_files_) {
+      if (kvp.second.garbage_count < kvp.second.total_count) {
+        v->blob_files_.insert(kvp);
+      }
+    }
+
     BySmallestKey cmp;
     cmp.internal_comparator = &vset_->icmp_;
     for (int level = 0; level < config::kNumLevels; level++) {
@@ -1570,9 +1713,38 @@ void VersionSet::MarkFileNumberUsed(uint64_t number) {
 }
 
 void VersionSet::Finalize(Version* v) {
+  if (options_->compaction_style == kCompactionStyleTiered) {
+    // Every level-0 file and every non-empty level is a sorted run.  The
+    // runs are merged once there are as many as level-0 files trigger a
+    // leveled compaction, and all but the oldest need rewriting.
+    int runs = v->files_[0].size();
+    uint64_t total_bytes = TotalFileSize(v->files_[0]);
+    const FileMetaData* oldest = nullptr;
+    for (size_t i = 0; i < v->files_[0].size(); i++) {
+      if (oldest == nullptr || v->files_[0][i]->number < oldest->number) {
+        oldest = v->files_[0][i];
+      }
+    }
+    uint64_t oldest_bytes = (oldest != nullptr ? oldest->file_size : 0);
+    for (int level = 1; level < config::kNumLevels; level++) {
+      if (!v->files_[level].empty()) {
+        runs++;
+        oldest_bytes = TotalFileSize(v->files_[level]);
+        total_bytes += oldest_bytes;
+      }
+    }
+    v->compaction_level_ = 0;
+    v->compaction_score_ =
+        runs / static_cast<double>(config::kL0_CompactionTrigger);
+    v->pending_compaction_bytes_ =
+        v->compaction_score_ >= 1 ? total_bytes - oldest_bytes : 0;
+    return;
+  }
+
   // Precomputed best level for next compaction
   int best_level = -1;
   double best_score = -1;
+  uint64_t pending_bytes = 0;
 
   for (int level = 0; level < config::kNumLevels - 1; level++) {
     double score;
@@ -1590,13 +1762,20 @@ void VersionSet::Finalize(Version* v) {
       // overwrites/deletions).
       score = v->files_[level].size() /
               static_cast<double>(config::kL0_CompactionTrigger);
+      if (score >= 1) {
+        pending_bytes += TotalFileSize(v->files_[level]);
+      }
     } else {
       // Compute the ratio of current size to size limit.
       const uint64_t level_bytes = TotalFileSize(v->files_[level]);
-      score =
-          static_cast<double>(level_bytes) / MaxBytesForLevel(options_, level);
+      const double max_bytes = MaxBytesForLevel(options_, level);
+      score = static_cast<double>(level_bytes) / max_bytes;
+      if (level_bytes > max_bytes) {
+        pending_bytes += level_bytes - static_cast<uint64_t>(max_bytes);
+      }
     }
 
+    v->level_scores_[level] = score;
     if (score > best_score) {
       best_level = level;
       best_score = score;
@@ -1605,6 +1784,7 @@ void VersionSet::Finalize(Version* v) {
 
   v->compaction_level_ = best_level;
   v->compaction_score_ = best_score;
+  v->pending_compaction_bytes_ = pending_bytes;
 }
 
 Status VersionSet::WriteSnapshot(log::Writer* log) {
@@ -1632,6 +1812,15 @@ Status VersionSet::WriteSnapshot(log::Writer* log) {
     }
   }
 
+  // Save blob files
+  for (const auto& kvp : current_->blob_files_) {
+    const BlobFileMetaData& b = kvp.second;
+    edit.AddBlobFile(b.number, b.total_count, b.total_bytes);
+    if (b.garbage_count > 0) {
+      edit.AddBlobGarbage(b.number, b.garbage_count, b.garbage_bytes);
+    }
+  }
+
   std::string record;
   edit.EncodeTo(&record);
   return log->AddRecord(record);
@@ -1687,6 +1876,187 @@ uint64_t VersionSet::ApproximateOffsetOf(Version* v, const InternalKey& ikey) {
   return result;
 }
 
+void VersionSet::SplitCompaction(Compaction* c, int n,
+                                 std::vector<std::string>* boundaries) {
+  boundaries->clear();
+  if (n <= 1) {
+    return;
+  }
+
+  // Collect the last key and the size of every data block of the inputs.
+  // Level-0 inputs overlap, so the blocks rather than the files give an
+  // even spread of candidate cuts.
+  std::vector<std::pair<std::string, uint64_t>> blocks;
+  uint64_t total_bytes = 0;
+  for (int which = 0; which < c->num_input_levels(); which++) {
+    for (size_t i = 0; i < c->inputs_[which].size(); i++) {
+      FileMetaData* f = c->inputs_[which][i];
+      // Keep the table pinned in the cache while its index is read
+      Iterator* pin =
+          table_cache_->NewIterator(ReadOptions(), f->number, f->file_size);
+      Iterator* iiter = nullptr;
+      FilterBlockReader* filter = nullptr;
+      Status s = table_cache_->IndexFilterBlockGet(f->number, f->file_size,
+                                                   &iiter, &filter);
+      if (s.ok()) {
+        for (iiter->SeekToFirst(); iiter->Valid(); iiter->Next()) {
+          Slice input = iiter->value();
+          BlockHandle handle;
+          if (handle.DecodeFrom(&input).ok()) {
+            blocks.emplace_back(ExtractUserKey(iiter->key()).ToString(),
+                                handle.size());
+            total_bytes += handle.size();
+          }
+        }
+        delete iiter;
+      }
+      delete pin;
+    }
+  }
+  const Comparator* ucmp = icmp_.user_comparator();
+  std::sort(blocks.begin(), blocks.end(),
+            [ucmp](const std::pair<std::string, uint64_t>& a,
+                   const std::pair<std::string, uint64_t>& b) {
+              return ucmp->Compare(a.first, b.first) < 0;
+            });
+
+  // Cut after the block that crosses each multiple of total_bytes / n.
+  // A block ending with the last input key would leave an empty range.
+  uint64_t bytes_before = 0;
+  int next_range = 1;
+  for (size_t i = 0; i + 1 < blocks.size() && next_range < n; i++) {
+    bytes_before += blocks[i].second;
+    if (bytes_before * n < total_bytes * next_range) {
+      continue;
+    }
+    if (ucmp->Compare(blocks[i].first, blocks.back().first) >= 0 ||
+        (!boundaries->empty() &&
+         ucmp->Compare(blocks[i].first, boundaries->back()) <= 0)) {
+      continue;
+    }
+    boundaries->push_back(blocks[i].first);
+    while (next_range < n && bytes_before * n >= total_bytes * next_range) {
+      next_range++;
+    }
+  }
+}
+
+void VersionSet::SplitRange(Version* v, const Slice* begin, const Slice* end,
+                            int n, GlobalIndex* global_index,
+                            std::vector<std::string>* boundaries) {
+  boundaries->clear();
+  if (n <= 1) {
+    return;
+  }
+
+  // Collect the last keys of the data blocks inside the range
+  const Comparator* ucmp = icmp_.user_comparator();
+  std::vector<std::string> candidates;
+  auto add_candidate = [&](const Slice& internal_key) {
+    Slice user_key = ExtractUserKey(internal_key);
+    if ((begin == nullptr || ucmp->Compare(user_key, *begin) > 0) &&
+        (end == nullptr || ucmp->Compare(user_key, *end) < 0)) {
+      candidates.push_back(user_key.ToString());
+    }
+  };
+  if (global_index != nullptr) {
+    // The global index keeps the block boundaries in memory
+    std::vector<GlobalIndex::GITable*> gitables =
+        global_index->Get_index_files_level0();
+    std::vector<GlobalIndex::GITable*> others =
+        global_index->Get_index_files_();
+    gitables.insert(gitables.end(), others.begin(), others.end());
+    for (size_t i = 0; i < gitables.size(); i++) {
+      GITIter iter(gitables[i]);
+      for (iter.SeekToFirst(); iter.Valid(); iter.Next()) {
+        add_candidate(iter.Item().key);
+      }
+    }
+  } else {
+    for (int level = 0; level < config::kNumLevels; level++) {
+      for (FileMetaData* f : v->files_[level]) {
+        if ((begin != nullptr &&
+             ucmp->Compare(f->largest.user_key(), *begin) < 0) ||
+            (end != nullptr &&
+             ucmp->Compare(f->smallest.user_key(), *end) >= 0)) {
+          continue;
+        }
+        // Keep the table pinned in the cache while its index is read
+        Iterator* pin =
+            table_cache_->NewIterator(ReadOptions(), f->number, f->file_size);
+        Iterator* iiter = nullptr;
+        FilterBlockReader* filter = nullptr;
+        Status s = table_cache_->IndexFilterBlockGet(f->number, f->file_size,
+                                                     &iiter, &filter);
+        if (s.ok()) {
+          for (iiter->SeekToFirst(); iiter->Valid(); iiter->Next()) {
+            add_candidate(iiter->key());
+          }
+          delete iiter;
+        }
+        delete pin;
+      }
+    }
+  }
+  std::sort(candidates.begin(), candidates.end(),
+            [ucmp](const std::string& a, const std::string& b) {
+              return ucmp->Compare(a, b) < 0;
+            });
+  candidates.erase(std::unique(candidates.begin(), candidates.end(),
+                               [ucmp](const std::string& a,
+                                      const std::string& b) {
+                                 return ucmp->Compare(a, b) == 0;
+                               }),
+                   candidates.end());
+
+  // Looking up the offset of a key visits every level, so only a sample
+  // of the candidates, spread evenly, is weighed.
+  const size_t max_samples = 64 * static_cast<size_t>(n);
+  if (candidates.size() > max_samples) {
+    std::vector<std::string> sample;
+    sample.reserve(max_samples);
+    for (size_t i = 0; i < max_samples; i++) {
+      sample.push_back(
+          std::move(candidates[i * candidates.size() / max_samples]));
+    }
+    candidates.swap(sample);
+  }
+
+  auto offset_of = [&](const Slice& user_key) {
+    return ApproximateOffsetOf(
+        v, InternalKey(user_key, kMaxSequenceNumber, kValueTypeForSeek));
+  };
+  const uint64_t start = (begin == nullptr) ? 0 : offset_of(*begin);
+  uint64_t limit = 0;
+  if (end != nullptr) {
+    limit = offset_of(*end);
+  } else {
+    for (int level = 0; level < config::kNumLevels; level++) {
+      limit += TotalFileSize(v->files_[level]);
+    }
+  }
+  if (limit <= start) {
+    return;
+  }
+
+  // Cut at the first candidate at or after each multiple of the range
+  // size / n.
+  int next_range = 1;
+  for (size_t i = 0; i < candidates.size() && next_range < n; i++) {
+    const uint64_t offset = offset_of(candidates[i]);
+    if ((offset - std::min(offset, start)) * n <
+        (limit - start) * next_range) {
+      continue;
+    }
+    boundaries->push_back(candidates[i]);
+    while (next_range < n &&
+           (offset - std::min(offset, start)) * n >=
+               (limit - start) * next_range) {
+      next_range++;
+    }
+  }
+}
+
 void VersionSet::AddLiveFiles(std::set<uint64_t>* live) {
   for (Version* v = dummy_versions_.next_; v != &dummy_versions_;
        v = v->next_) {
@@ -1699,6 +2069,15 @@ void VersionSet::AddLiveFiles(std::set<uint64_t>* live) {
   }
 }
 
+void VersionSet::AddLiveBlobFiles(std::set<uint64_t>* live) {
+  for (Version* v = dummy_versions_.next_; v != &dummy_versions_;
+       v = v->next_) {
+    for (const auto& kvp : v->blob_files_) {
+      live->insert(kvp.first);
+    }
+  }
+}
+
 int64_t VersionSet::NumLevelBytes(int level) const {
   assert(level >= 0);
   assert(level < config::kNumLevels);
@@ -1765,12 +2144,15 @@ Iterator* VersionSet::MakeInputIterator(Compaction* c) {
   // Level-0 files have to be merged together.  For other levels,
   // we will make a concatenating iterator per level.
   // TODO(opt): use concatenating iterator for level-0 if there is no overlap
-  const int space = (c->level() == 0 ? c->inputs_[0].size() + 1 : 2);
+  int space = 0;
+  for (int which = 0; which < c->num_input_levels(); which++) {
+    space += (c->input_level(which) == 0 ? c->inputs_[which].size() : 1);
+  }
   Iterator** list = new Iterator*[space];
   int num = 0;
-  for (int which = 0; which < 2; which++) {
+  for (int which = 0; which < c->num_input_levels(); which++) {
     if (!c->inputs_[which].empty()) {
-      if (c->level() + which == 0) {
+      if (c->input_level(which) == 0) {
         const std::vector<FileMetaData*>& files = c->inputs_[which];
         for (size_t i = 0; i < files.size(); i++) {
           list[num++] = table_cache_->NewIterator(options, files[i]->number,
@@ -1790,46 +2172,226 @@ Iterator* VersionSet::MakeInputIterator(Compaction* c) {
   return result;
 }
 
+// Returns true if any of "files" is an input of a running compaction.
+static bool AnyBeingCompacted(const std::vector<FileMetaData*>& files) {
+  for (size_t i = 0; i < files.size(); i++) {
+    if (files[i]->being_compacted) {
+      return true;
+    }
+  }
+  return false;
+}
+
 Compaction* VersionSet::PickCompaction() {
-  Compaction* c;
-  int level;
+  if (!options_->enable_compaction) {
+    return nullptr;
+  }
+  if (options_->compaction_style == kCompactionStyleTiered) {
+    return PickTieredCompaction();
+  }
 
   // We prefer compactions triggered by too much data in a level over
-  // the compactions triggered by seeks.
-  const bool size_compaction = options_->enable_compaction && (current_->compaction_score_ >= 1);
-  const bool seek_compaction = options_->enable_compaction && (current_->file_to_compact_ != nullptr);
-  if (size_compaction) {
-    level = current_->compaction_level_;
-    assert(level >= 0);
-    assert(level + 1 < config::kNumLevels);
-    c = new Compaction(options_, level);
-
-    // Pick the first file that comes after compact_pointer_[level]
-    for (size_t i = 0; i < current_->files_[level].size(); i++) {
-      FileMetaData* f = current_->files_[level][i];
-      if (compact_pointer_[level].empty() ||
-          icmp_.Compare(f->largest.Encode(), compact_pointer_[level]) > 0) {
-        c->inputs_[0].push_back(f);
-        break;
+  // the compactions triggered by seeks.  Other compaction threads may
+  // be busy with the level that needs it most, so try the levels in
+  // decreasing order of score.
+  std::vector<int> levels;
+  for (int level = 0; level < config::kNumLevels - 1; level++) {
+    if (current_->level_scores_[level] >= 1) {
+      levels.push_back(level);
+    }
+  }
+  Version* const v = current_;
+  std::sort(levels.begin(), levels.end(), [v](int a, int b) {
+    return v->level_scores_[a] > v->level_scores_[b];
+  });
+  for (size_t i = 0; i < levels.size(); i++) {
+    Compaction* c = PickLevelCompaction(levels[i]);
+    if (c != nullptr) {
+      return c;
+    }
+  }
+
+  FileMetaData* f = current_->file_to_compact_;
+  if (f != nullptr && !f->being_compacted) {
+    Compaction* c = new Compaction(options_, current_->file_to_compact_level_);
+    c->inputs_[0].push_back(f);
+    if (SetupCompactionInputs(c)) {
+      return c;
+    }
+    delete c;
+  }
+  return nullptr;
+}
+
+Compaction* VersionSet::PickLevelCompaction(int level) {
+  assert(level >= 0);
+  assert(level + 1 < config::kNumLevels);
+  const std::vector<FileMetaData*>& files = current_->files_[level];
+
+  // Start with the first file that comes after compact_pointer_[level],
+  // wrapping around to the beginning of the key space.
+  size_t start = 0;
+  if (!compact_pointer_[level].empty()) {
+    while (start < files.size() &&
+           icmp_.Compare(files[start]->largest.Encode(),
+                         compact_pointer_[level]) <= 0) {
+      start++;
+    }
+    if (start == files.size()) {
+      start = 0;
+    }
+  }
+
+  for (size_t i = 0; i < files.size(); i++) {
+    FileMetaData* f = files[(start + i) % files.size()];
+    if (f->being_compacted) {
+      continue;
+    }
+    Compaction* c = new Compaction(options_, level);
+    c->inputs_[0].push_back(f);
+    if (SetupCompactionInputs(c)) {
+      return c;
+    }
+    delete c;
+  }
+  return nullptr;
+}
+
+Compaction* VersionSet::PickTieredCompaction() {
+  Version* const v = current_;
+
+  // The sorted runs from newest to oldest: every level-0 file, then every
+  // non-empty level.
+  struct SortedRun {
+    int level;
+    FileMetaData* file;  // The level-0 file, or nullptr for a whole level
+    uint64_t size;
+    bool being_compacted;
+  };
+  std::vector<SortedRun> runs;
+  std::vector<FileMetaData*> level0 = v->files_[0];
+  std::sort(level0.begin(), level0.end(), NewestFirst);
+  for (size_t i = 0; i < level0.size(); i++) {
+    runs.push_back({0, level0[i], level0[i]->file_size,
+                    level0[i]->being_compacted});
+  }
+  const size_t num_level0 = runs.size();
+  for (int level = 1; level < config::kNumLevels; level++) {
+    if (!v->files_[level].empty()) {
+      runs.push_back({level, nullptr,
+                      static_cast<uint64_t>(TotalFileSize(v->files_[level])),
+                      AnyBeingCompacted(v->files_[level])});
+    }
+  }
+  const size_t n = runs.size();
+  if (n < static_cast<size_t>(config::kL0_CompactionTrigger)) {
+    return nullptr;
+  }
+
+  // Returns the level the merge of runs [start, end) writes to, or -1 if
+  // it cannot run now.  The outputs of a merge are read after every
+  // level-0 file, so a merge that takes one level-0 file takes all of
+  // them.  A merge of only level-0 files writes to the empty level right
+  // above the next run, and takes that run too if it is level-1.
+  auto output_level_for = [&](size_t start, size_t* end) -> int {
+    if (start > 0 && start < num_level0) {
+      return -1;
+    }
+    if (start == 0 && *end < num_level0) {
+      *end = num_level0;
+    }
+    int output_level = runs[*end - 1].level;
+    if (output_level == 0) {
+      output_level = (*end < n ? runs[*end].level : config::kNumLevels) - 1;
+      if (output_level == 0) {
+        ++*end;
+        output_level = 1;
       }
     }
-    if (c->inputs_[0].empty()) {
-      // Wrap-around to the beginning of the key space
-      c->inputs_[0].push_back(current_->files_[level][0]);
+    for (size_t i = start; i < *end; i++) {
+      if (runs[i].being_compacted) {
+        return -1;
+      }
     }
-  } else if (seek_compaction) {
-    level = current_->file_to_compact_level_;
-    c = new Compaction(options_, level);
-    c->inputs_[0].push_back(current_->file_to_compact_);
-  } else {
+    return output_level;
+  };
+
+  size_t start = 0;
+  size_t end = 0;
+  int output_level = -1;
+  const char* reason = nullptr;
+
+  // Bound the space taken by obsolete versions: once the newer runs grow
+  // too large next to the oldest one, merge everything.
+  uint64_t newer_bytes = 0;
+  for (size_t i = 0; i + 1 < n; i++) {
+    newer_bytes += runs[i].size;
+  }
+  if (newer_bytes * 100 >
+      runs[n - 1].size * options_->tiered_max_size_amplification_percent) {
+    end = n;
+    output_level = output_level_for(0, &end);
+    reason = "size amplification";
+  }
+
+  // Otherwise merge the first series of runs in which each run is not much
+  // larger than the runs before it put together.
+  for (size_t i = 0; i < n && output_level < 0; i++) {
+    uint64_t size = runs[i].size;
+    size_t j = i + 1;
+    while (j < n &&
+           runs[j].size * 100 <= size * (100 + options_->tiered_size_ratio)) {
+      size += runs[j].size;
+      j++;
+    }
+    if (j - i >= 2) {
+      start = i;
+      end = j;
+      output_level = output_level_for(start, &end);
+      reason = "size ratio";
+    }
+  }
+
+  // Too many runs slow reads down and soon stop writes: merge the newest.
+  if (output_level < 0 &&
+      n >= static_cast<size_t>(config::kL0_SlowdownWritesTrigger)) {
+    start = 0;
+    end = n - config::kL0_CompactionTrigger + 1;
+    output_level = output_level_for(start, &end);
+    reason = "run count";
+  }
+  if (output_level < 0) {
     return nullptr;
   }
 
+  Compaction* c = new Compaction(options_, runs[start].level, output_level);
+  for (size_t i = start; i < end; i++) {
+    if (runs[i].level == 0) {
+      if (c->inputs_.empty()) {
+        c->inputs_.emplace_back();
+        c->input_levels_.push_back(0);
+      }
+      c->inputs_[0].push_back(runs[i].file);
+    } else {
+      c->inputs_.push_back(v->files_[runs[i].level]);
+      c->input_levels_.push_back(runs[i].level);
+    }
+  }
+  c->input_version_ = v;
+  c->input_version_->Ref();
+  c->MarkInputs(true);
+  Log(options_->info_log, "Tiered compaction of %d of %d runs into level-%d (%s)",
+      static_cast<int>(end - start), static_cast<int>(n), output_level,
+      reason);
+  return c;
+}
+
+bool VersionSet::SetupCompactionInputs(Compaction* c) {
   c->input_version_ = current_;
   c->input_version_->Ref();
 
   // Files in level 0 may overlap each other, so pick up all overlapping ones
-  if (level == 0) {
+  if (c->level() == 0) {
     InternalKey smallest, largest;
     GetRange(c->inputs_[0], &smallest, &largest);
     // Note that the next call will discard the file we placed in
@@ -1841,7 +2403,14 @@ Compaction* VersionSet::PickCompaction() {
 
   SetupOtherInputs(c);
 
-  return c;
+  // Inputs that do not overlap any running compaction also keep the
+  // outputs apart: a running compaction owns every file of its output
+  // level that overlaps its key range.
+  if (AnyBeingCompacted(c->inputs_[0]) || AnyBeingCompacted(c->inputs_[1])) {
+    return false;
+  }
+  c->MarkInputs(true);
+  return true;
 }
 
 // Finds the largest key in a vector of files. Returns true if files it not
@@ -1948,7 +2517,8 @@ void VersionSet::SetupOtherInputs(Compaction* c) {
     const int64_t expanded0_size = TotalFileSize(expanded0);
     if (expanded0.size() > c->inputs_[0].size() &&
         inputs1_size + expanded0_size <
-            ExpandedCompactionByteSizeLimit(options_)) {
+            ExpandedCompactionByteSizeLimit(options_) &&
+        !AnyBeingCompacted(expanded0)) {
       InternalKey new_start, new_limit;
       GetRange(expanded0, &new_start, &new_limit);
       std::vector<FileMetaData*> expanded1;
@@ -2014,52 +2584,65 @@ Compaction* VersionSet::CompactRange(int level, const InternalKey* begin,
   c->input_version_->Ref();
   c->inputs_[0] = inputs;
   SetupOtherInputs(c);
+  c->MarkInputs(true);
   return c;
 }
 
 Compaction::Compaction(const Options* options, int level)
     : level_(level),
+      output_level_(level + 1),
       max_output_file_size_(MaxFileSizeForLevel(options, level)),
       input_version_(nullptr),
-      grandparent_index_(0),
-      seen_key_(false),
-      overlapped_bytes_(0) {
+      inputs_(2),
+      input_levels_{level, level + 1},
+      inputs_marked_(false) {}
+
+Compaction::Compaction(const Options* options, int level, int output_level)
+    : level_(level),
+      output_level_(output_level),
+      max_output_file_size_(MaxFileSizeForLevel(options, output_level)),
+      input_version_(nullptr),
+      inputs_marked_(false) {}
+
+Compaction::KeyCursor::KeyCursor()
+    : grandparent_index(0), seen_key(false), overlapped_bytes(0) {
   for (int i = 0; i < config::kNumLevels; i++) {
-    level_ptrs_[i] = 0;
+    level_ptrs[i] = 0;
   }
 }
 
-Compaction::~Compaction() {
-  if (input_version_ != nullptr) {
-    input_version_->Unref();
-  }
-}
+Compaction::~Compaction() { ReleaseInputs(); }
 
 bool Compaction::IsTrivialMove() const {
   const VersionSet* vset = input_version_->vset_;
   // Avoid a move if there is lots of overlapping grandparent data.
   // Otherwise, the move could create a parent file that will require
   // a very expensive merge later on.
-  return (num_input_files(0) == 1 && num_input_files(1) == 0 &&
+  size_t num_files = 0;
+  for (size_t which = 0; which < inputs_.size(); which++) {
+    num_files += inputs_[which].size();
+  }
+  return (num_files == 1 && num_input_files(0) == 1 &&
           TotalFileSize(grandparents_) <=
               MaxGrandParentOverlapBytes(vset->options_));
 }
 
 void Compaction::AddInputDeletions(VersionEdit* edit) {
-  for (int which = 0; which < 2; which++) {
+  for (size_t which = 0; which < inputs_.size(); which++) {
     for (size_t i = 0; i < inputs_[which].size(); i++) {
-      edit->RemoveFile(level_ + which, inputs_[which][i]->number);
+      edit->RemoveFile(input_levels_[which], inputs_[which][i]->number);
     }
   }
 }
 
-bool Compaction::IsBaseLevelForKey(const Slice& user_key) {
+bool Compaction::IsBaseLevelForKey(const Slice& user_key,
+                                   KeyCursor* cursor) {
   // Maybe use binary search to find right entry instead of linear search?
   const Comparator* user_cmp = input_version_->vset_->icmp_.user_comparator();
-  for (int lvl = level_ + 2; lvl < config::kNumLevels; lvl++) {
+  for (int lvl = output_level_ + 1; lvl < config::kNumLevels; lvl++) {
     const std::vector<FileMetaData*>& files = input_version_->files_[lvl];
-    while (level_ptrs_[lvl] < files.size()) {
-      FileMetaData* f = files[level_ptrs_[lvl]];
+    while (cursor->level_ptrs[lvl] < files.size()) {
+      FileMetaData* f = files[cursor->level_ptrs[lvl]];
       if (user_cmp->Compare(user_key, f->largest.user_key()) <= 0) {
         // We've advanced far enough
         if (user_cmp->Compare(user_key, f->smallest.user_key()) >= 0) {
@@ -2068,37 +2651,52 @@ bool Compaction::IsBaseLevelForKey(const Slice& user_key) {
         }
         break;
       }
-      level_ptrs_[lvl]++;
+      cursor->level_ptrs[lvl]++;
     }
   }
   return true;
 }
 
-bool Compaction::ShouldStopBefore(const Slice& internal_key) {
+bool Compaction::ShouldStopBefore(const Slice& internal_key,
+                                  KeyCursor* cursor) {
   const VersionSet* vset = input_version_->vset_;
   // Scan to find earliest grandparent file that contains key.
   const InternalKeyComparator* icmp = &vset->icmp_;
-  while (grandparent_index_ < grandparents_.size() &&
-         icmp->Compare(internal_key,
-                       grandparents_[grandparent_index_]->largest.Encode()) >
-             0) {
-    if (seen_key_) {
-      overlapped_bytes_ += grandparents_[grandparent_index_]->file_size;
+  while (cursor->grandparent_index < grandparents_.size() &&
+         icmp->Compare(
+             internal_key,
+             grandparents_[cursor->grandparent_index]->largest.Encode()) > 0) {
+    if (cursor->seen_key) {
+      cursor->overlapped_bytes +=
+          grandparents_[cursor->grandparent_index]->file_size;
     }
-    grandparent_index_++;
+    cursor->grandparent_index++;
   }
-  seen_key_ = true;
+  cursor->seen_key = true;
 
-  if (overlapped_bytes_ > MaxGrandParentOverlapBytes(vset->options_)) {
+  if (cursor->overlapped_bytes > MaxGrandParentOverlapBytes(vset->options_)) {
     // Too much overlap for current output; start new output
-    overlapped_bytes_ = 0;
+    cursor->overlapped_bytes = 0;
     return true;
   } else {
     return false;
   }
 }
 
+void Compaction::MarkInputs(bool being_compacted) {
+  for (size_t which = 0; which < inputs_.size(); which++) {
+    for (size_t i = 0; i < inputs_[which].size(); i++) {
+      inputs_[which][i]->being_compacted = being_compacted;
+    }
+  }
+  inputs_marked_ = being_compacted;
+}
+
 void Compaction::ReleaseInputs() {
+  if (inputs_marked_) {
+    // The input version keeps the files alive until it is unreferenced.
+    MarkInputs(false);
+  }
   if (input_version_ != nullptr) {
     input_version_->Unref();
     input_version_ = nullptr;
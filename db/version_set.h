@@ -21,6 +21,7 @@
 
 #include "db/dbformat.h"
 #include "db/version_edit.h"
+#include "leveldb/pinnable_slice.h"
 #include "port/port.h"
 #include "port/thread_annotations.h"
 #include "db/skiplist.h"
@@ -36,6 +37,7 @@ class Writer;
 class Compaction;
 class Iterator;
 class MemTable;
+class MergeContext;
 class TableBuilder;
 class TableCache;
 class Version;
@@ -138,12 +140,13 @@ class GlobalIndex {
     //      and it will be updated after this method (but I don't know why)
     // @param arg_saver: the saver to save operation status,
     //      and it will be updated after this method
-    // @param handle_result: the method to handle found result
+    // @param handle_result: the method to handle found result,
+    //      which returns true to be called with the next entry as well
     void SearchGITable(const ReadOptions& options, Slice internal_key,
                        GITable* gitable_, GITable::Node** next_level_,
                        void* arg_saver,
-                       void (*handle_result)(void*, const Slice&,
-                                             const Slice&));
+                       bool (*handle_result)(void*, const Slice&,
+                                             const Slice&, Cleanable*));
     
     // Build a global index table.
     // After this method, index_files_level0 and index_files_ 
@@ -160,8 +163,8 @@ class GlobalIndex {
     // @param handle_result: the method to handle found result
     bool GetFromGlobalIndex(const ReadOptions& options,
                             Slice internal_key, void* arg_saver, void* arg_stats,
-                            void (*handle_result)(void*, const Slice&,
-                                                  const Slice&));
+                            bool (*handle_result)(void*, const Slice&,
+                                                  const Slice&, Cleanable*));
 
     // Build a skipList from an index block. 
     // At last, some nodes will be inserted into *gitable_
@@ -235,8 +238,14 @@ class Version {
   // We call this method before getting keys by Get() or iterator.
   void BuildGlobalIndex(const ReadOptions& options, GlobalIndex* global_index);
 
-  Status Get(const ReadOptions&, const LookupKey& key, std::string* val,
-             GetStats* stats, leveldb::GlobalIndex* global_index_);
+  // Lookup the value for key.  If found, store it in *val, pinning the
+  // block it was read from, and return OK.  Else return a non-OK status.
+  // The merge operands newer than the value are pushed to *merge_context.
+  // Fills *stats.
+  // REQUIRES: lock is not held
+  Status Get(const ReadOptions&, const LookupKey& key, PinnableSlice* val,
+             GetStats* stats, leveldb::GlobalIndex* global_index_,
+             MergeContext* merge_context);
 
   // Adds "stats" into the current state.  Returns true if a new
   // compaction may need to be triggered, false otherwise.
@@ -272,8 +281,24 @@ class Version {
   int PickLevelForMemTableOutput(const Slice& smallest_user_key,
                                  const Slice& largest_user_key);
 
+  // Return the deepest level at which an ingested file that covers the
+  // range [smallest_user_key,largest_user_key] overlaps no file in that
+  // level or any level above it.  Level 0 if level 0 overlaps the range.
+  int PickLevelForExternalFile(const Slice& smallest_user_key,
+                               const Slice& largest_user_key);
+
+  // Returns true iff some file in any level overlaps some part of
+  // [smallest_user_key,largest_user_key].
+  bool OverlapInAnyLevel(const Slice& smallest_user_key,
+                         const Slice& largest_user_key);
+
   int NumFiles(int level) const { return files_[level].size(); }
 
+  // Add to *numbers every blob file of which at least "garbage_ratio" of
+  // the bytes are garbage.
+  void GetBlobFilesToCollect(double garbage_ratio,
+                             std::set<uint64_t>* numbers) const;
+
   // Return a human readable string that describes this version's contents.
   std::string DebugString() const;
   /*
@@ -296,7 +321,12 @@ class Version {
         file_to_compact_(nullptr),
         file_to_compact_level_(-1),
         compaction_score_(-1),
-        compaction_level_(-1) {}
+        compaction_level_(-1),
+        pending_compaction_bytes_(0) {
+    for (int level = 0; level < config::kNumLevels; level++) {
+      level_scores_[level] = -1;
+    }
+  }
 
   Version(const Version&) = delete;
   Version& operator=(const Version&) = delete;
@@ -321,6 +351,9 @@ class Version {
   // List of files per level
   std::vector<FileMetaData*> files_[config::kNumLevels];
 
+  // Blob files referenced by the tables, by number
+  std::map<uint64_t, BlobFileMetaData> blob_files_;
+
   // Next file to compact based on seek stats.
   FileMetaData* file_to_compact_;
   int file_to_compact_level_;
@@ -330,6 +363,14 @@ class Version {
   // are initialized by Finalize().
   double compaction_score_;
   int compaction_level_;
+
+  // Compaction score of every level, so that another level can be picked
+  // when the best one is busy with a running compaction.
+  double level_scores_[config::kNumLevels];
+
+  // Estimated bytes compactions must read to bring all levels back within
+  // their limits.  Initialized by Finalize().
+  uint64_t pending_compaction_bytes_;
   friend class GlobalIndex;
 };
 
@@ -377,6 +418,12 @@ class VersionSet {
   // Return the combined file size of all files at the specified level.
   int64_t NumLevelBytes(int level) const;
 
+  // Return the estimated bytes of compaction work the current version is
+  // behind by.
+  uint64_t PendingCompactionBytes() const {
+    return current_->pending_compaction_bytes_;
+  }
+
   // Return the last sequence number.
   uint64_t LastSequence() const { return last_sequence_; }
 
@@ -400,6 +447,11 @@ class VersionSet {
   // Returns nullptr if there is no compaction to be done.
   // Otherwise returns a pointer to a heap-allocated object that
   // describes the compaction.  Caller should delete the result.
+  //
+  // The inputs of the result are marked as being compacted until it is
+  // deleted or its inputs are released, and never overlap the inputs of
+  // another live compaction, so several compactions picked this way can
+  // run concurrently.
   Compaction* PickCompaction();
 
   // Return a compaction object for compacting the range [begin,end] in
@@ -427,10 +479,31 @@ class VersionSet {
   // May also mutate some internal state.
   void AddLiveFiles(std::set<uint64_t>* live);
 
+  // Add all blob files referenced by any live version to *live.
+  void AddLiveBlobFiles(std::set<uint64_t>* live);
+
   // Return the approximate offset in the database of the data for
   // "key" as of version "v".
   uint64_t ApproximateOffsetOf(Version* v, const InternalKey& key);
 
+  // Store in *boundaries up to "n - 1" increasing user keys that cut the
+  // input of "c" into key ranges holding roughly equal amounts of data.
+  // The cuts are chosen among the data block boundaries of the inputs.
+  // REQUIRES: lock is not held
+  void SplitCompaction(Compaction* c, int n,
+                       std::vector<std::string>* boundaries);
+
+  // Store in *boundaries up to "n - 1" increasing user keys that cut the
+  // keys of "v" in [*begin, *end) into ranges holding roughly equal
+  // amounts of table data, as measured by ApproximateOffsetOf().  A null
+  // "begin" or "end" leaves that side of the range open.  The cuts are
+  // chosen among the data block boundaries, taken from "global_index" if
+  // it is non-null and from the index blocks of the tables otherwise.
+  // REQUIRES: lock is not held, and "v" is pinned by the caller
+  void SplitRange(Version* v, const Slice* begin, const Slice* end, int n,
+                  GlobalIndex* global_index,
+                  std::vector<std::string>* boundaries);
+
   // Return a human-readable short (single-line) summary of the number
   // of files per level.  Uses *scratch as backing store.
   struct LevelSummaryStorage {
@@ -457,6 +530,17 @@ class VersionSet {
 
   void SetupOtherInputs(Compaction* c);
 
+  // Pick a compaction of "level" whose inputs are not being compacted.
+  Compaction* PickLevelCompaction(int level);
+
+  // Pick a merge of adjacent sorted runs for kCompactionStyleTiered.
+  Compaction* PickTieredCompaction();
+
+  // Complete the inputs of "c" from its initial level-"level" inputs and
+  // mark them as being compacted.  Returns false if "c" would share an
+  // input with a running compaction.
+  bool SetupCompactionInputs(Compaction* c);
+
   // Save current contents to *log
   Status WriteSnapshot(log::Writer* log);
 
@@ -492,16 +576,29 @@ class Compaction {
 
   // Return the level that is being compacted.  Inputs from "level"
   // and "level+1" will be merged to produce a set of "level+1" files.
+  // A tiered compaction returns the level of its newest input.
   int level() const { return level_; }
 
+  // Return the level the outputs are written to: "level+1", or for a
+  // tiered compaction the level of its oldest input or an empty level
+  // above the runs it leaves alone.
+  int output_level() const { return output_level_; }
+
   // Return the object that holds the edits to the descriptor done
   // by this compaction.
   VersionEdit* edit() { return &edit_; }
 
-  // "which" must be either 0 or 1
+  // Number of sets of inputs: 2 for a leveled compaction, one per level
+  // read for a tiered compaction.
+  int num_input_levels() const { return inputs_.size(); }
+
+  // Return the level of the "which"th set of inputs.
+  int input_level(int which) const { return input_levels_[which]; }
+
+  // "which" must be less than num_input_levels()
   int num_input_files(int which) const { return inputs_[which].size(); }
 
-  // Return the ith input file at "level()+which" ("which" must be 0 or 1).
+  // Return the ith input file at "input_level(which)".
   FileMetaData* input(int which, int i) const { return inputs_[which][i]; }
 
   // Maximum size of files to build during this compaction.
@@ -514,48 +611,71 @@ class Compaction {
   // Add all inputs to this compaction as delete operations to *edit.
   void AddInputDeletions(VersionEdit* edit);
 
+  // Position of IsBaseLevelForKey() and ShouldStopBefore() in the files
+  // below the compaction.  Both expect keys in increasing order, so each
+  // sub-compaction walking its own key range keeps its own cursor.
+  struct KeyCursor {
+    KeyCursor();
+
+    // State used to check for number of overlapping grandparent files
+    // (parent == level_ + 1, grandparent == level_ + 2)
+    size_t grandparent_index;  // Index in grandparents_
+    bool seen_key;             // Some output key has been seen
+    int64_t overlapped_bytes;  // Bytes of overlap between current output
+                               // and grandparent files
+
+    // State for implementing IsBaseLevelForKey
+
+    // level_ptrs holds indices into input_version_->levels_: our state
+    // is that we are positioned at one of the file ranges for each
+    // higher level than the ones involved in this compaction (i.e. for
+    // all L >= level_ + 2).
+    size_t level_ptrs[config::kNumLevels];
+  };
+
   // Returns true if the information we have available guarantees that
   // the compaction is producing data in "level+1" for which no data exists
   // in levels greater than "level+1".
-  bool IsBaseLevelForKey(const Slice& user_key);
+  bool IsBaseLevelForKey(const Slice& user_key, KeyCursor* cursor);
 
   // Returns true iff we should stop building the current output
   // before processing "internal_key".
-  bool ShouldStopBefore(const Slice& internal_key);
+  bool ShouldStopBefore(const Slice& internal_key, KeyCursor* cursor);
+
+  // The version the inputs were picked from, until ReleaseInputs().
+  Version* input_version() const { return input_version_; }
 
   // Release the input version for the compaction, once the compaction
-  // is successful.
+  // is successful, and let other compactions pick its inputs again.
   void ReleaseInputs();
 
  private:
   friend class Version;
   friend class VersionSet;
 
+  // A leveled compaction of "level" into "level+1"
   Compaction(const Options* options, int level);
 
+  // A tiered compaction into "output_level", with no inputs yet
+  Compaction(const Options* options, int level, int output_level);
+
+  // Set the being_compacted flag of every input file.
+  void MarkInputs(bool being_compacted);
+
   int level_;
+  int output_level_;
   uint64_t max_output_file_size_;
   Version* input_version_;
   VersionEdit edit_;
 
-  // Each compaction reads inputs from "level_" and "level_+1"
-  std::vector<FileMetaData*> inputs_[2];  // The two sets of inputs
+  // A leveled compaction reads inputs from "level_" and "level_+1"; a
+  // tiered one from every level in input_levels_, newest first.
+  std::vector<std::vector<FileMetaData*>> inputs_;
+  std::vector<int> input_levels_;
+  bool inputs_marked_;  // Inputs are flagged as being compacted
 
-  // State used to check for number of overlapping grandparent files
-  // (parent == level_ + 1, grandparent == level_ + 2)
+  // Files in level_ + 2 overlapping the key range of the compaction
   std::vector<FileMetaData*> grandparents_;
-  size_t grandparent_index_;  // Index in grandparent_starts_
-  bool seen_key_;             // Some output key has been seen
-  int64_t overlapped_bytes_;  // Bytes of overlap between current output
-                              // and grandparent files
-
-  // State for implementing IsBaseLevelForKey
-
-  // level_ptrs_ holds indices into input_version_->levels_: our state
-  // is that we are positioned at one of the file ranges for each
-  // higher level than the ones involved in this compaction (i.e. for
-  // all L >= level_ + 2).
-  size_t level_ptrs_[config::kNumLevels];
 };
 
 }  // namespace leveldb
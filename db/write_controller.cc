@@ -0,0 +1,53 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/write_controller.h"
+
+namespace leveldb {
+
+const uint64_t WriteController::kMinDelayMicros;
+const uint64_t WriteController::kMinRate;
+
+WriteController::WriteController(uint64_t max_rate)
+    : max_rate_(max_rate < kMinRate ? kMinRate : max_rate),
+      delayed_rate_(0),
+      last_backlog_(0),
+      next_write_micros_(0) {}
+
+void WriteController::Update(bool slowdown, uint64_t backlog) {
+  if (!slowdown) {
+    delayed_rate_ = 0;
+  } else if (delayed_rate_ == 0) {
+    delayed_rate_ = max_rate_;
+  } else if (backlog > last_backlog_) {
+    // Compactions are still losing ground; slow writes down further.
+    delayed_rate_ = delayed_rate_ / 5 * 4;
+    if (delayed_rate_ < kMinRate) delayed_rate_ = kMinRate;
+  } else if (backlog < last_backlog_) {
+    delayed_rate_ = delayed_rate_ / 4 * 5;
+    if (delayed_rate_ > max_rate_) delayed_rate_ = max_rate_;
+  }
+  last_backlog_ = backlog;
+}
+
+uint64_t WriteController::DelayMicros(uint64_t now_micros) const {
+  if (delayed_rate_ == 0 || next_write_micros_ < now_micros + kMinDelayMicros) {
+    return 0;
+  }
+  return next_write_micros_ - now_micros;
+}
+
+void WriteController::Charge(uint64_t now_micros, uint64_t bytes) {
+  if (delayed_rate_ == 0) {
+    return;
+  }
+  // Time not spent writing is not banked beyond the current moment, so a
+  // burst after an idle period is still paced.
+  if (next_write_micros_ < now_micros) {
+    next_write_micros_ = now_micros;
+  }
+  next_write_micros_ += bytes * 1000000 / delayed_rate_;
+}
+
+}  // namespace leveldb
@@ -0,0 +1,62 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_DB_WRITE_CONTROLLER_H_
+#define STORAGE_LEVELDB_DB_WRITE_CONTROLLER_H_
+
+#include <cstdint>
+
+namespace leveldb {
+
+// Paces writes while compactions fall behind.  Rather than sleeping a
+// fixed amount per write, writes are charged against a token bucket
+// whose rate is lowered each time the compaction backlog grows and
+// raised again as it shrinks, so ingest slows down smoothly instead of
+// alternating between full speed and hard stalls.
+//
+// Not thread-safe; DBImpl calls it with its mutex held.
+class WriteController {
+ public:
+  // "max_rate" is the rate in bytes per second that writes are limited to
+  // when the backlog first crosses the slowdown threshold.
+  explicit WriteController(uint64_t max_rate);
+
+  WriteController(const WriteController&) = delete;
+  WriteController& operator=(const WriteController&) = delete;
+
+  // Reports the current compaction backlog: whether it is past the
+  // slowdown threshold, and a measure of its size that is compared
+  // against the previous report to decide whether to slow down further.
+  void Update(bool slowdown, uint64_t backlog);
+
+  bool IsDelayed() const { return delayed_rate_ != 0; }
+
+  // Current write rate limit in bytes per second, or 0 if not delayed.
+  uint64_t delayed_rate() const { return delayed_rate_; }
+
+  // Returns how long a write arriving at "now_micros" must sleep to stay
+  // within the rate.  Delays shorter than kMinDelayMicros are not worth a
+  // sleep; they are carried over until they add up.
+  uint64_t DelayMicros(uint64_t now_micros) const;
+
+  // Charges "bytes" written at "now_micros" against the rate.
+  void Charge(uint64_t now_micros, uint64_t bytes);
+
+  static const uint64_t kMinDelayMicros = 1000;
+
+  // The rate is never lowered below this many bytes per second.
+  static const uint64_t kMinRate = 16 << 10;
+
+ private:
+  const uint64_t max_rate_;
+  uint64_t delayed_rate_;
+  uint64_t last_backlog_;
+
+  // Time at which the bytes charged so far have been paid for
+  uint64_t next_write_micros_;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_WRITE_CONTROLLER_H_
@@ -0,0 +1,72 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/write_controller.h"
+
+#include "gtest/gtest.h"
+
+namespace leveldb {
+
+TEST(WriteControllerTest, NotDelayed) {
+  WriteController controller(1 << 20);
+  ASSERT_FALSE(controller.IsDelayed());
+  controller.Charge(0, 100 << 20);
+  ASSERT_EQ(0, controller.DelayMicros(0));
+}
+
+TEST(WriteControllerTest, PacesWrites) {
+  WriteController controller(1 << 20);
+  controller.Update(true, 10);
+  ASSERT_TRUE(controller.IsDelayed());
+  ASSERT_EQ(1 << 20, controller.delayed_rate());
+
+  // One second worth of writes must be spread over one second.
+  controller.Charge(0, 1 << 20);
+  ASSERT_EQ(1000000, controller.DelayMicros(0));
+  ASSERT_EQ(400000, controller.DelayMicros(600000));
+
+  // Small debts are carried over rather than slept.
+  controller.Charge(1000000, 100);
+  ASSERT_EQ(0, controller.DelayMicros(1000000));
+  controller.Charge(1000000, 2000);
+  ASSERT_LE(1000, controller.DelayMicros(1000000));
+
+  controller.Update(false, 0);
+  ASSERT_FALSE(controller.IsDelayed());
+  ASSERT_EQ(0, controller.DelayMicros(1000000));
+}
+
+TEST(WriteControllerTest, FollowsBacklog) {
+  WriteController controller(1 << 20);
+  controller.Update(true, 10);
+  const uint64_t initial = controller.delayed_rate();
+
+  controller.Update(true, 20);
+  const uint64_t slower = controller.delayed_rate();
+  ASSERT_LT(slower, initial);
+
+  // An unchanged backlog keeps the rate.
+  controller.Update(true, 20);
+  ASSERT_EQ(slower, controller.delayed_rate());
+
+  controller.Update(true, 15);
+  ASSERT_GT(controller.delayed_rate(), slower);
+  ASSERT_LE(controller.delayed_rate(), initial);
+
+  for (int i = 0; i < 100; i++) {
+    controller.Update(true, 100 + i);
+  }
+  ASSERT_EQ(WriteController::kMinRate, controller.delayed_rate());
+  for (int i = 0; i < 100; i++) {
+    controller.Update(true, 100 - i);
+  }
+  ASSERT_EQ(initial, controller.delayed_rate());
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
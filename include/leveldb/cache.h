@@ -31,6 +31,19 @@ class LEVELDB_EXPORT Cache;
 // of Cache uses a least-recently-used eviction policy.
 LEVELDB_EXPORT Cache* NewLRUCache(size_t capacity);
 
+// Create a new cache with a fixed size capacity that uses a CLOCK eviction
+// policy.  Lookup() and Release() do not take any lock, and entries that
+// are only touched once (e.g. by a long scan) are evicted before entries
+// that are read repeatedly.
+//
+// The cache is split into 2^num_shard_bits shards; a negative value picks
+// a shard count from the capacity.  Each shard has a fixed number of
+// slots sized for entries of roughly "estimated_entry_charge", so a cache
+// holding much smaller entries is limited by slot count rather than by
+// capacity.
+LEVELDB_EXPORT Cache* NewClockCache(size_t capacity, int num_shard_bits = -1,
+                                    size_t estimated_entry_charge = 4096);
+
 class LEVELDB_EXPORT Cache {
  public:
   Cache() = default;
@@ -0,0 +1,64 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A Cleanable runs a list of registered cleanup functions when it is
+// destroyed.  Iterators use it to release the blocks and tables they
+// read from, and a PinnableSlice to keep the memory it points into alive.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_CLEANABLE_H_
+#define STORAGE_LEVELDB_INCLUDE_CLEANABLE_H_
+
+#include <cassert>
+
+#include "leveldb/export.h"
+
+namespace leveldb {
+
+class LEVELDB_EXPORT Cleanable {
+ public:
+  Cleanable();
+
+  Cleanable(const Cleanable&) = delete;
+  Cleanable& operator=(const Cleanable&) = delete;
+
+  virtual ~Cleanable();
+
+  // Clients are allowed to register function/arg1/arg2 triples that
+  // will be invoked when this object is destroyed.  Functions run in
+  // no particular order.
+  using CleanupFunction = void (*)(void* arg1, void* arg2);
+  void RegisterCleanup(CleanupFunction function, void* arg1, void* arg2);
+
+  // Hand all the cleanup functions registered so far over to "other",
+  // which then runs them instead of this object.
+  void DelegateCleanupsTo(Cleanable* other);
+
+ protected:
+  // Run the registered cleanup functions and forget them.
+  void DoCleanup();
+
+ private:
+  // Cleanup functions are stored in a single-linked list.
+  // The list's head node is inlined in the object.
+  struct CleanupNode {
+    // True if the node is not used. Only head nodes might be unused.
+    bool IsEmpty() const { return function == nullptr; }
+    // Invokes the cleanup function.
+    void Run() {
+      assert(function != nullptr);
+      (*function)(arg1, arg2);
+    }
+
+    // The head node is used if the function pointer is not null.
+    CleanupFunction function;
+    void* arg1;
+    void* arg2;
+    CleanupNode* next;
+  };
+  CleanupNode cleanup_head_;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_CLEANABLE_H_
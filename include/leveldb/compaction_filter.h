@@ -0,0 +1,63 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A CompactionFilter lets an application remove or rewrite values while
+// compactions copy them, instead of scanning for them and writing
+// deletions or new values itself.  Options::compaction_filter sets it.
+// NewTTLCompactionFilter() returns a filter that removes values once they
+// are older than a time to live.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_COMPACTION_FILTER_H_
+#define STORAGE_LEVELDB_INCLUDE_COMPACTION_FILTER_H_
+
+#include <cstdint>
+#include <string>
+
+#include "leveldb/export.h"
+#include "leveldb/slice.h"
+
+namespace leveldb {
+
+class Env;
+
+class LEVELDB_EXPORT CompactionFilter {
+ public:
+  virtual ~CompactionFilter();
+
+  // The name of the filter.  Used in the info log.
+  virtual const char* Name() const = 0;
+
+  // Called for the newest value of "key" that a compaction of "level"
+  // copies, unless it was written before the newest live snapshot was
+  // taken.  Return true to remove the key.  Otherwise, the value is kept,
+  // unless "*value_changed" is set to true, in which case "*new_value"
+  // replaces it.
+  //
+  // Values only get filtered once they are compacted, so reads may still
+  // return values the filter would remove.  Memtable flushes do not call
+  // the filter.
+  //
+  // Compactions may call Filter() from several threads at once.
+  virtual bool Filter(int level, const Slice& key, const Slice& existing_value,
+                      std::string* new_value, bool* value_changed) const = 0;
+};
+
+// Append "unix_seconds" to "*value" as the timestamp the filter returned
+// by NewTTLCompactionFilter() reads.  The timestamp takes the last 8 bytes
+// of the value, which readers have to strip again.
+LEVELDB_EXPORT void AppendTTLTimestamp(std::string* value,
+                                       uint64_t unix_seconds);
+
+// Return a new filter that removes the values whose timestamp, appended
+// by AppendTTLTimestamp(), is more than "ttl_seconds" before the time of
+// "env".  Values shorter than a timestamp are kept.
+//
+// Callers must delete the result after any database that is using the
+// result has been closed.
+LEVELDB_EXPORT const CompactionFilter* NewTTLCompactionFilter(
+    uint64_t ttl_seconds, Env* env);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_COMPACTION_FILTER_H_
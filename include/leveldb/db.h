@@ -7,10 +7,13 @@
 
 #include <cstdint>
 #include <cstdio>
+#include <string>
+#include <vector>
 
 #include "leveldb/export.h"
 #include "leveldb/iterator.h"
 #include "leveldb/options.h"
+#include "leveldb/pinnable_slice.h"
 
 namespace leveldb {
 
@@ -18,7 +21,9 @@ namespace leveldb {
 static const int kMajorVersion = 1;
 static const int kMinorVersion = 23;
 
+struct IngestExternalFileOptions;
 struct Options;
+struct ParallelScanOptions;
 struct ReadOptions;
 struct WriteOptions;
 class WriteBatch;
@@ -40,6 +45,16 @@ struct LEVELDB_EXPORT Range {
   Slice limit;  // Not included in the range
 };
 
+// Receives the entries of DB::ParallelScan().
+class LEVELDB_EXPORT ScanCallback {
+ public:
+  virtual ~ScanCallback();
+
+  // Called for each entry of the scan, with the index of the key range
+  // the entry is in.  Return false to end the scan early.
+  virtual bool Entry(int partition, const Slice& key, const Slice& value) = 0;
+};
+
 // A DB is a persistent ordered map from keys to values.
 // A DB is safe for concurrent access from multiple threads without
 // any external synchronization.
@@ -72,6 +87,13 @@ class LEVELDB_EXPORT DB {
   // Note: consider setting options.sync = true.
   virtual Status Delete(const WriteOptions& options, const Slice& key) = 0;
 
+  // Apply the operand "value" to the database entry for "key" with
+  // Options::merge_operator, the next time the entry is read or compacted.
+  // Returns InvalidArgument if the database has no merge operator.
+  // Note: consider setting options.sync = true.
+  virtual Status Merge(const WriteOptions& options, const Slice& key,
+                       const Slice& value);
+
   // Apply the specified updates to the database.
   // Returns OK on success, non-OK on failure.
   // Note: consider setting options.sync = true.
@@ -91,6 +113,16 @@ class LEVELDB_EXPORT DB {
   virtual Status Get(const ReadOptions& options, const Slice& key,
                      std::string* value) = 0;
 
+  // Like Get() above, but a value read from a table is not copied:
+  // "*value" points into the block cache, or into the table file when
+  // it is memory-mapped, and keeps that memory pinned until it is Reset()
+  // or destroyed (see leveldb/pinnable_slice.h).  Anything "*value" held
+  // before is released first.
+  //
+  // The default implementation copies the result of the Get() above.
+  virtual Status Get(const ReadOptions& options, const Slice& key,
+                     PinnableSlice* value);
+
   // Return a heap-allocated iterator over the contents of the database.
   // The result of NewIterator() is initially invalid (caller must
   // call one of the Seek methods on the iterator before using it).
@@ -99,6 +131,22 @@ class LEVELDB_EXPORT DB {
   // The returned iterator should be deleted before this db is deleted.
   virtual Iterator* NewIterator(const ReadOptions& options) = 0;
 
+  // Pass every entry in [*begin, *end) to "callback".  A null "begin" or
+  // "end" leaves that side of the range open.  The range is cut into
+  // ranges of about equal size that are scanned by several threads, all
+  // reading from the same snapshot (options.snapshot, or a snapshot of
+  // the current state), and delivered as ParallelScanOptions say.
+  // "begin" and "end" take the place of the iterate bounds of "options".
+  //
+  // Returns the first error any of the scans hit.  The scan ends early,
+  // with an OK status, if "callback" returns false.
+  //
+  // The default implementation scans the range on the calling thread.
+  virtual Status ParallelScan(const ReadOptions& options,
+                              const ParallelScanOptions& scan_options,
+                              const Slice* begin, const Slice* end,
+                              ScanCallback* callback);
+
   // Return a handle to the current DB state.  Iterators created with
   // this handle will all observe a stable snapshot of the current DB
   // state.  The caller must call ReleaseSnapshot(result) when the
@@ -125,6 +173,30 @@ class LEVELDB_EXPORT DB {
   //     of the sstables that make up the db contents.
   //  "leveldb.approximate-memory-usage" - returns the approximate number of
   //     bytes of memory in use by the DB.
+  //  "leveldb.block-cache-hits", "leveldb.block-cache-misses" - return the
+  //     number of data block reads served / not served by block_cache.
+  //  "leveldb.compressed-block-cache-hits",
+  //  "leveldb.compressed-block-cache-misses" - likewise for
+  //     compressed_block_cache, which is only consulted on a block_cache miss.
+  //  "leveldb.actual-delayed-write-rate" - returns the rate in bytes per
+  //     second writes are currently slowed down to, or 0 if they are not.
+  //  "leveldb.write-stall-micros" - returns the total time writes have spent
+  //     delayed or stopped waiting for compactions.
+  //  "leveldb.estimate-pending-compaction-bytes" - returns the estimated
+  //     number of bytes compactions are behind by.
+  //  "leveldb.table-bytes-written" - returns the number of bytes memtable
+  //     flushes and compactions have written to table files since the DB
+  //     was opened.  Divided by the bytes written by the user, this is the
+  //     write amplification.
+  //  "leveldb.compaction-filter-removed-keys",
+  //  "leveldb.compaction-filter-removed-bytes" - return the number of keys
+  //     Options::compaction_filter removed, and the bytes of their keys and
+  //     values.
+  //  "leveldb.rate-limiter-throttled-bytes" - returns the number of flush
+  //     and compaction bytes that had to wait for Options::rate_limiter.
+  //     Not available if no rate limiter is set.
+  //  "leveldb.log-syncs" - returns the number of times writes have synced
+  //     the log since the DB was opened.
   virtual bool GetProperty(const Slice& property, std::string* value) = 0;
 
   // For each i in [0,n-1], store in "sizes[i]", the approximate
@@ -149,6 +221,23 @@ class LEVELDB_EXPORT DB {
   // Therefore the following call will compact the entire database:
   //    db->CompactRange(nullptr, nullptr);
   virtual void CompactRange(const Slice* begin, const Slice* end) = 0;
+
+  // Add the tables in "paths", built with SstFileWriter, to the database.
+  // The files must not overlap each other.  Their entries become visible
+  // at once and shadow older entries of the same keys; snapshots taken
+  // before the call do not see them.  Writes are blocked while the files
+  // are added.
+  //
+  // Each file is placed in the deepest level that keeps the LSM tree
+  // ordered, so a file whose key range is not yet in the database is not
+  // rewritten by compactions on its way down.  A file is copied (or
+  // renamed, see IngestExternalFileOptions) into the database as is,
+  // unless it overlaps existing data: then it is rewritten once to give
+  // its entries a newer sequence number.
+  //
+  // The files must use the comparator the database was opened with.
+  virtual Status IngestExternalFile(const IngestExternalFileOptions& options,
+                                    const std::vector<std::string>& paths) = 0;
 };
 
 // Destroy the contents of the specified database.
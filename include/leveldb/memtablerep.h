@@ -0,0 +1,132 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A MemTableRep is the in-memory index of a memtable: it orders the
+// entries the memtable hands it and iterates over them.  A database can
+// be configured with a MemTableRepFactory to pick the data structure:
+//
+//   skiplist       (default) Fast inserts, point lookups and scans at any
+//                  time, and the only one that allows concurrent inserts.
+//   vector         Appends to an unsorted array and sorts it once the
+//                  memtable stops taking writes.  Fastest to fill, but a
+//                  read of a memtable still being written sorts a copy
+//                  of it.  Meant for bulk loads that do not read.
+//   hash-skiplist  One skiplist per hash bucket of a fixed-length user
+//                  key prefix.  Point lookups only search one small
+//                  skiplist, but a scan has to sort all entries first.
+//
+// Entries are byte arrays owned by the memtable that stay valid for the
+// life of the rep.  Each starts with its key, a varint32 length followed
+// by the internal key, which is how entries are ordered.  Lookup keys
+// passed to Seek() and Get() are encoded the same way.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_MEMTABLEREP_H_
+#define STORAGE_LEVELDB_INCLUDE_MEMTABLEREP_H_
+
+#include <cstddef>
+
+#include "leveldb/export.h"
+
+namespace leveldb {
+
+class LEVELDB_EXPORT MemTableRep {
+ public:
+  // Orders entries and lookup keys by their length-prefixed internal key.
+  class LEVELDB_EXPORT KeyComparator {
+   public:
+    virtual ~KeyComparator();
+
+    virtual int operator()(const char* a, const char* b) const = 0;
+  };
+
+  // Iteration over the entries of a rep in KeyComparator order.
+  class LEVELDB_EXPORT Iterator {
+   public:
+    virtual ~Iterator();
+
+    virtual bool Valid() const = 0;
+
+    // REQUIRES: Valid()
+    virtual const char* key() const = 0;
+
+    // REQUIRES: Valid()
+    virtual void Next() = 0;
+
+    // REQUIRES: Valid()
+    virtual void Prev() = 0;
+
+    // Position at the first entry at or after "key".
+    virtual void Seek(const char* key) = 0;
+
+    virtual void SeekToFirst() = 0;
+    virtual void SeekToLast() = 0;
+  };
+
+  MemTableRep() = default;
+
+  MemTableRep(const MemTableRep&) = delete;
+  MemTableRep& operator=(const MemTableRep&) = delete;
+
+  virtual ~MemTableRep();
+
+  // Add "entry" to the rep.  Calls are externally synchronized, but
+  // readers may run at the same time.
+  // REQUIRES: nothing that compares equal to entry is in the rep.
+  virtual void Insert(const char* entry) = 0;
+
+  // True if InsertConcurrently() may be used.
+  virtual bool IsInsertConcurrentlySupported() const { return false; }
+
+  // Like Insert(), but may be called from several threads at once.
+  // REQUIRES: IsInsertConcurrentlySupported()
+  virtual void InsertConcurrently(const char* entry);
+
+  // Called once the memtable takes no more inserts.
+  virtual void MarkReadOnly() {}
+
+  // Memory taken by the rep itself, not counting the entries.  Safe to
+  // call while the rep is being modified.
+  virtual size_t ApproximateMemoryUsage() = 0;
+
+  // Call callback(arg, entry) on the entries at or after "key", in order,
+  // until it returns false or the entries run out.  Entries of user keys
+  // other than the one in "key" may be skipped.  The default goes through
+  // GetIterator().
+  virtual void Get(const char* key, void* arg,
+                   bool (*callback)(void* arg, const char* entry));
+
+  // Return an iterator over all entries.  The rep must outlive it.
+  virtual Iterator* GetIterator() = 0;
+};
+
+class LEVELDB_EXPORT MemTableRepFactory {
+ public:
+  virtual ~MemTableRepFactory();
+
+  // The rep must use "cmp", which outlives it, to order its entries.
+  virtual MemTableRep* CreateMemTableRep(
+      const MemTableRep::KeyComparator& cmp) = 0;
+
+  virtual const char* Name() const = 0;
+};
+
+// Each of the functions below returns a new factory.  Callers must delete
+// the result after any database that is using it has been closed.
+
+LEVELDB_EXPORT MemTableRepFactory* NewSkipListRepFactory();
+
+// "reserve" is the number of entries to make room for up front.
+LEVELDB_EXPORT MemTableRepFactory* NewVectorRepFactory(size_t reserve = 0);
+
+// Entries are hashed on the first "prefix_length" bytes of their user
+// key (all of it if shorter) into "bucket_count" buckets.  Entries with
+// different prefixes are never compared on a point lookup.  Each memtable
+// allocates a pointer per bucket up front, which does not count towards
+// Options::write_buffer_size.
+LEVELDB_EXPORT MemTableRepFactory* NewHashSkipListRepFactory(
+    size_t prefix_length, size_t bucket_count = 50000);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_MEMTABLEREP_H_
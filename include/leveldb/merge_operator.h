@@ -0,0 +1,68 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A MergeOperator lets an application record an update to a value, like
+// adding to a counter or appending to a list, with DB::Merge() instead of
+// reading the value, changing it and writing it back.  The database keeps
+// the operands next to the value and combines them when the key is read
+// or compacted.  Options::merge_operator sets it.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_MERGE_OPERATOR_H_
+#define STORAGE_LEVELDB_INCLUDE_MERGE_OPERATOR_H_
+
+#include <string>
+#include <vector>
+
+#include "leveldb/export.h"
+#include "leveldb/slice.h"
+
+namespace leveldb {
+
+class LEVELDB_EXPORT MergeOperator {
+ public:
+  virtual ~MergeOperator();
+
+  // The name of the operator.  The operands written by an operator are
+  // only meaningful to operators of the same name.
+  virtual const char* Name() const = 0;
+
+  // Store in "*new_value" the value of "key" after applying "operands",
+  // oldest first, to "*existing_value", or to nothing if "existing_value"
+  // is nullptr because the key had no value or was deleted.
+  //
+  // Return false if the operands cannot be applied, which reads and
+  // compactions report as corruption.
+  virtual bool FullMerge(const Slice& key, const Slice* existing_value,
+                         const std::vector<Slice>& operands,
+                         std::string* new_value) const = 0;
+
+  // Combine two consecutive operands, "left" older than "right", into one
+  // operand in "*new_value" that has the same effect as applying both.
+  // Compactions that cannot see the value of a key use this to shrink its
+  // operands.  Return false if the operands cannot be combined without
+  // the value, in which case they are kept as they are.
+  //
+  // The default implementation never combines operands.
+  virtual bool PartialMerge(const Slice& key, const Slice& left,
+                            const Slice& right, std::string* new_value) const;
+};
+
+// Return a new operator for counters stored as 8-byte little-endian
+// unsigned integers (see EncodeFixed64 in util/coding.h).  Every operand
+// is added to the value, and a missing value counts as zero.
+//
+// Callers must delete the result after any database that is using the
+// result has been closed.
+LEVELDB_EXPORT const MergeOperator* NewUInt64AddOperator();
+
+// Return a new operator that appends every operand to the value, with
+// "delim" in between.
+//
+// Callers must delete the result after any database that is using the
+// result has been closed.
+LEVELDB_EXPORT const MergeOperator* NewStringAppendOperator(char delim);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_MERGE_OPERATOR_H_
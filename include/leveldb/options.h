@@ -6,17 +6,25 @@
 #define STORAGE_LEVELDB_INCLUDE_OPTIONS_H_
 
 #include <cstddef>
+#include <cstdint>
 #include <cassert>
+#include <vector>
 
 #include "leveldb/export.h"
 
 namespace leveldb {
 
 class Cache;
+class CompactionFilter;
 class Comparator;
 class Env;
 class FilterPolicy;
 class Logger;
+class MemTableRepFactory;
+class MergeOperator;
+class RateLimiter;
+class Slice;
+class SliceTransform;
 class Snapshot;
 
 // DB contents are stored in a set of blocks, each of which holds a
@@ -27,7 +35,23 @@ enum CompressionType {
   // NOTE: do not change the values of existing entries, as these are
   // part of the persistent format on disk.
   kNoCompression = 0x0,
-  kSnappyCompression = 0x1
+  kSnappyCompression = 0x1,
+  kZstdCompression = 0x2,
+  kLZ4Compression = 0x3
+};
+
+// How the sorted runs of the database are merged by compactions.
+enum CompactionStyle {
+  // Every level above level-0 is one sorted run that is kept about ten
+  // times the size of the previous one by merging its overlapping
+  // files into the next level.  Keeps reads and space overhead low.
+  kCompactionStyleLevel = 0x0,
+
+  // Each level-0 file and each non-empty level is a sorted run, and runs
+  // of similar size are merged into one.  Every byte is rewritten far
+  // fewer times than with kCompactionStyleLevel, at the cost of more runs
+  // to search and of space taken by obsolete versions.
+  kCompactionStyleTiered = 0x1
 };
 
 // Options to control the behavior of a database (passed to DB::Open)
@@ -52,8 +76,39 @@ struct LEVELDB_EXPORT Options {
   // If false, the database will not do compaction background
   bool enable_compaction = false;
 
-  // the thread count used for compaciton
-  bool thread_compaction = 1;
+  // Maximum number of compactions that run at the same time, each on its
+  // own background thread of "env".  Compactions that run together never
+  // share input files, so they always touch disjoint key ranges.
+  int thread_compaction = 1;
+
+  // Maximum number of key-range shards one compaction is split into.  The
+  // shards are cut at data block boundaries of the inputs, run on their
+  // own threads and produce their own output files, which are installed
+  // together in a single version edit.  1 keeps each compaction on a
+  // single thread.
+  int max_subcompactions = 1;
+
+  // Number of threads that replay the log files when the database is
+  // opened.  With more than one, the opening thread reads and checksums
+  // the log records while the others insert them into memtables, a new
+  // memtable for each write_buffer_size worth of records, and write out
+  // the full memtables as level-0 tables in parallel.  Ignored with a
+  // memtable_factory whose reps do not support concurrent inserts.
+  int max_recovery_threads = 1;
+
+  // Compaction policy.  A database written with either style can be
+  // reopened with the other.
+  CompactionStyle compaction_style = kCompactionStyleLevel;
+
+  // kCompactionStyleTiered: a run joins the runs newer than it in one
+  // compaction if it is at most this many percent larger than their
+  // total size.
+  int tiered_size_ratio = 1;
+
+  // kCompactionStyleTiered: once the runs newer than the oldest one add
+  // up to more than this many percent of its size, all runs are merged
+  // into one.  Bounds the space taken by obsolete versions.
+  int tiered_max_size_amplification_percent = 200;
 
   // If true, the database will use direct IO for accessing file
   bool enable_direct_io = false;
@@ -91,6 +146,24 @@ struct LEVELDB_EXPORT Options {
   // the next time the database is opened.
   size_t write_buffer_size = 4 * 1024 * 1024;
 
+  // Rate in bytes per second that writes are slowed down to once level-0
+  // approaches its file limit or the estimated compaction backlog exceeds
+  // soft_pending_compaction_bytes_limit.  The rate is lowered further while
+  // the backlog keeps growing and raised again as compactions catch up.
+  // 0 falls back to delaying each write by a fixed 1ms instead.
+  uint64_t delayed_write_rate = 16 * 1024 * 1024;
+
+  // Estimated number of bytes compactions need to rewrite to bring every
+  // level back within its size limit, beyond which writes are slowed
+  // down.  0 disables the check, leaving level-0 as the only trigger.
+  uint64_t soft_pending_compaction_bytes_limit = 64 * 1024 * 1024;
+
+  // If non-null, the table files written by memtable flushes and
+  // compactions, and the input compactions read, are paced through this
+  // limiter.  Flushes take priority over compactions.  Log writes and
+  // foreground reads are never limited.
+  RateLimiter* rate_limiter = nullptr;
+
   // Number of open files that can be used by the DB.  You may need to
   // increase this if your database has a large working set (budget
   // one open file per 2MB of working set).
@@ -103,6 +176,14 @@ struct LEVELDB_EXPORT Options {
   // If null, leveldb will automatically create and use an 8MB internal cache.
   Cache* block_cache = nullptr;
 
+  // If non-null, blocks are also cached in their compressed on-disk form
+  // in this cache.  A block_cache miss that hits here costs a decompress
+  // rather than a read, and a compressed block takes a fraction of the
+  // memory of its uncompressed form, so this cache can usually be made
+  // several times larger than block_cache for the same memory budget.
+  // Blocks stored without compression are not added.
+  Cache* compressed_block_cache = nullptr;
+
   // Approximate size of user data packed per block.  Note that the
   // block size specified here corresponds to uncompressed data.  The
   // actual size of the unit read from disk may be smaller if
@@ -114,6 +195,30 @@ struct LEVELDB_EXPORT Options {
   // leave this parameter alone.
   int block_restart_interval = 16;
 
+  // If true, every data block carries a small hash index that maps each
+  // key to the restart interval holding it.  Point lookups then skip the
+  // binary search over restart points.  Blocks written with this option
+  // cannot be read by releases that predate it.
+  //
+  // Default: false
+  bool data_block_hash_index = false;
+
+  // Ratio of hash index buckets to distinct keys in a data block.  Only
+  // used when data_block_hash_index is true.  Larger values reduce bucket
+  // collisions (which fall back to binary search) at the cost of space.
+  double data_block_hash_ratio = 1.33;
+
+  // If true, every block also stores the first 8 bytes of the key at each
+  // restart point, so that a seek can binary search the restart points
+  // with integer comparisons and only decode the keys that tie.  Only
+  // used when keys are ordered by BytewiseComparator() (for a database,
+  // when the user comparator is).  Costs 8 bytes per restart point.
+  // Blocks written with this option cannot be read by releases that
+  // predate it.
+  //
+  // Default: false
+  bool block_restart_key_prefixes = false;
+
   // Leveldb will write up to this amount of bytes to a file before
   // switching to a new one.
   // Most clients should leave this parameter alone.  However if your
@@ -140,16 +245,99 @@ struct LEVELDB_EXPORT Options {
   // efficiently detect that and will switch to uncompressed mode.
   CompressionType compression = kSnappyCompression;
 
+  // Compression level used when a block is compressed with
+  // kZstdCompression.  Higher levels trade compression speed for ratio.
+  int zstd_compression_level = 1;
+
+  // If non-empty, overrides "compression" for tables written to a level:
+  // tables written to level L use compression_per_level[L], or the last
+  // entry if L is past the end.  Memtable flushes use the entry for level
+  // 0.  A typical setup leaves the CPU-bound upper levels on a fast codec
+  // (or none) and switches the large lower levels to kZstdCompression.
+  std::vector<CompressionType> compression_per_level;
+
   // EXPERIMENTAL: If true, append to existing MANIFEST and log files
   // when a database is opened.  This can significantly speed up open.
   //
   // Default: currently false, but may become true later.
   bool reuse_logs = false;
 
+  // If true, DB::Write pipelines group commit: the next group of writers
+  // appends its batch to the log while the previous group is still being
+  // applied to the memtable.  Groups are applied, and become visible to
+  // readers, in log order, so the semantics of Write() are unchanged.
+  // Helps write throughput with many concurrent writers.
+  bool enable_pipelined_write = false;
+
+  // If true, the writers of a write group apply their own batches to the
+  // memtable in parallel once the group's log record is written, instead
+  // of the group leader applying the whole group alone.  Helps write
+  // throughput with many concurrent writers.  Ignored when
+  // enable_pipelined_write is set, and with a memtable_factory whose reps
+  // do not support concurrent inserts.
+  bool allow_concurrent_memtable_write = false;
+
+  // If true, file system space for about write_buffer_size bytes, the
+  // size a log file grows to before its memtable is written out, is
+  // reserved when each log file is created.  Appends to the log then do
+  // not have to allocate blocks, which makes synced writes cheaper.
+  bool preallocate_log_file = false;
+
+  // If true, log files are written with direct I/O, bypassing the page
+  // cache, where the file system supports it.  Every write group still
+  // goes to the file right away, padded to a whole device block, so this
+  // mostly suits workloads that write with WriteOptions::sync.
+  bool use_direct_io_for_log = false;
+
+  // A write group that is going to sync the log first waits this many
+  // microseconds for more writers to join it, so that a single sync
+  // covers all of them.  Under many concurrent synced writers this trades
+  // a little latency for far fewer syncs.  0 does not wait.
+  uint64_t log_sync_delay_micros = 0;
+
+  // Values of at least this many bytes are moved out of the tables into
+  // append-only blob files when a memtable is written out or compacted,
+  // and the tables keep a small reference to them instead.  Compactions
+  // then move the references rather than the values, which cuts write
+  // amplification for large values; reading such a value takes one more
+  // file read.  0 keeps every value in the tables.
+  size_t min_blob_size = 0;
+
+  // Once at least this fraction of the bytes of a blob file belongs to
+  // values that have since been overwritten or deleted, compactions copy
+  // the values still referenced out of it, so that the file can go.  A
+  // blob file is deleted as soon as nothing references it.
+  double blob_gc_garbage_ratio = 0.5;
+
+  // If non-null, use the specified factory for the index of each memtable
+  // (see leveldb/memtablerep.h).
+  // If null, leveldb indexes memtables with a skiplist.
+  MemTableRepFactory* memtable_factory = nullptr;
+
   // If non-null, use the specified filter policy to reduce disk reads.
   // Many applications will benefit from passing the result of
   // NewBloomFilterPolicy() here.
   const FilterPolicy* filter_policy = nullptr;
+
+  // If non-null, the filters built with filter_policy also hold the
+  // prefixes this transform extracts from the keys, so that iterators
+  // reading with ReadOptions::prefix_same_as_start skip the tables and
+  // data blocks that hold no key with the prefix they seek to.  Tables
+  // written with another prefix extractor, or none, are read without
+  // their filters.
+  const SliceTransform* prefix_extractor = nullptr;
+
+  // If non-null, compactions pass the newest value of every key to this
+  // filter, which may remove the key or change the value (see
+  // leveldb/compaction_filter.h).  NewTTLCompactionFilter() removes the
+  // values older than a time to live.
+  const CompactionFilter* compaction_filter = nullptr;
+
+  // If non-null, DB::Merge() records operands that this operator applies
+  // to the value of their key when the key is read or compacted (see
+  // leveldb/merge_operator.h).  A database holding operands must always be
+  // opened with an operator of the same name.
+  const MergeOperator* merge_operator = nullptr;
 };
 
 // Options that control read operations
@@ -193,6 +381,24 @@ struct LEVELDB_EXPORT ReadOptions {
   // snapshot of the state at the beginning of this read operation.
   const Snapshot* snapshot = nullptr;
 
+  // If true, an iterator only yields keys that share the prefix, as
+  // extracted by Options::prefix_extractor, of the target of its last
+  // Seek(), and becomes invalid after them.  Without a prefix extractor,
+  // or after SeekToFirst() or SeekToLast(), all keys are yielded.
+  bool prefix_same_as_start = false;
+
+  // If non-null, an iterator does not go back past *iterate_lower_bound:
+  // SeekToFirst() and seeks to smaller targets go to the bound, and the
+  // iterator becomes invalid before the keys less than it.  The slice must
+  // outlive the iterator.
+  const Slice* iterate_lower_bound = nullptr;
+
+  // If non-null, an iterator becomes invalid at the first key at or after
+  // *iterate_upper_bound instead of reading on, and SeekToLast() goes to
+  // the last key before it.  The files and data blocks entirely outside
+  // the bounds are not read.  The slice must outlive the iterator.
+  const Slice* iterate_upper_bound = nullptr;
+
   // Whether to use global index table
   // If 0, don't use global index table
   // If 1, only use global index table
@@ -226,6 +432,44 @@ struct LEVELDB_EXPORT WriteOptions {
   bool sync = false;
 };
 
+// Options that control DB::IngestExternalFile()
+struct LEVELDB_EXPORT IngestExternalFileOptions {
+  IngestExternalFileOptions() = default;
+
+  // If true, the files are moved into the database instead of copied: a
+  // file that is added unchanged is renamed, and one that is rewritten is
+  // removed once it is in.  The files must then be on the same file
+  // system as the database.
+  bool move_files = false;
+
+  // If true, unflushed writes to the key range of a file are written to
+  // a table before the file is added.  If false, such an ingestion fails
+  // with InvalidArgument instead.
+  bool allow_blocking_flush = true;
+};
+
+// Options that control DB::ParallelScan()
+struct LEVELDB_EXPORT ParallelScanOptions {
+  ParallelScanOptions() = default;
+
+  // Number of key ranges the scan is cut into.  The ranges hold about
+  // the same amount of table data; unflushed writes are not weighed.
+  int num_partitions = 8;
+
+  // Number of threads that scan the ranges.  An unordered scan counts
+  // the calling thread as one of them.
+  int max_threads = 4;
+
+  // If true, the entries are delivered on the calling thread in key
+  // order.  If false, each thread delivers the entries of the range it
+  // scans, so the callback is called from several threads at once.
+  bool ordered = true;
+
+  // Ordered scans only: bytes of entries a range may read ahead of the
+  // entries delivered so far before its thread waits.
+  size_t max_buffered_bytes = 4 * 1024 * 1024;
+};
+
 }  // namespace leveldb
 
 #endif  // STORAGE_LEVELDB_INCLUDE_OPTIONS_H_
@@ -0,0 +1,103 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A PinnableSlice is a Slice that can keep the memory it points into
+// alive.  DB::Get() uses it to hand out a value in place, straight from
+// the block cache or a memory-mapped table, instead of copying it:
+//
+//   leveldb::PinnableSlice value;
+//   leveldb::Status s = db->Get(leveldb::ReadOptions(), key, &value);
+//   if (s.ok()) Use(value);
+//   value.Reset();   // Or let it go out of scope
+//
+// While a value is pinned, the cache block or table it points into
+// cannot be freed, so a pinned value should be released soon and must be
+// released before the database (and its caches) are deleted.  Values the
+// database cannot pin, such as those still in a memtable, are copied
+// into a buffer owned by the PinnableSlice.
+//
+// A PinnableSlice is not thread-safe.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_PINNABLE_SLICE_H_
+#define STORAGE_LEVELDB_INCLUDE_PINNABLE_SLICE_H_
+
+#include <cassert>
+#include <string>
+
+#include "leveldb/cleanable.h"
+#include "leveldb/export.h"
+#include "leveldb/slice.h"
+
+namespace leveldb {
+
+class LEVELDB_EXPORT PinnableSlice : public Slice, public Cleanable {
+ public:
+  // Copies go to a buffer owned by the PinnableSlice.
+  PinnableSlice() : buf_(&self_space_), pinned_(false) {}
+
+  // Copies go to "*buf", which must outlive the PinnableSlice.
+  explicit PinnableSlice(std::string* buf) : buf_(buf), pinned_(false) {}
+
+  PinnableSlice(const PinnableSlice&) = delete;
+  PinnableSlice& operator=(const PinnableSlice&) = delete;
+
+  // Point at "s", which stays valid until the cleanup functions that
+  // "cleanable" has registered run.  Those now run on Reset() or when
+  // this object is destroyed instead.
+  // REQUIRES: !IsPinned()
+  void PinSlice(const Slice& s, Cleanable* cleanable) {
+    assert(!pinned_);
+    pinned_ = true;
+    Slice::operator=(s);
+    cleanable->DelegateCleanupsTo(this);
+  }
+
+  // Point at "s", which stays valid until (*function)(arg1, arg2) runs.
+  // REQUIRES: !IsPinned()
+  void PinSlice(const Slice& s, CleanupFunction function, void* arg1,
+                void* arg2) {
+    assert(!pinned_);
+    pinned_ = true;
+    Slice::operator=(s);
+    RegisterCleanup(function, arg1, arg2);
+  }
+
+  // Point at a copy of "s" in the buffer.
+  // REQUIRES: !IsPinned()
+  void PinSelf(const Slice& s) {
+    assert(!pinned_);
+    buf_->assign(s.data(), s.size());
+    Slice::operator=(*buf_);
+  }
+
+  // Point at the buffer, after it has been filled in through GetSelf().
+  // REQUIRES: !IsPinned()
+  void PinSelf() {
+    assert(!pinned_);
+    Slice::operator=(*buf_);
+  }
+
+  std::string* GetSelf() { return buf_; }
+
+  // True if the value points into memory the object keeps alive rather
+  // than into its buffer.
+  bool IsPinned() const { return pinned_; }
+
+  // Release whatever is pinned and become empty.  The buffer is left
+  // as it is.
+  void Reset() {
+    DoCleanup();
+    pinned_ = false;
+    Slice::clear();
+  }
+
+ private:
+  std::string self_space_;
+  std::string* buf_;
+  bool pinned_;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_PINNABLE_SLICE_H_
@@ -0,0 +1,65 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A RateLimiter caps the rate of the background I/O a database does for
+// memtable flushes and compactions, so that it does not starve foreground
+// reads of device bandwidth.  One limiter may be shared by several
+// databases to bound their combined background I/O.
+//
+// Most people will want to use the builtin token bucket implementation
+// (see NewGenericRateLimiter() below).
+
+#ifndef STORAGE_LEVELDB_INCLUDE_RATE_LIMITER_H_
+#define STORAGE_LEVELDB_INCLUDE_RATE_LIMITER_H_
+
+#include <cstdint>
+
+#include "leveldb/export.h"
+
+namespace leveldb {
+
+class LEVELDB_EXPORT RateLimiter {
+ public:
+  // Background I/O is served in priority order: flushes free up memtable
+  // space that foreground writes may be waiting for, so they go first.
+  enum IOPriority { kFlush = 0, kCompaction = 1, kNumPriorities = 2 };
+
+  RateLimiter() = default;
+
+  RateLimiter(const RateLimiter&) = delete;
+  RateLimiter& operator=(const RateLimiter&) = delete;
+
+  virtual ~RateLimiter();
+
+  // Blocks until "bytes" of I/O at priority "pri" fit within the rate.
+  // Safe to call from multiple threads.
+  virtual void Request(int64_t bytes, IOPriority pri) = 0;
+
+  // Current rate limit in bytes per second.
+  virtual int64_t GetBytesPerSecond() const = 0;
+
+  // Total bytes requested at priority "pri".
+  virtual uint64_t GetTotalBytesThrough(IOPriority pri) const = 0;
+
+  // Bytes requested at priority "pri" that had to wait for the rate.
+  virtual uint64_t GetThrottledBytes(IOPriority pri) const = 0;
+};
+
+// Return a new token bucket rate limiter allowing "rate_bytes_per_sec"
+// bytes per second, refilled every "refill_period_us" microseconds.
+//
+// If "auto_tuned" is true, the rate adapts to the observed demand between
+// rate_bytes_per_sec / 20 and rate_bytes_per_sec: it is lowered while the
+// background I/O does not use the rate it has, and raised again while
+// requests keep draining the bucket.
+//
+// Callers must delete the result after any database that is using the
+// result has been closed.
+LEVELDB_EXPORT RateLimiter* NewGenericRateLimiter(
+    int64_t rate_bytes_per_sec, int64_t refill_period_us = 100 * 1000,
+    bool auto_tuned = false);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_RATE_LIMITER_H_
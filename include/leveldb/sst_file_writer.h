@@ -0,0 +1,73 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// SstFileWriter builds a table outside of any database that can later be
+// added to one with DB::IngestExternalFile().  Bulk loading sorted data
+// this way skips the log, the memtable and most compactions.
+//
+//   leveldb::SstFileWriter writer(options);
+//   leveldb::Status s = writer.Open("/tmp/batch.ldb");
+//   for (...) s = writer.Put(key, value);   // Keys in increasing order
+//   s = writer.Finish();
+//   s = db->IngestExternalFile(leveldb::IngestExternalFileOptions(),
+//                              {"/tmp/batch.ldb"});
+//
+// An SstFileWriter is not thread-safe.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_SST_FILE_WRITER_H_
+#define STORAGE_LEVELDB_INCLUDE_SST_FILE_WRITER_H_
+
+#include <cstdint>
+#include <string>
+
+#include "leveldb/export.h"
+#include "leveldb/options.h"
+#include "leveldb/slice.h"
+#include "leveldb/status.h"
+
+namespace leveldb {
+
+class LEVELDB_EXPORT SstFileWriter {
+ public:
+  // "options" should match those the database is opened with: the
+  // comparator orders the keys, and the filter policy, compression and
+  // block settings shape the table.
+  explicit SstFileWriter(const Options& options);
+
+  SstFileWriter(const SstFileWriter&) = delete;
+  SstFileWriter& operator=(const SstFileWriter&) = delete;
+
+  // Abandons the file if Finish() has not been called.
+  ~SstFileWriter();
+
+  // Create the file at "path" and start a new table in it.
+  Status Open(const std::string& path);
+
+  // Add an entry.  Returns InvalidArgument unless "key" is after every
+  // key added before it.
+  // REQUIRES: Open() succeeded and Finish() has not been called.
+  Status Put(const Slice& key, const Slice& value);
+
+  // Record that "key" is deleted: ingesting the file hides any older
+  // value of "key" in the database.  Ordered like Put().
+  Status Delete(const Slice& key);
+
+  // Finish the table and sync and close the file.  If file_size is not
+  // null, it is set to the size of the file.  A table must not be empty.
+  Status Finish(uint64_t* file_size = nullptr);
+
+  // Size of the file generated so far.
+  uint64_t FileSize() const;
+
+ private:
+  struct Rep;
+
+  Status Add(const Slice& key, const Slice& value, bool deletion);
+
+  Rep* rep_;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_SST_FILE_WRITER_H_
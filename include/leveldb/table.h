@@ -68,11 +68,17 @@ class LEVELDB_EXPORT Table {
   explicit Table(Rep* rep) : rep_(rep) {}
 
   // Calls (*handle_result)(arg, ...) with the entry found after a call
-  // to Seek(key).  May not make such a call if filter policy says
-  // that key is not present.
+  // to Seek(key), and with the entries after it for as long as it returns
+  // true.  May not make such a call if filter policy says that key is not
+  // present.  The entry stays valid while the cleanup functions of
+  // "value_pinner" have not run; handle_result may take them over with
+  // DelegateCleanupsTo().  Cleanup functions registered on "table_pin" are
+  // handed to "value_pinner" first.
   Status InternalGet(const ReadOptions&, const Slice& key, void* arg,
-                     void (*handle_result)(void* arg, const Slice& k,
-                                           const Slice& v));
+                     bool (*handle_result)(void* arg, const Slice& k,
+                                           const Slice& v,
+                                           Cleanable* value_pinner),
+                     Cleanable* table_pin);
 
 
   // *****************************************************************
@@ -37,6 +37,16 @@ class LEVELDB_EXPORT WriteBatch {
     virtual ~Handler();
     virtual void Put(const Slice& key, const Slice& value) = 0;
     virtual void Delete(const Slice& key) = 0;
+
+    // Called for the records written by WriteBatch::Merge().  The default
+    // implementation makes Iterate() fail with NotSupported, for handlers
+    // written before batches could hold merges.
+    virtual void Merge(const Slice& key, const Slice& value);
+
+   private:
+    friend class WriteBatch;
+
+    bool merge_not_supported_ = false;
   };
 
   WriteBatch();
@@ -53,6 +63,10 @@ class LEVELDB_EXPORT WriteBatch {
   // If the database contains a mapping for "key", erase it.  Else do nothing.
   void Delete(const Slice& key);
 
+  // Apply the operand "value" to the mapping for "key" with the
+  // Options::merge_operator of the database the batch is written to.
+  void Merge(const Slice& key, const Slice& value);
+
   // Clear all updates buffered in this batch.
   void Clear();
 
@@ -81,6 +81,41 @@ bool Snappy_GetUncompressedLength(const char* input, size_t length,
 bool Snappy_Uncompress(const char* input_data, size_t input_length,
                        char* output);
 
+// Store the zstd compression of "input[0,input_length-1]" in *output,
+// using the given compression level.  Returns false if zstd is not
+// supported by this port.
+bool Zstd_Compress(int level, const char* input, size_t input_length,
+                   std::string* output);
+
+// If input[0,input_length-1] looks like a valid zstd compressed
+// buffer, store the size of the uncompressed data in *result and
+// return true.  Else return false.
+bool Zstd_GetUncompressedLength(const char* input, size_t length,
+                                size_t* result);
+
+// Attempt to zstd uncompress input[0,input_length-1] into *output.
+// Returns true if successful, false if the input is invalid zstd
+// compressed data.
+//
+// REQUIRES: at least the first "n" bytes of output[] must be writable
+// where "n" is the result of a successful call to
+// Zstd_GetUncompressedLength.
+bool Zstd_Uncompress(const char* input_data, size_t input_length,
+                     char* output);
+
+// Store the lz4 compression of "input[0,input_length-1]" in *output.
+// Returns false if lz4 is not supported by this port.  The raw lz4
+// format does not record the uncompressed length, so callers must
+// store it themselves.
+bool LZ4_Compress(const char* input, size_t input_length,
+                  std::string* output);
+
+// Attempt to lz4 uncompress input[0,input_length-1] into *output, which
+// must hold exactly "output_length" bytes once uncompressed.  Returns
+// true if successful, false if the input is invalid lz4 compressed data.
+bool LZ4_Uncompress(const char* input_data, size_t input_length, char* output,
+                    size_t output_length);
+
 // ------------------ Miscellaneous -------------------
 
 // If heap profiling is not supported, returns false.
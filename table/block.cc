@@ -19,23 +19,61 @@ namespace leveldb {
 
 inline uint32_t Block::NumRestarts() const {
   assert(size_ >= sizeof(uint32_t));
-  return DecodeFixed32(data_ + size_ - sizeof(uint32_t));
+  return DecodeFixed32(data_ + size_ - sizeof(uint32_t)) &
+         ~(kBlockHashIndexFlag | kBlockKeyPrefixFlag);
 }
 
 Block::Block(const BlockContents& contents)
     : data_(contents.data.data()),
       size_(contents.data.size()),
-      owned_(contents.heap_allocated) {
+      owned_(contents.heap_allocated),
+      hash_buckets_(nullptr),
+      num_hash_buckets_(0),
+      hash_suffix_len_(0),
+      key_prefixes_(nullptr),
+      key_prefix_suffix_len_(0) {
   if (size_ < sizeof(uint32_t)) {
     size_ = 0;  // Error marker
-  } else {
-    size_t max_restarts_allowed = (size_ - sizeof(uint32_t)) / sizeof(uint32_t);
-    if (NumRestarts() > max_restarts_allowed) {
-      // The size is too small for NumRestarts()
+    return;
+  }
+  // Bytes between the restart array and the end of the block
+  size_t trailer = sizeof(uint32_t);
+  const uint32_t flags = DecodeFixed32(data_ + size_ - sizeof(uint32_t));
+  const bool has_hash_index = (flags & kBlockHashIndexFlag) != 0;
+  const bool has_key_prefixes = (flags & kBlockKeyPrefixFlag) != 0;
+  if (has_hash_index) {
+    if (size_ < trailer + 3) {
       size_ = 0;
-    } else {
-      restart_offset_ = size_ - (1 + NumRestarts()) * sizeof(uint32_t);
+      return;
+    }
+    const uint8_t* p =
+        reinterpret_cast<const uint8_t*>(data_ + size_ - trailer - 3);
+    num_hash_buckets_ = p[0] | (static_cast<uint32_t>(p[1]) << 8);
+    hash_suffix_len_ = p[2];
+    trailer += 3 + num_hash_buckets_;
+    if (num_hash_buckets_ == 0 || size_ < trailer) {
+      size_ = 0;
+      return;
+    }
+    hash_buckets_ = p - num_hash_buckets_;
+  }
+  if (has_key_prefixes) {
+    if (size_ < trailer + 1 ||
+        NumRestarts() > (size_ - trailer - 1) / sizeof(uint64_t)) {
+      size_ = 0;
+      return;
     }
+    key_prefix_suffix_len_ =
+        static_cast<uint8_t>(data_[size_ - trailer - 1]);
+    trailer += 1 + NumRestarts() * sizeof(uint64_t);
+    key_prefixes_ = data_ + size_ - trailer;
+  }
+  size_t max_restarts_allowed = (size_ - trailer) / sizeof(uint32_t);
+  if (NumRestarts() > max_restarts_allowed) {
+    // The size is too small for NumRestarts()
+    size_ = 0;
+  } else {
+    restart_offset_ = size_ - trailer - NumRestarts() * sizeof(uint32_t);
   }
 }
 
@@ -62,6 +100,15 @@ static inline const char* DecodeEntry(const char* p, const char* limit,
   if ((*shared | *non_shared | *value_length) < 128) {
     // Fast path: all three values are encoded in one byte each
     p += 3;
+  } else if ((*shared | *non_shared) < 128 && limit - p >= 4 &&
+             reinterpret_cast<const uint8_t*>(p)[3] < 128) {
+    // Second fast path: one-byte key lengths and a two-byte value length,
+    // the usual header for values of 128 bytes to 16KB
+    *value_length = (*value_length & 0x7f) |
+                    (static_cast<uint32_t>(
+                         reinterpret_cast<const uint8_t*>(p)[3])
+                     << 7);
+    p += 4;
   } else {
     if ((p = GetVarint32Ptr(p, limit, shared)) == nullptr) return nullptr;
     if ((p = GetVarint32Ptr(p, limit, non_shared)) == nullptr) return nullptr;
@@ -87,6 +134,7 @@ class Block::Iter : public Iterator {
   std::string key_;
   Slice value_;
   Status status_;
+  const Block* const block_;  // Source of the hash index
 
   inline int Compare(const Slice& a, const Slice& b) const {
     return comparator_->Compare(a, b);
@@ -114,13 +162,14 @@ class Block::Iter : public Iterator {
 
  public:
   Iter(const Comparator* comparator, const char* data, uint32_t restarts,
-       uint32_t num_restarts)
+       uint32_t num_restarts, const Block* block)
       : comparator_(comparator),
         data_(data),
         restarts_(restarts),
         num_restarts_(num_restarts),
         current_(restarts_),
-        restart_index_(num_restarts_) {
+        restart_index_(num_restarts_),
+        block_(block) {
     assert(num_restarts_ > 0);
   }
 
@@ -184,8 +233,28 @@ class Block::Iter : public Iterator {
       }
     }
 
+    // With key prefixes, restart points whose prefix differs from the
+    // target's are ordered without decoding their keys.
+    const char* const prefixes = block_->key_prefixes_;
+    const uint32_t suffix_len = block_->key_prefix_suffix_len_;
+    const bool use_prefixes =
+        prefixes != nullptr && target.size() >= suffix_len;
+    const uint64_t target_prefix =
+        use_prefixes ? BlockKeyPrefix(target, suffix_len) : 0;
+
     while (left < right) {
       uint32_t mid = (left + right + 1) / 2;
+      if (use_prefixes) {
+        const uint64_t mid_prefix =
+            DecodeFixed64(prefixes + mid * sizeof(uint64_t));
+        if (mid_prefix < target_prefix) {
+          left = mid;
+          continue;
+        } else if (mid_prefix > target_prefix) {
+          right = mid - 1;
+          continue;
+        }
+      }
       uint32_t region_offset = GetRestartPoint(mid);
       uint32_t shared, non_shared, value_length;
       const char* key_ptr =
@@ -226,6 +295,46 @@ class Block::Iter : public Iterator {
     }
   }
 
+  // Point lookup through the hash index.  Returns false if the index
+  // cannot answer and a regular Seek() is required.
+  bool HashSeek(const Slice& target) {
+    if (block_->hash_buckets_ == nullptr ||
+        target.size() < block_->hash_suffix_len_) {
+      return false;
+    }
+    const uint32_t h = BlockKeyHash(target, block_->hash_suffix_len_);
+    const uint8_t bucket =
+        block_->hash_buckets_[h % block_->num_hash_buckets_];
+    if (bucket == kHashBucketCollision) {
+      return false;
+    }
+    if (bucket == kHashBucketEmpty || bucket >= num_restarts_) {
+      // Key is not in this block
+      current_ = restarts_;
+      restart_index_ = num_restarts_;
+      return true;
+    }
+
+    // Linear search within the restart interval for first key >= target.
+    // All versions of a key live in one interval, so running off its end
+    // means target is absent.
+    SeekToRestartPoint(bucket);
+    const uint32_t limit = bucket + 1 < num_restarts_
+                               ? GetRestartPoint(bucket + 1)
+                               : restarts_;
+    while (ParseNextKey()) {
+      if (current_ >= limit) {
+        current_ = restarts_;
+        restart_index_ = num_restarts_;
+        return true;
+      }
+      if (Compare(key_, target) >= 0) {
+        return true;
+      }
+    }
+    return true;
+  }
+
   void SeekToFirst() override {
     SeekToRestartPoint(0);
     ParseNextKey();
@@ -285,7 +394,14 @@ Iterator* Block::NewIterator(const Comparator* comparator) {
   if (num_restarts == 0) {
     return NewEmptyIterator();
   } else {
-    return new Iter(comparator, data_, restart_offset_, num_restarts);
+    return new Iter(comparator, data_, restart_offset_, num_restarts, this);
+  }
+}
+
+void Block::SeekForGet(Iterator* iter, const Slice& target) {
+  Iter* block_iter = dynamic_cast<Iter*>(iter);
+  if (block_iter == nullptr || !block_iter->HashSeek(target)) {
+    iter->Seek(target);
   }
 }
 
@@ -9,12 +9,42 @@
 #include <cstdint>
 
 #include "leveldb/iterator.h"
+#include "leveldb/slice.h"
+#include "util/hash.h"
 
 namespace leveldb {
 
 struct BlockContents;
 class Comparator;
 
+// Set in the trailing num_restarts word of a block that carries a hash
+// index (see block_builder.cc for the layout).
+static const uint32_t kBlockHashIndexFlag = 1u << 31;
+// Set in the trailing num_restarts word of a block that carries the key
+// prefixes of its restart points.
+static const uint32_t kBlockKeyPrefixFlag = 1u << 30;
+static const uint8_t kHashBucketEmpty = 255;
+static const uint8_t kHashBucketCollision = 254;
+static const uint32_t kMaxHashRestartIndex = 253;
+
+inline uint32_t BlockKeyHash(const Slice& key, size_t suffix_len) {
+  return Hash(key.data(), key.size() - suffix_len, 0x9ae16a3b);
+}
+
+// The first 8 bytes of "key" minus its last "suffix_len" bytes, padded
+// with zeros, read as a big-endian number.  Under bytewise ordering the
+// key with the smaller prefix is the smaller key; equal prefixes decide
+// nothing.
+inline uint64_t BlockKeyPrefix(const Slice& key, size_t suffix_len) {
+  const size_t n = key.size() - suffix_len;
+  uint64_t prefix = 0;
+  for (size_t i = 0; i < 8; i++) {
+    prefix <<= 8;
+    if (i < n) prefix |= static_cast<uint8_t>(key[i]);
+  }
+  return prefix;
+}
+
 class Block {
  public:
   // Initialize the block with the specified contents.
@@ -28,6 +58,13 @@ class Block {
   size_t size() const { return size_; }
   Iterator* NewIterator(const Comparator* comparator);
 
+  // Position "iter" for a point lookup of "target".  If "iter" came from
+  // a block with a hash index, the restart interval is found through the
+  // index and "iter" may be left invalid (or past the keys matching
+  // target) when target is not in the block.  Otherwise this is
+  // equivalent to iter->Seek(target).
+  static void SeekForGet(Iterator* iter, const Slice& target);
+
  private:
   class Iter;
 
@@ -37,6 +74,15 @@ class Block {
   size_t size_;
   uint32_t restart_offset_;  // Offset in data_ of restart array
   bool owned_;               // Block owns data_[]
+
+  // Hash index, if present
+  const uint8_t* hash_buckets_;
+  uint32_t num_hash_buckets_;
+  uint32_t hash_suffix_len_;
+
+  // Fixed64 key prefixes of the restart points, if present
+  const char* key_prefixes_;
+  uint32_t key_prefix_suffix_len_;
 };
 
 }  // namespace leveldb
@@ -25,20 +25,54 @@
 //     restarts: uint32[num_restarts]
 //     num_restarts: uint32
 // restarts[i] contains the offset within the block of the ith restart point.
+//
+// If options.data_block_hash_index is set, a hash index is placed between
+// the restart array and num_restarts, and the high bit of num_restarts is
+// set to mark its presence:
+//     restarts: uint32[num_restarts]
+//     buckets: uint8[num_buckets]
+//     num_buckets: uint16
+//     suffix_len: uint8
+//     num_restarts | kBlockHashIndexFlag: uint32
+// buckets[Hash(key minus its last suffix_len bytes) % num_buckets] holds
+// the index of the restart interval containing that key, or one of the
+// markers kHashBucketEmpty / kHashBucketCollision.  For tables keyed by
+// internal keys suffix_len is 8, so all versions of a user key share a
+// bucket.
+//
+// If options.block_restart_key_prefixes is set and keys are ordered
+// bytewise, the key prefixes of the restart points follow the restart
+// array, and the second highest bit of num_restarts marks them:
+//     restarts: uint32[num_restarts]
+//     prefixes: fixed64[num_restarts]
+//     prefix_suffix_len: uint8
+//     [hash index, as above]
+//     num_restarts | kBlockKeyPrefixFlag [| kBlockHashIndexFlag]: uint32
+// prefixes[i] is BlockKeyPrefix(restart key i, prefix_suffix_len).
 
 #include "table/block_builder.h"
 
 #include <algorithm>
 #include <cassert>
 
+#include "db/dbformat.h"
 #include "leveldb/comparator.h"
 #include "leveldb/options.h"
+#include "table/block.h"
 #include "util/coding.h"
+#include "util/hash.h"
 
 namespace leveldb {
 
 BlockBuilder::BlockBuilder(const Options* options)
-    : options_(options), restarts_(), counter_(0), finished_(false) {
+    : options_(options),
+      restarts_(),
+      counter_(0),
+      finished_(false),
+      hash_suffix_len_(0),
+      hash_indexable_(true),
+      prefix_suffix_len_(0),
+      store_key_prefixes_(false) {
   assert(options->block_restart_interval >= 1);
   restarts_.push_back(0);  // First restart point is at offset 0
 }
@@ -50,12 +84,23 @@ void BlockBuilder::Reset() {
   counter_ = 0;
   finished_ = false;
   last_key_.clear();
+  hash_entries_.clear();
+  hash_indexable_ = true;
+  key_prefixes_.clear();
+  store_key_prefixes_ = false;
 }
 
 size_t BlockBuilder::CurrentSizeEstimate() const {
-  return (buffer_.size() +                       // Raw data buffer
-          restarts_.size() * sizeof(uint32_t) +  // Restart array
-          sizeof(uint32_t));                     // Restart array length
+  size_t estimate = (buffer_.size() +                       // Raw data buffer
+                     restarts_.size() * sizeof(uint32_t) +  // Restart array
+                     sizeof(uint32_t));  // Restart array length
+  if (options_->data_block_hash_index) {
+    estimate += hash_entries_.size() * options_->data_block_hash_ratio + 3;
+  }
+  if (store_key_prefixes_) {
+    estimate += restarts_.size() * sizeof(uint64_t) + 1;
+  }
+  return estimate;
 }
 
 Slice BlockBuilder::Finish() {
@@ -63,11 +108,51 @@ Slice BlockBuilder::Finish() {
   for (size_t i = 0; i < restarts_.size(); i++) {
     PutFixed32(&buffer_, restarts_[i]);
   }
-  PutFixed32(&buffer_, restarts_.size());
+  uint32_t num_restarts = restarts_.size();
+  if (store_key_prefixes_) {
+    assert(key_prefixes_.size() == restarts_.size());
+    for (size_t i = 0; i < key_prefixes_.size(); i++) {
+      PutFixed64(&buffer_, key_prefixes_[i]);
+    }
+    buffer_.push_back(static_cast<char>(prefix_suffix_len_));
+    num_restarts |= kBlockKeyPrefixFlag;
+  }
+  if (options_->data_block_hash_index && AppendHashIndex()) {
+    num_restarts |= kBlockHashIndexFlag;
+  }
+  PutFixed32(&buffer_, num_restarts);
   finished_ = true;
   return Slice(buffer_);
 }
 
+bool BlockBuilder::AppendHashIndex() {
+  if (!hash_indexable_ || hash_entries_.empty()) {
+    return false;
+  }
+  double ratio = options_->data_block_hash_ratio;
+  if (ratio < 1.0) ratio = 1.0;
+  size_t num_buckets = static_cast<size_t>(hash_entries_.size() * ratio) | 1;
+  if (num_buckets > 0xffff) {
+    return false;
+  }
+
+  std::string buckets(num_buckets, static_cast<char>(kHashBucketEmpty));
+  for (const auto& entry : hash_entries_) {
+    char& bucket = buckets[entry.first % num_buckets];
+    const uint8_t current = static_cast<uint8_t>(bucket);
+    if (current == kHashBucketEmpty) {
+      bucket = static_cast<char>(entry.second);
+    } else if (current != entry.second) {
+      bucket = static_cast<char>(kHashBucketCollision);
+    }
+  }
+  buffer_.append(buckets);
+  buffer_.push_back(static_cast<char>(num_buckets & 0xff));
+  buffer_.push_back(static_cast<char>(num_buckets >> 8));
+  buffer_.push_back(static_cast<char>(hash_suffix_len_));
+  return true;
+}
+
 void BlockBuilder::Add(const Slice& key, const Slice& value) {
   Slice last_key_piece(last_key_);
   assert(!finished_);
@@ -88,6 +173,52 @@ void BlockBuilder::Add(const Slice& key, const Slice& value) {
   }
   const size_t non_shared = key.size() - shared;
 
+  if (buffer_.empty() && options_->block_restart_key_prefixes) {
+    // Prefixes only order keys that are ordered bytewise; internal keys
+    // are, up to their 8-byte suffix, when the user comparator is.
+    const Comparator* user_comparator = options_->comparator;
+    const InternalKeyComparator* icmp =
+        dynamic_cast<const InternalKeyComparator*>(options_->comparator);
+    if (icmp != nullptr) {
+      user_comparator = icmp->user_comparator();
+    }
+    prefix_suffix_len_ = (icmp != nullptr) ? 8 : 0;
+    store_key_prefixes_ = (user_comparator == BytewiseComparator());
+  }
+  if (store_key_prefixes_ && counter_ == 0) {
+    if (key.size() < prefix_suffix_len_) {
+      store_key_prefixes_ = false;
+      key_prefixes_.clear();
+    } else {
+      key_prefixes_.push_back(BlockKeyPrefix(key, prefix_suffix_len_));
+    }
+  }
+
+  if (options_->data_block_hash_index && hash_indexable_) {
+    if (buffer_.empty()) {
+      // Hash only the user key portion of internal keys so that a lookup
+      // for any sequence number lands in the same bucket.
+      hash_suffix_len_ =
+          dynamic_cast<const InternalKeyComparator*>(options_->comparator) !=
+                  nullptr
+              ? 8
+              : 0;
+    }
+    const size_t restart_index = restarts_.size() - 1;
+    if (restart_index > kMaxHashRestartIndex ||
+        key.size() < hash_suffix_len_) {
+      hash_indexable_ = false;
+      hash_entries_.clear();
+    } else {
+      const uint32_t h = BlockKeyHash(key, hash_suffix_len_);
+      const uint8_t r = static_cast<uint8_t>(restart_index);
+      if (hash_entries_.empty() || hash_entries_.back().first != h ||
+          hash_entries_.back().second != r) {
+        hash_entries_.emplace_back(h, r);
+      }
+    }
+  }
+
   // Add "<shared><non_shared><value_size>" to buffer_
   PutVarint32(&buffer_, shared);
   PutVarint32(&buffer_, non_shared);
@@ -6,6 +6,8 @@
 #define STORAGE_LEVELDB_TABLE_BLOCK_BUILDER_H_
 
 #include <cstdint>
+#include <string>
+#include <utility>
 #include <vector>
 
 #include "leveldb/slice.h"
@@ -41,12 +43,29 @@ class BlockBuilder {
   bool empty() const { return buffer_.empty(); }
 
  private:
+  // Append the hash index (see block_builder.cc) to buffer_.  Returns
+  // false if the block cannot be indexed, e.g. too many restart points.
+  bool AppendHashIndex();
+
   const Options* options_;
   std::string buffer_;              // Destination buffer
   std::vector<uint32_t> restarts_;  // Restart points
   int counter_;                     // Number of entries emitted since restart
   bool finished_;                   // Has Finish() been called?
   std::string last_key_;
+
+  // (hash, restart index) of each distinct hashed key; only filled when
+  // options_->data_block_hash_index is set.
+  std::vector<std::pair<uint32_t, uint8_t>> hash_entries_;
+  size_t hash_suffix_len_;  // Bytes trimmed from keys before hashing
+  bool hash_indexable_;     // False once there are too many restarts
+
+  // BlockKeyPrefix() of each restart key; only filled when
+  // options_->block_restart_key_prefixes is set and keys are ordered
+  // bytewise.
+  std::vector<uint64_t> key_prefixes_;
+  size_t prefix_suffix_len_;  // Bytes trimmed from keys before prefixing
+  bool store_key_prefixes_;
 };
 
 }  // namespace leveldb
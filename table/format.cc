@@ -4,6 +4,8 @@
 
 #include "table/format.h"
 
+#include <cstring>
+
 #include "leveldb/env.h"
 #include "port/port.h"
 #include "table/block.h"
@@ -61,8 +63,62 @@ Status Footer::DecodeFrom(Slice* input) {
   return result;
 }
 
+// Uncompress "data[0,n-1]", stored with compression "type", into a new
+// heap allocated buffer owned by *result.
+static Status UncompressBlockData(const char* data, size_t n, char type,
+                                  BlockContents* result) {
+  size_t ulength = 0;
+  char* ubuf = nullptr;
+  switch (type) {
+    case kSnappyCompression: {
+      if (!port::Snappy_GetUncompressedLength(data, n, &ulength)) {
+        return Status::Corruption("corrupted compressed block contents");
+      }
+      ubuf = new char[ulength];
+      if (!port::Snappy_Uncompress(data, n, ubuf)) {
+        delete[] ubuf;
+        return Status::Corruption("corrupted compressed block contents");
+      }
+      break;
+    }
+    case kZstdCompression: {
+      if (!port::Zstd_GetUncompressedLength(data, n, &ulength)) {
+        return Status::Corruption("corrupted zstd compressed block contents");
+      }
+      ubuf = new char[ulength];
+      if (!port::Zstd_Uncompress(data, n, ubuf)) {
+        delete[] ubuf;
+        return Status::Corruption("corrupted zstd compressed block contents");
+      }
+      break;
+    }
+    case kLZ4Compression: {
+      // See TableBuilder::WriteBlock for the length prefix.
+      uint32_t length = 0;
+      const char* p = GetVarint32Ptr(data, data + n, &length);
+      if (p == nullptr) {
+        return Status::Corruption("corrupted lz4 compressed block contents");
+      }
+      ulength = length;
+      ubuf = new char[ulength];
+      if (!port::LZ4_Uncompress(p, (data + n) - p, ubuf, ulength)) {
+        delete[] ubuf;
+        return Status::Corruption("corrupted lz4 compressed block contents");
+      }
+      break;
+    }
+    default:
+      return Status::Corruption("bad block type");
+  }
+  result->data = Slice(ubuf, ulength);
+  result->heap_allocated = true;
+  result->cachable = true;
+  return Status::OK();
+}
+
 Status ReadBlock(RandomAccessFile* file, const ReadOptions& options,
-                 const BlockHandle& handle, BlockContents* result) {
+                 const BlockHandle& handle, BlockContents* result,
+                 std::string* compressed_block) {
   result->data = Slice();
   result->cachable = false;
   result->heap_allocated = false;
@@ -84,58 +140,66 @@ Status ReadBlock(RandomAccessFile* file, const ReadOptions& options,
 
   // Check the crc of the type and the block contents
   const char* data = contents.data();  // Pointer to where Read put the data
+  // A compressed block that the caller keeps is copied out in the same
+  // pass over the data as the checksum.
+  const bool copy_compressed =
+      compressed_block != nullptr && data[n] != kNoCompression;
+  if (copy_compressed) {
+    compressed_block->resize(n + 1);
+  }
   if (options.verify_checksums) {
     const uint32_t crc = crc32c::Unmask(DecodeFixed32(data + n + 1));
-    const uint32_t actual = crc32c::Value(data, n + 1);
+    const uint32_t actual =
+        copy_compressed
+            ? crc32c::ExtendAndCopy(0, data, n + 1, &(*compressed_block)[0])
+            : crc32c::Value(data, n + 1);
     if (actual != crc) {
       delete[] buf;
+      if (copy_compressed) {
+        compressed_block->clear();
+      }
       s = Status::Corruption("block checksum mismatch");
       return s;
     }
+  } else if (copy_compressed) {
+    std::memcpy(&(*compressed_block)[0], data, n + 1);
   }
 
-  switch (data[n]) {
-    case kNoCompression:
-      if (data != buf) {
-        // File implementation gave us pointer to some other data.
-        // Use it directly under the assumption that it will be live
-        // while the file is open.
-        delete[] buf;
-        result->data = Slice(data, n);
-        result->heap_allocated = false;
-        result->cachable = false;  // Do not double-cache
-      } else {
-        result->data = Slice(buf, n);
-        result->heap_allocated = true;
-        result->cachable = true;
-      }
-
-      // Ok
-      break;
-    case kSnappyCompression: {
-      size_t ulength = 0;
-      if (!port::Snappy_GetUncompressedLength(data, n, &ulength)) {
-        delete[] buf;
-        return Status::Corruption("corrupted compressed block contents");
-      }
-      char* ubuf = new char[ulength];
-      if (!port::Snappy_Uncompress(data, n, ubuf)) {
-        delete[] buf;
-        delete[] ubuf;
-        return Status::Corruption("corrupted compressed block contents");
-      }
+  if (data[n] == kNoCompression) {
+    if (data != buf) {
+      // File implementation gave us pointer to some other data.
+      // Use it directly under the assumption that it will be live
+      // while the file is open.
       delete[] buf;
-      result->data = Slice(ubuf, ulength);
+      result->data = Slice(data, n);
+      result->heap_allocated = false;
+      result->cachable = false;  // Do not double-cache
+    } else {
+      result->data = Slice(buf, n);
       result->heap_allocated = true;
       result->cachable = true;
-      break;
     }
-    default:
-      delete[] buf;
-      return Status::Corruption("bad block type");
+    return Status::OK();
   }
 
-  return Status::OK();
+  s = UncompressBlockData(data, n, data[n], result);
+  if (!s.ok() && copy_compressed) {
+    compressed_block->clear();
+  }
+  delete[] buf;
+  return s;
+}
+
+Status UncompressBlock(const Slice& compressed_block, BlockContents* result) {
+  result->data = Slice();
+  result->cachable = false;
+  result->heap_allocated = false;
+  if (compressed_block.empty()) {
+    return Status::Corruption("empty compressed block");
+  }
+  const size_t n = compressed_block.size() - 1;
+  return UncompressBlockData(compressed_block.data(), n, compressed_block[n],
+                             result);
 }
 
 }  // namespace leveldb
@@ -5,6 +5,7 @@
 #ifndef STORAGE_LEVELDB_TABLE_FORMAT_H_
 #define STORAGE_LEVELDB_TABLE_FORMAT_H_
 
+#include <atomic>
 #include <cstdint>
 #include <string>
 
@@ -84,10 +85,28 @@ struct BlockContents {
   bool heap_allocated;  // True iff caller should delete[] data.data()
 };
 
+// Hit and miss counts of the block cache tiers consulted when a Table
+// reads a data block.  Shared by all tables opened through one TableCache.
+struct BlockCacheStats {
+  std::atomic<uint64_t> block_cache_hits{0};
+  std::atomic<uint64_t> block_cache_misses{0};
+  std::atomic<uint64_t> compressed_cache_hits{0};
+  std::atomic<uint64_t> compressed_cache_misses{0};
+};
+
 // Read the block identified by "handle" from "file".  On failure
 // return non-OK.  On success fill *result and return OK.
+//
+// If "compressed_block" is non-null and the block is stored compressed,
+// it is set to the on-disk block contents followed by the compression
+// type byte, suitable for UncompressBlock().
 Status ReadBlock(RandomAccessFile* file, const ReadOptions& options,
-                 const BlockHandle& handle, BlockContents* result);
+                 const BlockHandle& handle, BlockContents* result,
+                 std::string* compressed_block = nullptr);
+
+// Uncompress a block saved by ReadBlock() into *result, which always
+// owns a new heap allocated buffer on success.
+Status UncompressBlock(const Slice& compressed_block, BlockContents* result);
 
 // Implementation details follow.  Clients should ignore,
 
@@ -6,12 +6,14 @@
 
 namespace leveldb {
 
-Iterator::Iterator() {
+Cleanable::Cleanable() {
   cleanup_head_.function = nullptr;
   cleanup_head_.next = nullptr;
 }
 
-Iterator::~Iterator() {
+Cleanable::~Cleanable() { DoCleanup(); }
+
+void Cleanable::DoCleanup() {
   if (!cleanup_head_.IsEmpty()) {
     cleanup_head_.Run();
     for (CleanupNode* node = cleanup_head_.next; node != nullptr;) {
@@ -20,10 +22,12 @@ Iterator::~Iterator() {
       delete node;
       node = next_node;
     }
+    cleanup_head_.function = nullptr;
+    cleanup_head_.next = nullptr;
   }
 }
 
-void Iterator::RegisterCleanup(CleanupFunction func, void* arg1, void* arg2) {
+void Cleanable::RegisterCleanup(CleanupFunction func, void* arg1, void* arg2) {
   assert(func != nullptr);
   CleanupNode* node;
   if (cleanup_head_.IsEmpty()) {
@@ -38,6 +42,27 @@ void Iterator::RegisterCleanup(CleanupFunction func, void* arg1, void* arg2) {
   node->arg2 = arg2;
 }
 
+void Cleanable::DelegateCleanupsTo(Cleanable* other) {
+  assert(other != this);
+  if (cleanup_head_.IsEmpty()) {
+    return;
+  }
+  other->RegisterCleanup(cleanup_head_.function, cleanup_head_.arg1,
+                         cleanup_head_.arg2);
+  for (CleanupNode* node = cleanup_head_.next; node != nullptr;) {
+    other->RegisterCleanup(node->function, node->arg1, node->arg2);
+    CleanupNode* next_node = node->next;
+    delete node;
+    node = next_node;
+  }
+  cleanup_head_.function = nullptr;
+  cleanup_head_.next = nullptr;
+}
+
+Iterator::Iterator() = default;
+
+Iterator::~Iterator() = default;
+
 namespace {
 
 class EmptyIterator : public Iterator {
@@ -74,7 +74,7 @@ class IteratorWrapper {
     Update();
   }
 
- private:
+  // Refreshes the cached state after iter() was repositioned directly.
   void Update() {
     valid_ = iter_->Valid();
     if (valid_) {
@@ -82,6 +82,8 @@ class IteratorWrapper {
     }
   }
 
+ private:
+
   Iterator* iter_;
   bool valid_;
   Slice key_;
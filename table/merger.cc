@@ -4,6 +4,9 @@
 
 #include "table/merger.h"
 
+#include <utility>
+#include <vector>
+
 #include "leveldb/comparator.h"
 #include "leveldb/iterator.h"
 #include "table/iterator_wrapper.h"
@@ -21,7 +24,9 @@ class MergingIterator : public Iterator {
         children_(new IteratorWrapper[n]),
         n_(n),
         current_(nullptr),
-        direction_(kForward) {
+        direction_(kForward),
+        losers_(n),
+        winners_(n) {
     for (int i = 0; i < n; i++) {
       children_[i].Set(children[i]);
     }
@@ -35,16 +40,16 @@ class MergingIterator : public Iterator {
     for (int i = 0; i < n_; i++) {
       children_[i].SeekToFirst();
     }
-    FindSmallest();
     direction_ = kForward;
+    Rebuild();
   }
 
   void SeekToLast() override {
     for (int i = 0; i < n_; i++) {
       children_[i].SeekToLast();
     }
-    FindLargest();
     direction_ = kReverse;
+    Rebuild();
   }
 
   void Seek(const Slice& target) override {
@@ -54,6 +59,7 @@ class MergingIterator : public Iterator {
       if (IsTwoLevelIterator(children_[i])) {
         TwoLevelIterator* two_level_iter = dynamic_cast<TwoLevelIterator*>(children_[i].iter());
         two_level_iter->SeekWithOrWithoutNode(target, next_level_node);
+        children_[i].Update();
         // get next_level_node to accelerate next search
         if (two_level_iter->Valid() && two_level_iter->UseGit()) {
           Iterator* index_iter = two_level_iter->Get_index_iter().iter();
@@ -67,8 +73,8 @@ class MergingIterator : public Iterator {
         children_[i].Seek(target);
       }
     }
-    FindSmallest();
     direction_ = kForward;
+    Rebuild();
   }
 
   void Next() override {
@@ -91,10 +97,13 @@ class MergingIterator : public Iterator {
         }
       }
       direction_ = kForward;
+      current_->Next();
+      Rebuild();
+      return;
     }
 
     current_->Next();
-    FindSmallest();
+    Replay(current_ - children_);
   }
 
   void Prev() override {
@@ -120,10 +129,13 @@ class MergingIterator : public Iterator {
         }
       }
       direction_ = kReverse;
+      current_->Prev();
+      Rebuild();
+      return;
     }
 
     current_->Prev();
-    FindLargest();
+    Replay(current_ - children_);
   }
 
   Slice key() const override {
@@ -151,11 +163,19 @@ class MergingIterator : public Iterator {
   // Which direction is the iterator moving?
   enum Direction { kForward, kReverse };
 
-  void FindSmallest();
-  void FindLargest();
+  // Return true if child "a" comes before child "b" in direction_.
+  // Exhausted children come after all others.
+  bool Beats(int a, int b) const;
+
+  // Play the whole tournament again, after all children moved.
+  void Rebuild();
+
+  // Replay the matches of child "i" on its way to the root, after it was
+  // the winner and moved.
+  void Replay(int i);
 
   // Check whether iterator_wrapper is an encapsulation of TwoLevelIterator
-  bool IsTwoLevelIterator(IteratorWrapper iterator_wrapper) {
+  bool IsTwoLevelIterator(const IteratorWrapper& iterator_wrapper) {
     if (dynamic_cast<TwoLevelIterator*>(iterator_wrapper.iter())) {
       return true;
     } else {
@@ -163,44 +183,59 @@ class MergingIterator : public Iterator {
     }
   }
 
-  // We might want to use a heap in case there are lots of children.
-  // For now we use a simple array since we expect a very small number
-  // of children in leveldb.
+  // The children are merged with a tournament (loser) tree, so moving
+  // the current child costs about log2(n) comparisons of the keys cached
+  // by the IteratorWrappers instead of n - 1.  Node p of the tree has the
+  // nodes 2p and 2p+1 below it, and child i is the leaf at node n + i.
   const Comparator* comparator_;
   IteratorWrapper* children_;
   int n_;
   IteratorWrapper* current_;
   Direction direction_;
+  std::vector<int> losers_;   // losers_[p]: child that lost the match at p
+  std::vector<int> winners_;  // Scratch space for Rebuild()
 };
 
-void MergingIterator::FindSmallest() {
-  IteratorWrapper* smallest = nullptr;
-  for (int i = 0; i < n_; i++) {
-    IteratorWrapper* child = &children_[i];
-    if (child->Valid()) {
-      if (smallest == nullptr) {
-        smallest = child;
-      } else if (comparator_->Compare(child->key(), smallest->key()) < 0) {
-        smallest = child;
-      }
+bool MergingIterator::Beats(int a, int b) const {
+  const IteratorWrapper& x = children_[a];
+  const IteratorWrapper& y = children_[b];
+  if (!x.Valid() || !y.Valid()) {
+    return x.Valid();
+  }
+  const int r = comparator_->Compare(x.key(), y.key());
+  if (r != 0) {
+    return direction_ == kForward ? r < 0 : r > 0;
+  }
+  // Equal keys come out in the order the children were given going
+  // forward, and in the opposite order in reverse.
+  return direction_ == kForward ? a < b : a > b;
+}
+
+void MergingIterator::Rebuild() {
+  for (int p = n_ - 1; p >= 1; p--) {
+    const int left = 2 * p >= n_ ? 2 * p - n_ : winners_[2 * p];
+    const int right = 2 * p + 1 >= n_ ? 2 * p + 1 - n_ : winners_[2 * p + 1];
+    if (Beats(right, left)) {
+      winners_[p] = right;
+      losers_[p] = left;
+    } else {
+      winners_[p] = left;
+      losers_[p] = right;
     }
   }
-  current_ = smallest;
+  IteratorWrapper* winner = &children_[winners_[1]];
+  current_ = winner->Valid() ? winner : nullptr;
 }
 
-void MergingIterator::FindLargest() {
-  IteratorWrapper* largest = nullptr;
-  for (int i = n_ - 1; i >= 0; i--) {
-    IteratorWrapper* child = &children_[i];
-    if (child->Valid()) {
-      if (largest == nullptr) {
-        largest = child;
-      } else if (comparator_->Compare(child->key(), largest->key()) > 0) {
-        largest = child;
-      }
+void MergingIterator::Replay(int i) {
+  int winner = i;
+  for (int p = (n_ + i) / 2; p >= 1; p /= 2) {
+    if (Beats(losers_[p], winner)) {
+      std::swap(losers_[p], winner);
     }
   }
-  current_ = largest;
+  winners_[1] = winner;
+  current_ = children_[winner].Valid() ? &children_[winner] : nullptr;
 }
 }  // namespace
 
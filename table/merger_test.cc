@@ -0,0 +1,178 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "table/merger.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "leveldb/comparator.h"
+#include "leveldb/iterator.h"
+#include "util/random.h"
+
+namespace leveldb {
+
+namespace {
+
+// Iterates over a sorted vector of keys.  The value of every entry is the
+// number of its child, so the order of equal keys can be checked.
+class VectorIterator : public Iterator {
+ public:
+  VectorIterator(std::vector<std::string> keys, int child)
+      : keys_(std::move(keys)),
+        value_(std::to_string(child)),
+        pos_(keys_.size()) {}
+
+  bool Valid() const override { return pos_ < keys_.size(); }
+  void SeekToFirst() override { pos_ = 0; }
+  void SeekToLast() override {
+    pos_ = keys_.empty() ? keys_.size() : keys_.size() - 1;
+  }
+  void Seek(const Slice& target) override {
+    pos_ = std::lower_bound(keys_.begin(), keys_.end(), target.ToString()) -
+           keys_.begin();
+  }
+  void Next() override {
+    assert(Valid());
+    pos_++;
+  }
+  void Prev() override {
+    assert(Valid());
+    pos_ = pos_ == 0 ? keys_.size() : pos_ - 1;
+  }
+  Slice key() const override { return keys_[pos_]; }
+  Slice value() const override { return value_; }
+  Status status() const override { return Status::OK(); }
+
+ private:
+  const std::vector<std::string> keys_;
+  const std::string value_;
+  size_t pos_;
+};
+
+std::string Key(int i) {
+  char buf[16];
+  std::snprintf(buf, sizeof(buf), "key%06d", i);
+  return buf;
+}
+
+// An entry of the model: key and the number of the child it is in.
+typedef std::pair<std::string, int> Entry;
+
+}  // namespace
+
+class MergerTest : public testing::Test {
+ public:
+  // Spread the keys [0, num_keys) over "n" children, some of which may
+  // end up empty, and return the merging iterator over them.
+  Iterator* NewRandomMerger(Random* rnd, int n, int num_keys,
+                            std::vector<Entry>* model) {
+    std::vector<std::vector<std::string>> keys(n);
+    for (int k = 0; k < num_keys; k++) {
+      const int child = rnd->Uniform(n);
+      keys[child].push_back(Key(k));
+      model->push_back(Entry(Key(k), child));
+    }
+    std::vector<Iterator*> children;
+    for (int i = 0; i < n; i++) {
+      children.push_back(new VectorIterator(keys[i], i));
+    }
+    return NewMergingIterator(BytewiseComparator(), children.data(), n);
+  }
+};
+
+TEST_F(MergerTest, Empty) {
+  Iterator* children[3];
+  for (int i = 0; i < 3; i++) {
+    children[i] = new VectorIterator({}, i);
+  }
+  Iterator* iter = NewMergingIterator(BytewiseComparator(), children, 3);
+  iter->SeekToFirst();
+  ASSERT_FALSE(iter->Valid());
+  iter->SeekToLast();
+  ASSERT_FALSE(iter->Valid());
+  iter->Seek("a");
+  ASSERT_FALSE(iter->Valid());
+  delete iter;
+}
+
+TEST_F(MergerTest, EqualKeys) {
+  // Equal keys come out in the order of the children going forward and
+  // in the opposite order in reverse.
+  Iterator* children[5];
+  for (int i = 0; i < 5; i++) {
+    children[i] = new VectorIterator({"a", "b", "c"}, i);
+  }
+  Iterator* iter = NewMergingIterator(BytewiseComparator(), children, 5);
+  std::string forward;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    forward += iter->key().ToString() + iter->value().ToString();
+  }
+  ASSERT_EQ("a0a1a2a3a4b0b1b2b3b4c0c1c2c3c4", forward);
+  std::string reverse;
+  for (iter->SeekToLast(); iter->Valid(); iter->Prev()) {
+    reverse += iter->key().ToString() + iter->value().ToString();
+  }
+  ASSERT_EQ("c4c3c2c1c0b4b3b2b1b0a4a3a2a1a0", reverse);
+  delete iter;
+}
+
+TEST_F(MergerTest, Randomized) {
+  Random rnd(301);
+  for (int n : {2, 3, 5, 8, 13, 20, 64}) {
+    SCOPED_TRACE(n);
+    std::vector<Entry> model;
+    Iterator* iter = NewRandomMerger(&rnd, n, 50 * n, &model);
+    const int size = model.size();
+    int pos = -1;  // Position in model, or -1 if not valid
+    for (int step = 0; step < 20000; step++) {
+      switch (rnd.Uniform(pos >= 0 ? 6 : 3)) {
+        case 0:
+          iter->SeekToFirst();
+          pos = 0;
+          break;
+        case 1:
+          iter->SeekToLast();
+          pos = size - 1;
+          break;
+        case 2: {
+          std::string target = Key(rnd.Uniform(size + 2) - 1);
+          if (rnd.OneIn(2)) target += "+";
+          iter->Seek(target);
+          pos = std::lower_bound(model.begin(), model.end(),
+                                 Entry(target, -1)) -
+                model.begin();
+          if (pos == size) pos = -1;
+          break;
+        }
+        case 3:
+        case 4:
+          iter->Next();
+          pos = pos + 1 < size ? pos + 1 : -1;
+          break;
+        default:
+          iter->Prev();
+          pos = pos - 1;
+          break;
+      }
+      ASSERT_EQ(pos >= 0, iter->Valid()) << "step " << step;
+      if (pos >= 0) {
+        ASSERT_EQ(model[pos].first, iter->key().ToString());
+        ASSERT_EQ(std::to_string(model[pos].second), iter->value().ToString());
+      }
+    }
+    delete iter;
+  }
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,138 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/sst_file_writer.h"
+
+#include "db/dbformat.h"
+#include "leveldb/comparator.h"
+#include "leveldb/env.h"
+#include "leveldb/table_builder.h"
+
+namespace leveldb {
+
+// Entries are stored under internal keys with sequence number zero, the
+// format of the tables in a database.  IngestExternalFile() gives them a
+// real sequence number when it has to.
+struct SstFileWriter::Rep {
+  explicit Rep(const Options& opt)
+      : internal_comparator(opt.comparator),
+        internal_filter_policy(opt.filter_policy, opt.prefix_extractor),
+        options(opt),
+        file(nullptr),
+        builder(nullptr),
+        has_last_key(false) {
+    options.comparator = &internal_comparator;
+    if (opt.filter_policy != nullptr) {
+      options.filter_policy = &internal_filter_policy;
+    }
+  }
+
+  const InternalKeyComparator internal_comparator;
+  const InternalFilterPolicy internal_filter_policy;
+  Options options;  // options.comparator == &internal_comparator
+  std::string path;
+  WritableFile* file;
+  TableBuilder* builder;
+  bool has_last_key;
+  std::string last_key;  // Last user key added
+  std::string internal_key;
+};
+
+SstFileWriter::SstFileWriter(const Options& options)
+    : rep_(new Rep(options)) {}
+
+SstFileWriter::~SstFileWriter() {
+  if (rep_->builder != nullptr) {
+    // Finish() was not called
+    rep_->builder->Abandon();
+    delete rep_->builder;
+    delete rep_->file;
+    rep_->options.env->RemoveFile(rep_->path);
+  }
+  delete rep_;
+}
+
+Status SstFileWriter::Open(const std::string& path) {
+  Rep* r = rep_;
+  if (r->builder != nullptr) {
+    return Status::InvalidArgument("SstFileWriter is already open", r->path);
+  }
+  Status s = r->options.env->NewWritableFile(path, &r->file);
+  if (!s.ok()) {
+    return s;
+  }
+  r->path = path;
+  r->builder = new TableBuilder(r->options, r->file);
+  r->has_last_key = false;
+  r->last_key.clear();
+  return s;
+}
+
+Status SstFileWriter::Put(const Slice& key, const Slice& value) {
+  return Add(key, value, false);
+}
+
+Status SstFileWriter::Delete(const Slice& key) {
+  return Add(key, Slice(), true);
+}
+
+Status SstFileWriter::Add(const Slice& key, const Slice& value,
+                          bool deletion) {
+  Rep* r = rep_;
+  if (r->builder == nullptr) {
+    return Status::InvalidArgument("SstFileWriter is not open");
+  }
+  if (r->has_last_key &&
+      r->internal_comparator.user_comparator()->Compare(key, r->last_key) <=
+          0) {
+    return Status::InvalidArgument("Keys must be added in increasing order",
+                                   key);
+  }
+  r->internal_key.clear();
+  AppendInternalKey(&r->internal_key,
+                    ParsedInternalKey(key, 0, deletion ? kTypeDeletion
+                                                       : kTypeValue));
+  r->builder->Add(r->internal_key, value);
+  r->last_key.assign(key.data(), key.size());
+  r->has_last_key = true;
+  return r->builder->status();
+}
+
+Status SstFileWriter::Finish(uint64_t* file_size) {
+  Rep* r = rep_;
+  if (r->builder == nullptr) {
+    return Status::InvalidArgument("SstFileWriter is not open");
+  }
+  Status s;
+  if (!r->has_last_key) {
+    r->builder->Abandon();
+    s = Status::InvalidArgument("Cannot create a table with no entries",
+                                r->path);
+  } else {
+    s = r->builder->Finish();
+  }
+  if (s.ok()) {
+    if (file_size != nullptr) {
+      *file_size = r->builder->FileSize();
+    }
+    s = r->file->Sync();
+  }
+  if (s.ok()) {
+    s = r->file->Close();
+  }
+  delete r->builder;
+  r->builder = nullptr;
+  delete r->file;
+  r->file = nullptr;
+  if (!s.ok()) {
+    r->options.env->RemoveFile(r->path);
+  }
+  return s;
+}
+
+uint64_t SstFileWriter::FileSize() const {
+  return rep_->builder == nullptr ? 0 : rep_->builder->FileSize();
+}
+
+}  // namespace leveldb
@@ -13,29 +13,12 @@
 #include "table/block.h"
 #include "table/filter_block.h"
 #include "table/format.h"
+#include "table/table_rep.h"
 #include "table/two_level_iterator.h"
 #include "util/coding.h"
 
 namespace leveldb {
 
-struct Table::Rep {
-  ~Rep() {
-    delete filter;
-    delete[] filter_data;
-    delete index_block;
-  }
-
-  Options options;
-  Status status;
-  RandomAccessFile* file;
-  uint64_t cache_id;
-  FilterBlockReader* filter;
-  const char* filter_data;
-
-  BlockHandle metaindex_handle;  // Handle to metaindex_block: saved from footer
-  Block* index_block;
-};
-
 // Open the table from the file
 Status Table::Open(const Options& options, RandomAccessFile* file,
                    uint64_t size, Table** table) {
@@ -72,6 +55,11 @@ Status Table::Open(const Options& options, RandomAccessFile* file,
     rep->metaindex_handle = footer.metaindex_handle();
     rep->index_block = index_block;
     rep->cache_id = (options.block_cache ? options.block_cache->NewId() : 0);
+    rep->compressed_cache_id =
+        (options.compressed_block_cache
+             ? options.compressed_block_cache->NewId()
+             : 0);
+    rep->cache_stats = nullptr;
     rep->filter_data = nullptr;
     rep->filter = nullptr;
     *table = new Table(rep);
@@ -135,6 +123,10 @@ void Table::ReadFilter(const Slice& filter_handle_value) {
 
 Table::~Table() { delete rep_; }
 
+static void DeleteCompressedBlock(const Slice& key, void* value) {
+  delete reinterpret_cast<std::string*>(value);
+}
+
 static void DeleteBlock(void* arg, void* ignored) {
   delete reinterpret_cast<Block*>(arg);
 }
@@ -150,6 +142,50 @@ static void ReleaseBlock(void* arg, void* h) {
   cache->Release(handle);
 }
 
+static void RecordCacheLookup(BlockCacheStats* stats,
+                              std::atomic<uint64_t> BlockCacheStats::*counter) {
+  if (stats != nullptr) {
+    (stats->*counter).fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+// Read the block at "handle", consulting the compressed block cache
+// "compressed_cache" (if any) before going to "file".
+static Status ReadBlockThroughCompressedCache(
+    Cache* compressed_cache, uint64_t compressed_cache_id,
+    BlockCacheStats* stats, RandomAccessFile* file,
+    const ReadOptions& options, const BlockHandle& handle,
+    BlockContents* contents) {
+  if (compressed_cache == nullptr) {
+    return ReadBlock(file, options, handle, contents);
+  }
+
+  char cache_key_buffer[16];
+  EncodeFixed64(cache_key_buffer, compressed_cache_id);
+  EncodeFixed64(cache_key_buffer + 8, handle.offset());
+  Slice key(cache_key_buffer, sizeof(cache_key_buffer));
+  Cache::Handle* cache_handle = compressed_cache->Lookup(key);
+  if (cache_handle != nullptr) {
+    RecordCacheLookup(stats, &BlockCacheStats::compressed_cache_hits);
+    const std::string* compressed =
+        reinterpret_cast<std::string*>(compressed_cache->Value(cache_handle));
+    Status s = UncompressBlock(*compressed, contents);
+    compressed_cache->Release(cache_handle);
+    return s;
+  }
+
+  RecordCacheLookup(stats, &BlockCacheStats::compressed_cache_misses);
+  std::string* compressed = new std::string;
+  Status s = ReadBlock(file, options, handle, contents, compressed);
+  if (s.ok() && !compressed->empty() && options.fill_cache) {
+    compressed_cache->Release(compressed_cache->Insert(
+        key, compressed, compressed->size(), &DeleteCompressedBlock));
+  } else {
+    delete compressed;
+  }
+  return s;
+}
+
 // Convert an index iterator value (i.e., an encoded BlockHandle)
 // into an iterator over the contents of the corresponding block.
 Iterator* Table::BlockReader(void* arg, const ReadOptions& options,
@@ -175,8 +211,15 @@ Iterator* Table::BlockReader(void* arg, const ReadOptions& options,
       cache_handle = block_cache->Lookup(key);
       if (cache_handle != nullptr) {
         block = reinterpret_cast<Block*>(block_cache->Value(cache_handle));
+        RecordCacheLookup(table->rep_->cache_stats,
+                          &BlockCacheStats::block_cache_hits);
       } else {
-        s = ReadBlock(table->rep_->file, options, handle, &contents);
+        RecordCacheLookup(table->rep_->cache_stats,
+                          &BlockCacheStats::block_cache_misses);
+        s = ReadBlockThroughCompressedCache(
+            table->rep_->options.compressed_block_cache,
+            table->rep_->compressed_cache_id, table->rep_->cache_stats,
+            table->rep_->file, options, handle, &contents);
         if (s.ok()) {
           block = new Block(contents);
           if (contents.cachable && options.fill_cache) {
@@ -186,7 +229,10 @@ Iterator* Table::BlockReader(void* arg, const ReadOptions& options,
         }
       }
     } else {
-      s = ReadBlock(table->rep_->file, options, handle, &contents);
+      s = ReadBlockThroughCompressedCache(
+          table->rep_->options.compressed_block_cache,
+          table->rep_->compressed_cache_id, table->rep_->cache_stats,
+          table->rep_->file, options, handle, &contents);
       if (s.ok()) {
         block = new Block(contents);
       }
@@ -208,9 +254,14 @@ Iterator* Table::BlockReader(void* arg, const ReadOptions& options,
 }
 
 Iterator* Table::NewIterator(const ReadOptions& options) const {
+  const SliceTransform* prefix_extractor = nullptr;
+  if (options.prefix_same_as_start && rep_->filter != nullptr) {
+    prefix_extractor = rep_->options.prefix_extractor;
+  }
   return NewTwoLevelIterator(
       rep_->index_block->NewIterator(rep_->options.comparator),
-      &Table::BlockReader, const_cast<Table*>(this), options);
+      &Table::BlockReader, const_cast<Table*>(this), options,
+      rep_->options.comparator, prefix_extractor, rep_->filter);
 }
 
 // **************************************************************************
@@ -234,8 +285,9 @@ void IndexSeek(Iterator** iiter, const Slice& k) { (*iiter)->Seek(k); }
 // **************************************************************************
 
 Status Table::InternalGet(const ReadOptions& options, const Slice& k, void* arg,
-                          void (*handle_result)(void*, const Slice&,
-                                                const Slice&)) {
+                          bool (*handle_result)(void*, const Slice&,
+                                                const Slice&, Cleanable*),
+                          Cleanable* table_pin) {
   Status s;
   Iterator* iiter = rep_->index_block->NewIterator(rep_->options.comparator);
   IndexSeek(&iiter, k);
@@ -248,10 +300,26 @@ Status Table::InternalGet(const ReadOptions& options, const Slice& k, void* arg,
       // Not found
     } else {
       Iterator* block_iter = BlockReader(this, options, iiter->value());
-      block_iter->Seek(k);
-      if (block_iter->Valid()) {
-        // std::cout << "leveldb found key: " << block_iter->key().ToString() << std::endl;
-        (*handle_result)(arg, block_iter->key(), block_iter->value());
+      if (table_pin != nullptr) {
+        table_pin->DelegateCleanupsTo(block_iter);
+      }
+      Block::SeekForGet(block_iter, k);
+      while (block_iter->Valid() &&
+             (*handle_result)(arg, block_iter->key(), block_iter->value(),
+                              block_iter)) {
+        // The older entries of a key may continue in the next block.
+        block_iter->Next();
+        if (!block_iter->Valid() && block_iter->status().ok()) {
+          iiter->Next();
+          if (!iiter->Valid()) {
+            break;
+          }
+          Iterator* next_iter = BlockReader(this, options, iiter->value());
+          block_iter->DelegateCleanupsTo(next_iter);
+          delete block_iter;
+          block_iter = next_iter;
+          block_iter->SeekToFirst();
+        }
       }
       s = block_iter->status();
       delete block_iter;
@@ -33,6 +33,7 @@ struct TableBuilder::Rep {
                          : new FilterBlockBuilder(opt.filter_policy)),
         pending_index_entry(false) {
     index_block_options.block_restart_interval = 1;
+    index_block_options.data_block_hash_index = false;
   }
 
   Options options;
@@ -88,6 +89,7 @@ Status TableBuilder::ChangeOptions(const Options& options) {
   rep_->options = options;
   rep_->index_block_options = options;
   rep_->index_block_options.block_restart_interval = 1;
+  rep_->index_block_options.data_block_hash_index = false;
   return Status::OK();
 }
 
@@ -149,26 +151,40 @@ void TableBuilder::WriteBlock(BlockBuilder* block, BlockHandle* handle) {
 
   Slice block_contents;
   CompressionType type = r->options.compression;
-  // TODO(postrelease): Support more compression options: zlib?
+  std::string* compressed = &r->compressed_output;
+  bool compressed_ok = false;
   switch (type) {
     case kNoCompression:
-      block_contents = raw;
       break;
 
-    case kSnappyCompression: {
-      std::string* compressed = &r->compressed_output;
-      if (port::Snappy_Compress(raw.data(), raw.size(), compressed) &&
-          compressed->size() < raw.size() - (raw.size() / 8u)) {
-        block_contents = *compressed;
-      } else {
-        // Snappy not supported, or compressed less than 12.5%, so just
-        // store uncompressed form
-        block_contents = raw;
-        type = kNoCompression;
+    case kSnappyCompression:
+      compressed_ok = port::Snappy_Compress(raw.data(), raw.size(), compressed);
+      break;
+
+    case kZstdCompression:
+      compressed_ok = port::Zstd_Compress(r->options.zstd_compression_level,
+                                          raw.data(), raw.size(), compressed);
+      break;
+
+    case kLZ4Compression: {
+      // Raw lz4 does not record the uncompressed length, so prefix it.
+      std::string lz4_output;
+      if (port::LZ4_Compress(raw.data(), raw.size(), &lz4_output)) {
+        PutVarint32(compressed, raw.size());
+        compressed->append(lz4_output);
+        compressed_ok = true;
       }
       break;
     }
   }
+  if (compressed_ok && compressed->size() < raw.size() - (raw.size() / 8u)) {
+    block_contents = *compressed;
+  } else {
+    // Compression not requested or not supported, or compressed less
+    // than 12.5%, so just store uncompressed form
+    block_contents = raw;
+    type = kNoCompression;
+  }
   WriteRawBlock(block_contents, type, handle);
   r->compressed_output.clear();
   block->Reset();
@@ -211,7 +227,7 @@ Status TableBuilder::Finish() {
 
   // Write metaindex block
   if (ok()) {
-    BlockBuilder meta_index_block(&r->options);
+    BlockBuilder meta_index_block(&r->index_block_options);
     if (r->filter_block != nullptr) {
       // Add mapping from "filter.Name" to location of filter data
       std::string key = "filter.";
@@ -0,0 +1,47 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// The state of an open Table.  Only table.cc and its friend TableCache
+// use it, which lets TableCache wire up block cache counting without
+// exposing it through include/leveldb/table.h.
+
+#ifndef STORAGE_LEVELDB_TABLE_TABLE_REP_H_
+#define STORAGE_LEVELDB_TABLE_TABLE_REP_H_
+
+#include <cstdint>
+
+#include "leveldb/options.h"
+#include "leveldb/status.h"
+#include "leveldb/table.h"
+#include "table/block.h"
+#include "table/filter_block.h"
+#include "table/format.h"
+
+namespace leveldb {
+
+class RandomAccessFile;
+
+struct Table::Rep {
+  ~Rep() {
+    delete filter;
+    delete[] filter_data;
+    delete index_block;
+  }
+
+  Options options;
+  Status status;
+  RandomAccessFile* file;
+  uint64_t cache_id;
+  uint64_t compressed_cache_id;
+  BlockCacheStats* cache_stats;  // May be null; must outlive the table
+  FilterBlockReader* filter;
+  const char* filter_data;
+
+  BlockHandle metaindex_handle;  // Handle to metaindex_block: saved from footer
+  Block* index_block;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_TABLE_TABLE_REP_H_
@@ -4,13 +4,16 @@
 
 #include "leveldb/table.h"
 
+#include <algorithm>
 #include <map>
 #include <string>
+#include <vector>
 
 #include "gtest/gtest.h"
 #include "db/dbformat.h"
 #include "db/memtable.h"
 #include "db/write_batch_internal.h"
+#include "leveldb/cache.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
 #include "leveldb/iterator.h"
@@ -721,6 +724,161 @@ TEST_F(Harness, RandomizedLongDB) {
   ASSERT_GT(files, 0);
 }
 
+TEST(BlockHashIndexTest, PointLookups) {
+  InternalKeyComparator icmp(BytewiseComparator());
+  Options options;
+  options.comparator = &icmp;
+  options.block_restart_interval = 4;
+  options.data_block_hash_index = true;
+
+  // Three versions of every other key so that versions straddle restarts.
+  std::vector<std::string> keys;
+  BlockBuilder builder(&options);
+  for (int i = 0; i < 100; i++) {
+    char user_key[16];
+    std::snprintf(user_key, sizeof(user_key), "key%06d", i * 2);
+    const int versions = (i % 2 == 0) ? 3 : 1;
+    for (int v = versions; v > 0; v--) {
+      std::string ikey;
+      AppendInternalKey(&ikey, ParsedInternalKey(user_key, v, kTypeValue));
+      builder.Add(ikey, user_key);
+      keys.push_back(ikey);
+    }
+  }
+  std::string data = builder.Finish().ToString();
+  BlockContents contents;
+  contents.data = data;
+  contents.cachable = false;
+  contents.heap_allocated = false;
+  Block block(contents);
+
+  Iterator* iter = block.NewIterator(&icmp);
+  iter->SeekToFirst();
+  for (const std::string& k : keys) {
+    ASSERT_TRUE(iter->Valid());
+    ASSERT_EQ(k, iter->key().ToString());
+    iter->Next();
+  }
+  ASSERT_TRUE(!iter->Valid());
+
+  for (int i = 0; i < 200; i++) {
+    char user_key[16];
+    std::snprintf(user_key, sizeof(user_key), "key%06d", i);
+    LookupKey lkey(user_key, kMaxSequenceNumber);
+    Block::SeekForGet(iter, lkey.internal_key());
+    ASSERT_LEVELDB_OK(iter->status());
+    const bool found =
+        iter->Valid() && ExtractUserKey(iter->key()) == Slice(user_key);
+    if (i % 2 == 0) {
+      ASSERT_TRUE(found) << user_key;
+      ASSERT_EQ(user_key, iter->value().ToString());
+    } else {
+      ASSERT_TRUE(!found) << user_key;
+    }
+  }
+  delete iter;
+}
+
+TEST(BlockKeyPrefixTest, Seek) {
+  // Keys shorter than a prefix, keys that tie on their prefix, and values
+  // whose lengths take one to three varint bytes.
+  Random rnd(301);
+  std::vector<std::string> user_keys;
+  for (int i = 0; i < 300; i++) {
+    std::string key;
+    switch (i % 3) {
+      case 0:
+        key = test::RandomKey(&rnd, 1 + rnd.Uniform(6));
+        break;
+      case 1:
+        key = "commonprefix" + test::RandomKey(&rnd, rnd.Uniform(4));
+        break;
+      default:
+        key = test::RandomKey(&rnd, 8 + rnd.Uniform(8));
+        break;
+    }
+    user_keys.push_back(key);
+  }
+  std::sort(user_keys.begin(), user_keys.end());
+  user_keys.erase(std::unique(user_keys.begin(), user_keys.end()),
+                  user_keys.end());
+
+  InternalKeyComparator icmp(BytewiseComparator());
+  for (int internal = 0; internal < 2; internal++) {
+    SCOPED_TRACE(internal);
+    const Comparator* cmp =
+        internal ? static_cast<const Comparator*>(&icmp) : BytewiseComparator();
+    std::vector<std::string> keys;
+    for (const std::string& user_key : user_keys) {
+      if (internal) {
+        std::string ikey;
+        AppendInternalKey(&ikey, ParsedInternalKey(user_key, 7, kTypeValue));
+        keys.push_back(ikey);
+      } else {
+        keys.push_back(user_key);
+      }
+    }
+
+    std::string blocks[2];
+    for (int prefixes = 0; prefixes < 2; prefixes++) {
+      Options options;
+      options.comparator = cmp;
+      options.block_restart_interval = 4;
+      options.block_restart_key_prefixes = prefixes;
+      BlockBuilder builder(&options);
+      for (size_t i = 0; i < keys.size(); i++) {
+        const size_t value_size =
+            (i % 3 == 0) ? 10 : (i % 3 == 1) ? 300 : 20000;
+        builder.Add(keys[i], std::string(value_size, 'a' + i % 26));
+      }
+      blocks[prefixes] = builder.Finish().ToString();
+    }
+    ASSERT_GT(blocks[1].size(), blocks[0].size());
+
+    BlockContents contents;
+    contents.data = blocks[1];
+    contents.cachable = false;
+    contents.heap_allocated = false;
+    Block block(contents);
+    Iterator* iter = block.NewIterator(cmp);
+
+    iter->SeekToFirst();
+    for (const std::string& k : keys) {
+      ASSERT_TRUE(iter->Valid());
+      ASSERT_EQ(k, iter->key().ToString());
+      iter->Next();
+    }
+    ASSERT_TRUE(!iter->Valid());
+
+    for (int i = 0; i < 2000; i++) {
+      std::string target = (i % 2 == 0)
+                               ? user_keys[rnd.Uniform(user_keys.size())]
+                               : test::RandomKey(&rnd, rnd.Uniform(14));
+      if (i % 4 == 0) target.resize(rnd.Uniform(target.size() + 1));
+      if (internal) {
+        std::string ikey;
+        AppendInternalKey(&ikey, ParsedInternalKey(target, kMaxSequenceNumber,
+                                                   kValueTypeForSeek));
+        target = ikey;
+      }
+      auto expected = std::lower_bound(
+          keys.begin(), keys.end(), target,
+          [cmp](const std::string& a, const std::string& b) {
+            return cmp->Compare(a, b) < 0;
+          });
+      iter->Seek(target);
+      ASSERT_LEVELDB_OK(iter->status());
+      if (expected == keys.end()) {
+        ASSERT_TRUE(!iter->Valid());
+      } else {
+        ASSERT_TRUE(iter->Valid());
+        ASSERT_EQ(*expected, iter->key().ToString());
+      }
+    }
+    delete iter;
+  }
+}
+
 TEST(MemTableTest, Simple) {
   InternalKeyComparator cmp(BytewiseComparator());
   MemTable* memtable = new MemTable(cmp);
@@ -826,6 +984,119 @@ TEST(TableTest, ApproximateOffsetOfCompressed) {
   ASSERT_TRUE(Between(c.ApproximateOffsetOf("xyz"), 2 * min_z, 2 * max_z));
 }
 
+static bool CompressionSupported(CompressionType type) {
+  std::string out;
+  Slice in = "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa";
+  switch (type) {
+    case kZstdCompression:
+      return port::Zstd_Compress(1, in.data(), in.size(), &out);
+    case kLZ4Compression:
+      return port::LZ4_Compress(in.data(), in.size(), &out);
+    default:
+      return port::Snappy_Compress(in.data(), in.size(), &out);
+  }
+}
+
+TEST(TableTest, ZstdAndLZ4RoundTrip) {
+  for (CompressionType type : {kZstdCompression, kLZ4Compression}) {
+    if (!CompressionSupported(type)) {
+      std::fprintf(stderr, "skipping compression type %d\n", type);
+      continue;
+    }
+    Random rnd(301);
+    TableConstructor c(BytewiseComparator());
+    std::string tmp;
+    for (int i = 0; i < 20; i++) {
+      char key[16];
+      std::snprintf(key, sizeof(key), "k%02d", i);
+      c.Add(key, test::CompressibleString(&rnd, 0.25, 4000, &tmp));
+    }
+    std::vector<std::string> keys;
+    KVMap kvmap;
+    Options options;
+    options.block_size = 1024;
+    options.compression = type;
+    c.Finish(options, &keys, &kvmap);
+
+    // Compressed blocks take well under their raw 4000 bytes on disk.
+    ASSERT_TRUE(Between(c.ApproximateOffsetOf("k19"), 0, 19 * 2000));
+
+    Iterator* iter = c.NewIterator();
+    iter->SeekToFirst();
+    for (const auto& kvp : kvmap) {
+      ASSERT_TRUE(iter->Valid());
+      ASSERT_EQ(kvp.first, iter->key().ToString());
+      ASSERT_EQ(kvp.second, iter->value().ToString());
+      iter->Next();
+    }
+    ASSERT_TRUE(!iter->Valid());
+    ASSERT_LEVELDB_OK(iter->status());
+    delete iter;
+  }
+}
+
+TEST(TableTest, CompressedBlockCache) {
+  CompressionType type = kNoCompression;
+  for (CompressionType t :
+       {kSnappyCompression, kZstdCompression, kLZ4Compression}) {
+    if (CompressionSupported(t)) {
+      type = t;
+      break;
+    }
+  }
+  if (type == kNoCompression) {
+    std::fprintf(stderr, "skipping compressed block cache test\n");
+    return;
+  }
+
+  Random rnd(301);
+  std::string tmp;
+  KVMap kvmap((STLLessThan(BytewiseComparator())));
+  for (int i = 0; i < 20; i++) {
+    char key[16];
+    std::snprintf(key, sizeof(key), "k%02d", i);
+    kvmap[key] = test::CompressibleString(&rnd, 0.25, 4000, &tmp).ToString();
+  }
+  Options options;
+  options.block_size = 1024;
+  options.compression = type;
+  StringSink sink;
+  TableBuilder builder(options, &sink);
+  for (const auto& kvp : kvmap) {
+    builder.Add(kvp.first, kvp.second);
+  }
+  ASSERT_LEVELDB_OK(builder.Finish());
+
+  // No uncompressed block cache, so every read goes to the compressed tier.
+  Cache* compressed_cache = NewLRUCache(1 << 20);
+  Options table_options;
+  table_options.compressed_block_cache = compressed_cache;
+  StringSource source(sink.contents());
+  Table* table = nullptr;
+  ASSERT_LEVELDB_OK(
+      Table::Open(table_options, &source, sink.contents().size(), &table));
+
+  for (int pass = 0; pass < 2; pass++) {
+    Iterator* iter = table->NewIterator(ReadOptions());
+    iter->SeekToFirst();
+    for (const auto& kvp : kvmap) {
+      ASSERT_TRUE(iter->Valid());
+      ASSERT_EQ(kvp.first, iter->key().ToString());
+      ASSERT_EQ(kvp.second, iter->value().ToString());
+      iter->Next();
+    }
+    ASSERT_TRUE(!iter->Valid());
+    delete iter;
+
+    // Cached blocks are charged at their compressed size.
+    ASSERT_GT(compressed_cache->TotalCharge(), 0);
+    ASSERT_LT(compressed_cache->TotalCharge(), 20 * 2000);
+  }
+
+  delete table;
+  delete compressed_cache;
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) {
@@ -3,20 +3,40 @@
 // found in the LICENSE file. See the AUTHORS file for names of contributors.
 
 #include "table/two_level_iterator.h"
+#include "leveldb/slice_transform.h"
 #include "leveldb/table.h"
+#include "db/dbformat.h"
 #include "db/git_iter.h"
 #include "db/table_cache.h"
+#include "table/filter_block.h"
 
 namespace leveldb {
 
 TwoLevelIterator::TwoLevelIterator(Iterator* index_iter,
                                    BlockFunction block_function, void* arg,
-                                   const ReadOptions& options)
+                                   const ReadOptions& options,
+                                   const Comparator* comparator,
+                                   const SliceTransform* prefix_extractor,
+                                   const FilterBlockReader* filter)
     : block_function_(block_function),
       arg_(arg),
       options_(options),
+      comparator_(comparator),
+      prefix_extractor_(prefix_extractor),
+      filter_(filter),
       index_iter_(index_iter),
-      data_iter_(nullptr) {}
+      data_iter_(nullptr) {
+  if (comparator_ != nullptr && options_.iterate_lower_bound != nullptr) {
+    AppendInternalKey(&lower_bound_,
+                      ParsedInternalKey(*options_.iterate_lower_bound,
+                                        kMaxSequenceNumber, kValueTypeForSeek));
+  }
+  if (comparator_ != nullptr && options_.iterate_upper_bound != nullptr) {
+    AppendInternalKey(&upper_bound_,
+                      ParsedInternalKey(*options_.iterate_upper_bound,
+                                        kMaxSequenceNumber, kValueTypeForSeek));
+  }
+}
 
 TwoLevelIterator::~TwoLevelIterator() = default;
 
@@ -35,24 +55,55 @@ bool TwoLevelIterator::SeekWithOrWithoutNode(const Slice& target, void* node) {
   }
   // seek the target in index block or git
   index_iter_.Seek(target);
-  // check bloom filter
-  if (!index_iter_.Valid()) {
+  // check bloom filter.  Only the prefix can be checked: the scan goes on
+  // to the keys after the target, which the filter does not rule out.
+  if (!PrefixMayMatch(target)) {
+    SetDataIterator(nullptr);
     return false;
-  } else if (UseGit()) {
-    GlobalIndex::SkipListItem item = dynamic_cast<GITIter*>(index_iter_.iter())->Item();
-    bool kv_maybe_valid = item.KeyMaybeInDataBlock(target,
-                                                   options_.useFileGranFilter());
-    if (kv_maybe_valid) {
-      return false;
-    }
   }
   // load data block
   InitDataBlock();
-  if (data_iter_.iter() != nullptr) data_iter_.Seek(target);
+  if (data_iter_.iter() != nullptr) {
+    TwoLevelIterator* table_iter =
+        dynamic_cast<TwoLevelIterator*>(data_iter_.iter());
+    if (table_iter == nullptr) {
+      data_iter_.Seek(target);
+    } else if (table_iter->SeekWithOrWithoutNode(target, nullptr)) {
+      data_iter_.Update();
+    } else {
+      // The tables of a level are sorted as well
+      SetDataIterator(nullptr);
+      return false;
+    }
+  }
   SkipEmptyDataBlocksForward();
   return true;
 }
 
+bool TwoLevelIterator::PrefixMayMatch(const Slice& target) {
+  if (prefix_extractor_ == nullptr || !index_iter_.Valid()) {
+    return true;
+  }
+  const Slice user_key = ExtractUserKey(target);
+  if (!prefix_extractor_->InDomain(user_key)) {
+    return true;
+  }
+  InternalKey probe(prefix_extractor_->Transform(user_key), kMaxSequenceNumber,
+                    kValueTypeForSeek);
+  if (UseGit()) {
+    GlobalIndex::SkipListItem item =
+        dynamic_cast<GITIter*>(index_iter_.iter())->Item();
+    return item.KeyMaybeInDataBlock(probe.Encode(),
+                                    options_.useFileGranFilter());
+  }
+  Slice handle_value = index_iter_.value();
+  BlockHandle handle;
+  if (filter_ != nullptr && handle.DecodeFrom(&handle_value).ok()) {
+    return filter_->KeyMayMatch(handle.offset(), probe.Encode());
+  }
+  return true;
+}
+
 void TwoLevelIterator::SeekToFirst() {
   index_iter_.SeekToFirst();
   InitDataBlock();
@@ -87,14 +138,26 @@ bool TwoLevelIterator::UseGit() const {
   }
 }
 
-IteratorWrapper TwoLevelIterator::Get_index_iter() const {
+const IteratorWrapper& TwoLevelIterator::Get_index_iter() const {
   return index_iter_;
 }
 
+bool TwoLevelIterator::NextBlocksPastUpperBound() const {
+  // The index key of a block is at or after its last key and before the
+  // first key of the next block.
+  return !upper_bound_.empty() &&
+         comparator_->Compare(index_iter_.key(), upper_bound_) >= 0;
+}
+
+bool TwoLevelIterator::BlockBeforeLowerBound() const {
+  return !lower_bound_.empty() &&
+         comparator_->Compare(index_iter_.key(), lower_bound_) < 0;
+}
+
 void TwoLevelIterator::SkipEmptyDataBlocksForward() {
   while (data_iter_.iter() == nullptr || !data_iter_.Valid()) {
     // Move to next block
-    if (!index_iter_.Valid()) {
+    if (!index_iter_.Valid() || NextBlocksPastUpperBound()) {
       SetDataIterator(nullptr);
       return;
     }
@@ -112,6 +175,10 @@ void TwoLevelIterator::SkipEmptyDataBlocksBackward() {
       return;
     }
     index_iter_.Prev();
+    if (index_iter_.Valid() && BlockBeforeLowerBound()) {
+      SetDataIterator(nullptr);
+      return;
+    }
     InitDataBlock();
     if (data_iter_.iter() != nullptr) data_iter_.SeekToLast();
   }
@@ -154,8 +221,12 @@ void TwoLevelIterator::InitDataBlock() {
 
 Iterator* NewTwoLevelIterator(Iterator* index_iter,
                               BlockFunction block_function, void* arg,
-                              const ReadOptions& options) {
-  return new TwoLevelIterator(index_iter, block_function, arg, options);
+                              const ReadOptions& options,
+                              const Comparator* comparator,
+                              const SliceTransform* prefix_extractor,
+                              const FilterBlockReader* filter) {
+  return new TwoLevelIterator(index_iter, block_function, arg, options,
+                              comparator, prefix_extractor, filter);
 }
 
 }  // namespace leveldb
\ No newline at end of file
@@ -12,20 +12,29 @@
 
 namespace leveldb {
 
+class Comparator;
+class FilterBlockReader;
+class SliceTransform;
 struct ReadOptions;
 typedef Iterator* (*BlockFunction)(void*, const ReadOptions&, const Slice&);
 
 class TwoLevelIterator : public Iterator {
  public:
   TwoLevelIterator(Iterator* index_iter, BlockFunction block_function,
-                   void* arg, const ReadOptions& options);
+                   void* arg, const ReadOptions& options,
+                   const Comparator* comparator,
+                   const SliceTransform* prefix_extractor,
+                   const FilterBlockReader* filter);
 
   ~TwoLevelIterator() override;
 
   // We almost don't use this method.
   void Seek(const Slice& target) override;
   // We can seek target after node for git, or ignoring node for index block.
-  // If the target is definitely not in the block, then we return false.
+  // This is the seek that starts a scan: with a prefix extractor, if the
+  // filter of the data block the target falls into excludes its prefix,
+  // no later block holds the prefix either, so the iterator is left
+  // invalid and false is returned.
   bool SeekWithOrWithoutNode(const Slice& target, void* node);
   void SeekToFirst() override;
   void SeekToLast() override;
@@ -54,7 +63,7 @@ class TwoLevelIterator : public Iterator {
   // whether to use gitable.
   bool UseGit() const;
 
-  IteratorWrapper Get_index_iter() const;
+  const IteratorWrapper& Get_index_iter() const;
 
  private:
   void SaveError(const Status& s) {
@@ -64,11 +73,25 @@ class TwoLevelIterator : public Iterator {
   void SkipEmptyDataBlocksBackward();
   void SetDataIterator(Iterator* data_iter);
   void InitDataBlock();
+  // True if the blocks after the one index_iter_ points to only hold
+  // keys at or after the upper bound.
+  bool NextBlocksPastUpperBound() const;
+  // True if the block index_iter_ points to only holds keys before the
+  // lower bound.
+  bool BlockBeforeLowerBound() const;
+  // False if the filter of the block index_iter_ points to rules out
+  // any key with the prefix of "target".
+  bool PrefixMayMatch(const Slice& target);
 
   // for accessing data block
   BlockFunction block_function_;
   void* arg_;
   const ReadOptions options_;
+  const Comparator* const comparator_;  // Null if bounds are not checked
+  std::string lower_bound_;  // Internal key, if options_ has a lower bound
+  std::string upper_bound_;  // Internal key, if options_ has an upper bound
+  const SliceTransform* const prefix_extractor_;  // May be nullptr
+  const FilterBlockReader* const filter_;         // May be nullptr
   Status status_;
   IteratorWrapper index_iter_;
   IteratorWrapper data_iter_;  // May be nullptr
@@ -86,11 +109,24 @@ class TwoLevelIterator : public Iterator {
 //
 // Uses a supplied function to convert an index_iter value into
 // an iterator over the contents of the corresponding block.
+//
+// If "comparator" is non-null, it orders the internal keys of the index,
+// and the iterator stops at the blocks that lie entirely outside the
+// bounds of "options" (see ReadOptions::iterate_upper_bound).  The keys
+// inside the bounds are yielded as usual, so a caller still needs to
+// check the bounds itself.
+//
+// If "prefix_extractor" is non-null, the blocks are skipped by prefix
+// (see SeekWithOrWithoutNode()), using "filter" for the blocks of a
+// table or the filters the global index keeps for its entries.
 Iterator* NewTwoLevelIterator(
     Iterator* index_iter,
     Iterator* (*block_function)(void* arg, const ReadOptions& options,
                                 const Slice& index_value),
-    void* arg, const ReadOptions& options);
+    void* arg, const ReadOptions& options,
+    const Comparator* comparator = nullptr,
+    const SliceTransform* prefix_extractor = nullptr,
+    const FilterBlockReader* filter = nullptr);
 
 }  // namespace leveldb
 
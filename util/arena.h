@@ -10,7 +10,10 @@
 #include <cstddef>
 #include <cstdint>
 #include <vector>
+#include "port/port.h"
+#include "port/thread_annotations.h"
 #include "table/filter_block.h"
+#include "util/mutexlock.h"
 
 namespace leveldb {
 
@@ -31,6 +34,13 @@ class Arena {
   // Allocate memory with the normal alignment guarantees provided by malloc.
   T* AllocateAligned(size_t bytes);
 
+  // Variants of Allocate() and AllocateAligned() that may be called from
+  // several threads at once.  Each thread carves its allocations out of
+  // the block of one of kNumShards shards, so threads rarely contend.
+  // Must not run at the same time as Allocate() or AllocateAligned().
+  T* AllocateConcurrently(size_t bytes);
+  T* AllocateAlignedConcurrently(size_t bytes);
+
   // Returns an estimate of the total memory usage of data allocated
   // by the arena.
   size_t MemoryUsage() const {
@@ -38,13 +48,37 @@ class Arena {
   }
 
  private:
+  enum { kNumShards = 8 };
+
+  // Allocation state of one shard used by AllocateConcurrently().
+  struct Shard {
+    Shard() : alloc_ptr(nullptr), alloc_bytes_remaining(0) {}
+    ~Shard() {
+      for (size_t i = 0; i < blocks.size(); i++) {
+        delete[] blocks[i];
+      }
+    }
+
+    port::Mutex mu;
+    T* alloc_ptr GUARDED_BY(mu);
+    size_t alloc_bytes_remaining GUARDED_BY(mu);
+    std::vector<T*> blocks GUARDED_BY(mu);  // Blocks allocated by the shard
+  };
+
   T* AllocateFallback(size_t bytes);
   T* AllocateNewBlock(size_t block_bytes);
+  T* AllocateNewShardBlock(Shard* shard, size_t block_bytes)
+      EXCLUSIVE_LOCKS_REQUIRED(shard->mu);
+  T* AllocateFromShard(size_t bytes, bool aligned);
+  Shard* GetShard();
 
   // Allocation state
   T* alloc_ptr_;
   size_t alloc_bytes_remaining_;
 
+  // Created by the first concurrent allocation.
+  std::atomic<Shard*> shards_;
+
   // Array of new[] allocated memory blocks
   std::vector<T*> blocks_;
 
@@ -72,12 +106,25 @@ inline T* Arena<T>::Allocate(size_t bytes) {
 
 static const int kBlockSize = 4096;
 
+// Small integer that is fixed for the life of the calling thread and
+// differs between threads started one after another.
+inline size_t ArenaThreadIndex() {
+  static std::atomic<size_t> next_index(0);
+  thread_local size_t index =
+      next_index.fetch_add(1, std::memory_order_relaxed);
+  return index;
+}
+
 template<typename T>
 Arena<T>::Arena()
-    : alloc_ptr_(nullptr), alloc_bytes_remaining_(0), memory_usage_(0) {}
+    : alloc_ptr_(nullptr),
+      alloc_bytes_remaining_(0),
+      shards_(nullptr),
+      memory_usage_(0) {}
 
 template<typename T>
 Arena<T>::~Arena() {
+  delete[] shards_.load(std::memory_order_relaxed);
   for (size_t i = 0; i < blocks_.size(); i++) {
     delete[] blocks_[i];
   }
@@ -132,6 +179,74 @@ T* Arena<T>::AllocateNewBlock(size_t block_bytes) {
   return result;
 }
 
+// Like AllocateNewBlock(), but records the block in "shard" so that
+// the serial allocation path stays free of locks.
+template<typename T>
+T* Arena<T>::AllocateNewShardBlock(Shard* shard, size_t block_bytes) {
+  T* result = new T[block_bytes];
+  shard->blocks.push_back(result);
+  memory_usage_.fetch_add(block_bytes + sizeof(T*),
+                          std::memory_order_relaxed);
+  return result;
+}
+
+template<typename T>
+typename Arena<T>::Shard* Arena<T>::GetShard() {
+  Shard* shards = shards_.load(std::memory_order_acquire);
+  if (shards == nullptr) {
+    Shard* created = new Shard[kNumShards];
+    if (shards_.compare_exchange_strong(shards, created,
+                                        std::memory_order_acq_rel)) {
+      shards = created;
+    } else {
+      // Another thread got there first; "shards" now holds its array.
+      delete[] created;
+    }
+  }
+  return &shards[ArenaThreadIndex() % kNumShards];
+}
+
+template<typename T>
+T* Arena<T>::AllocateFromShard(size_t bytes, bool aligned) {
+  assert(bytes > 0);
+  Shard* shard = GetShard();
+  MutexLock l(&shard->mu);
+  if (bytes > kBlockSize / 4) {
+    // Same policy as AllocateFallback(): large objects get their own block.
+    return AllocateNewShardBlock(shard, bytes);
+  }
+
+  const int align = (sizeof(void*) > 8) ? sizeof(void*) : 8;
+  size_t slop = 0;
+  if (aligned) {
+    size_t current_mod =
+        reinterpret_cast<uintptr_t>(shard->alloc_ptr) & (align - 1);
+    slop = (current_mod == 0 ? 0 : align - current_mod);
+  }
+  if (bytes + slop > shard->alloc_bytes_remaining) {
+    // We waste the remaining space in the shard's block.  New blocks
+    // are always aligned.
+    shard->alloc_ptr = AllocateNewShardBlock(shard, kBlockSize);
+    shard->alloc_bytes_remaining = kBlockSize;
+    slop = 0;
+  }
+  T* result = shard->alloc_ptr + slop;
+  shard->alloc_ptr += bytes + slop;
+  shard->alloc_bytes_remaining -= bytes + slop;
+  assert(!aligned || (reinterpret_cast<uintptr_t>(result) & (align - 1)) == 0);
+  return result;
+}
+
+template<typename T>
+inline T* Arena<T>::AllocateConcurrently(size_t bytes) {
+  return AllocateFromShard(bytes, false);
+}
+
+template<typename T>
+inline T* Arena<T>::AllocateAlignedConcurrently(size_t bytes) {
+  return AllocateFromShard(bytes, true);
+}
+
 }  // namespace leveldb
 
 #endif  // STORAGE_LEVELDB_UTIL_ARENA_H_
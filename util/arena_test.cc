@@ -4,6 +4,9 @@
 
 #include "util/arena.h"
 
+#include <thread>
+#include <vector>
+
 #include "gtest/gtest.h"
 #include "util/random.h"
 
@@ -58,6 +61,51 @@ TEST(ArenaTest, Simple) {
   }
 }
 
+TEST(ArenaTest, Concurrent) {
+  const int kThreads = 4;
+  const int N = 20000;
+  Arena<char> arena;
+  std::vector<std::vector<std::pair<size_t, char*>>> allocated(kThreads);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; t++) {
+    threads.emplace_back([&arena, &allocated, t]() {
+      Random rnd(301 + t);
+      for (int i = 0; i < N; i++) {
+        size_t s = rnd.OneIn(1000) ? rnd.Uniform(6000) + 1
+                                   : rnd.Uniform(100) + 1;
+        char* r;
+        if (rnd.OneIn(2)) {
+          r = arena.AllocateAlignedConcurrently(s);
+          ASSERT_EQ(0, reinterpret_cast<uintptr_t>(r) & (sizeof(void*) - 1));
+        } else {
+          r = arena.AllocateConcurrently(s);
+        }
+        // Tag each byte with the thread and allocation it belongs to.
+        for (size_t b = 0; b < s; b++) {
+          r[b] = (t * 64 + i) % 256;
+        }
+        allocated[t].push_back(std::make_pair(s, r));
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+
+  size_t bytes = 0;
+  for (int t = 0; t < kThreads; t++) {
+    for (int i = 0; i < N; i++) {
+      size_t num_bytes = allocated[t][i].first;
+      const char* p = allocated[t][i].second;
+      for (size_t b = 0; b < num_bytes; b++) {
+        ASSERT_EQ(int(p[b]) & 0xff, (t * 64 + i) % 256);
+      }
+      bytes += num_bytes;
+    }
+  }
+  ASSERT_GE(arena.MemoryUsage(), bytes);
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) {
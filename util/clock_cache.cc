@@ -0,0 +1,465 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstring>
+
+#include "leveldb/cache.h"
+#include "port/port.h"
+#include "port/thread_annotations.h"
+#include "util/hash.h"
+#include "util/mutexlock.h"
+
+namespace leveldb {
+
+namespace {
+
+// CLOCK cache implementation
+//
+// Each shard keeps its entries in a fixed-size open-addressed (linear
+// probing) table of slots that is allocated once and never resized, so a
+// slot's memory stays valid for the lifetime of the cache.  That lets
+// Lookup() and Release() run without taking the shard mutex: they only
+// touch a slot's atomic "meta" word, which packs the slot state together
+// with the count of external references:
+//
+//   meta = state << kStateShift | refs
+//
+//   kStateEmpty         slot holds no entry
+//   kStateConstruction  one thread has exclusive use of the slot, to fill
+//                       it in or to destroy its entry
+//   kStateVisible       entry is in the cache and may be looked up
+//   kStateInvisible     entry was erased or evicted but is still
+//                       referenced by clients; freed by the last Release()
+//
+// Lookup() acquires a reference with a single fetch_add and then checks
+// the state it observed.  If the slot was not shareable (empty or under
+// construction) the increment is deliberately left in place: the thread
+// owning the slot overwrites the whole meta word when it is done.
+//
+// Insert(), Erase(), Prune() and eviction are serialized by the shard
+// mutex.  Only they make entries visible or invisible, so a visible
+// entry's key is stable while the mutex is held.
+//
+// Because the table is never rehashed, removing an entry cannot leave a
+// gap that would cut a probe sequence short.  Instead every slot counts
+// the entries whose probe sequence passed over it ("displacements"), and
+// a lookup only stops at an empty slot with no displacements.
+//
+// Eviction is CLOCK with a small frequency counter per entry.  New entries
+// start at zero and every hit increments the counter up to kMaxClock; the
+// clock hand decrements non-zero counters and evicts the first
+// unreferenced entry whose counter is already zero.  Blocks touched once by
+// a long scan are therefore evicted on the first sweep, while frequently
+// read blocks survive several sweeps, which makes the cache scan resistant
+// in the manner of S3-FIFO's probationary queue.
+
+static const int kStateShift = 30;
+static const uint32_t kRefsMask = (1u << kStateShift) - 1;
+static const uint32_t kStateEmpty = 0;
+static const uint32_t kStateConstruction = 1;
+static const uint32_t kStateVisible = 2;
+static const uint32_t kStateInvisible = 3;
+static const uint8_t kMaxClock = 3;
+
+inline uint32_t StateOf(uint32_t meta) { return meta >> kStateShift; }
+inline uint32_t RefsOf(uint32_t meta) { return meta & kRefsMask; }
+inline bool IsShareable(uint32_t meta) {
+  return StateOf(meta) >= kStateVisible;
+}
+
+struct ClockHandle {
+  std::atomic<uint32_t> meta{0};
+  std::atomic<uint32_t> hash{0};
+  std::atomic<uint32_t> displacements{0};
+  std::atomic<uint8_t> clock{0};
+  bool detached = false;  // Not in any table; deleted on last Release()
+
+  // Written only while the slot is under construction.
+  void* value = nullptr;
+  void (*deleter)(const Slice&, void* value) = nullptr;
+  size_t charge = 0;
+  char* key_data = nullptr;
+  size_t key_length = 0;
+
+  Slice key() const { return Slice(key_data, key_length); }
+};
+
+// Destroy the entry in "h", which the caller owns exclusively.
+void FreeEntry(ClockHandle* h) {
+  (*h->deleter)(h->key(), h->value);
+  delete[] h->key_data;
+  h->key_data = nullptr;
+  if (h->detached) {
+    delete h;
+  } else {
+    h->meta.store(kStateEmpty << kStateShift, std::memory_order_release);
+  }
+}
+
+// Free "h" if it is invisible and no longer referenced.
+void MaybeFree(ClockHandle* h) {
+  uint32_t expected = kStateInvisible << kStateShift;
+  if (h->meta.compare_exchange_strong(expected,
+                                      kStateConstruction << kStateShift,
+                                      std::memory_order_acq_rel)) {
+    FreeEntry(h);
+  }
+}
+
+void UnrefHandle(ClockHandle* h) {
+  const uint32_t old = h->meta.fetch_sub(1, std::memory_order_acq_rel);
+  assert(RefsOf(old) > 0);
+  if (RefsOf(old) == 1 && StateOf(old) == kStateInvisible) {
+    MaybeFree(h);
+  }
+}
+
+// A single shard of sharded cache.
+class ClockCacheShard {
+ public:
+  ClockCacheShard();
+  ~ClockCacheShard();
+
+  // Separate from constructor so caller can easily make an array of shards
+  void Init(size_t capacity, size_t num_slots);
+
+  // Like Cache methods, but with an extra "hash" parameter.
+  Cache::Handle* Insert(const Slice& key, uint32_t hash, void* value,
+                        size_t charge,
+                        void (*deleter)(const Slice& key, void* value));
+  Cache::Handle* Lookup(const Slice& key, uint32_t hash);
+  void Erase(const Slice& key, uint32_t hash);
+  void Prune();
+  size_t TotalCharge() const {
+    MutexLock l(&mutex_);
+    return usage_;
+  }
+
+ private:
+  // Return the index of the visible entry for key, or num_slots_.
+  size_t FindVisible(const Slice& key, uint32_t hash)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Take the visible entry at "index" out of the cache.  It is freed now
+  // if unreferenced, else by the last Release().
+  void Remove(size_t index) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Advance the clock hand until one entry is evicted.  Returns false if
+  // every entry is in use.
+  bool EvictOne() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Initialized before use.
+  size_t capacity_;
+  ClockHandle* slots_;
+  size_t num_slots_;  // Power of two
+  size_t max_occupancy_;
+
+  mutable port::Mutex mutex_;
+  size_t usage_ GUARDED_BY(mutex_);
+  size_t occupancy_ GUARDED_BY(mutex_);  // Number of visible entries
+  size_t clock_hand_ GUARDED_BY(mutex_);
+};
+
+ClockCacheShard::ClockCacheShard()
+    : capacity_(0),
+      slots_(nullptr),
+      num_slots_(0),
+      max_occupancy_(0),
+      usage_(0),
+      occupancy_(0),
+      clock_hand_(0) {}
+
+ClockCacheShard::~ClockCacheShard() {
+  for (size_t i = 0; i < num_slots_; i++) {
+    ClockHandle* h = &slots_[i];
+    const uint32_t meta = h->meta.load(std::memory_order_acquire);
+    if (StateOf(meta) == kStateVisible) {
+      assert(RefsOf(meta) == 0);  // Error if caller has an unreleased handle
+      FreeEntry(h);
+    } else {
+      assert(StateOf(meta) == kStateEmpty);
+    }
+  }
+  delete[] slots_;
+}
+
+void ClockCacheShard::Init(size_t capacity, size_t num_slots) {
+  assert((num_slots & (num_slots - 1)) == 0);
+  capacity_ = capacity;
+  num_slots_ = num_slots;
+  max_occupancy_ = num_slots - num_slots / 8;
+  slots_ = new ClockHandle[num_slots];
+}
+
+Cache::Handle* ClockCacheShard::Lookup(const Slice& key, uint32_t hash) {
+  for (size_t i = 0; i < num_slots_; i++) {
+    ClockHandle* h = &slots_[(hash + i) & (num_slots_ - 1)];
+    const uint32_t meta = h->meta.load(std::memory_order_acquire);
+    if (StateOf(meta) == kStateVisible &&
+        h->hash.load(std::memory_order_relaxed) == hash) {
+      const uint32_t old = h->meta.fetch_add(1, std::memory_order_acquire);
+      if (StateOf(old) == kStateVisible) {
+        // Our reference keeps the entry from being destroyed, so its key
+        // is safe to read.
+        if (h->key() == key) {
+          const uint8_t clock = h->clock.load(std::memory_order_relaxed);
+          if (clock < kMaxClock) {
+            h->clock.store(clock + 1, std::memory_order_relaxed);
+          }
+          return reinterpret_cast<Cache::Handle*>(h);
+        }
+        UnrefHandle(h);
+      } else if (IsShareable(old)) {
+        UnrefHandle(h);
+      }
+      // Else the slot is owned by another thread, which will reset meta.
+    } else if (StateOf(meta) == kStateEmpty &&
+               h->displacements.load(std::memory_order_relaxed) == 0) {
+      break;
+    }
+  }
+  return nullptr;
+}
+
+size_t ClockCacheShard::FindVisible(const Slice& key, uint32_t hash) {
+  for (size_t i = 0; i < num_slots_; i++) {
+    const size_t index = (hash + i) & (num_slots_ - 1);
+    ClockHandle* h = &slots_[index];
+    const uint32_t meta = h->meta.load(std::memory_order_acquire);
+    if (StateOf(meta) == kStateVisible &&
+        h->hash.load(std::memory_order_relaxed) == hash && h->key() == key) {
+      return index;
+    } else if (StateOf(meta) == kStateEmpty &&
+               h->displacements.load(std::memory_order_relaxed) == 0) {
+      break;
+    }
+  }
+  return num_slots_;
+}
+
+void ClockCacheShard::Remove(size_t index) {
+  ClockHandle* h = &slots_[index];
+  // Read everything needed before the entry becomes invisible: after that
+  // the last Release() may free it at any time.
+  const uint32_t hash = h->hash.load(std::memory_order_relaxed);
+  const size_t charge = h->charge;
+
+  const uint32_t old = h->meta.fetch_or(kStateInvisible << kStateShift,
+                                        std::memory_order_acq_rel);
+  assert(StateOf(old) == kStateVisible);
+  for (size_t i = hash & (num_slots_ - 1); i != index;
+       i = (i + 1) & (num_slots_ - 1)) {
+    slots_[i].displacements.fetch_sub(1, std::memory_order_relaxed);
+  }
+  usage_ -= charge;
+  occupancy_--;
+  if (RefsOf(old) == 0) {
+    MaybeFree(h);
+  }
+}
+
+bool ClockCacheShard::EvictOne() {
+  // Every counter reaches zero within kMaxClock + 1 full sweeps.
+  const size_t max_steps = (kMaxClock + 1) * num_slots_;
+  for (size_t step = 0; step < max_steps; step++) {
+    const size_t index = clock_hand_;
+    clock_hand_ = (clock_hand_ + 1) & (num_slots_ - 1);
+    ClockHandle* h = &slots_[index];
+    const uint32_t meta = h->meta.load(std::memory_order_acquire);
+    if (StateOf(meta) != kStateVisible || RefsOf(meta) != 0) {
+      continue;
+    }
+    const uint8_t clock = h->clock.load(std::memory_order_relaxed);
+    if (clock > 0) {
+      h->clock.store(clock - 1, std::memory_order_relaxed);
+      continue;
+    }
+    Remove(index);
+    return true;
+  }
+  return false;
+}
+
+Cache::Handle* ClockCacheShard::Insert(const Slice& key, uint32_t hash,
+                                       void* value, size_t charge,
+                                       void (*deleter)(const Slice& key,
+                                                       void* value)) {
+  MutexLock l(&mutex_);
+
+  const size_t existing = FindVisible(key, hash);
+  if (existing != num_slots_) {
+    Remove(existing);
+  }
+  while ((usage_ + charge > capacity_ || occupancy_ >= max_occupancy_) &&
+         occupancy_ > 0 && EvictOne()) {
+  }
+
+  ClockHandle* h = nullptr;
+  size_t index = 0;
+  if (capacity_ > 0 && occupancy_ < max_occupancy_) {
+    for (size_t i = 0; i < num_slots_; i++) {
+      index = (hash + i) & (num_slots_ - 1);
+      ClockHandle* slot = &slots_[index];
+      uint32_t meta = slot->meta.load(std::memory_order_relaxed);
+      // Stray reader increments may have left refs on an empty slot.
+      if (StateOf(meta) == kStateEmpty &&
+          slot->meta.compare_exchange_strong(
+              meta, kStateConstruction << kStateShift,
+              std::memory_order_acquire)) {
+        h = slot;
+        break;
+      }
+    }
+  }
+  if (h == nullptr) {
+    // Don't cache: the cache is disabled (capacity_==0), or every slot is
+    // taken by entries that are still referenced.
+    h = new ClockHandle;
+    h->detached = true;
+  }
+
+  h->value = value;
+  h->deleter = deleter;
+  h->charge = charge;
+  h->key_length = key.size();
+  h->key_data = new char[key.size()];
+  std::memcpy(h->key_data, key.data(), key.size());
+  h->hash.store(hash, std::memory_order_relaxed);
+  h->clock.store(0, std::memory_order_relaxed);
+
+  if (h->detached) {
+    h->meta.store(kStateInvisible << kStateShift | 1,
+                  std::memory_order_release);
+  } else {
+    for (size_t i = hash & (num_slots_ - 1); i != index;
+         i = (i + 1) & (num_slots_ - 1)) {
+      slots_[i].displacements.fetch_add(1, std::memory_order_relaxed);
+    }
+    usage_ += charge;
+    occupancy_++;
+    // Publish the entry, with one reference for the returned handle.
+    h->meta.store(kStateVisible << kStateShift | 1, std::memory_order_release);
+  }
+  return reinterpret_cast<Cache::Handle*>(h);
+}
+
+void ClockCacheShard::Erase(const Slice& key, uint32_t hash) {
+  MutexLock l(&mutex_);
+  const size_t index = FindVisible(key, hash);
+  if (index != num_slots_) {
+    Remove(index);
+  }
+}
+
+void ClockCacheShard::Prune() {
+  MutexLock l(&mutex_);
+  for (size_t i = 0; i < num_slots_; i++) {
+    const uint32_t meta = slots_[i].meta.load(std::memory_order_acquire);
+    if (StateOf(meta) == kStateVisible && RefsOf(meta) == 0) {
+      Remove(i);
+    }
+  }
+}
+
+// Shards should hold at least this much so that a few hot entries do not
+// crowd out a shard.
+static const size_t kMinShardCapacity = 512 * 1024;
+static const int kMaxNumShardBits = 6;
+static const size_t kMinSlotsPerShard = 16;
+
+class ShardedClockCache : public Cache {
+ private:
+  ClockCacheShard* shards_;
+  const int num_shard_bits_;
+  std::atomic<uint64_t> last_id_;
+
+  static inline uint32_t HashSlice(const Slice& s) {
+    return Hash(s.data(), s.size(), 0);
+  }
+
+  uint32_t Shard(uint32_t hash) const {
+    return num_shard_bits_ > 0 ? hash >> (32 - num_shard_bits_) : 0;
+  }
+
+  static int DefaultNumShardBits(size_t capacity) {
+    int bits = 0;
+    while (bits < kMaxNumShardBits &&
+           (capacity >> (bits + 1)) >= kMinShardCapacity) {
+      bits++;
+    }
+    return bits;
+  }
+
+ public:
+  ShardedClockCache(size_t capacity, int num_shard_bits,
+                    size_t estimated_entry_charge)
+      : num_shard_bits_(num_shard_bits >= 0
+                            ? std::min(num_shard_bits, 16)
+                            : DefaultNumShardBits(capacity)),
+        last_id_(0) {
+    const size_t num_shards = size_t{1} << num_shard_bits_;
+    const size_t per_shard = (capacity + (num_shards - 1)) / num_shards;
+    if (estimated_entry_charge == 0) {
+      estimated_entry_charge = 1;
+    }
+    // Aim for a load factor of about 0.7 when the shard is full.
+    const size_t wanted = per_shard / estimated_entry_charge * 10 / 7 + 1;
+    size_t num_slots = kMinSlotsPerShard;
+    while (num_slots < wanted && num_slots < (size_t{1} << 30)) {
+      num_slots *= 2;
+    }
+    shards_ = new ClockCacheShard[num_shards];
+    for (size_t s = 0; s < num_shards; s++) {
+      shards_[s].Init(per_shard, num_slots);
+    }
+  }
+  ~ShardedClockCache() override { delete[] shards_; }
+  Handle* Insert(const Slice& key, void* value, size_t charge,
+                 void (*deleter)(const Slice& key, void* value)) override {
+    const uint32_t hash = HashSlice(key);
+    return shards_[Shard(hash)].Insert(key, hash, value, charge, deleter);
+  }
+  Handle* Lookup(const Slice& key) override {
+    const uint32_t hash = HashSlice(key);
+    return shards_[Shard(hash)].Lookup(key, hash);
+  }
+  void Release(Handle* handle) override {
+    UnrefHandle(reinterpret_cast<ClockHandle*>(handle));
+  }
+  void Erase(const Slice& key) override {
+    const uint32_t hash = HashSlice(key);
+    shards_[Shard(hash)].Erase(key, hash);
+  }
+  void* Value(Handle* handle) override {
+    return reinterpret_cast<ClockHandle*>(handle)->value;
+  }
+  uint64_t NewId() override {
+    return last_id_.fetch_add(1, std::memory_order_relaxed) + 1;
+  }
+  void Prune() override {
+    for (int s = 0; s < (1 << num_shard_bits_); s++) {
+      shards_[s].Prune();
+    }
+  }
+  size_t TotalCharge() const override {
+    size_t total = 0;
+    for (int s = 0; s < (1 << num_shard_bits_); s++) {
+      total += shards_[s].TotalCharge();
+    }
+    return total;
+  }
+};
+
+}  // end anonymous namespace
+
+Cache* NewClockCache(size_t capacity, int num_shard_bits,
+                     size_t estimated_entry_charge) {
+  return new ShardedClockCache(capacity, num_shard_bits,
+                               estimated_entry_charge);
+}
+
+}  // namespace leveldb
@@ -2,15 +2,19 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file. See the AUTHORS file for names of contributors.
 //
-// A portable implementation of crc32c.
+// A portable implementation of crc32c, and the choice between it and
+// the hardware implementations.
 
 #include "util/crc32c.h"
 
+#include <algorithm>
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
 
 #include "port/port.h"
 #include "util/coding.h"
+#include "util/crc32c_internal.h"
 
 namespace leveldb {
 namespace crc32c {
@@ -273,12 +277,161 @@ static bool CanAccelerateCRC32C() {
   return port::AcceleratedCRC32C(0, kTestCRCBuffer, kBufSize) == kTestCRCValue;
 }
 
-uint32_t Extend(uint32_t crc, const char* data, size_t n) {
-  static bool accelerate = CanAccelerateCRC32C();
-  if (accelerate) {
-    return port::AcceleratedCRC32C(crc, data, n);
+namespace {
+
+// The crc polynomial, bit-reversed.
+const uint32_t kPolynomial = 0x82f63b78u;
+
+// Returns mat * vec over GF(2), where mat is a 32x32 bit matrix stored
+// one column per word.
+uint32_t MatrixTimes(const uint32_t* mat, uint32_t vec) {
+  uint32_t sum = 0;
+  for (; vec != 0; vec >>= 1, mat++) {
+    if (vec & 1) sum ^= *mat;
+  }
+  return sum;
+}
+
+void MatrixSquare(uint32_t* square, const uint32_t* mat) {
+  for (int i = 0; i < 32; i++) {
+    square[i] = MatrixTimes(mat, mat[i]);
+  }
+}
+
+// Lookup tables for the operator that feeds some number of zero bytes
+// into a crc register, one table per byte of the register.
+struct ZerosTable {
+  explicit ZerosTable(size_t bytes) {
+    // op starts out as the operator for one zero bit, and is squared
+    // into the operator for 2, 4, 8, ... bits.
+    uint32_t op[32];
+    op[0] = kPolynomial;
+    for (int i = 1; i < 32; i++) {
+      op[i] = 1u << (i - 1);
+    }
+    uint32_t square[32];
+    for (int i = 0; i < 3; i++) {  // 8 zero bits
+      MatrixSquare(square, op);
+      std::memcpy(op, square, sizeof(op));
+    }
+    // Multiply together the operators for the set bits of "bytes".
+    uint32_t result[32];
+    for (int i = 0; i < 32; i++) {
+      result[i] = 1u << i;
+    }
+    for (; bytes != 0; bytes >>= 1) {
+      if (bytes & 1) {
+        for (int i = 0; i < 32; i++) {
+          square[i] = MatrixTimes(op, result[i]);
+        }
+        std::memcpy(result, square, sizeof(result));
+      }
+      MatrixSquare(square, op);
+      std::memcpy(op, square, sizeof(op));
+    }
+    for (uint32_t b = 0; b < 256; b++) {
+      table[0][b] = MatrixTimes(result, b);
+      table[1][b] = MatrixTimes(result, b << 8);
+      table[2][b] = MatrixTimes(result, b << 16);
+      table[3][b] = MatrixTimes(result, b << 24);
+    }
+  }
+
+  uint32_t Shift(uint32_t crc) const {
+    return table[0][crc & 0xff] ^ table[1][(crc >> 8) & 0xff] ^
+           table[2][(crc >> 16) & 0xff] ^ table[3][crc >> 24];
+  }
+
+  uint32_t table[4][256];
+};
+
+typedef uint32_t (*ExtendFunction)(uint32_t, const char*, size_t);
+typedef uint32_t (*ExtendAndCopyFunction)(uint32_t, const char*, size_t,
+                                          char*);
+
+uint32_t ExtendWithPort(uint32_t crc, const char* data, size_t n) {
+  return port::AcceleratedCRC32C(crc, data, n);
+}
+
+// Copies in chunks small enough for the checksum pass to read them back
+// from the cache.
+template <ExtendFunction kExtend>
+uint32_t ExtendAndCopyInChunks(uint32_t crc, const char* data, size_t n,
+                               char* dst) {
+  static const size_t kChunk = 16 << 10;
+  while (n > 0) {
+    const size_t chunk = std::min(n, kChunk);
+    std::memcpy(dst, data, chunk);
+    crc = (*kExtend)(crc, dst, chunk);
+    data += chunk;
+    dst += chunk;
+    n -= chunk;
   }
+  return crc;
+}
+
+struct Implementation {
+  Implementation() {
+#if HAVE_SSE42
+    if (CanUseSse42()) {
+      name = "sse4.2";
+      extend = &ExtendSse42;
+      extend_and_copy = &ExtendAndCopySse42;
+      return;
+    }
+#endif  // HAVE_SSE42
+#if HAVE_ARM64_CRC32C
+    if (CanUseArm64()) {
+      name = "arm64";
+      extend = &ExtendArm64;
+      extend_and_copy = &ExtendAndCopyArm64;
+      return;
+    }
+#endif  // HAVE_ARM64_CRC32C
+    if (CanAccelerateCRC32C()) {
+      name = "crc32c library";
+      extend = &ExtendWithPort;
+      extend_and_copy = &ExtendAndCopyInChunks<ExtendWithPort>;
+      return;
+    }
+    name = "portable";
+    extend = &ExtendPortable;
+    extend_and_copy = &ExtendAndCopyInChunks<ExtendPortable>;
+  }
+
+  const char* name;
+  ExtendFunction extend;
+  ExtendAndCopyFunction extend_and_copy;
+};
+
+const Implementation& GetImplementation() {
+  static const Implementation implementation;
+  return implementation;
+}
+
+}  // namespace
+
+uint32_t ShiftLong(uint32_t crc) {
+  static const ZerosTable table(kLongBlock);
+  return table.Shift(crc);
+}
+
+uint32_t ShiftShort(uint32_t crc) {
+  static const ZerosTable table(kShortBlock);
+  return table.Shift(crc);
+}
+
+uint32_t Extend(uint32_t crc, const char* data, size_t n) {
+  return GetImplementation().extend(crc, data, n);
+}
+
+uint32_t ExtendAndCopy(uint32_t crc, const char* data, size_t n, char* dst) {
+  return GetImplementation().extend_and_copy(crc, data, n, dst);
+}
+
+const char* ImplementationName() { return GetImplementation().name; }
 
+uint32_t ExtendPortable(uint32_t crc, const char* data, size_t n) {
   const uint8_t* p = reinterpret_cast<const uint8_t*>(data);
   const uint8_t* e = p + n;
   uint32_t l = crc ^ kCRC32Xor;
@@ -19,6 +19,20 @@ uint32_t Extend(uint32_t init_crc, const char* data, size_t n);
 // Return the crc32c of data[0,n-1]
 inline uint32_t Value(const char* data, size_t n) { return Extend(0, data, n); }
 
+// Same as Extend(), but also copies data[0,n-1] to dst[0,n-1], which must
+// not overlap it.  Cheaper than a copy followed by Extend() because the
+// data is read only once.
+uint32_t ExtendAndCopy(uint32_t init_crc, const char* data, size_t n,
+                       char* dst);
+
+// Extend() with the portable, table-driven implementation, whatever the
+// CPU supports.  For tests and benchmarks.
+uint32_t ExtendPortable(uint32_t init_crc, const char* data, size_t n);
+
+// Name of the implementation behind Extend(): "sse4.2", "arm64",
+// "crc32c library" or "portable".
+const char* ImplementationName();
+
 static const uint32_t kMaskDelta = 0xa282ead8ul;
 
 // Return a masked representation of crc.
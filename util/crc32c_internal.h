@@ -0,0 +1,51 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// Hardware implementations of crc32c, picked by util/crc32c.cc at run
+// time.  Each is built with the instruction set flags it needs, so it
+// must only be called once its Can...() check has passed.
+
+#ifndef STORAGE_LEVELDB_UTIL_CRC32C_INTERNAL_H_
+#define STORAGE_LEVELDB_UTIL_CRC32C_INTERNAL_H_
+
+#include <cstddef>
+#include <cstdint>
+
+#include "port/port.h"
+
+namespace leveldb {
+namespace crc32c {
+
+// The hardware implementations checksum three adjacent blocks of input
+// at a time, so that the latency of the crc instruction is hidden, and
+// combine their crcs with ShiftLong() or ShiftShort().
+static const size_t kLongBlock = 8192;
+static const size_t kShortBlock = 256;
+
+// Return the crc register that results from feeding kLongBlock
+// (kShortBlock) zero bytes into register "crc".  No pre- or
+// post-conditioning is applied.
+uint32_t ShiftLong(uint32_t crc);
+uint32_t ShiftShort(uint32_t crc);
+
+#if HAVE_SSE42
+// True if the CPU has the SSE4.2 crc32 instruction.
+bool CanUseSse42();
+uint32_t ExtendSse42(uint32_t crc, const char* data, size_t n);
+uint32_t ExtendAndCopySse42(uint32_t crc, const char* data, size_t n,
+                            char* dst);
+#endif  // HAVE_SSE42
+
+#if HAVE_ARM64_CRC32C
+// True if the CPU has the ARMv8 crc32 instructions.
+bool CanUseArm64();
+uint32_t ExtendArm64(uint32_t crc, const char* data, size_t n);
+uint32_t ExtendAndCopyArm64(uint32_t crc, const char* data, size_t n,
+                            char* dst);
+#endif  // HAVE_ARM64_CRC32C
+
+}  // namespace crc32c
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_UTIL_CRC32C_INTERNAL_H_
@@ -0,0 +1,113 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// crc32c with the SSE4.2 crc32 instruction.  This file is compiled with
+// -msse4.2, so nothing in it may run before CanUseSse42() returns true.
+
+#include "util/crc32c_internal.h"
+
+#if HAVE_SSE42
+
+#include <cstring>
+
+#include <cpuid.h>
+#include <nmmintrin.h>
+
+namespace leveldb {
+namespace crc32c {
+
+namespace {
+
+inline uint64_t Load64(const char* p) {
+  uint64_t word;
+  std::memcpy(&word, p, sizeof(word));
+  return word;
+}
+
+inline void Store64(char* p, uint64_t word) {
+  std::memcpy(p, &word, sizeof(word));
+}
+
+// With kCopy, data[0,n-1] is also copied to dst, from the same loads.
+template <bool kCopy>
+uint32_t ExtendImpl(uint32_t crc, const char* p, size_t n, char* dst) {
+  const char* e = p + n;
+  uint64_t l = crc ^ 0xffffffffu;
+
+  // Align the loads of the main loops.
+  while (p != e && (reinterpret_cast<uintptr_t>(p) & 7) != 0) {
+    if (kCopy) *dst++ = *p;
+    l = _mm_crc32_u8(static_cast<uint32_t>(l), static_cast<uint8_t>(*p++));
+  }
+
+  // Checksum three blocks at a time, each into a register of its own,
+  // then fold the second and third blocks' registers into the first.
+  for (const size_t block : {kLongBlock, kShortBlock}) {
+    while (static_cast<size_t>(e - p) >= 3 * block) {
+      uint64_t l1 = 0;
+      uint64_t l2 = 0;
+      const char* end = p + block;
+      do {
+        const uint64_t w0 = Load64(p);
+        const uint64_t w1 = Load64(p + block);
+        const uint64_t w2 = Load64(p + 2 * block);
+        if (kCopy) {
+          Store64(dst, w0);
+          Store64(dst + block, w1);
+          Store64(dst + 2 * block, w2);
+          dst += 8;
+        }
+        l = _mm_crc32_u64(l, w0);
+        l1 = _mm_crc32_u64(l1, w1);
+        l2 = _mm_crc32_u64(l2, w2);
+        p += 8;
+      } while (p != end);
+      if (block == kLongBlock) {
+        l = ShiftLong(static_cast<uint32_t>(l)) ^ l1;
+        l = ShiftLong(static_cast<uint32_t>(l)) ^ l2;
+      } else {
+        l = ShiftShort(static_cast<uint32_t>(l)) ^ l1;
+        l = ShiftShort(static_cast<uint32_t>(l)) ^ l2;
+      }
+      p += 2 * block;
+      if (kCopy) dst += 2 * block;
+    }
+  }
+
+  while (e - p >= 8) {
+    const uint64_t w = Load64(p);
+    if (kCopy) {
+      Store64(dst, w);
+      dst += 8;
+    }
+    l = _mm_crc32_u64(l, w);
+    p += 8;
+  }
+  while (p != e) {
+    if (kCopy) *dst++ = *p;
+    l = _mm_crc32_u8(static_cast<uint32_t>(l), static_cast<uint8_t>(*p++));
+  }
+  return static_cast<uint32_t>(l) ^ 0xffffffffu;
+}
+
+}  // namespace
+
+bool CanUseSse42() {
+  unsigned int eax, ebx, ecx, edx;
+  return __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_SSE4_2) != 0;
+}
+
+uint32_t ExtendSse42(uint32_t crc, const char* data, size_t n) {
+  return ExtendImpl<false>(crc, data, n, nullptr);
+}
+
+uint32_t ExtendAndCopySse42(uint32_t crc, const char* data, size_t n,
+                            char* dst) {
+  return ExtendImpl<true>(crc, data, n, dst);
+}
+
+}  // namespace crc32c
+}  // namespace leveldb
+
+#endif  // HAVE_SSE42
@@ -4,6 +4,8 @@
 
 #include "util/crc32c.h"
 
+#include <string>
+
 #include "gtest/gtest.h"
 
 namespace leveldb {
@@ -44,6 +46,46 @@ TEST(CRC, Extend) {
   ASSERT_EQ(Value("hello world", 11), Extend(Value("hello ", 6), "world", 5));
 }
 
+// Lengths that reach the three-way loops of the hardware
+// implementations, with and without leftovers.
+static const size_t kLengths[] = {0,    1,    7,    8,     255,   768,
+                                  769,  1000, 4096, 24575, 24576, 24577,
+                                  30000, 100000};
+
+TEST(CRC, MatchesPortable) {
+  std::string data(100000 + 8, '\0');
+  for (size_t i = 0; i < data.size(); i++) {
+    data[i] = static_cast<char>(i * 131 + (i >> 8));
+  }
+  SCOPED_TRACE(ImplementationName());
+  for (size_t offset = 0; offset < 8; offset++) {
+    for (size_t n : kLengths) {
+      ASSERT_EQ(ExtendPortable(0x12345678, data.data() + offset, n),
+                Extend(0x12345678, data.data() + offset, n))
+          << "offset " << offset << " length " << n;
+    }
+  }
+}
+
+TEST(CRC, ExtendAndCopy) {
+  std::string data(100000 + 8, '\0');
+  for (size_t i = 0; i < data.size(); i++) {
+    data[i] = static_cast<char>(i * 7 + (i >> 12));
+  }
+  for (size_t offset = 0; offset < 8; offset += 3) {
+    for (size_t n : kLengths) {
+      std::string copy(n + 2, 'z');
+      const uint32_t crc =
+          ExtendAndCopy(Value("a", 1), data.data() + offset, n, &copy[1]);
+      ASSERT_EQ(Extend(Value("a", 1), data.data() + offset, n), crc)
+          << "offset " << offset << " length " << n;
+      ASSERT_EQ(data.substr(offset, n), copy.substr(1, n));
+      ASSERT_EQ('z', copy[0]);
+      ASSERT_EQ('z', copy[n + 1]);
+    }
+  }
+}
+
 TEST(CRC, Mask) {
   uint32_t crc = Value("foo", 3);
   ASSERT_NE(crc, Mask(crc));
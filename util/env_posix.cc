@@ -12,6 +12,7 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <atomic>
 #include <cerrno>
 #include <cstddef>
@@ -101,6 +102,66 @@ class Limiter {
   std::atomic<int> acquires_allowed_;
 };
 
+// Detects runs of sequential reads of a random access file, such as the
+// data blocks of a table read by a range scan or a compaction, and tells
+// which range past the last read to ask the kernel to read ahead.  The
+// readahead starts at kMinReadahead bytes and doubles with every further
+// sequential read up to kMaxReadahead; any other read ends the run.
+//
+// Instances of this class are thread-safe.  Reads from several threads
+// may interleave and spoil each other's runs, which only costs readahead.
+class ReadaheadTracker {
+ public:
+  static constexpr uint64_t kMinReadahead = 16 * 1024;
+  static constexpr uint64_t kMaxReadahead = 256 * 1024;
+
+  ReadaheadTracker() : next_offset_(0), readahead_(0), readahead_end_(0) {}
+
+  ReadaheadTracker(const ReadaheadTracker&) = delete;
+  ReadaheadTracker& operator=(const ReadaheadTracker&) = delete;
+
+  // Record a read of [offset, offset + n).  Returns true and sets
+  // [*ahead_offset, *ahead_offset + *ahead_size) to the range to read
+  // ahead if the read continues a run and the kernel has not been asked
+  // for that range yet.
+  bool OnRead(uint64_t offset, size_t n, uint64_t* ahead_offset,
+              uint64_t* ahead_size) {
+    const uint64_t end = offset + n;
+    const uint64_t expected = next_offset_.exchange(end,
+                                                    std::memory_order_relaxed);
+    if (offset != expected || n == 0) {
+      readahead_.store(0, std::memory_order_relaxed);
+      readahead_end_.store(0, std::memory_order_relaxed);
+      return false;
+    }
+
+    uint64_t readahead = readahead_.load(std::memory_order_relaxed);
+    readahead = std::min(std::max(2 * readahead, kMinReadahead),
+                         kMaxReadahead);
+    readahead_.store(readahead, std::memory_order_relaxed);
+
+    // Only ask again once the run has used up half of the last request.
+    const uint64_t hinted = readahead_end_.load(std::memory_order_relaxed);
+    if (end + readahead / 2 <= hinted) {
+      return false;
+    }
+    *ahead_offset = std::max(end, hinted);
+    *ahead_size = end + readahead - *ahead_offset;
+    readahead_end_.store(end + readahead, std::memory_order_relaxed);
+    return true;
+  }
+
+ private:
+  // These are only hints for the next read, so they are not kept
+  // consistent with each other and can be accessed relaxed.
+  std::atomic<uint64_t> next_offset_;    // End of the last read
+  std::atomic<uint64_t> readahead_;      // Bytes to read ahead in this run
+  std::atomic<uint64_t> readahead_end_;  // End of the range asked for
+};
+
+constexpr uint64_t ReadaheadTracker::kMinReadahead;
+constexpr uint64_t ReadaheadTracker::kMaxReadahead;
+
 // Implements sequential read access in a file using read().
 //
 // Instances of this class are thread-friendly but not thread-safe, as required
@@ -143,8 +204,8 @@ class PosixSequentialFile final : public SequentialFile {
 // Implements random read access in a file using pread().
 //
 // Instances of this class are thread-safe, as required by the RandomAccessFile
-// API. Instances are immutable and Read() only calls thread-safe library
-// functions.
+// API. Apart from the thread-safe readahead tracker, instances are immutable
+// and Read() only calls thread-safe library functions.
 class PosixRandomAccessFile final : public RandomAccessFile {
  public:
   // The new instance takes ownership of |fd|. |fd_limiter| must outlive this
@@ -180,6 +241,16 @@ class PosixRandomAccessFile final : public RandomAccessFile {
 
     assert(fd != -1);
 
+#if HAVE_POSIX_FADVISE
+    uint64_t ahead_offset, ahead_size;
+    if (readahead_.OnRead(offset, n, &ahead_offset, &ahead_size)) {
+      // The kernel reads the range in the background, into the page cache
+      // that the next preads of the run are served from.
+      ::posix_fadvise(fd, static_cast<off_t>(ahead_offset),
+                      static_cast<off_t>(ahead_size), POSIX_FADV_WILLNEED);
+    }
+#endif  // HAVE_POSIX_FADVISE
+
     Status status;
     ssize_t read_size = ::pread(fd, scratch, n, static_cast<off_t>(offset));
     *result = Slice(scratch, (read_size < 0) ? 0 : read_size);
@@ -200,13 +271,14 @@ class PosixRandomAccessFile final : public RandomAccessFile {
   const int fd_;                 // -1 if has_permanent_fd_ is false.
   Limiter* const fd_limiter_;
   const std::string filename_;
+  mutable ReadaheadTracker readahead_;
 };
 
 // Implements random read access in a file using mmap().
 //
 // Instances of this class are thread-safe, as required by the RandomAccessFile
-// API. Instances are immutable and Read() only calls thread-safe library
-// functions.
+// API. Apart from the thread-safe readahead tracker, instances are immutable
+// and Read() only calls thread-safe library functions.
 class PosixMmapReadableFile final : public RandomAccessFile {
  public:
   // mmap_base[0, length-1] points to the memory-mapped contents of the file. It
@@ -235,6 +307,19 @@ class PosixMmapReadableFile final : public RandomAccessFile {
       return PosixError(filename_, EINVAL);
     }
 
+    uint64_t ahead_offset, ahead_size;
+    if (readahead_.OnRead(offset, n, &ahead_offset, &ahead_size)) {
+      // Fault the pages of the range in before the run touches them.
+      // madvise() needs a page aligned address.
+      static const uint64_t page_size = ::sysconf(_SC_PAGESIZE);
+      const uint64_t start = ahead_offset - ahead_offset % page_size;
+      const uint64_t limit = std::min<uint64_t>(ahead_offset + ahead_size,
+                                                length_);
+      if (start < limit) {
+        ::madvise(mmap_base_ + start, limit - start, MADV_WILLNEED);
+      }
+    }
+
     *result = Slice(mmap_base_ + offset, n);
     return Status::OK();
   }
@@ -244,8 +329,53 @@ class PosixMmapReadableFile final : public RandomAccessFile {
   const size_t length_;
   Limiter* const mmap_limiter_;
   const std::string filename_;
+  mutable ReadaheadTracker readahead_;
 };
 
+// Ensures that all the caches associated with the given file descriptor's
+// data are flushed all the way to durable media, and can withstand power
+// failures.
+//
+// The path argument is only used to populate the description string in the
+// returned Status if an error occurs.
+Status SyncFd(int fd, const std::string& fd_path) {
+#if HAVE_FULLFSYNC
+  // On macOS and iOS, fsync() doesn't guarantee durability past power
+  // failures. fcntl(F_FULLFSYNC) is required for that purpose. Some
+  // filesystems don't support fcntl(F_FULLFSYNC), and require a fallback to
+  // fsync().
+  if (::fcntl(fd, F_FULLFSYNC) == 0) {
+    return Status::OK();
+  }
+#endif  // HAVE_FULLFSYNC
+
+#if HAVE_FDATASYNC
+  bool sync_success = ::fdatasync(fd) == 0;
+#else
+  bool sync_success = ::fsync(fd) == 0;
+#endif  // HAVE_FDATASYNC
+
+  if (sync_success) {
+    return Status::OK();
+  }
+  return PosixError(fd_path, errno);
+}
+
+// Reserves bytes [offset, offset + length) of the file behind "fd" without
+// changing its size.  Does nothing where fallocate() is not available or
+// the file system does not support it.
+Status PreallocateFd(int fd, uint64_t offset, uint64_t length,
+                     const std::string& fd_path) {
+#if HAVE_FALLOCATE
+  if (::fallocate(fd, FALLOC_FL_KEEP_SIZE, static_cast<off_t>(offset),
+                  static_cast<off_t>(length)) != 0 &&
+      errno != EOPNOTSUPP && errno != ENOSYS) {
+    return PosixError(fd_path, errno);
+  }
+#endif  // HAVE_FALLOCATE
+  return Status::OK();
+}
+
 class PosixWritableFile final : public WritableFile {
  public:
   PosixWritableFile(std::string filename, int fd)
@@ -322,6 +452,10 @@ class PosixWritableFile final : public WritableFile {
     return SyncFd(fd_, filename_);
   }
 
+  Status Preallocate(uint64_t offset, uint64_t length) override {
+    return PreallocateFd(fd_, offset, length, filename_);
+  }
+
  private:
   Status FlushBuffer() {
     Status status = WriteUnbuffered(buf_, pos_);
@@ -360,35 +494,6 @@ class PosixWritableFile final : public WritableFile {
     return status;
   }
 
-  // Ensures that all the caches associated with the given file descriptor's
-  // data are flushed all the way to durable media, and can withstand power
-  // failures.
-  //
-  // The path argument is only used to populate the description string in the
-  // returned Status if an error occurs.
-  static Status SyncFd(int fd, const std::string& fd_path) {
-#if HAVE_FULLFSYNC
-    // On macOS and iOS, fsync() doesn't guarantee durability past power
-    // failures. fcntl(F_FULLFSYNC) is required for that purpose. Some
-    // filesystems don't support fcntl(F_FULLFSYNC), and require a fallback to
-    // fsync().
-    if (::fcntl(fd, F_FULLFSYNC) == 0) {
-      return Status::OK();
-    }
-#endif  // HAVE_FULLFSYNC
-
-#if HAVE_FDATASYNC
-    bool sync_success = ::fdatasync(fd) == 0;
-#else
-    bool sync_success = ::fsync(fd) == 0;
-#endif  // HAVE_FDATASYNC
-
-    if (sync_success) {
-      return Status::OK();
-    }
-    return PosixError(fd_path, errno);
-  }
-
   // Returns the directory name in a path pointing to a file.
   //
   // Returns "." if the path does not contain any directory separator.
@@ -436,6 +541,119 @@ class PosixWritableFile final : public WritableFile {
   const std::string dirname_;  // The directory of filename_.
 };
 
+#if HAVE_O_DIRECT
+// Offsets, sizes and buffer addresses of direct I/O are multiples of this,
+// which covers the logical block size of common devices.
+constexpr const size_t kDirectIOAlignment = 4096;
+
+// Writes through a file descriptor opened with O_DIRECT.  Data is staged
+// in an aligned buffer.  Flush() writes the partial block at the end of
+// the file padded with zeros, and writes it again once more data arrives;
+// Close() truncates the padding off.
+class PosixDirectWritableFile final : public WritableFile {
+ public:
+  // Takes ownership of "buf", which holds kWritableFileBufferSize bytes
+  // aligned to kDirectIOAlignment.
+  PosixDirectWritableFile(std::string filename, int fd, char* buf)
+      : buf_(buf),
+        pos_(0),
+        offset_(0),
+        fd_(fd),
+        filename_(std::move(filename)) {}
+
+  ~PosixDirectWritableFile() override {
+    if (fd_ >= 0) {
+      // Ignoring any potential errors
+      Close();
+    }
+    std::free(buf_);
+  }
+
+  Status Append(const Slice& data) override {
+    const char* p = data.data();
+    size_t left = data.size();
+    while (left > 0) {
+      const size_t n = std::min(left, kWritableFileBufferSize - pos_);
+      std::memcpy(buf_ + pos_, p, n);
+      p += n;
+      left -= n;
+      pos_ += n;
+      if (pos_ == kWritableFileBufferSize) {
+        Status status = FlushBuffer();
+        if (!status.ok()) {
+          return status;
+        }
+      }
+    }
+    return Status::OK();
+  }
+
+  Status Close() override {
+    Status status = FlushBuffer();
+    if (status.ok() && ::ftruncate(fd_, offset_ + pos_) != 0) {
+      status = PosixError(filename_, errno);
+    }
+    const int close_result = ::close(fd_);
+    if (close_result < 0 && status.ok()) {
+      status = PosixError(filename_, errno);
+    }
+    fd_ = -1;
+    return status;
+  }
+
+  Status Flush() override { return FlushBuffer(); }
+
+  Status Sync() override {
+    Status status = FlushBuffer();
+    if (!status.ok()) {
+      return status;
+    }
+    return SyncFd(fd_, filename_);
+  }
+
+  Status Preallocate(uint64_t offset, uint64_t length) override {
+    return PreallocateFd(fd_, offset, length, filename_);
+  }
+
+ private:
+  // Writes buf_[0, pos_ - 1] at offset_, and keeps only the trailing
+  // partial block, if any, in buf_.
+  Status FlushBuffer() {
+    if (pos_ == 0) {
+      return Status::OK();
+    }
+    const size_t padded = (pos_ + kDirectIOAlignment - 1) &
+                          ~(kDirectIOAlignment - 1);
+    std::memset(buf_ + pos_, 0, padded - pos_);
+    size_t done = 0;
+    while (done < padded) {
+      ssize_t write_result =
+          ::pwrite(fd_, buf_ + done, padded - done, offset_ + done);
+      if (write_result < 0) {
+        if (errno == EINTR) {
+          continue;  // Retry
+        }
+        return PosixError(filename_, errno);
+      }
+      done += write_result;
+    }
+    const size_t whole = pos_ & ~(kDirectIOAlignment - 1);
+    std::memmove(buf_, buf_ + whole, pos_ - whole);
+    offset_ += whole;
+    pos_ -= whole;
+    return Status::OK();
+  }
+
+  // buf_[0, pos_ - 1] contains data to be written to fd_ at offset_.
+  char* const buf_;
+  size_t pos_;
+  uint64_t offset_;  // Multiple of kDirectIOAlignment
+  int fd_;
+
+  const std::string filename_;
+};
+#endif  // HAVE_O_DIRECT
+
 int LockOrUnlock(int fd, bool lock) {
   errno = 0;
   struct ::flock file_lock_info;
@@ -560,6 +778,34 @@ class PosixEnv : public Env {
     return Status::OK();
   }
 
+  Status NewDirectWritableFile(const std::string& filename,
+                               WritableFile** result) override {
+#if HAVE_O_DIRECT
+    void* buf = nullptr;
+    if (::posix_memalign(&buf, kDirectIOAlignment, kWritableFileBufferSize) !=
+        0) {
+      *result = nullptr;
+      return Status::IOError(filename, "cannot allocate direct I/O buffer");
+    }
+    int fd = ::open(filename.c_str(),
+                    O_TRUNC | O_WRONLY | O_CREAT | O_DIRECT | kOpenBaseFlags,
+                    0644);
+    if (fd >= 0) {
+      *result = new PosixDirectWritableFile(filename, fd,
+                                            static_cast<char*>(buf));
+      return Status::OK();
+    }
+    const int open_errno = errno;
+    std::free(buf);
+    if (open_errno != EINVAL) {
+      *result = nullptr;
+      return PosixError(filename, open_errno);
+    }
+    // The file system does not support direct I/O.
+#endif  // HAVE_O_DIRECT
+    return NewWritableFile(filename, result);
+  }
+
   Status NewAppendableFile(const std::string& filename,
                            WritableFile** result) override {
     int fd = ::open(filename.c_str(),
@@ -668,6 +914,8 @@ class PosixEnv : public Env {
   void Schedule(void (*background_work_function)(void* background_work_arg),
                 void* background_work_arg) override;
 
+  void SetBackgroundThreads(int number) override;
+
   void StartThread(void (*thread_main)(void* thread_main_arg),
                    void* thread_main_arg) override {
     std::thread new_thread(thread_main, thread_main_arg);
@@ -744,7 +992,8 @@ class PosixEnv : public Env {
 
   port::Mutex background_work_mutex_;
   port::CondVar background_work_cv_ GUARDED_BY(background_work_mutex_);
-  bool started_background_thread_ GUARDED_BY(background_work_mutex_);
+  int started_background_threads_ GUARDED_BY(background_work_mutex_);
+  int max_background_threads_ GUARDED_BY(background_work_mutex_);
 
   std::queue<BackgroundWorkItem> background_work_queue_
       GUARDED_BY(background_work_mutex_);
@@ -779,7 +1028,8 @@ int MaxOpenFiles() {
 
 PosixEnv::PosixEnv()
     : background_work_cv_(&background_work_mutex_),
-      started_background_thread_(false),
+      started_background_threads_(0),
+      max_background_threads_(1),
       mmap_limiter_(MaxMmaps()),
       fd_limiter_(MaxOpenFiles()) {}
 
@@ -788,22 +1038,29 @@ void PosixEnv::Schedule(
     void* background_work_arg) {
   background_work_mutex_.Lock();
 
-  // Start the background thread, if we haven't done so already.
-  if (!started_background_thread_) {
-    started_background_thread_ = true;
+  // Grow the pool of background threads lazily, one thread per work item,
+  // until it reaches the configured size.
+  if (started_background_threads_ < max_background_threads_) {
+    ++started_background_threads_;
     std::thread background_thread(PosixEnv::BackgroundThreadEntryPoint, this);
     background_thread.detach();
   }
 
-  // If the queue is empty, the background thread may be waiting for work.
-  if (background_work_queue_.empty()) {
-    background_work_cv_.Signal();
-  }
+  // Wake up one background thread that may be waiting for work.
+  background_work_cv_.Signal();
 
   background_work_queue_.emplace(background_work_function, background_work_arg);
   background_work_mutex_.Unlock();
 }
 
+void PosixEnv::SetBackgroundThreads(int number) {
+  background_work_mutex_.Lock();
+  if (number > max_background_threads_) {
+    max_background_threads_ = number;
+  }
+  background_work_mutex_.Unlock();
+}
+
 void PosixEnv::BackgroundThreadMain() {
   while (true) {
     background_work_mutex_.Lock();
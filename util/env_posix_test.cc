@@ -6,6 +6,7 @@
 #include <sys/wait.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
@@ -212,6 +213,46 @@ TEST_F(EnvPosixTest, TestOpenOnRead) {
   ASSERT_LEVELDB_OK(env_->RemoveFile(test_file));
 }
 
+TEST_F(EnvPosixTest, TestSequentialRandomReads) {
+  // Runs of sequential reads make the files read ahead; check that the
+  // reads still return the right data, for mmap, pread and open-on-read.
+  std::string test_dir;
+  ASSERT_LEVELDB_OK(env_->GetTestDirectory(&test_dir));
+  std::string test_file = test_dir + "/sequential_random_reads.txt";
+
+  Random rnd(301);
+  std::string data;
+  test::RandomString(&rnd, 1 << 20, &data);
+  ASSERT_LEVELDB_OK(WriteStringToFile(env_, data, test_file));
+
+  const int kNumFiles = kReadOnlyFileLimit + kMMapLimit + 1;
+  leveldb::RandomAccessFile* files[kNumFiles] = {0};
+  for (int i = 0; i < kNumFiles; i++) {
+    ASSERT_LEVELDB_OK(env_->NewRandomAccessFile(test_file, &files[i]));
+  }
+  const size_t kReadSize = 4096 + 5;  // A block and its trailer
+  std::string scratch(kReadSize, '\0');
+  Slice read_result;
+  for (int i = 0; i < kNumFiles; i++) {
+    for (size_t offset = 0; offset < data.size(); offset += kReadSize) {
+      const size_t n = std::min(kReadSize, data.size() - offset);
+      ASSERT_LEVELDB_OK(files[i]->Read(offset, n, &read_result, &scratch[0]));
+      ASSERT_EQ(Slice(data.data() + offset, n), read_result);
+      if (offset % (16 * kReadSize) == 0) {
+        // An unrelated read in between restarts the run.
+        const size_t other = rnd.Uniform(data.size() - kReadSize);
+        ASSERT_LEVELDB_OK(
+            files[i]->Read(other, kReadSize, &read_result, &scratch[0]));
+        ASSERT_EQ(Slice(data.data() + other, kReadSize), read_result);
+      }
+    }
+  }
+  for (int i = 0; i < kNumFiles; i++) {
+    delete files[i];
+  }
+  ASSERT_LEVELDB_OK(env_->RemoveFile(test_file));
+}
+
 #if HAVE_O_CLOEXEC
 
 TEST_F(EnvPosixTest, TestCloseOnExecSequentialFile) {
@@ -134,6 +134,41 @@ TEST_F(EnvTest, RunMany) {
   }
 }
 
+TEST_F(EnvTest, SetBackgroundThreads) {
+  struct RunState {
+    port::Mutex mu;
+    port::CondVar cvar{&mu};
+    int started = 0;
+    int finished = 0;
+  };
+
+  // Each work item waits for the other one to start, so both can only
+  // finish if they run on different background threads.
+  struct Callback {
+    static void Run(void* arg) {
+      RunState* state = reinterpret_cast<RunState*>(arg);
+      MutexLock l(&state->mu);
+      state->started++;
+      state->cvar.SignalAll();
+      while (state->started < 2) {
+        state->cvar.Wait();
+      }
+      state->finished++;
+      state->cvar.SignalAll();
+    }
+  };
+
+  RunState state;
+  env_->SetBackgroundThreads(2);
+  env_->Schedule(&Callback::Run, &state);
+  env_->Schedule(&Callback::Run, &state);
+
+  MutexLock l(&state.mu);
+  while (state.finished != 2) {
+    state.cvar.Wait();
+  }
+}
+
 struct State {
   port::Mutex mu;
   port::CondVar cvar{&mu};
@@ -232,6 +267,48 @@ TEST_F(EnvTest, ReopenAppendableFile) {
   env_->RemoveFile(test_file_name);
 }
 
+TEST_F(EnvTest, DirectWritableFile) {
+  Random rnd(test::RandomSeed());
+  std::string test_dir;
+  ASSERT_LEVELDB_OK(env_->GetTestDirectory(&test_dir));
+  std::string test_file_name = test_dir + "/direct_writable_file.txt";
+  env_->RemoveFile(test_file_name);
+
+  WritableFile* writable_file;
+  ASSERT_LEVELDB_OK(
+      env_->NewDirectWritableFile(test_file_name, &writable_file));
+  ASSERT_LEVELDB_OK(writable_file->Preallocate(0, 1 << 20));
+  uint64_t size;
+  ASSERT_LEVELDB_OK(env_->GetFileSize(test_file_name, &size));
+  ASSERT_EQ(0, size);
+
+  // Writes of any size and alignment, some of them flushed or synced
+  // while the last block is only partly filled.
+  std::string data;
+  while (data.size() < 1048576) {
+    std::string r;
+    test::RandomString(&rnd, rnd.Skewed(17), &r);
+    ASSERT_LEVELDB_OK(writable_file->Append(r));
+    data += r;
+    if (rnd.OneIn(4)) {
+      ASSERT_LEVELDB_OK(writable_file->Flush());
+    } else if (rnd.OneIn(20)) {
+      ASSERT_LEVELDB_OK(writable_file->Sync());
+      std::string contents;
+      ASSERT_LEVELDB_OK(ReadFileToString(env_, test_file_name, &contents));
+      ASSERT_GE(contents.size(), data.size());
+      ASSERT_TRUE(Slice(contents).starts_with(data));
+    }
+  }
+  ASSERT_LEVELDB_OK(writable_file->Close());
+  delete writable_file;
+
+  std::string contents;
+  ASSERT_LEVELDB_OK(ReadFileToString(env_, test_file_name, &contents));
+  ASSERT_EQ(data, contents);
+  env_->RemoveFile(test_file_name);
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) {
@@ -20,11 +20,12 @@ class Histogram {
 
   std::string ToString() const;
 
+  double Percentile(double p) const;
+
  private:
   enum { kNumBuckets = 154 };
 
   double Median() const;
-  double Percentile(double p) const;
   double Average() const;
   double StandardDeviation() const;
 
@@ -0,0 +1,214 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/rate_limiter.h"
+
+#include <algorithm>
+#include <deque>
+
+#include "leveldb/env.h"
+#include "port/port.h"
+#include "port/thread_annotations.h"
+#include "util/mutexlock.h"
+#include "util/rate_limited_file.h"
+
+namespace leveldb {
+
+RateLimiter::~RateLimiter() = default;
+
+namespace {
+
+// Token bucket refilled every refill_period_us_.  Requests that do not
+// fit in the bucket queue up per priority; one of the waiting threads
+// sleeps until the next refill and then hands the new tokens out, flush
+// requests first.
+class GenericRateLimiter : public RateLimiter {
+ public:
+  GenericRateLimiter(int64_t rate_bytes_per_sec, int64_t refill_period_us,
+                     bool auto_tuned)
+      : env_(Env::Default()),
+        refill_period_us_(std::max<int64_t>(refill_period_us, 1000)),
+        max_bytes_per_sec_(std::max<int64_t>(rate_bytes_per_sec, 1)),
+        auto_tuned_(auto_tuned),
+        cv_(&mu_),
+        rate_bytes_per_sec_(max_bytes_per_sec_),
+        refill_bytes_per_period_(RefillBytes(max_bytes_per_sec_)),
+        available_bytes_(refill_bytes_per_period_),
+        next_refill_micros_(env_->NowMicros() + refill_period_us_),
+        refilling_(false),
+        tune_periods_(0),
+        drained_periods_(0) {
+    for (int i = 0; i < kNumPriorities; i++) {
+      total_bytes_[i] = 0;
+      throttled_bytes_[i] = 0;
+    }
+  }
+
+  ~GenericRateLimiter() override = default;
+
+  void Request(int64_t bytes, IOPriority pri) override {
+    MutexLock l(&mu_);
+    total_bytes_[pri] += bytes;
+    if (queue_[kFlush].empty() && queue_[kCompaction].empty()) {
+      if (!refilling_ && env_->NowMicros() >= next_refill_micros_) {
+        Refill();
+      }
+      if (available_bytes_ >= bytes) {
+        available_bytes_ -= bytes;
+        return;
+      }
+    }
+
+    throttled_bytes_[pri] += bytes;
+    Req req(bytes);
+    queue_[pri].push_back(&req);
+    while (req.remaining > 0) {
+      if (!refilling_) {
+        // This thread waits out the period for everyone
+        refilling_ = true;
+        const uint64_t now = env_->NowMicros();
+        if (now < next_refill_micros_) {
+          mu_.Unlock();
+          env_->SleepForMicroseconds(
+              static_cast<int>(next_refill_micros_ - now));
+          mu_.Lock();
+        }
+        Refill();
+        refilling_ = false;
+        cv_.SignalAll();
+      } else {
+        cv_.Wait();
+      }
+    }
+  }
+
+  int64_t GetBytesPerSecond() const override {
+    MutexLock l(&mu_);
+    return rate_bytes_per_sec_;
+  }
+
+  uint64_t GetTotalBytesThrough(IOPriority pri) const override {
+    MutexLock l(&mu_);
+    return total_bytes_[pri];
+  }
+
+  uint64_t GetThrottledBytes(IOPriority pri) const override {
+    MutexLock l(&mu_);
+    return throttled_bytes_[pri];
+  }
+
+ private:
+  struct Req {
+    explicit Req(int64_t bytes) : remaining(bytes) {}
+    int64_t remaining;
+  };
+
+  // A period's worth of tokens is the most that can be used in a burst.
+  int64_t RefillBytes(int64_t rate) const {
+    return std::max<int64_t>(rate * refill_period_us_ / 1000000, 1);
+  }
+
+  // Starts a new period and grants its tokens to the queued requests in
+  // priority order.  A request larger than what is left is granted in
+  // parts over several periods and keeps its place at the head.
+  void Refill() EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    next_refill_micros_ = env_->NowMicros() + refill_period_us_;
+    available_bytes_ = refill_bytes_per_period_;
+    for (int pri = 0; pri < kNumPriorities; pri++) {
+      std::deque<Req*>* queue = &queue_[pri];
+      while (!queue->empty() && available_bytes_ > 0) {
+        Req* req = queue->front();
+        const int64_t granted = std::min(req->remaining, available_bytes_);
+        req->remaining -= granted;
+        available_bytes_ -= granted;
+        if (req->remaining == 0) {
+          queue->pop_front();
+        }
+      }
+    }
+    if (auto_tuned_) {
+      Tune();
+    }
+  }
+
+  // Every kTunePeriods periods, lowers the rate by 5% if the bucket was
+  // rarely drained and raises it by 5% if it nearly always was.
+  void Tune() EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    static const int kTunePeriods = 100;
+    tune_periods_++;
+    if (available_bytes_ == 0) {
+      drained_periods_++;
+    }
+    if (tune_periods_ < kTunePeriods) {
+      return;
+    }
+    const int64_t min_rate = std::max<int64_t>(max_bytes_per_sec_ / 20, 1);
+    int64_t rate = rate_bytes_per_sec_;
+    if (drained_periods_ * 100 < tune_periods_ * 50) {
+      rate = std::max(min_rate, rate / 20 * 19);
+    } else if (drained_periods_ * 100 > tune_periods_ * 90) {
+      rate = std::min(max_bytes_per_sec_, rate / 20 * 21);
+    }
+    rate_bytes_per_sec_ = rate;
+    refill_bytes_per_period_ = RefillBytes(rate);
+    tune_periods_ = 0;
+    drained_periods_ = 0;
+  }
+
+  Env* const env_;
+  const int64_t refill_period_us_;
+  const int64_t max_bytes_per_sec_;
+  const bool auto_tuned_;
+
+  mutable port::Mutex mu_;
+  port::CondVar cv_ GUARDED_BY(mu_);
+  int64_t rate_bytes_per_sec_ GUARDED_BY(mu_);
+  int64_t refill_bytes_per_period_ GUARDED_BY(mu_);
+  int64_t available_bytes_ GUARDED_BY(mu_);
+  uint64_t next_refill_micros_ GUARDED_BY(mu_);
+  bool refilling_ GUARDED_BY(mu_);  // Is a thread waiting for the refill?
+  std::deque<Req*> queue_[kNumPriorities] GUARDED_BY(mu_);
+  int tune_periods_ GUARDED_BY(mu_);
+  int drained_periods_ GUARDED_BY(mu_);
+  uint64_t total_bytes_[kNumPriorities] GUARDED_BY(mu_);
+  uint64_t throttled_bytes_[kNumPriorities] GUARDED_BY(mu_);
+};
+
+class RateLimitedWritableFile : public WritableFile {
+ public:
+  RateLimitedWritableFile(WritableFile* target, RateLimiter* limiter,
+                          RateLimiter::IOPriority pri)
+      : target_(target), limiter_(limiter), pri_(pri) {}
+
+  ~RateLimitedWritableFile() override { delete target_; }
+
+  Status Append(const Slice& data) override {
+    limiter_->Request(data.size(), pri_);
+    return target_->Append(data);
+  }
+  Status Close() override { return target_->Close(); }
+  Status Flush() override { return target_->Flush(); }
+  Status Sync() override { return target_->Sync(); }
+
+ private:
+  WritableFile* const target_;
+  RateLimiter* const limiter_;
+  const RateLimiter::IOPriority pri_;
+};
+
+}  // namespace
+
+RateLimiter* NewGenericRateLimiter(int64_t rate_bytes_per_sec,
+                                   int64_t refill_period_us, bool auto_tuned) {
+  return new GenericRateLimiter(rate_bytes_per_sec, refill_period_us,
+                                auto_tuned);
+}
+
+WritableFile* NewRateLimitedWritableFile(WritableFile* target,
+                                         RateLimiter* limiter,
+                                         RateLimiter::IOPriority pri) {
+  return new RateLimitedWritableFile(target, limiter, pri);
+}
+
+}  // namespace leveldb
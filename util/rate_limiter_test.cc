@@ -0,0 +1,97 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/rate_limiter.h"
+
+#include <atomic>
+#include <memory>
+#include <thread>
+
+#include "gtest/gtest.h"
+#include "leveldb/env.h"
+
+namespace leveldb {
+
+TEST(RateLimiterTest, Counters) {
+  std::unique_ptr<RateLimiter> limiter(
+      NewGenericRateLimiter(1 << 20, 10 * 1000));
+  ASSERT_EQ(1 << 20, limiter->GetBytesPerSecond());
+
+  // The first period's worth fits without waiting.
+  limiter->Request(1000, RateLimiter::kFlush);
+  ASSERT_EQ(1000, limiter->GetTotalBytesThrough(RateLimiter::kFlush));
+  ASSERT_EQ(0, limiter->GetThrottledBytes(RateLimiter::kFlush));
+
+  limiter->Request(20000, RateLimiter::kCompaction);
+  ASSERT_EQ(20000, limiter->GetTotalBytesThrough(RateLimiter::kCompaction));
+  ASSERT_EQ(20000, limiter->GetThrottledBytes(RateLimiter::kCompaction));
+  ASSERT_EQ(0, limiter->GetThrottledBytes(RateLimiter::kFlush));
+}
+
+TEST(RateLimiterTest, Rate) {
+  Env* env = Env::Default();
+  const int64_t kRate = 1 << 20;
+  std::unique_ptr<RateLimiter> limiter(NewGenericRateLimiter(kRate, 10 * 1000));
+
+  // Half a second worth of requests, larger than one refill period each.
+  const uint64_t start = env->NowMicros();
+  for (int i = 0; i < 16; i++) {
+    limiter->Request(kRate / 32, RateLimiter::kCompaction);
+  }
+  const uint64_t elapsed = env->NowMicros() - start;
+  ASSERT_GE(elapsed, 400 * 1000);
+  ASSERT_LE(elapsed, 2 * 1000 * 1000);
+}
+
+TEST(RateLimiterTest, FlushGoesFirst) {
+  const int64_t kRate = 1 << 20;
+  std::unique_ptr<RateLimiter> limiter(NewGenericRateLimiter(kRate, 10 * 1000));
+
+  // Keep the bucket drained with compaction requests from one thread,
+  // then see that a flush request is not stuck behind them.
+  std::atomic<bool> done(false);
+  std::thread compaction([&]() {
+    while (!done.load(std::memory_order_acquire)) {
+      limiter->Request(kRate / 10, RateLimiter::kCompaction);
+    }
+  });
+  Env::Default()->SleepForMicroseconds(50 * 1000);
+
+  const uint64_t start = Env::Default()->NowMicros();
+  limiter->Request(kRate / 200, RateLimiter::kFlush);
+  const uint64_t elapsed = Env::Default()->NowMicros() - start;
+  done.store(true, std::memory_order_release);
+  compaction.join();
+
+  // The queued compaction request is a tenth of a second worth of bytes;
+  // the flush must be granted within about one refill period instead.
+  ASSERT_LE(elapsed, 60 * 1000);
+  ASSERT_EQ(kRate / 200, limiter->GetThrottledBytes(RateLimiter::kFlush));
+}
+
+TEST(RateLimiterTest, AutoTune) {
+  const int64_t kRate = 10 << 20;
+  std::unique_ptr<RateLimiter> limiter(
+      NewGenericRateLimiter(kRate, 1000, /*auto_tuned=*/true));
+
+  // A trickle of requests that never drains the bucket lowers the rate.
+  for (int i = 0; i < 400; i++) {
+    limiter->Request(100, RateLimiter::kCompaction);
+    Env::Default()->SleepForMicroseconds(1000);
+  }
+  const int64_t lowered = limiter->GetBytesPerSecond();
+  ASSERT_LT(lowered, kRate);
+  ASSERT_GE(lowered, kRate / 20);
+
+  // Demand that keeps it drained raises the rate again.
+  limiter->Request(lowered / 2, RateLimiter::kCompaction);
+  ASSERT_GT(limiter->GetBytesPerSecond(), lowered);
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}